@@ -8,25 +8,270 @@
 #include <string.h>
 #include <time.h>
 #include "../users/interface.h"
+#include <toolbox/tb_string.h>
+#include <dynastring.h>
 #include <plugins.h>
 
 #define PLUG_NAME "Calc"
 
+#define CALC_ADMIN_BUCKETS 64
+// Whole admin cache is dropped when it has this many hosts.
+#define CALC_ADMIN_MAX 4096
+
+// One calc entry, owned by the name hash. Sorted index points to the same
+// entries.
+typedef struct sCalcEntry CalcEntry;
+struct sCalcEntry {
+	char *name;
+	char *fold;			// Lower case name, key of hash and sorted index
+	char *value;
+
+	CalcEntry *next;	// Next entry in the same hash bucket
+};
+
+// Cached result of calcadmin privilege lookup for one host.
+typedef struct sCalcAdmin CalcAdmin;
+struct sCalcAdmin {
+	char *host;
+	int canUpdate;
+
+	CalcAdmin *next;
+};
+
 typedef struct {
 	EVENT_HANDLER *onmessage;
+	EVENT_HANDLER *onusersdbchanged;
 	sqlite3 *db;
-	sqlite3_stmt *stmtQuery;
 	sqlite3_stmt *stmtInsert;
 	sqlite3_stmt *stmtUpdate;
 	sqlite3_stmt *stmtDelete;
+
+	CalcEntry **buckets;	// Case insensitive hash by name
+	size_t bucketsCount;
+	size_t count;
+
+	CalcEntry **sorted;		// Entries sorted by fold, for prefix search
+	size_t sortedAllocated;
+
+	CalcAdmin *admins[CALC_ADMIN_BUCKETS];
+	size_t adminsCount;
+	int maxMatches;
 } CalcPluginData;
 
+static char *calc_fold(const char *name) {
+	char *fold = strdup(name);
+	for (char *c = fold; *c != '\0'; c++) {
+		*c = tolower((unsigned char)*c);
+	}
+	return fold;
+}
+
+static unsigned int calc_hash(const char *fold) {
+	unsigned int hash = 5381;
+	while (*fold != '\0') {
+		hash = hash * 33 + (unsigned char)*fold++;
+	}
+	return hash;
+}
+
+// Lower bound of fold in sorted index.
+static size_t calc_sorted_find(CalcPluginData *plugData, const char *fold) {
+	size_t lo = 0, hi = plugData->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(plugData->sorted[mid]->fold, fold) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void calc_rehash(CalcPluginData *plugData, size_t bucketsCount) {
+	CalcEntry **buckets = calloc(bucketsCount, sizeof(CalcEntry *));
+	for (size_t i = 0; i < plugData->bucketsCount; i++) {
+		CalcEntry *entry = plugData->buckets[i];
+		while (entry != NULL) {
+			CalcEntry *next = entry->next;
+			size_t b = calc_hash(entry->fold) % bucketsCount;
+			entry->next = buckets[b];
+			buckets[b] = entry;
+			entry = next;
+		}
+	}
+	free(plugData->buckets);
+	plugData->buckets = buckets;
+	plugData->bucketsCount = bucketsCount;
+}
+
+CalcEntry *calc_find(CalcPluginData *plugData, const char *name) {
+	char *fold = calc_fold(name);
+	CalcEntry *entry = plugData->buckets[calc_hash(fold) % plugData->bucketsCount];
+	while (entry != NULL && !eq(entry->fold, fold)) {
+		entry = entry->next;
+	}
+	free(fold);
+	return entry;
+}
+
+CalcEntry *calc_add(CalcPluginData *plugData, const char *name, const char *value) {
+	if (plugData->count >= plugData->bucketsCount * 2) {
+		calc_rehash(plugData, plugData->bucketsCount * 2);
+	}
+	if (plugData->count == plugData->sortedAllocated) {
+		plugData->sortedAllocated = (plugData->sortedAllocated > 0)?plugData->sortedAllocated * 2:256;
+		plugData->sorted = realloc(plugData->sorted, plugData->sortedAllocated * sizeof(CalcEntry *));
+	}
+
+	CalcEntry *entry = malloc(sizeof(CalcEntry));
+	entry->name = strdup(name);
+	entry->fold = calc_fold(name);
+	entry->value = strdup(value);
+
+	size_t b = calc_hash(entry->fold) % plugData->bucketsCount;
+	entry->next = plugData->buckets[b];
+	plugData->buckets[b] = entry;
+
+	size_t pos = calc_sorted_find(plugData, entry->fold);
+	memmove(plugData->sorted + pos + 1, plugData->sorted + pos, (plugData->count - pos) * sizeof(CalcEntry *));
+	plugData->sorted[pos] = entry;
+
+	plugData->count++;
+	return entry;
+}
+
+static void calc_entry_free(CalcEntry *entry) {
+	free(entry->name);
+	free(entry->fold);
+	free(entry->value);
+	free(entry);
+}
+
+void calc_remove(CalcPluginData *plugData, CalcEntry *entry) {
+	CalcEntry **link = &plugData->buckets[calc_hash(entry->fold) % plugData->bucketsCount];
+	while (*link != entry) {
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+
+	size_t pos = calc_sorted_find(plugData, entry->fold);
+	while (plugData->sorted[pos] != entry) {
+		pos++;
+	}
+	memmove(plugData->sorted + pos, plugData->sorted + pos + 1, (plugData->count - pos - 1) * sizeof(CalcEntry *));
+	plugData->count--;
+
+	calc_entry_free(entry);
+}
+
+// List names beginning with prefix, using the sorted index.
+void calc_search(CalcPluginData *plugData, IRCEvent_Message *message, char *prefix) {
+	char *fold = calc_fold(prefix);
+	size_t len = strlen(fold);
+
+	string reply = dynastring_init();
+	int found = 0;
+	for (size_t i = calc_sorted_find(plugData, fold); i < plugData->count && eqn(plugData->sorted[i]->fold, fold, len); i++) {
+		if (found == plugData->maxMatches) {
+			dynastring_appendstring(reply, ", ...");
+			break;
+		}
+
+		if (found > 0) {
+			dynastring_appendstring(reply, ", ");
+		}
+		dynastring_appendstring(reply, plugData->sorted[i]->name);
+		found++;
+	}
+
+	if (found > 0) {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: Znam %s",
+			message->address->nick,
+			dynastring_getstring(reply)
+		);
+	} else {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: Netusim, co %s* je.",
+			message->address->nick,
+			prefix
+		);
+	}
+
+	dynastring_free(reply);
+	free(fold);
+}
+
+void calc_admins_clear(CalcPluginData *plugData) {
+	for (size_t i = 0; i < CALC_ADMIN_BUCKETS; i++) {
+		CalcAdmin *admin = plugData->admins[i];
+		while (admin != NULL) {
+			CalcAdmin *next = admin->next;
+			free(admin->host);
+			free(admin);
+			admin = next;
+		}
+		plugData->admins[i] = NULL;
+	}
+	plugData->adminsCount = 0;
+}
+
+// Users database changed, privileges must be looked up again.
+void calc_usersdbchanged(EVENT *event) {
+	calc_admins_clear((CalcPluginData *)event->handlerData);
+}
+
+// Whether the host has calcadmin privilege. Result is cached per host until
+// users database changes, or until the cache is full.
+int calc_can_update(CalcPluginData *plugData, IRCLib_Host *address) {
+	char *host = irclib_construct_addr(address);
+	size_t b = calc_hash(host) % CALC_ADMIN_BUCKETS;
+
+	CalcAdmin *admin = plugData->admins[b];
+	while (admin != NULL && !eq(admin->host, host)) {
+		admin = admin->next;
+	}
+
+	if (admin == NULL) {
+		if (plugData->adminsCount >= CALC_ADMIN_MAX) {
+			calc_admins_clear(plugData);
+		}
+
+		admin = malloc(sizeof(CalcAdmin));
+		admin->host = host;
+		admin->canUpdate = 0; // Noone can update by default.
+
+		// If user has calcadmin privilege, allow it to modify
+		// the entrys.
+		PluginInfo *usersPlugin = plugins_getinfo("users");
+		if (usersPlugin != NULL) {
+			UsersPluginData *uData = (UsersPluginData *)usersPlugin->customData;
+			UsersList list = users_match_host(uData->usersdb, host);
+			if (users_get_priv(list, NULL, "calcadmin")) {
+				admin->canUpdate = 1;
+			}
+			users_free_list(list);
+		}
+
+		admin->next = plugData->admins[b];
+		plugData->admins[b] = admin;
+		plugData->adminsCount++;
+	} else {
+		free(host);
+	}
+
+	return admin->canUpdate;
+}
+
 void calc_message(EVENT *event) {
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 	CalcPluginData *plugData = event->handlerData;
 
-	int result;
-
 	if (strncmp(message->message, "??", 2) == 0) {
 		// It is calc request...
 		
@@ -59,22 +304,6 @@ void calc_message(EVENT *event) {
 			char *name;
 			char *value;
 
-			int canUpdate = 0; // Noone can update by default.
-
-			// If user has calcadmin privilege, allow it to modify
-			// the entrys.
-			PluginInfo *usersPlugin = plugins_getinfo("users");
-			if (usersPlugin != NULL) {
-				UsersPluginData *uData = (UsersPluginData *)usersPlugin->customData;
-				char *host = irclib_construct_addr(message->address);
-			    UsersList list = users_match_host(uData->usersdb, host);
-				if (users_get_priv(list, NULL, "calcadmin")) {
-					canUpdate = 1;
-				}
-				users_free_list(list);
-				free(host);
-			}
-
 			size_t namelen = valueBegin - msgtrim;
 
 			// Trim right name. From left it is already trimmed from initial trim.
@@ -94,15 +323,16 @@ void calc_message(EVENT *event) {
 				value++;
 			}
 
-			sqlite3_bind_text(plugData->stmtQuery, 1, name, -1, SQLITE_TRANSIENT);
-			if (sqlite3_step(plugData->stmtQuery) == SQLITE_ROW) {
-				if (canUpdate) {
+			CalcEntry *entry = calc_find(plugData, name);
+			if (entry != NULL) {
+				if (calc_can_update(plugData, message->address)) {
 					// Already exists, update or delete.
 					
 					if (*value == '\0') {
 						// Delete the value.
 						sqlite3_bind_text(plugData->stmtDelete, 1, name, -1, SQLITE_TRANSIENT);
 						if (sqlite3_step(plugData->stmtDelete) == SQLITE_DONE) {
+							calc_remove(plugData, entry);
 							irclib_message(
 								message->sender,
 								message->channel,
@@ -130,6 +360,8 @@ void calc_message(EVENT *event) {
 						sqlite3_bind_text(plugData->stmtUpdate, 5, name, -1, SQLITE_TRANSIENT);
 
 						if (sqlite3_step(plugData->stmtUpdate) == SQLITE_DONE) {
+							free(entry->value);
+							entry->value = strdup(value);
 							irclib_message(
 								message->sender,
 								message->channel,
@@ -168,7 +400,8 @@ void calc_message(EVENT *event) {
 					sqlite3_bind_text(plugData->stmtInsert, 4, message->channel, -1, SQLITE_TRANSIENT);
 					sqlite3_bind_int64(plugData->stmtInsert, 5, time(NULL));
 
-					if ((result = sqlite3_step(plugData->stmtInsert)) == SQLITE_DONE) {
+					if (sqlite3_step(plugData->stmtInsert) == SQLITE_DONE) {
+						calc_add(plugData, name, value);
 						irclib_message(
 							message->sender,
 							message->channel,
@@ -184,6 +417,7 @@ void calc_message(EVENT *event) {
 							"%s: Tohle si zapamatovat odmitam :(",
 							message->address->nick
 						);
+						printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
 					}
 
 					sqlite3_reset(plugData->stmtInsert);
@@ -197,21 +431,27 @@ void calc_message(EVENT *event) {
 					);
 				}
 			}
-			sqlite3_reset(plugData->stmtQuery);
 
 		// Query
 		} else {
-			sqlite3_bind_text(plugData->stmtQuery, 1, msgtrim, -1, SQLITE_TRANSIENT);
-			if (sqlite3_step(plugData->stmtQuery) == SQLITE_ROW) {
+			// Whole table is in memory, so miss here is a definitive miss
+			// without touching the db.
+			CalcEntry *entry = calc_find(plugData, msgtrim);
+			size_t len = strlen(msgtrim);
+			if (entry != NULL) {
 				// Got data!
 				irclib_message(
 					message->sender,
 					message->channel,
 					"%s: %s je %s",
 					message->address->nick,
-					sqlite3_column_text(plugData->stmtQuery, 0),
-					sqlite3_column_text(plugData->stmtQuery, 1)
+					entry->name,
+					entry->value
 				);
+			} else if (msgtrim[len - 1] == '*') {
+				// Prefix search
+				msgtrim[len - 1] = '\0';
+				calc_search(plugData, message, msgtrim);
 			} else {
 				irclib_message(
 					message->sender,
@@ -221,9 +461,6 @@ void calc_message(EVENT *event) {
 					msgtrim
 				);
 			}
-
-			// Prepare the statement for next use.
-			sqlite3_reset(plugData->stmtQuery);
 		}
 
 		free(msgtrim);
@@ -247,18 +484,38 @@ void PluginInit(PluginInfo *info) {
 			printError(info->name, "Cannot create calc index: %s", sqlite3_errmsg(plugData->db));
 		}
 
-		// Prepare the statements
-		if (sqlite3_prepare(
-				plugData->db,
-				"SELECT \"name\", \"value\", \"user\", \"channel\", \"date\" FROM \"calc\" WHERE \"name\" = ? COLLATE NOCASE",
-				-1,
-				&plugData->stmtQuery,
-				NULL
-			) != SQLITE_OK) {
-
+		// Load all entries into memory.
+		plugData->bucketsCount = 256;
+		plugData->buckets = calloc(plugData->bucketsCount, sizeof(CalcEntry *));
+		plugData->count = 0;
+		plugData->sorted = NULL;
+		plugData->sortedAllocated = 0;
+		for (size_t i = 0; i < CALC_ADMIN_BUCKETS; i++) {
+			plugData->admins[i] = NULL;
+		}
+		plugData->adminsCount = 0;
+		plugData->maxMatches = config_getvalue_int(info->config, "calc:maxmatches", 10);
+
+		sqlite3_stmt *stmtLoad;
+		if (sqlite3_prepare_v2(plugData->db, "SELECT \"name\", \"value\" FROM \"calc\" ORDER BY \"rowid\"", -1, &stmtLoad, NULL) == SQLITE_OK) {
+			while ((result = sqlite3_step(stmtLoad)) == SQLITE_ROW) {
+				const char *name = (const char *)sqlite3_column_text(stmtLoad, 0);
+				const char *value = (const char *)sqlite3_column_text(stmtLoad, 1);
+
+				// Lookups were always case insensitive, first one wins.
+				if (name != NULL && calc_find(plugData, name) == NULL) {
+					calc_add(plugData, name, (value != NULL)?value:"");
+				}
+			}
+			if (result != SQLITE_DONE) {
+				printError(info->name, "SQLite: %s", sqlite3_errmsg(plugData->db));
+			}
+		} else {
 			printError(info->name, "Query exception: %s", sqlite3_errmsg(plugData->db));
 		}
+		sqlite3_finalize(stmtLoad);
 
+		// Prepare the statements
 		if (sqlite3_prepare(plugData->db, "INSERT INTO \"calc\" (\"name\", \"value\", \"user\", \"channel\", \"date\") VALUES (?, ?, ?, ?, ?)", -1, &plugData->stmtInsert, NULL) != SQLITE_OK) {
 			printError(info->name, "Query exception: %s", sqlite3_errmsg(plugData->db));
 		}
@@ -272,6 +529,7 @@ void PluginInit(PluginInfo *info) {
 		}
 
 		plugData->onmessage = events_addEventListener(info->events, "onchannelmessage", calc_message, plugData);
+		plugData->onusersdbchanged = events_addEventListener(info->events, "onusersdbchanged", calc_usersdbchanged, plugData);
 		info->customData = plugData;
 	} else {
 		printError(info->name, "Unable to open database: %s (code: %d)", sqlite3_errmsg(plugData->db), result);
@@ -285,14 +543,26 @@ void PluginDone(PluginInfo *info) {
 		CalcPluginData *plugData = (CalcPluginData *)info->customData;
 
 		events_removeEventListener(plugData->onmessage);
+		events_removeEventListener(plugData->onusersdbchanged);
 
-		sqlite3_finalize(plugData->stmtQuery);
 		sqlite3_finalize(plugData->stmtInsert);
 		sqlite3_finalize(plugData->stmtUpdate);
 		sqlite3_finalize(plugData->stmtDelete);
 
 		sqlite3_close(plugData->db);
 
+		for (size_t i = 0; i < plugData->bucketsCount; i++) {
+			CalcEntry *entry = plugData->buckets[i];
+			while (entry != NULL) {
+				CalcEntry *next = entry->next;
+				calc_entry_free(entry);
+				entry = next;
+			}
+		}
+		free(plugData->buckets);
+		free(plugData->sorted);
+		calc_admins_clear(plugData);
+
 		free(plugData);
 	}
 }
@@ -23,12 +23,31 @@
 #include <pluginapi.h>
 #include <events.h>
 
+// Standard headers
+#include <time.h>
+
+/**
+ * Number of buckets in command registry hash table.
+ */
+#define COMMANDS_BUCKETS 64
+
+// Forward
+typedef struct sCommands_Command *Commands_Command;
+typedef struct sCommands_Name *Commands_Name;
+
 typedef struct {
 	PluginInfo *info;
 
 	EVENT_HANDLER *onchannelmessage;
 	EVENT_HANDLER *onquerymessage;
-	EVENT_HANDLER *oncommand;
+
+	char *prefix;				/**< Cached commands:prefix value */
+	size_t prefixLength;		/**< Length of prefix */
+	unsigned long configRevision;	/**< Config revision the prefix was
+									 read from */
+
+	Commands_Name names[COMMANDS_BUCKETS];	/**< Registered command names and
+											 aliases */
 } CommandsPluginData;
 
 typedef enum {
@@ -44,4 +63,97 @@ typedef struct {
 	char *params;
 } Commands_Event;
 
+/**
+ * Handler of registered command.
+ * void Commands_Handler(Commands_Event *event, void *customData)
+ * @param event Command event data
+ * @param customData Custom data passed to commands_register
+ */
+typedef void (*Commands_Handler)(Commands_Event *, void *);
+
+/**
+ * Registered command. Command is owned by the plugin that registered it.
+ */
+struct sCommands_Command {
+	char *name;					/**< Primary name of command */
+	Commands_Handler handler;	/**< Command handler */
+	void *customData;			/**< Handler custom data */
+
+	char *privilege;			/**< Users privilege required to run the
+									 command, NULL if anyone can run it. */
+	time_t interval;			/**< Minimal number of seconds between two
+									 invocations, 0 for no limit. */
+	time_t lastRun;				/**< Time of last invocation */
+};
+
+/**
+ * Name (or alias) of registered command in registry hash table.
+ */
+struct sCommands_Name {
+	char *name;					/**< Name of command */
+	Commands_Command command;	/**< Command this name belongs to */
+	Commands_Name next;			/**< Next name in bucket */
+};
+
+/**
+ * Commands plugin fires oncommandsready event when it's loaded, with NULL as
+ * event data. Plugins that register commands should not depend on commands
+ * plugin, so it's not unloaded together with them. Instead, they register
+ * commands in PluginInit if commands plugin is loaded, and again from
+ * oncommandsready listener, because registry is emptied when commands
+ * plugin is unloaded.
+ */
+
+/**
+ * Sends reply to command. Variable arguments are formatted by
+ * format parameter.
+ * @param event Commands event data
+ * @param format Reply message format
+ */
+extern void commands_reply(Commands_Event *event, char *format, ...);
+
+/**
+ * Register new command. Commands that are registered are dispatched directly
+ * to their handler, without firing the oncommand event.
+ * @param name Name of command (without prefix)
+ * @param handler Command handler
+ * @param customData Custom data passed to handler
+ * @return Registered command or NULL if name is already taken.
+ */
+extern Commands_Command commands_register(char *name, Commands_Handler handler,
+	void *customData);
+
+/**
+ * Add alias to registered command.
+ * @param command Registered command
+ * @param alias Alias name
+ * @return True if alias was added, false if name is already taken.
+ */
+extern bool commands_alias(Commands_Command command, char *alias);
+
+/**
+ * Set privilege from users database required to run the command. If users
+ * plugin isn't loaded, anyone can run the command. The privilege is resolved
+ * for the channel the command was sent to, so channel specific privileges
+ * are honored as well as global ones.
+ * @param command Registered command
+ * @param privilege Name of privilege, or NULL to allow anyone.
+ */
+extern void commands_set_privilege(Commands_Command command, char *privilege);
+
+/**
+ * Set rate limit of the command.
+ * @param command Registered command
+ * @param interval Minimal number of seconds between two invocations. Calls
+ *   within the interval are silently ignored.
+ */
+extern void commands_set_ratelimit(Commands_Command command, time_t interval);
+
+/**
+ * Unregister command and all of its aliases. Should be called from
+ * PluginBeforeUnload of plugin that owns the command.
+ * @param name Name or alias of registered command
+ */
+extern void commands_unregister(char *name);
+
 #endif
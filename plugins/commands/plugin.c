@@ -28,14 +28,18 @@
 
 // Plugins API
 #include <pluginapi.h>
+#include <plugins.h>
 
 // This plugin interface
 #include "interface.h"
 
 // My includes
 #include <irclib/irclib.h>
-#include <tokenizer.h>
 #include <main.h>
+#include <tokenizer.h>
+
+// Other plugins
+#include "../users/interface.h"
 
 #ifndef PLUGIN_NAME
 # define PLUGIN_NAME "commands"
@@ -70,35 +74,303 @@ void commands_reply(Commands_Event *event, char *format, ...) {
 } // commands_reply
 
 /**
- * Parses message from user on IRC and call command event.
+ * Compute hash of command name.
+ * @param name Command name
+ * @param length Length of name
+ * @return Bucket index
+ */
+static size_t commands_hash(const char *name, size_t length) {
+	size_t hash = 5381;
+	for (size_t i = 0; i < length; i++) {
+		hash = ((hash << 5) + hash) + (unsigned char)name[i];
+	}
+	return hash % COMMANDS_BUCKETS;
+} // commands_hash
+
+/**
+ * Find registered command by name.
+ * @param plugData Commands plugin data
+ * @param name Command name, doesn't need to be zero terminated
+ * @param length Length of command name
+ * @return Registered command or NULL if no command has that name.
+ */
+static Commands_Command commands_find(CommandsPluginData *plugData,
+	const char *name, size_t length) {
+
+	Commands_Name item = plugData->names[commands_hash(name, length)];
+	while (item != NULL) {
+		if (strncmp(item->name, name, length) == 0
+			&& item->name[length] == '\0') {
+			return item->command;
+		}
+		item = item->next;
+	}
+	return NULL;
+} // commands_find
+
+/**
+ * Add name to the registry.
+ * @param plugData Commands plugin data
+ * @param command Command the name belongs to
+ * @param name Name of command
+ * @return True if name was added, false if it is already taken.
+ */
+static bool commands_add_name(CommandsPluginData *plugData,
+	Commands_Command command, char *name) {
+
+	if (commands_find(plugData, name, strlen(name)) != NULL) {
+		printError(PLUGIN_NAME, "Command %s is already registered.", name);
+		return false;
+	}
+
+	size_t bucket = commands_hash(name, strlen(name));
+	Commands_Name item = malloc(sizeof(struct sCommands_Name));
+	item->name = strdup(name);
+	item->command = command;
+	item->next = plugData->names[bucket];
+	plugData->names[bucket] = item;
+	return true;
+} // commands_add_name
+
+/**
+ * Register new command within given registry.
+ * @param plugData Commands plugin data
+ * @param name Name of command
+ * @param handler Command handler
+ * @param customData Handler custom data
+ * @return Registered command or NULL if name is already taken.
+ */
+static Commands_Command commands_register_internal(CommandsPluginData *plugData,
+	char *name, Commands_Handler handler, void *customData) {
+
+	Commands_Command command = malloc(sizeof(struct sCommands_Command));
+	command->name = strdup(name);
+	command->handler = handler;
+	command->customData = customData;
+	command->privilege = NULL;
+	command->interval = 0;
+	command->lastRun = 0;
+
+	if (!commands_add_name(plugData, command, name)) {
+		free(command->name);
+		free(command);
+		return NULL;
+	}
+
+	return command;
+} // commands_register_internal
+
+/**
+ * Remove command and all names that belong to it from the registry.
+ * @param plugData Commands plugin data
+ * @param command Command to remove
+ */
+static void commands_remove(CommandsPluginData *plugData,
+	Commands_Command command) {
+
+	for (size_t i = 0; i < COMMANDS_BUCKETS; i++) {
+		Commands_Name *item = &plugData->names[i];
+		while (*item != NULL) {
+			if ((*item)->command == command) {
+				Commands_Name next = (*item)->next;
+				free((*item)->name);
+				free(*item);
+				*item = next;
+			} else {
+				item = &(*item)->next;
+			}
+		}
+	}
+
+	free(command->name);
+	if (command->privilege) free(command->privilege);
+	free(command);
+} // commands_remove
+
+/**
+ * Get commands plugin data of loaded commands plugin.
+ */
+static CommandsPluginData *commands_data() {
+	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
+	if (info == NULL) return NULL;
+	return (CommandsPluginData *)info->customData;
+} // commands_data
+
+/**
+ * Register new command. Commands that are registered are dispatched directly
+ * to their handler, without firing the oncommand event.
+ * @param name Name of command (without prefix)
+ * @param handler Command handler
+ * @param customData Custom data passed to handler
+ * @return Registered command or NULL if name is already taken.
+ */
+Commands_Command commands_register(char *name, Commands_Handler handler,
+	void *customData) {
+
+	CommandsPluginData *plugData = commands_data();
+	if (plugData == NULL) return NULL;
+
+	return commands_register_internal(plugData, name, handler, customData);
+} // commands_register
+
+/**
+ * Add alias to registered command.
+ * @param command Registered command
+ * @param alias Alias name
+ * @return True if alias was added, false if name is already taken.
+ */
+bool commands_alias(Commands_Command command, char *alias) {
+	CommandsPluginData *plugData = commands_data();
+	if (plugData == NULL || command == NULL) return false;
+
+	return commands_add_name(plugData, command, alias);
+} // commands_alias
+
+/**
+ * Set privilege from users database required to run the command. If users
+ * plugin isn't loaded, anyone can run the command.
+ * @param command Registered command
+ * @param privilege Name of privilege, or NULL to allow anyone.
+ */
+void commands_set_privilege(Commands_Command command, char *privilege) {
+	if (command == NULL) return;
+
+	if (command->privilege) free(command->privilege);
+	command->privilege = (privilege != NULL)?strdup(privilege):NULL;
+} // commands_set_privilege
+
+/**
+ * Set rate limit of the command.
+ * @param command Registered command
+ * @param interval Minimal number of seconds between two invocations. Calls
+ *   within the interval are silently ignored.
+ */
+void commands_set_ratelimit(Commands_Command command, time_t interval) {
+	if (command == NULL) return;
+
+	command->interval = interval;
+} // commands_set_ratelimit
+
+/**
+ * Unregister command and all of its aliases. Should be called from
+ * PluginBeforeUnload of plugin that owns the command.
+ * @param name Name or alias of registered command
+ */
+void commands_unregister(char *name) {
+	CommandsPluginData *plugData = commands_data();
+	if (plugData == NULL) return;
+
+	Commands_Command command = commands_find(plugData, name, strlen(name));
+	if (command != NULL) {
+		commands_remove(plugData, command);
+	}
+} // commands_unregister
+
+/**
+ * Test whether sender of the message is allowed to run the command.
+ * @param command Registered command
+ * @param message Message containing the command
+ * @return True if command can be run.
+ */
+static bool commands_allowed(Commands_Command command,
+	IRCEvent_Message *message) {
+
+	if (command->interval > 0
+		&& time(NULL) - command->lastRun < command->interval) {
+		return false;
+	}
+
+	if (command->privilege != NULL) {
+		PluginInfo *usersPlugin = plugins_getinfo("users");
+		if (usersPlugin != NULL) {
+			UsersPluginData *uData = (UsersPluginData *)usersPlugin->customData;
+
+			char *host = irclib_construct_addr(message->address);
+			UsersList list = users_match_host(uData->usersdb, host);
+			int priv = users_get_priv(list, message->channel,
+				command->privilege);
+			users_free_list(list);
+			free(host);
+
+			if (priv <= 0) {
+				printError(PLUGIN_NAME, "User %s does not have privilege %s.",
+					message->address->nick, command->privilege);
+				return false;
+			}
+		}
+	}
+
+	return true;
+} // commands_allowed
+
+/**
+ * Refresh cached configuration values when configuration has changed since
+ * they were read.
+ * @param plugData Commands plugin data
+ */
+static void commands_load_config(CommandsPluginData *plugData) {
+	CONF_SECTION *config = plugData->info->config;
+
+	if (plugData->prefix != NULL &&
+		plugData->configRevision == config->revision) {
+		return;
+	}
+
+	if (plugData->prefix) free(plugData->prefix);
+
+	plugData->prefix = strdup(config_getvalue_string(config,
+		PLUGIN_NAME ":prefix", "!"));
+	plugData->prefixLength = strlen(plugData->prefix);
+	plugData->configRevision = config->revision;
+} // commands_load_config
+
+/**
+ * Parses message from user on IRC and dispatch it to registered command
+ * handler. If command isn't registered, oncommand event is fired.
  * @param event Event data
  */
 void commands_ircmessage(EVENT *event) {
 	CommandsPluginData *plugData = (CommandsPluginData *)event->handlerData;
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 
-	char *prefix = config_getvalue_string(plugData->info->config,
-		PLUGIN_NAME ":prefix", "!");
-
-	if (strncmp(message->message, prefix, strlen(prefix)) == 0) {
-		TOKENS tok = tokenizer_tokenize(message->message, ' ');
-		char *command = tokenizer_gettok(tok, 0);
-		if (strlen(command) > strlen(prefix)) {
-			Commands_Event evt = {
-				.plugData = plugData,
-				.source = (message->channel != NULL)?CMD_CHANNEL:CMD_QUERY,
-				.replyData = message,
-				.command = strdup(command + strlen(prefix)),
-				.params = strdup(tokenizer_gettok_skipleft(tok, 1))
-			};
-
-			events_fireEvent(plugData->info->events, "oncommand", &evt);
-
-			free(evt.command);
-			free(evt.params);
-		}
-		tokenizer_free(tok);
+	commands_load_config(plugData);
+	if (strncmp(message->message, plugData->prefix,
+		plugData->prefixLength) != 0) {
+		return;
+	}
+
+	TOK_ITER it;
+	tok_init(&it, message->message + plugData->prefixLength);
+	TOK_SLICE name = tok_next(&it, ' ');
+	if (name.length == 0) return;
+
+	Commands_Command command = commands_find(plugData, name.str, name.length);
+	if (command != NULL && !commands_allowed(command, message)) {
+		return;
+	}
+
+	// Extra spaces between command and parameters are not part of them.
+	const char *params = tok_rest(&it);
+	if (params == NULL) params = "";
+	params += strspn(params, " ");
+
+	Commands_Event evt = {
+		.plugData = plugData,
+		.source = (message->channel != NULL)?CMD_CHANNEL:CMD_QUERY,
+		.replyData = message,
+		.command = strndup(name.str, name.length),
+		.params = strdup(params)
+	};
+
+	if (command != NULL) {
+		command->lastRun = time(NULL);
+		command->handler(&evt, command->customData);
+	} else {
+		events_fireEvent(plugData->info->events, "oncommand", &evt);
 	}
+
+	free(evt.command);
+	free(evt.params);
 } // commands_ircmessage
 
 /**
@@ -143,22 +415,22 @@ char *commands_format_time(time_t value) {
 } // commands_format_time
 
 /**
- * Basic commands handler
- * @param event Event data
+ * Uptime command handler
+ * @param command Command event data
+ * @param customData Unused
  */
-void commands_basic_commands(EVENT *event) {
-	Commands_Event *command = (Commands_Event *)event->customData;
-	if (strcmp(command->command, "uptime") == 0) {
-		char *format_bot = commands_format_time(time(NULL) - system_boottime());
-		char *format_system = commands_format_time(commands_get_uptime());
+void commands_uptime(Commands_Event *command, void *customData) {
+	(void)customData;
 
-		commands_reply(command, "Uptime: Bot: %s, System: %s",
-			format_bot, format_system);
+	char *format_bot = commands_format_time(time(NULL) - system_boottime());
+	char *format_system = commands_format_time(commands_get_uptime());
 
-		if (format_bot) free(format_bot);
-		if (format_system) free(format_system);
-	}
-} // commands_basic_commands
+	commands_reply(command, "Uptime: Bot: %s, System: %s",
+		format_bot, format_system);
+
+	if (format_bot) free(format_bot);
+	if (format_system) free(format_system);
+} // commands_uptime
 
 /**
  * Initialize plugin.
@@ -167,21 +439,32 @@ void commands_basic_commands(EVENT *event) {
 void PluginInit(PluginInfo *info) {
 	info->name = "Commands";
 	info->author = "Niximor";
-	info->version = "1.0.0";
+	info->version = "1.1.0";
 
 	CommandsPluginData *plugData = malloc(sizeof(CommandsPluginData));
 	plugData->info = info;
+	plugData->prefix = NULL;
+	plugData->configRevision = 0;
+	for (size_t i = 0; i < COMMANDS_BUCKETS; i++) {
+		plugData->names[i] = NULL;
+	}
+
+	commands_load_config(plugData);
 
 	events_addEvent(info->events, "oncommand");
+	events_addEvent(info->events, "oncommandsready");
 
 	plugData->onchannelmessage = events_addEventListener(
 		info->events, "onchannelmessage", commands_ircmessage, plugData);
 	plugData->onquerymessage = events_addEventListener(
 		info->events, "onquerymessage", commands_ircmessage, plugData);
-	plugData->oncommand = events_addEventListener(
-		info->events, "oncommand", commands_basic_commands, NULL);
+
+	commands_register_internal(plugData, "uptime", commands_uptime, NULL);
 
 	info->customData = plugData;
+
+	// Let plugins loaded before us register their commands.
+	events_fireEvent(info->events, "oncommandsready", NULL);
 } // PluginInit
 
 /**
@@ -195,5 +478,13 @@ void PluginDone(PluginInfo *info) {
 	events_removeEventListener(plugData->onchannelmessage);
 	events_removeEventListener(plugData->onquerymessage);
 
+	// Free commands that weren't unregistered by their owners.
+	for (size_t i = 0; i < COMMANDS_BUCKETS; i++) {
+		while (plugData->names[i] != NULL) {
+			commands_remove(plugData, plugData->names[i]->command);
+		}
+	}
+
+	free(plugData->prefix);
 	free(plugData);
 } // PluginDone
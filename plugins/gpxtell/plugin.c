@@ -44,7 +44,7 @@ typedef struct {
 	sqlite3_stmt *stmtInsertReviewer;
 	sqlite3_stmt *stmtInsertState;
 	sqlite3_stmt *stmtInsertPattern;
-	EVENT_HANDLER *onignore;
+	EVENT_HANDLER *oncommandsready;
 } GpxTellPluginData;
 
 typedef struct {
@@ -339,88 +339,70 @@ void gpxtell_accept_client(Socket socket) {
 	}
 }
 
-void gpxtell_ignore(EVENT *event) {
-	GpxTellPluginData *dt = (GpxTellPluginData *)event->handlerData;
-	Commands_Event *cmd = (Commands_Event *)event->customData;
+void gpxtell_ignore(Commands_Event *cmd, void *customData) {
+	GpxTellPluginData *dt = (GpxTellPluginData *)customData;
 	IRCEvent_Message *message = cmd->replyData;
 
-	if (!eq(cmd->command, "gpxignore")) return;
-
 	char *source = message->channel != NULL ?
 		message->channel : message->address->nick;
 
-	PluginInfo *usersPlugin = plugins_getinfo("users");
-
-	char *host = irclib_construct_addr(message->address);
-	UsersList list;
-
-	if (usersPlugin != NULL) {
-		UsersPluginData *uData = (UsersPluginData *)usersPlugin->customData;
-		list = users_match_host(uData->usersdb, host);
-	}
-
-	if (usersPlugin == NULL || users_get_priv(list, NULL, "gpxignore") > 0) {
-		if (strncmp(cmd->params, "reviewer ", strlen("reviewer ")) == 0) {
-			char *pattern = cmd->params + strlen("reviewer ");
-
-			if (!eq(pattern, "")) {
-				sqlite3_bind_text(dt->stmtInsertReviewer, 1, pattern, -1, SQLITE_TRANSIENT);
-				sqlite3_bind_text(dt->stmtInsertReviewer, 2, message->address->nick, -1, SQLITE_TRANSIENT);
+	if (strncmp(cmd->params, "reviewer ", strlen("reviewer ")) == 0) {
+		char *pattern = cmd->params + strlen("reviewer ");
 
-				if (sqlite3_step(dt->stmtInsertReviewer) == SQLITE_DONE) {
-					irclib_message(message->sender, source, "%s: Ignoruji vse od reviewera %s.", message->address->nick, pattern);
-				} else {
-					printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
-				}
+		if (!eq(pattern, "")) {
+			sqlite3_bind_text(dt->stmtInsertReviewer, 1, pattern, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(dt->stmtInsertReviewer, 2, message->address->nick, -1, SQLITE_TRANSIENT);
 
-				sqlite3_reset(dt->stmtInsertReviewer);
+			if (sqlite3_step(dt->stmtInsertReviewer) == SQLITE_DONE) {
+				irclib_message(message->sender, source, "%s: Ignoruji vse od reviewera %s.", message->address->nick, pattern);
+			} else {
+				printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
 			}
+
+			sqlite3_reset(dt->stmtInsertReviewer);
 		}
+	}
 
-		if (strncmp(cmd->params, "state ", strlen("state ")) == 0) {
-			char *pattern = cmd->params + strlen("state ");
+	if (strncmp(cmd->params, "state ", strlen("state ")) == 0) {
+		char *pattern = cmd->params + strlen("state ");
 
-			if (!eq(pattern, "")) {
-				sqlite3_bind_text(dt->stmtInsertState, 1, pattern, -1, SQLITE_TRANSIENT);
-				sqlite3_bind_text(dt->stmtInsertState, 2, message->address->nick, -1, SQLITE_TRANSIENT);
+		if (!eq(pattern, "")) {
+			sqlite3_bind_text(dt->stmtInsertState, 1, pattern, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(dt->stmtInsertState, 2, message->address->nick, -1, SQLITE_TRANSIENT);
 
-				if (sqlite3_step(dt->stmtInsertState) == SQLITE_DONE) {
-					irclib_message(message->sender, source, "%s: Ignoruji vse ze statu %s.", message->address->nick, pattern);
-				} else {
-					printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
-				}
-				sqlite3_reset(dt->stmtInsertReviewer);
+			if (sqlite3_step(dt->stmtInsertState) == SQLITE_DONE) {
+				irclib_message(message->sender, source, "%s: Ignoruji vse ze statu %s.", message->address->nick, pattern);
+			} else {
+				printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
 			}
+			sqlite3_reset(dt->stmtInsertReviewer);
 		}
+	}
 
-		if (strncmp(cmd->params, "name ", strlen("name ")) == 0) {
-			char *pattern = cmd->params + strlen("name ");
+	if (strncmp(cmd->params, "name ", strlen("name ")) == 0) {
+		char *pattern = cmd->params + strlen("name ");
 
-			if (!eq(pattern, "")) {
-				sqlite3_bind_text(dt->stmtInsertPattern, 1, pattern, -1, SQLITE_TRANSIENT);
-				sqlite3_bind_text(dt->stmtInsertPattern, 2, message->address->nick, -1, SQLITE_TRANSIENT);
+		if (!eq(pattern, "")) {
+			sqlite3_bind_text(dt->stmtInsertPattern, 1, pattern, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(dt->stmtInsertPattern, 2, message->address->nick, -1, SQLITE_TRANSIENT);
 
-				if (sqlite3_step(dt->stmtInsertPattern) == SQLITE_DONE) {
-					irclib_message(message->sender, source, "%s: Ignoruji vse odpovidajici nazvu %s.", message->address->nick, pattern);
-				} else {
-					printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
-				}
-				sqlite3_reset(dt->stmtInsertPattern);
+			if (sqlite3_step(dt->stmtInsertPattern) == SQLITE_DONE) {
+				irclib_message(message->sender, source, "%s: Ignoruji vse odpovidajici nazvu %s.", message->address->nick, pattern);
+			} else {
+				printError(PLUGIN_NAME, "Query error: %s", sqlite3_errmsg(dt->db));
 			}
+			sqlite3_reset(dt->stmtInsertPattern);
 		}
-
-	} // users_get_priv
-	else {
-		printError(PLUGIN_NAME, "User %s does not have privilege gpxignore.", message->address->nick);
 	}
+}
 
-	if (usersPlugin != NULL) {
-		users_free_list(list);
-	}
+void gpxtell_register_commands(GpxTellPluginData *dt) {
+	commands_set_privilege(commands_register("gpxignore", gpxtell_ignore, dt), "gpxignore");
+	printError(PLUGIN_NAME, "Bound ignore command.");
+}
 
-	if (host != NULL) {
-		free(host);
-	}
+void gpxtell_commandsready(EVENT *event) {
+	gpxtell_register_commands((GpxTellPluginData *)event->handlerData);
 }
 
 void PluginInit(PluginInfo *info) {
@@ -508,23 +490,34 @@ void PluginInit(PluginInfo *info) {
 			printError(PLUGIN_NAME, "Query exception: %s", sqlite3_errmsg(dt->db));
 		}
 
-		dt->onignore = events_addEventListener(info->events, "oncommand", gpxtell_ignore, dt);
-		printError(PLUGIN_NAME, "Bound ignore command.");
+		dt->oncommandsready = events_addEventListener(info->events, "oncommandsready", gpxtell_commandsready, dt);
+		if (plugins_getinfo("commands") != NULL) {
+			gpxtell_register_commands(dt);
+		}
 	} else {
 		printError(PLUGIN_NAME, "Unable to open SQLite database: %s", sqlite3_errmsg(dt->db));
 	}
 
 }
 
+void PluginBeforeUnload(PluginInfo *info) {
+	(void)info;
+
+	if (plugins_getinfo("commands") != NULL) {
+		commands_unregister("gpxignore");
+	}
+}
+
 void PluginDone(PluginInfo *info) {
 	GpxTellPluginData *dt = (GpxTellPluginData *)info->customData;
 	
-	if (dt->onignore) {
-		events_removeEventListener(dt->onignore);
-	}
 
 	socketpool_close(info->socketpool, dt->socket);
 
+	if (dt->oncommandsready) {
+		events_removeEventListener(dt->oncommandsready);
+	}
+
 	if (dt->stmtFilterSelect) {
 		sqlite3_finalize(dt->stmtFilterSelect);
 	}
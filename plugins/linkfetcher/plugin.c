@@ -32,10 +32,8 @@ void linkfetcher_read(Socket socket) {
 #define BUFF_SIZE 4096
 	char buffer[BUFF_SIZE];
 	int readed;
-	memset(buffer, 0, BUFF_SIZE);
-	while ((readed = read(socket->socketfd, buffer, BUFF_SIZE - 1)) > 0) {
-		dynastring_appendstring(dt->s, buffer);
-		memset(buffer, 0, BUFF_SIZE);
+	while ((readed = read(socket->socketfd, buffer, BUFF_SIZE)) > 0) {
+		dynastring_appendn(dt->s, buffer, readed);
 	}
 
 	// Handle multi-line options.
@@ -49,11 +47,11 @@ void linkfetcher_read(Socket socket) {
 		newline = 1;
 	}
 
+	// Drop sent lines, rest is completed by next read.
 	if (newline) {
-		string s2 = dynastring_init();
-		dynastring_appendstring(s2, oldpos);
-		dynastring_free(dt->s);
-		dt->s = s2;
+		dynastring_seek(dt->s, 0, SEEK_SET);
+		dynastring_delete(dt->s, oldpos - dynastring_getstring(dt->s));
+		dynastring_seek(dt->s, 0, SEEK_END);
 	}
 
 	if (readed == 0) {
@@ -1,4 +1,5 @@
 #include <pluginapi.h>
+#include <plugins.h>
 #include <time.h>
 #include "../commands/interface.h"
 #include <toolbox/tb_string.h>
@@ -9,17 +10,13 @@ typedef struct {
 	int minut_na_pivo;
 	int max_piv;
 	time_t posledni_pivo;
-
-	EVENT_HANDLER *onpivo;
+	EVENT_HANDLER *oncommandsready;
 } pivo_data;
 
-void pivo_command(EVENT *event) {
-	pivo_data *pivo = (pivo_data *)event->handlerData;
-	Commands_Event *cmd = (Commands_Event *)event->customData;
+void pivo_command(Commands_Event *cmd, void *customData) {
+	pivo_data *pivo = (pivo_data *)customData;
 	IRCEvent_Message *message = cmd->replyData;
 
-	if (!eq(cmd->command, "pivo")) return;
-	
 	int zbyva_piv = (time(NULL) - pivo->posledni_pivo) / 60 / pivo->minut_na_pivo;
 	if (zbyva_piv > pivo->max_piv) {
 		zbyva_piv = 6;
@@ -62,6 +59,10 @@ void pivo_command(EVENT *event) {
 	}
 }
 
+void pivo_commandsready(EVENT *event) {
+	commands_register("pivo", pivo_command, event->handlerData);
+}
+
 void PluginInit(PluginInfo *p) {
 	pivo_data *plugData = malloc(sizeof(pivo_data));
 
@@ -69,15 +70,26 @@ void PluginInit(PluginInfo *p) {
 	plugData->max_piv = 6;
 	plugData->posledni_pivo = time(NULL) - 60 * plugData->minut_na_pivo * plugData->max_piv;
 
-	plugData->onpivo = events_addEventListener(p->events, "oncommand", pivo_command, plugData);
+	plugData->oncommandsready = events_addEventListener(p->events, "oncommandsready", pivo_commandsready, plugData);
+	if (plugins_getinfo("commands") != NULL) {
+		commands_register("pivo", pivo_command, plugData);
+	}
 
 	p->customData = plugData;
 }
 
+void PluginBeforeUnload(PluginInfo *p) {
+	(void)p;
+
+	if (plugins_getinfo("commands") != NULL) {
+		commands_unregister("pivo");
+	}
+}
+
 void PluginDone(PluginInfo *p) {
 	pivo_data *plugData = (pivo_data *)p->customData;
 
-	events_removeEventListener(plugData->onpivo);
+	events_removeEventListener(plugData->oncommandsready);
 
 	free(plugData);
 }
@@ -24,8 +24,13 @@
 #include "pythread.h"
 #include <events.h>
 
+#include <stdint.h>
+#include <semaphore.h>
+#include <pthread.h>
+
 #include <pluginapi.h>
 #include <events.h>
+#include <timers.h>
 
 #ifndef PLUGIN_NAME
 # define PLUGIN_NAME "python"
@@ -36,6 +41,17 @@ typedef struct s_plugin_PyObject {
 	PyThreadState *tstate;				/**< Thread state
 											 (working name 'python instance
 											 identifier') */
+	PyThreadState *workerState;			/**< Thread state of the same
+											 interpreter used by Python
+											 thread */
+	PyThreadState *watchdogState;		/**< Thread state of the same
+											 interpreter used by watchdog
+											 thread */
+	uint64_t cpuTime;					/**< CPU time spent in callbacks
+											 (nanoseconds) */
+	uint64_t calls;						/**< Number of called callbacks */
+	uint64_t timeouts;					/**< Number of callbacks interrupted
+											 by watchdog */
 	char *fileName;						/**< Filename of script */
 	PyObject *ircbot_module;			/**< ircbot python module */
 	struct s_plugin_PyObject *prev;		/**< Previous loaded script */
@@ -53,6 +69,7 @@ typedef struct {
 	PyObject *channels;		/**< List of channels the user is on. */
 	PyObject *dict;			/**< Dictionary with other properties set by
 		scripts. */
+	PyObject *weakreflist;	/**< Weak references to the object */
 } user_PyObject;
 
 /**
@@ -64,6 +81,7 @@ typedef struct {
 	PyObject *users;		/**< List of users that are on the channel. */
 	PyObject *dict;			/**< Dictionary with other properties set by
 								 scripts. */
+	PyObject *weakreflist;	/**< Weak references to the object */
 } channel_PyObject;
 
 /**
@@ -102,8 +120,172 @@ struct s_pyplugin_event_cb {
 typedef struct {
 	pyplugin_event_cb first;	/**< First callback in chain */
 	pyplugin_event_cb last;		/**< Last callback in chain */
+	const char *name;			/**< Event name, used in watchdog messages */
 } pyplugin_event;
 
+/**
+ * Function that builds argument tuple for event callbacks. Called with
+ * interpreter lock held, only if event has some callbacks.
+ * PyObject *pyplugin_args_builder(void *data)
+ * @param data Event data
+ * @return New reference to argument tuple, NULL on error.
+ */
+typedef PyObject *(*pyplugin_args_builder)(void *);
+
+/**
+ * User as seen by main loop when snapshot was taken.
+ */
+typedef struct {
+	const void *id;				/**< IRCLib user, used only as identity
+									 for object cache, NULL if not known */
+	const char *nick;			/**< Nick, NULL if not set */
+	const char *user;			/**< User name, NULL if user isn't known */
+	const char *host;			/**< Hostname, NULL if user isn't known */
+	bool known;					/**< User has been found in user storage */
+} pyplugin_snapshot_user;
+
+// Forward
+typedef struct s_pyplugin_snapshot *pyplugin_snapshot;
+typedef struct s_pyplugin_task *pyplugin_task;
+
+/**
+ * Coroutine started by ircbot.spawn(). The generator yields requests
+ * created by ircbot.sleep() or ircbot.readable() and it's resumed by the
+ * Python thread when the main loop finds the request satisfied.
+ */
+struct s_pyplugin_task {
+	PyObject *generator;		/**< Generator of task */
+	plugin_PyObject *plugin;	/**< Script that started the task */
+	Timer timer;				/**< Timer the task waits for, NULL if
+									 none. Owned by main loop. */
+	int fd;						/**< File descriptor the task waits for,
+									 -1 if none. Owned by main loop. */
+	pyplugin_task prev;			/**< Previous task */
+	pyplugin_task next;			/**< Next task */
+}; // struct s_pyplugin_task
+
+/**
+ * List of running tasks
+ */
+typedef struct {
+	pyplugin_task first;		/**< First task */
+	pyplugin_task last;			/**< Last task */
+} pyplugin_tasks;
+
+/**
+ * Immutable copy of IRC event data, which is passed from main loop to
+ * Python thread. All strings are stored in the same allocation.
+ */
+struct s_pyplugin_snapshot {
+	pyplugin_event *callbacks;	/**< Callbacks the event is dispatched to */
+	pyplugin_args_builder build; /**< Builds callback arguments from
+									 snapshot */
+	const char *channel;		/**< Channel name, NULL if channel isn't
+									 known */
+	const void *channelId;		/**< IRCLib channel, used only as identity
+									 for object cache */
+	pyplugin_snapshot_user user; /**< User that caused the event */
+	pyplugin_snapshot_user target; /**< User the event is targeted to */
+	const char *text;			/**< Message, reason or new nick, error of
+									 task wake-up */
+	pyplugin_task task;			/**< Task to resume instead of calling
+									 callbacks, NULL for IRC events */
+	bool invalidate;			/**< Remove user.id and channelId from
+									 object cache instead of calling
+									 callbacks */
+	char data[];				/**< Strings */
+}; // struct s_pyplugin_snapshot
+
+/**
+ * Bounded lock-free queue of pointers. It has single producer, but both
+ * consumer and producer can remove items, so producer can drop oldest
+ * items when queue is full.
+ */
+typedef struct {
+	void **slots;				/**< Items */
+	bool *pinned;				/**< Slots with items which can't be dropped,
+									 written only by producer */
+	uint64_t mask;				/**< Size of queue - 1, size is power of 2 */
+	uint64_t head;				/**< Number of removed items */
+	uint64_t tail;				/**< Number of inserted items */
+} pyplugin_queue;
+
+/**
+ * What to do with new event when event queue is full.
+ */
+typedef enum {
+	PYO_DROP_OLDEST = 0,		/**< Drop oldest event in queue */
+	PYO_BLOCK,					/**< Wait until Python thread makes space */
+	PYO_COALESCE				/**< Keep only newest event of each kind
+									 until there is space in queue */
+} pyplugin_overflow;
+
+/**
+ * Event queue metrics
+ */
+typedef struct {
+	uint64_t size;				/**< Queue capacity */
+	uint64_t depth;				/**< Number of queued events */
+	uint64_t maxDepth;			/**< Highest number of queued events */
+	uint64_t pushed;			/**< Number of queued events */
+	uint64_t dropped;			/**< Events dropped because of overflow */
+	uint64_t coalesced;			/**< Events replaced by newer ones */
+	uint64_t blocked;			/**< Number of times main loop has waited
+									 for space in queue */
+	uint64_t actions;			/**< Actions performed on behalf of Python
+									 thread */
+} pyplugin_queue_metrics;
+
+/**
+ * Object cache metrics
+ */
+typedef struct {
+	uint64_t hits;				/**< Objects found in cache */
+	uint64_t misses;			/**< Objects created because they weren't
+									 in cache or were already freed */
+	uint64_t invalidated;		/**< Entries removed because IRCLib has
+									 freed the user or channel */
+} pyplugin_cache_metrics;
+
+/**
+ * Action requested by Python thread and performed by main loop.
+ */
+typedef enum {
+	PYA_RAW,					/**< Send text to server */
+	PYA_MESSAGE,				/**< Send message text to target */
+	PYA_ACTION,					/**< Send ACTION text to target */
+	PYA_NOTICE,					/**< Send notice text to target */
+	PYA_KICK,					/**< Kick extra from target channel with
+									 reason text */
+	PYA_MODE,					/**< Set mode text */
+	PYA_PART,					/**< Part target channel with reason text */
+	PYA_FIND_USER,				/**< Find user target, answered by reply */
+	PYA_FIND_CHANNEL,			/**< Find channel target, answered by
+									 reply */
+	PYA_SLEEP,					/**< Wake task after value seconds */
+	PYA_READABLE				/**< Wake task when file descriptor value
+									 has data to read */
+} pyplugin_action_type;
+
+// Forward
+typedef struct s_pyplugin_action *pyplugin_action;
+
+/**
+ * Action passed from Python thread to main loop.
+ */
+struct s_pyplugin_action {
+	pyplugin_action_type type;	/**< Action type */
+	const char *target;			/**< Nick or channel, may be NULL */
+	const char *extra;			/**< Another parameter, may be NULL */
+	const char *text;			/**< Text, may be NULL */
+	pyplugin_snapshot reply;	/**< Result of query */
+	sem_t *done;				/**< Posted when query is answered, NULL
+									 for actions without reply */
+	pyplugin_task task;			/**< Task which waits for the action */
+	long int value;				/**< Seconds or file descriptor */
+	char data[];				/**< Strings */
+}; // struct s_pyplugin_action
+
 extern PyTypeObject plugin_PyTypeObject;	/**< Plugin python class type */
 
 extern PyTypeObject user_PyTypeObject;		/**< User python class type */
@@ -177,15 +359,22 @@ typedef struct {
 	EVENT_HANDLER *onkicked;
 	EVENT_HANDLER *onnickchanged;
 	EVENT_HANDLER *onnick;
+	EVENT_HANDLER *onuserremoved;
+	EVENT_HANDLER *onchannelremoved;
+	EVENT_HANDLER *ontelnetcmd;
 
-	PyObject *channel_dict;			/**< Channel objects dictionary for
-		persistent channel object storage */
-	PyObject *user_dict;			/**< User objects dictionary for
-		persistent user object storage */
+	PyObject *channel_dict;			/**< Weak references to channel objects
+		keyed by IRCLib channel */
+	PyObject *user_dict;			/**< Weak references to user objects
+		keyed by IRCLib user */
+	pyplugin_cache_metrics cache;	/**< Metrics of channel_dict and
+		user_dict, used only by Python thread */
 
 	PyThread_type_lock lock;		/**< Thread lock for Python instance */
 	PyThreadState *tstate;			/**< Main interpreter thread state */
 	PyObject *interp_plugin;		/**< Dummy plugin (why is this needed?) */
+
+	pyplugin_tasks tasks;			/**< Tasks started by ircbot.spawn() */
 } PythonPluginData;
 
 extern PythonPluginData *python_plugin_data; /**< Python plugin data */
@@ -285,7 +474,7 @@ extern PyObject *pyplugin_raw_send(PyObject *self, PyObject *args);
 /**
  * Construct python channel object from IRCLib channel
  * @param channel IRCLib channel
- * @return Python channel class instance
+ * @return New reference to channel class instance
  */
 extern PyObject *pyplugin_channel_object(IRCLib_Channel channel);
 
@@ -298,7 +487,7 @@ extern PyObject *pyplugin_find_channel(PyObject *self, PyObject *args);
 /**
  * Construct python user object from IRCLib user.
  * @param user IRCLib user structure
- * @return Python user class instance
+ * @return New reference to user class instance
  */
 extern PyObject *pyplugin_user_object(IRCLib_User user);
 
@@ -410,11 +599,219 @@ extern PyObject *pyplugin_channel_mode(PyObject *self, PyObject *args);
 extern PyObject *pyplugin_channel_part(PyObject *self, PyObject *args);
 
 /**
- * Call callback functions for specified list of callbacks.
+ * Call callback functions for specified list of callbacks. When no callback
+ * is registered, returns without touching Python. Otherwise the arguments
+ * are built once, and callbacks are called grouped by interpreter (in order
+ * in which the interpreters have hooked the event), so the interpreter lock
+ * is taken only once per event.
  * @param callbacks List of callbacks
- * @param arglist Arguments that will be passed to the Python function
+ * @param build Function that builds argument tuple passed to callbacks,
+ *   called with interpreter lock held.
+ * @param data Data passed to build function
+ */
+extern void pyplugin_callback(pyplugin_event *callbacks,
+	pyplugin_args_builder build, void *data);
+
+/**
+ * Take snapshot of event data. Users and channel are looked up in IRCLib
+ * storages, so this must be called from main loop.
+ * @param callbacks Callbacks the event is dispatched to
+ * @param build Function that builds callback arguments from snapshot
+ * @param channel Channel name or NULL
+ * @param nick Nick of user that caused the event or NULL
+ * @param target Nick of user the event is targeted to or NULL
+ * @param text Message, reason or new nick, or NULL
+ * @return New snapshot, which must be freed by free().
+ */
+extern pyplugin_snapshot pyplugin_snapshot_create(pyplugin_event *callbacks,
+	pyplugin_args_builder build, const char *channel, const char *nick,
+	const char *target, const char *text);
+
+/**
+ * Pass event to Python thread. Does nothing if event has no callbacks.
+ * Arguments are the same as of pyplugin_snapshot_create.
+ */
+extern void pyplugin_event_post(pyplugin_event *callbacks,
+	pyplugin_args_builder build, const char *channel, const char *nick,
+	const char *target, const char *text);
+
+/**
+ * Start Python thread. Scripts must be loaded before.
+ */
+extern void pyplugin_thread_start();
+
+/**
+ * Stop Python thread, events that are still queued are dispatched first.
+ */
+extern void pyplugin_thread_stop();
+
+/**
+ * Get event queue metrics
+ * @param stats Structure to fill in
+ */
+extern void pyplugin_thread_stats(pyplugin_queue_metrics *stats);
+
+/**
+ * Perform IRC action on behalf of Python script. When called from Python
+ * thread, action is passed to main loop and performed there.
+ * @param type Action type
+ * @param target Nick or channel, may be NULL
+ * @param extra Another parameter, may be NULL
+ * @param text Text, may be NULL
+ */
+extern void pyplugin_action_post(pyplugin_action_type type,
+	const char *target, const char *extra, const char *text);
+
+/**
+ * Find user or channel in IRCLib storage. When called from Python thread,
+ * the query is answered by main loop and the caller waits for it. Must be
+ * called with interpreter lock held.
+ * @param type PYA_FIND_USER or PYA_FIND_CHANNEL
+ * @param name Nick or channel name
+ * @return Snapshot with found user or channel, must be freed by free().
+ */
+extern pyplugin_snapshot pyplugin_query(pyplugin_action_type type,
+	const char *name);
+
+/**
+ * Make task wait for timer or file descriptor. When called from Python
+ * thread, the request is passed to main loop.
+ * @param type PYA_SLEEP or PYA_READABLE
+ * @param task Task
+ * @param value Seconds or file descriptor
+ * @return NULL, or error which must be thrown into the task. Errors are
+ *   returned only while script is loading, Python thread gets them as task
+ *   wake-up.
+ */
+extern const char *pyplugin_task_post(pyplugin_action_type type,
+	pyplugin_task task, long int value);
+
+/**
+ * Pass task to Python thread to be resumed. Called from main loop, task
+ * wake-ups are never dropped.
+ * @param task Task
+ * @param error Error thrown into task or NULL
  */
-extern void pyplugin_callback(pyplugin_event *callbacks, PyObject *arglist);
+extern void pyplugin_task_wake(pyplugin_task task, const char *error);
+
+/**
+ * Register timer or file descriptor the task waits for. Called from main
+ * loop.
+ * @param action PYA_SLEEP or PYA_READABLE action
+ * @return NULL, or error which must be thrown into the task.
+ */
+extern const char *pyplugin_task_watch(pyplugin_action action);
+
+/**
+ * Resume task in Python thread. Task is freed when it ends.
+ * @param task Task
+ * @param error Error thrown into task or NULL
+ */
+extern void pyplugin_task_resume(pyplugin_task task, const char *error);
+
+/**
+ * Remove all tasks started by script. Must be called from main loop
+ * while Python thread isn't running, with interpreter lock of script held.
+ * @param plugin Script
+ */
+extern void pyplugin_remove_tasks(plugin_PyObject *plugin);
+
+/**
+ * Start task
+ * API function ircbot.spawn(generator)
+ */
+extern PyObject *pyplugin_spawn(PyObject *self, PyObject *args);
+
+/**
+ * Create request that makes task sleep
+ * API function ircbot.sleep(seconds)
+ */
+extern PyObject *pyplugin_sleep(PyObject *self, PyObject *args);
+
+/**
+ * Create request that makes task wait for data on file descriptor
+ * API function ircbot.readable(fd)
+ */
+extern PyObject *pyplugin_readable(PyObject *self, PyObject *args);
+
+/**
+ * Get python channel object from cache or construct new one.
+ * @param id IRCLib channel used as cache key
+ * @param name Channel name
+ * @return New reference to channel class instance
+ */
+extern PyObject *pyplugin_channel_object_id(const void *id,
+	const char *name);
+
+/**
+ * Get python user object from cache or construct new one, and update it
+ * from user snapshot.
+ * @param user User snapshot
+ * @return New reference to user class instance, NULL if user isn't known.
+ */
+extern PyObject *pyplugin_user_object_snapshot(pyplugin_snapshot_user *user);
+
+/**
+ * Remove user and channel from object cache. Called from Python thread.
+ * @param user IRCLib user or NULL
+ * @param channel IRCLib channel or NULL
+ */
+extern void pyplugin_cache_invalidate(const void *user, const void *channel);
+
+/**
+ * Ask Python thread to remove user and channel from object cache. Called
+ * from main loop, requests are never dropped.
+ * @param user IRCLib user or NULL
+ * @param channel IRCLib channel or NULL
+ */
+extern void pyplugin_cache_post(const void *user, const void *channel);
+
+/**
+ * Start measuring CPU time of script callback. Called from Python thread
+ * with interpreter lock held. Nested calls are counted as part of the
+ * outermost one.
+ * @param plugin Script which is being called
+ * @param event Event name
+ */
+extern void pyplugin_watchdog_enter(plugin_PyObject *plugin,
+	const char *event);
+
+/**
+ * Stop measuring CPU time of script callback. Called from Python thread
+ * with interpreter lock held.
+ */
+extern void pyplugin_watchdog_leave();
+
+/**
+ * Start watchdog thread, which interrupts callbacks running longer than
+ * python:callbackbudget.
+ * @param thread Python thread
+ */
+extern void pyplugin_watchdog_start(pthread_t thread);
+
+/**
+ * Stop watchdog thread.
+ */
+extern void pyplugin_watchdog_stop();
+
+/**
+ * ontelnetcmd event handler, provides `python *` commands.
+ */
+extern void pyplugin_telnet_commands(EVENT *event);
+
+/**
+ * Get object cache metrics
+ * API function ircbot.cache_stats()
+ * @return Dictionary with metrics
+ */
+extern PyObject *pyplugin_cache_stats(PyObject *self, PyObject *args);
+
+/**
+ * Get event queue metrics
+ * API function ircbot.queue_stats()
+ * @return Dictionary with metrics
+ */
+extern PyObject *pyplugin_queue_stats(PyObject *self, PyObject *args);
 
 /**
  * onconnected IRC event handler
@@ -431,6 +828,16 @@ extern void pyplugin_event_ondisconnected(EVENT *event);
  */
 extern void pyplugin_event_onrawreceive(EVENT *event);
 
+/**
+ * onuserremoved IRC event handler
+ */
+extern void pyplugin_event_onuserremoved(EVENT *event);
+
+/**
+ * onchannelremoved IRC event handler
+ */
+extern void pyplugin_event_onchannelremoved(EVENT *event);
+
 
 /**
  * onjoin IRC event handler
@@ -56,6 +56,15 @@
 
 PythonPluginData *python_plugin_data; /**< Python plugin data */
 
+/**
+ * Init list of event callbacks, event name is used in watchdog messages.
+ * @param data Python plugin data
+ * @param event Name of pyplugin_event member
+ */
+#define pyplugin_init_event(data, event) \
+	ll_inits((data)->event); \
+	(data)->event.name = #event
+
 /**
  * Initialize plugin.
  * @param info Plugin info, where this function must fill in some informations
@@ -99,6 +108,7 @@ void PluginInit(PluginInfo *info) {
 
 	python_plugin_data->channel_dict = PyDict_New();
 	python_plugin_data->user_dict = PyDict_New();
+	memset(&python_plugin_data->cache, 0, sizeof(pyplugin_cache_metrics));
 
 	//pyplugin_install_api();
 
@@ -109,26 +119,27 @@ void PluginInit(PluginInfo *info) {
 	}
 
 	// Init linked lists for events
-	ll_inits(plugData->channel_message);
-	ll_inits(plugData->private_message);
-	ll_inits(plugData->channel_action);
-	ll_inits(plugData->private_action);
-	ll_inits(plugData->channel_notice);
-	ll_inits(plugData->private_notice);
-	ll_inits(plugData->join);
-	ll_inits(plugData->part);
-	ll_inits(plugData->quit);
-	ll_inits(plugData->kick);
-	ll_inits(plugData->mode);
-	ll_inits(plugData->raw);
-	ll_inits(plugData->nick);
-	ll_inits(plugData->nick_changed);
-	ll_inits(plugData->connected);
-	ll_inits(plugData->disconnected);
-	ll_inits(plugData->joined);
-	ll_inits(plugData->kicked);
-	ll_inits(plugData->parted);
-	ll_inits(plugData->exit);
+	pyplugin_init_event(plugData, channel_message);
+	pyplugin_init_event(plugData, private_message);
+	pyplugin_init_event(plugData, channel_action);
+	pyplugin_init_event(plugData, private_action);
+	pyplugin_init_event(plugData, channel_notice);
+	pyplugin_init_event(plugData, private_notice);
+	pyplugin_init_event(plugData, join);
+	pyplugin_init_event(plugData, part);
+	pyplugin_init_event(plugData, quit);
+	pyplugin_init_event(plugData, kick);
+	pyplugin_init_event(plugData, mode);
+	pyplugin_init_event(plugData, raw);
+	pyplugin_init_event(plugData, nick);
+	pyplugin_init_event(plugData, nick_changed);
+	pyplugin_init_event(plugData, connected);
+	pyplugin_init_event(plugData, disconnected);
+	pyplugin_init_event(plugData, joined);
+	pyplugin_init_event(plugData, kicked);
+	pyplugin_init_event(plugData, parted);
+	pyplugin_init_event(plugData, exit);
+	ll_inits(plugData->tasks);
 
 	// Here is python environment ready... So load scripts
 	ll_init(plugData);
@@ -140,7 +151,31 @@ void PluginInit(PluginInfo *info) {
 		)
 	);
 
+	// Scripts are loaded, from now on they run in Python thread
+	pyplugin_thread_start();
+
 	// Install event handlers in core
+	plugData->onuserremoved = events_addEventListener(
+		plugData->info->events,
+		"onuserremoved",
+		pyplugin_event_onuserremoved,
+		NULL
+	);
+
+	plugData->onchannelremoved = events_addEventListener(
+		plugData->info->events,
+		"onchannelremoved",
+		pyplugin_event_onchannelremoved,
+		NULL
+	);
+
+	plugData->ontelnetcmd = events_addEventListener(
+		plugData->info->events,
+		"ontelnetcmd",
+		pyplugin_telnet_commands,
+		NULL
+	);
+
 	plugData->onconnected = events_addEventListener(
 		plugData->info->events,
 		"onconnected",
@@ -359,6 +394,12 @@ void PluginDone(PluginInfo *info) {
 	events_removeEventListener(plugData->onkicked);
 	events_removeEventListener(plugData->onnickchanged);
 	events_removeEventListener(plugData->onnick);
+	events_removeEventListener(plugData->onuserremoved);
+	events_removeEventListener(plugData->onchannelremoved);
+	events_removeEventListener(plugData->ontelnetcmd);
+
+	// Dispatch queued events and wait for Python thread
+	pyplugin_thread_stop();
 
 	// Unload scripts
 	pyplugin_unload_all();
@@ -380,3 +421,11 @@ void PluginDone(PluginInfo *info) {
 
 	free(plugData);
 } // PluginDone
+
+/**
+ * Get list of dependencies
+ * @param deps Dependencies
+ */
+void PluginDeps(char **deps) {
+	*deps = "telnet";
+} // PluginDeps
@@ -53,6 +53,36 @@ PyMethodDef python_IrcBotMethods[] = {
 		METH_VARARGS,
 		"Find user by nickname."
 	},
+	{
+		"queue_stats",
+		pyplugin_queue_stats,
+		METH_VARARGS,
+		"Get event queue metrics."
+	},
+	{
+		"cache_stats",
+		pyplugin_cache_stats,
+		METH_VARARGS,
+		"Get user and channel object cache metrics."
+	},
+	{
+		"spawn",
+		pyplugin_spawn,
+		METH_VARARGS,
+		"Start task from generator, which yields sleep() or readable()."
+	},
+	{
+		"sleep",
+		pyplugin_sleep,
+		METH_VARARGS,
+		"Task request to wake up after given number of seconds."
+	},
+	{
+		"readable",
+		pyplugin_readable,
+		METH_VARARGS,
+		"Task request to wake up when file descriptor has data to read."
+	},
 	{
 		"hook_event",
 		pyplugin_hook_event,
@@ -163,54 +193,112 @@ PyObject *pyplugin_hook_event(PyObject *self, PyObject *args) {
  */
 PyObject *pyplugin_raw_send(PyObject *self, PyObject *args) {
 	char *msg;
-	PyArg_ParseTuple(args, "s", &msg);
-	irclib_sendraw(python_plugin_data->info->irc, "%s", msg);
+	if (!PyArg_ParseTuple(args, "s", &msg)) return NULL;
+	pyplugin_action_post(PYA_RAW, NULL, NULL, msg);
 
 	Py_RETURN_NONE;
 	(void)self;
 } // pyplugin_raw_send
 
 /**
- * Construct python channel object from IRCLib channel
- * @param channel IRCLib channel
- * @return Python channel class instance
+ * Find object in cache.
+ * @param cache channel_dict or user_dict
+ * @param key IRCLib identity
+ * @return New reference to object, NULL if it isn't cached or has been
+ *   freed meanwhile.
  */
-PyObject *pyplugin_channel_object(IRCLib_Channel channel) {
-	if (channel == NULL) return NULL;
+static PyObject *pyplugin_cache_get(PyObject *cache, PyObject *key) {
+	PyObject *ref = PyDict_GetItem(cache, key);
+	if (ref != NULL) {
+		PyObject *object = PyWeakref_GetObject(ref);
+		if (object != NULL && object != Py_None) {
+			python_plugin_data->cache.hits++;
+			Py_INCREF(object);
+			return object;
+		}
+	}
 
-	PyObject *channel_name = PyString_FromString(channel->name);
+	python_plugin_data->cache.misses++;
+	return NULL;
+} // pyplugin_cache_get
 
-	// Test if channel is already in dictionary, if so, return it instead
-	// of creating new object.
-	if (
-		PyDict_Contains(
-			python_plugin_data->channel_dict,
-			channel_name
-		)
-	) {
-		Py_DECREF(channel_name);
-		return PyDict_GetItem(python_plugin_data->channel_dict, channel_name);
+/**
+ * Store weak reference to object in cache.
+ * @param cache channel_dict or user_dict
+ * @param key IRCLib identity
+ * @param object Object
+ */
+static void pyplugin_cache_set(PyObject *cache, PyObject *key,
+	PyObject *object) {
+
+	PyObject *ref = PyWeakref_NewRef(object, NULL);
+	if (ref == NULL) {
+		PyErr_Clear();
+		return;
 	}
 
-	// Channel is not in dictionary, create new one.
+	PyDict_SetItem(cache, key, ref);
+	Py_DECREF(ref);
+} // pyplugin_cache_set
+
+/**
+ * Replace string attribute of object if it has changed.
+ * @param attr Attribute
+ * @param value New value, NULL is stored as empty string.
+ */
+static void pyplugin_cache_update(PyObject **attr, const char *value) {
+	if (value == NULL) value = "";
+	if (*attr != NULL && eq(PyString_AsString(*attr), value)) return;
+
+	PyObject *temp = *attr;
+	*attr = PyString_FromString(value);
+	Py_XDECREF(temp);
+} // pyplugin_cache_update
+
+/**
+ * Get python channel object from cache or construct new one.
+ * @param id IRCLib channel used as cache key
+ * @param name Channel name
+ * @return New reference to channel class instance
+ */
+PyObject *pyplugin_channel_object_id(const void *id, const char *name) {
+	PyObject *key = PyLong_FromVoidPtr((void *)id);
 
-	// SEGFAULT HERE
-	PyObject *result = pyplugin_channel_new(
+	// Test if channel is already in cache, if so, return it instead
+	// of creating new object.
+	PyObject *result = pyplugin_cache_get(python_plugin_data->channel_dict,
+		key);
+	if (result != NULL) {
+		Py_DECREF(key);
+		return result;
+	}
+
+	// Channel is not in cache, create new one.
+	result = pyplugin_channel_new(
 		&(channel_PyTypeObject),
 		NULL,
 		NULL
 	);
 
-	PyObject *temp = ((channel_PyObject *)result)->name;
-	((channel_PyObject *)result)->name = channel_name;
-	Py_XDECREF(temp);
+	pyplugin_cache_update(&((channel_PyObject *)result)->name, name);
 
 	// ToDo: Fill in users tuple
 
-	// Add channel to dictionary
-	PyDict_SetItem(python_plugin_data->channel_dict, channel_name, result);
+	// Add channel to cache
+	pyplugin_cache_set(python_plugin_data->channel_dict, key, result);
+	Py_DECREF(key);
 
 	return result;
+} // pyplugin_channel_object_id
+
+/**
+ * Construct python channel object from IRCLib channel
+ * @param channel IRCLib channel
+ * @return New reference to channel class instance
+ */
+PyObject *pyplugin_channel_object(IRCLib_Channel channel) {
+	if (channel == NULL) return NULL;
+	return pyplugin_channel_object_id(channel, channel->name);
 } // pyplugin_channel_object
 
 /**
@@ -221,74 +309,104 @@ PyObject *pyplugin_find_channel(PyObject *self, PyObject *args) {
 	char *channel;
 	if (!PyArg_ParseTuple(args, "s", &channel)) return NULL;
 
-	IRCLib_Channel s_channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		channel
-	);
-
-	PyObject *result = Py_None;
-	Py_INCREF(Py_None);
+	pyplugin_snapshot found = pyplugin_query(PYA_FIND_CHANNEL, channel);
 
-	if (channel != NULL) {
-		PyObject *temp = result;
-		result = pyplugin_channel_object(s_channel);
-		Py_XDECREF(temp);
+	PyObject *result;
+	if (found->channel != NULL) {
+		result = pyplugin_channel_object_id(found->channelId,
+			found->channel);
+	} else {
+		Py_INCREF(Py_None);
+		result = Py_None;
 	}
+	free(found);
 
 	return result;
 	(void)self;
 } // pyplugin_find_channel
 
 /**
- * Construct python user object from IRCLib user.
- * @param user IRCLib user structure
- * @return Python user class instance
+ * Get python user object from cache or construct new one, and update it
+ * from user snapshot.
+ * @param user User snapshot
+ * @return New reference to user class instance, NULL if user isn't known.
  */
-PyObject *pyplugin_user_object(IRCLib_User user) {
-	if (user == NULL) return NULL;
+PyObject *pyplugin_user_object_snapshot(pyplugin_snapshot_user *user) {
+	if (!user->known) return NULL;
 
-	PyObject *user_name = PyString_FromString(user->host->nick);
+	PyObject *key = PyLong_FromVoidPtr((void *)user->id);
 
-	// Test if user is already in dictionary, if so, return it instead
+	// Test if user is already in cache, if so, return it instead
 	// of creating new object.
-	if (
-		PyDict_Contains(
-			python_plugin_data->user_dict,
-			user_name
-		)
-	) {
-		Py_DECREF(user_name);
-		return PyDict_GetItem(python_plugin_data->user_dict, user_name);
+	PyObject *result = pyplugin_cache_get(python_plugin_data->user_dict,
+		key);
+	if (result == NULL) {
+		result = pyplugin_user_new(
+			&(user_PyTypeObject),
+			NULL,
+			NULL
+		);
+
+		// ToDo: Fill in channels tuple
+
+		// Add user to cache
+		pyplugin_cache_set(python_plugin_data->user_dict, key, result);
 	}
+	Py_DECREF(key);
 
-	// Channel is not in dictionary, create new one.
-
-	PyObject *result = pyplugin_user_new(
-		&(user_PyTypeObject),
-		NULL,
-		NULL
-	);
+	// User may have changed nick since the object was created.
+	pyplugin_cache_update(&((user_PyObject *)result)->nick, user->nick);
+	pyplugin_cache_update(&((user_PyObject *)result)->user, user->user);
+	pyplugin_cache_update(&((user_PyObject *)result)->hostname, user->host);
 
-	PyObject *temp = ((user_PyObject *)result)->nick;
-	((user_PyObject *)result)->nick = PyString_FromString(user->host->nick);
-	Py_XDECREF(temp);
-
-	temp = ((user_PyObject *)result)->user;
-	((user_PyObject *)result)->user = PyString_FromString(user->host->user);
-	Py_XDECREF(temp);
-
-	temp = ((user_PyObject *)result)->hostname;
-	((user_PyObject *)result)->hostname = PyString_FromString(user->host->host);
-	Py_XDECREF(temp);
-
-	// ToDo: Fill in channels tuple
+	return result;
+} // pyplugin_user_object_snapshot
 
-	// Add channel to dictionary
-	PyDict_SetItem(python_plugin_data->user_dict, user_name, result);
+/**
+ * Construct python user object from IRCLib user.
+ * @param user IRCLib user structure
+ * @return New reference to user class instance
+ */
+PyObject *pyplugin_user_object(IRCLib_User user) {
+	if (user == NULL) return NULL;
 
-	return result;
+	pyplugin_snapshot_user snapshot = {
+		.id = user,
+		.nick = user->host->nick,
+		.user = user->host->user,
+		.host = user->host->host,
+		.known = true
+	};
+	return pyplugin_user_object_snapshot(&snapshot);
 } // pyplugin_user_object
 
+/**
+ * Remove user and channel from object cache. Objects still referenced by
+ * scripts stay alive, only the cache forgets them.
+ * @param user IRCLib user or NULL
+ * @param channel IRCLib channel or NULL
+ */
+void pyplugin_cache_invalidate(const void *user, const void *channel) {
+	struct {
+		PyObject *cache;
+		const void *id;
+	} entries[] = {
+		{ python_plugin_data->user_dict, user },
+		{ python_plugin_data->channel_dict, channel }
+	};
+
+	for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+		if (entries[i].id == NULL) continue;
+
+		PyObject *key = PyLong_FromVoidPtr((void *)entries[i].id);
+		if (PyDict_GetItem(entries[i].cache, key) != NULL) {
+			PyDict_DelItem(entries[i].cache, key);
+			python_plugin_data->cache.invalidated++;
+		}
+		Py_DECREF(key);
+	}
+} // pyplugin_cache_invalidate
+
 /**
  * Find user acording to his nick.
  * API function ircbot.find_user(nick)
@@ -299,20 +417,59 @@ PyObject *pyplugin_find_user(PyObject *self, PyObject *args) {
 	char *nick;
 	if (!PyArg_ParseTuple(args, "s", &nick)) return NULL;
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		nick
-	);
-
-	PyObject *result = Py_None;
-	Py_INCREF(Py_None);
+	pyplugin_snapshot found = pyplugin_query(PYA_FIND_USER, nick);
 
-	if (user != NULL) {
-		PyObject *temp = result;
-		result = pyplugin_user_object(user);
-		Py_XDECREF(temp);
+	PyObject *result = pyplugin_user_object_snapshot(&found->user);
+	if (result == NULL) {
+		Py_INCREF(Py_None);
+		result = Py_None;
 	}
+	free(found);
 
 	return result;
 	(void)self;
-} // pyplugin_find_user
\ No newline at end of file
+} // pyplugin_find_user
+
+/**
+ * Get event queue metrics
+ * API function ircbot.queue_stats()
+ * @return Dictionary with metrics
+ */
+PyObject *pyplugin_queue_stats(PyObject *self, PyObject *args) {
+	pyplugin_queue_metrics stats;
+	pyplugin_thread_stats(&stats);
+
+	return Py_BuildValue(
+		"{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K}",
+		"size", (unsigned PY_LONG_LONG)stats.size,
+		"depth", (unsigned PY_LONG_LONG)stats.depth,
+		"max_depth", (unsigned PY_LONG_LONG)stats.maxDepth,
+		"pushed", (unsigned PY_LONG_LONG)stats.pushed,
+		"dropped", (unsigned PY_LONG_LONG)stats.dropped,
+		"coalesced", (unsigned PY_LONG_LONG)stats.coalesced,
+		"blocked", (unsigned PY_LONG_LONG)stats.blocked,
+		"actions", (unsigned PY_LONG_LONG)stats.actions
+	);
+	(void)self;
+	(void)args;
+} // pyplugin_queue_stats
+
+/**
+ * Get object cache metrics
+ * API function ircbot.cache_stats()
+ * @return Dictionary with metrics
+ */
+PyObject *pyplugin_cache_stats(PyObject *self, PyObject *args) {
+	pyplugin_cache_metrics *cache = &python_plugin_data->cache;
+
+	return Py_BuildValue(
+		"{s:n,s:n,s:K,s:K,s:K}",
+		"users", PyDict_Size(python_plugin_data->user_dict),
+		"channels", PyDict_Size(python_plugin_data->channel_dict),
+		"hits", (unsigned PY_LONG_LONG)cache->hits,
+		"misses", (unsigned PY_LONG_LONG)cache->misses,
+		"invalidated", (unsigned PY_LONG_LONG)cache->invalidated
+	);
+	(void)self;
+	(void)args;
+} // pyplugin_cache_stats
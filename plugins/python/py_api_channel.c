@@ -186,6 +186,8 @@ void pyplugin_install_channel_class() {
 	// Add class channel to ircbot module.
 	channel_PyTypeObject.tp_new = pyplugin_channel_new;
 	channel_PyTypeObject.tp_dealloc = (destructor)pyplugin_channel_dealloc;
+	channel_PyTypeObject.tp_weaklistoffset =
+		offsetof(channel_PyObject, weakreflist);
 	channel_PyTypeObject.tp_members = channel_members;
 	channel_PyTypeObject.tp_methods = channel_methods;
 
@@ -216,6 +218,7 @@ PyObject *pyplugin_channel_new(PyTypeObject *type, PyObject *args,
 		self->name = PyString_FromString("");
 		self->users = PyTuple_New(0);
 		self->dict = PyDict_New();
+		self->weakreflist = NULL;
 		Py_INCREF(Py_None);
 		PyDict_SetItemString(self->dict, "test", Py_None);
 	}
@@ -235,6 +238,11 @@ void pyplugin_channel_dealloc(channel_PyObject *self) {
 	Py_XDECREF(self->name);
 	Py_XDECREF(self->users);
 	Py_XDECREF(self->dict);
+
+	// Cache holds only weak reference
+	if (self->weakreflist != NULL) {
+		PyObject_ClearWeakRefs((PyObject *)self);
+	}
 	self->ob_type->tp_free((PyObject *)self);
 } // pyplugin_user_dealloc
 
@@ -249,7 +257,7 @@ PyObject *pyplugin_channel_message(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_message(python_plugin_data->info->irc, channel, "%s", message);
+			pyplugin_action_post(PYA_MESSAGE, channel, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
@@ -268,7 +276,7 @@ PyObject *pyplugin_channel_action(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_action(python_plugin_data->info->irc, channel, "%s", message);
+			pyplugin_action_post(PYA_ACTION, channel, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
@@ -287,7 +295,7 @@ PyObject *pyplugin_channel_notice(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_notice(python_plugin_data->info->irc, channel, "%s", message);
+			pyplugin_action_post(PYA_NOTICE, channel, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
@@ -303,18 +311,13 @@ PyObject *pyplugin_channel_kick(PyObject *self, PyObject *args) {
 	PyObject *result = NULL;
 
 	char *nick;
-	char *reason;
+	char *reason = NULL;
 
 	if (PyArg_ParseTuple(args, "s|s", &nick, &reason)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
 
-			if (reason != NULL) {
-				irclib_kick(python_plugin_data->info->irc, channel, nick, "%s",
-					reason);
-			} else {
-				irclib_kick(python_plugin_data->info->irc, channel, nick, "");
-			}
+			pyplugin_action_post(PYA_KICK, channel, nick, reason);
 
 			Py_INCREF(Py_None);
 			result = Py_None;
@@ -334,8 +337,11 @@ PyObject *pyplugin_channel_ban(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &address)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_mode(python_plugin_data->info->irc, "%s +b %s",
-				channel, address);
+			char *mode;
+			if (asprintf(&mode, "+b %s", address) >= 0) {
+				pyplugin_action_post(PYA_MODE, channel, NULL, mode);
+				free(mode);
+			}
 
 			Py_INCREF(Py_None);
 			result = Py_None;
@@ -355,8 +361,11 @@ PyObject *pyplugin_channel_unban(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &address)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_mode(python_plugin_data->info->irc, "%s -b %s",
-				channel, address);
+			char *mode;
+			if (asprintf(&mode, "-b %s", address) >= 0) {
+				pyplugin_action_post(PYA_MODE, channel, NULL, mode);
+				free(mode);
+			}
 
 			Py_INCREF(Py_None);
 			result = Py_None;
@@ -376,8 +385,7 @@ PyObject *pyplugin_channel_mode(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &mode)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
-			irclib_mode(python_plugin_data->info->irc, "%s %s",
-				channel, mode);
+			pyplugin_action_post(PYA_MODE, channel, NULL, mode);
 
 			Py_INCREF(Py_None);
 			result = Py_None;
@@ -393,18 +401,13 @@ PyObject *pyplugin_channel_mode(PyObject *self, PyObject *args) {
 PyObject *pyplugin_channel_part(PyObject *self, PyObject *args) {
 	PyObject *result = NULL;
 
-	char *reason;
+	char *reason = NULL;
 
 	if (PyArg_ParseTuple(args, "|s", &reason)) {
 		char *channel = PyString_AsString(((channel_PyObject *)self)->name);
 		if (!eq(channel, "")) {
 
-			if (reason != NULL) {
-				irclib_part(python_plugin_data->info->irc, channel, "%s",
-					reason);
-			} else {
-				irclib_part(python_plugin_data->info->irc, channel, "");
-			}
+			pyplugin_action_post(PYA_PART, channel, NULL, reason);
 
 			Py_INCREF(Py_None);
 			result = Py_None;
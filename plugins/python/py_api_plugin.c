@@ -88,6 +88,12 @@ PyObject *pyplugin_load(const char *path) {
 		goto error;
 	}
 
+	plugin->workerState = NULL;
+	plugin->watchdogState = NULL;
+	plugin->cpuTime = 0;
+	plugin->calls = 0;
+	plugin->timeouts = 0;
+
 	PyEval_AcquireLock();
 	plugin->tstate = Py_NewInterpreter();
 
@@ -242,6 +248,9 @@ void pyplugin_unload(plugin_PyObject *plugin) {
 	pyplugin_remove_hooks(&python_plugin_data->parted, plugin);
 	pyplugin_remove_hooks(&python_plugin_data->exit, plugin);
 
+	// Stop tasks started by this plugin
+	pyplugin_remove_tasks(plugin);
+
 	Py_DECREF(plugin);
 	Py_EndInterpreter(tstate);
 	PyThreadState_Swap(NULL);
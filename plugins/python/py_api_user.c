@@ -170,6 +170,8 @@ void pyplugin_install_user_class() {
 	// Add class user to ircbot module.
 	user_PyTypeObject.tp_new = pyplugin_user_new;
 	user_PyTypeObject.tp_dealloc = (destructor)pyplugin_user_dealloc;
+	user_PyTypeObject.tp_weaklistoffset =
+		offsetof(user_PyObject, weakreflist);
 	user_PyTypeObject.tp_members = user_members;
 	user_PyTypeObject.tp_methods = user_methods;
 
@@ -201,6 +203,7 @@ PyObject *pyplugin_user_new(PyTypeObject *type, PyObject *args,
 		self->hostname = PyString_FromString("");
 		self->channels = PyTuple_New(0);
 		self->dict = PyDict_New();
+		self->weakreflist = NULL;
 	}
 
 	return (PyObject *)self;
@@ -219,6 +222,11 @@ void pyplugin_user_dealloc(user_PyObject *self) {
 	Py_XDECREF(self->user);
 	Py_XDECREF(self->hostname);
 	Py_XDECREF(self->dict);
+
+	// Cache holds only weak reference
+	if (self->weakreflist != NULL) {
+		PyObject_ClearWeakRefs((PyObject *)self);
+	}
 	self->ob_type->tp_free((PyObject *)self);
 } // pyplugin_user_dealloc
 
@@ -234,7 +242,7 @@ PyObject *pyplugin_user_message(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *nick = PyString_AsString(((user_PyObject *)self)->nick);
 		if (!eq(nick, "")) {
-			irclib_message(python_plugin_data->info->irc, nick, "%s", message);
+			pyplugin_action_post(PYA_MESSAGE, nick, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
@@ -254,7 +262,7 @@ PyObject *pyplugin_user_action(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *nick = PyString_AsString(((user_PyObject *)self)->nick);
 		if (!eq(nick, "")) {
-			irclib_action(python_plugin_data->info->irc, nick, "%s", message);
+			pyplugin_action_post(PYA_ACTION, nick, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
@@ -274,7 +282,7 @@ PyObject *pyplugin_user_notice(PyObject *self, PyObject *args) {
 	if (PyArg_ParseTuple(args, "s", &message)) {
 		char *nick = PyString_AsString(((user_PyObject *)self)->nick);
 		if (!eq(nick, "")) {
-			irclib_notice(python_plugin_data->info->irc, nick, "%s", message);
+			pyplugin_action_post(PYA_NOTICE, nick, NULL, message);
 			Py_INCREF(Py_None);
 			result = Py_None;
 		}
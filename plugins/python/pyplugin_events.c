@@ -28,33 +28,107 @@
 #include <toolbox/linkedlist.h>
 
 /**
- * Call callback functions for specified list of callbacks.
+ * Call callback functions for specified list of callbacks. Runs in Python
+ * thread. When no callback is registered, returns without touching Python.
+ * Otherwise the arguments are built once, and callbacks are called grouped
+ * by interpreter (in order in which the interpreters have hooked the event),
+ * so the interpreter lock is taken only once per event.
  * @param callbacks List of callbacks
- * @param arglist Arguments that will be passed to the Python function
+ * @param build Function that builds argument tuple passed to callbacks,
+ *   called with interpreter lock held.
+ * @param data Data passed to build function
  */
-void pyplugin_callback(pyplugin_event *callbacks, PyObject *arglist) {
-	ll_loop(callbacks, cb) {
-		PyEval_AcquireThread(cb->plugin->tstate);
+void pyplugin_callback(pyplugin_event *callbacks, pyplugin_args_builder build,
+	void *data) {
+
+	if (callbacks->first == NULL) return;
+
+	PyThreadState *tstate = callbacks->first->plugin->workerState;
+	PyEval_AcquireThread(tstate);
 
-		Py_XINCREF(arglist);
-		PyObject *result = PyEval_CallObject(cb->callback, arglist);
-		if (!result) {
-			PyErr_Print();
+	PyObject *arglist = build(data);
+	if (arglist == NULL) {
+		PyErr_Print();
+		PyEval_ReleaseThread(tstate);
+		return;
+	}
+
+	ll_loop(callbacks, cb) {
+		// Callbacks of this interpreter have already been called.
+		bool done = false;
+		for (pyplugin_event_cb prev = callbacks->first; prev != cb;
+			prev = prev->next) {
+
+			if (prev->plugin == cb->plugin) {
+				done = true;
+				break;
+			}
 		}
-		Py_XDECREF(arglist);
-		Py_XDECREF(result);
+		if (done) continue;
 
-		PyEval_ReleaseThread(cb->plugin->tstate);
+		PyThreadState_Swap(cb->plugin->workerState);
+
+		for (pyplugin_event_cb same = cb; same != NULL; same = same->next) {
+			if (same->plugin != cb->plugin) continue;
+
+			pyplugin_watchdog_enter(same->plugin, callbacks->name);
+			PyObject *result = PyEval_CallObject(same->callback, arglist);
+			pyplugin_watchdog_leave();
+			if (!result) {
+				PyErr_Print();
+			}
+			Py_XDECREF(result);
+		}
 	}
+
+	Py_DECREF(arglist);
+
+	PyThreadState_Swap(tstate);
+	PyEval_ReleaseThread(tstate);
 } // pyplugin_callback
 
+/**
+ * Get Python object of channel from snapshot.
+ * @param snapshot Event snapshot
+ * @return New reference to channel object, or None.
+ */
+static PyObject *pyplugin_event_channel(pyplugin_snapshot snapshot) {
+	if (snapshot->channel == NULL) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return pyplugin_channel_object_id(snapshot->channelId, snapshot->channel);
+} // pyplugin_event_channel
+
+/**
+ * Get Python object of user from snapshot.
+ * @param user User snapshot
+ * @return New reference to user object, or None.
+ */
+static PyObject *pyplugin_event_user(pyplugin_snapshot_user *user) {
+	PyObject *result = pyplugin_user_object_snapshot(user);
+	if (result == NULL) {
+		Py_INCREF(Py_None);
+		result = Py_None;
+	}
+	return result;
+} // pyplugin_event_user
+
+/**
+ * Build empty argument list.
+ * @param data Not used
+ */
+static PyObject *pyplugin_args_none(void *data) {
+	(void)data;
+	return Py_BuildValue("()");
+} // pyplugin_args_none
+
 /**
  * onconnected IRC event handler
  */
 void pyplugin_event_onconnected(EVENT *event) {
-	PyObject *arglist = Py_BuildValue("()");
-	pyplugin_callback(&(python_plugin_data->connected), arglist);
-	Py_DECREF(arglist);
+	pyplugin_event_post(&(python_plugin_data->connected), pyplugin_args_none,
+		NULL, NULL, NULL, NULL);
 	(void)event;
 } // pyplugin_event_onconnected
 
@@ -62,76 +136,104 @@ void pyplugin_event_onconnected(EVENT *event) {
  * ondisconnected IRC event handler
  */
 void pyplugin_event_ondisconnected(EVENT *event) {
-	PyObject *arglist = Py_BuildValue("()");
-	pyplugin_callback(&(python_plugin_data->disconnected), arglist);
-	Py_DECREF(arglist);
+	pyplugin_event_post(&(python_plugin_data->disconnected),
+		pyplugin_args_none, NULL, NULL, NULL, NULL);
 	(void)event;
 } // pyplugin_event_ondisconnected
 
+/**
+ * Build argument list of raw event: (message)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_raw(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
+	return Py_BuildValue("(s)", snapshot->text);
+} // pyplugin_args_raw
+
 /**
  * onrawreceive IRC event handler
  */
 void pyplugin_event_onrawreceive(EVENT *event) {
-	PyObject *arglist = Py_BuildValue(
-		"(s)",
-		((IRCEvent_RawData *)event->customData)->message
-	);
-	pyplugin_callback(&(python_plugin_data->raw), arglist);
-	Py_DECREF(arglist);
-	(void)event;
+	pyplugin_event_post(&(python_plugin_data->raw), pyplugin_args_raw,
+		NULL, NULL, NULL,
+		((IRCEvent_RawData *)event->customData)->message);
 } // pyplugin_event_onrawreceive
 
 /**
- * onjoin IRC event handler
+ * onuserremoved IRC event handler, user object can't be reused anymore.
  */
-void pyplugin_event_onjoin(EVENT *event) {
-	IRCEvent_JoinPart *evt = (IRCEvent_JoinPart *)(event->customData);
-
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		evt->channel
-	);
+void pyplugin_event_onuserremoved(EVENT *event) {
+	IRCEvent_UserRemoved *data = (IRCEvent_UserRemoved *)event->customData;
+	pyplugin_cache_post(data->user, NULL);
+} // pyplugin_event_onuserremoved
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		evt->address->nick
-	);
+/**
+ * onchannelremoved IRC event handler, channel object can't be reused
+ * anymore.
+ */
+void pyplugin_event_onchannelremoved(EVENT *event) {
+	IRCEvent_ChannelRemoved *data =
+		(IRCEvent_ChannelRemoved *)event->customData;
+	pyplugin_cache_post(NULL, data->channel);
+} // pyplugin_event_onchannelremoved
 
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
+/**
+ * Build argument list of join event: (channel, user)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_join(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
+	return Py_BuildValue(
+		"(NN)",
+		pyplugin_event_channel(snapshot),
+		pyplugin_event_user(&snapshot->user)
+	);
+} // pyplugin_args_join
 
-	PyObject *arglist = Py_BuildValue("(OO)", po_channel, po_user);
-	pyplugin_callback(&(python_plugin_data->join), arglist);
-	Py_DECREF(arglist);
+/**
+ * onjoin IRC event handler
+ */
+void pyplugin_event_onjoin(EVENT *event) {
+	IRCEvent_JoinPart *evt = (IRCEvent_JoinPart *)(event->customData);
 
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
+	pyplugin_event_post(&(python_plugin_data->join), pyplugin_args_join,
+		evt->channel, evt->address->nick, NULL, NULL);
 } // pyplugin_event_onjoin
 
+/**
+ * Build argument list of joined event: (channel)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_joined(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
+	return Py_BuildValue("(N)", pyplugin_event_channel(snapshot));
+} // pyplugin_args_joined
+
 /**
  * onjoined IRC event handler
  */
 void pyplugin_event_onjoined(EVENT *event) {
 	IRCEvent_JoinPart *evt = (IRCEvent_JoinPart *)(event->customData);
 
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		evt->channel
-	);
-
-	PyObject *po_channel = pyplugin_channel_object(channel);
-
-	Py_INCREF(po_channel);
+	pyplugin_event_post(&(python_plugin_data->joined), pyplugin_args_joined,
+		evt->channel, NULL, NULL, NULL);
+} // pyplugin_event_onjoined
 
-	PyObject *arglist = Py_BuildValue("(O)", po_channel);
-	pyplugin_callback(&(python_plugin_data->joined), arglist);
-	Py_DECREF(arglist);
+/**
+ * Build argument list of part event: (channel, user, reason)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_part(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	Py_DECREF(po_channel);
-} // pyplugin_event_onjoined
+	return Py_BuildValue(
+		"(NNz)",
+		pyplugin_event_channel(snapshot),
+		pyplugin_event_user(&snapshot->user),
+		snapshot->text
+	);
+} // pyplugin_args_part
 
 /**
  * onpart IRC event handler
@@ -139,34 +241,23 @@ void pyplugin_event_onjoined(EVENT *event) {
 void pyplugin_event_onpart(EVENT *event) {
 	IRCEvent_JoinPart *evt = (IRCEvent_JoinPart *)(event->customData);
 
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		evt->channel
-	);
-
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		evt->address->nick
-	);
-
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
+	pyplugin_event_post(&(python_plugin_data->part), pyplugin_args_part,
+		evt->channel, evt->address->nick, NULL, evt->reason);
+} // pyplugin_event_onpart
 
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
+/**
+ * Build argument list of parted event: (channel, reason)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_parted(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	PyObject *arglist = Py_BuildValue(
-		"(OOs)",
-		po_channel,
-		po_user,
-		evt->reason
+	return Py_BuildValue(
+		"(Nz)",
+		pyplugin_event_channel(snapshot),
+		snapshot->text
 	);
-	pyplugin_callback(&(python_plugin_data->part), arglist);
-	Py_DECREF(arglist);
-
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
-} // pyplugin_event_onpart
+} // pyplugin_args_parted
 
 /**
  * onparted IRC event handler
@@ -174,21 +265,38 @@ void pyplugin_event_onpart(EVENT *event) {
 void pyplugin_event_onparted(EVENT *event) {
 	IRCEvent_JoinPart *evt = (IRCEvent_JoinPart *)(event->customData);
 
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		evt->channel
-	);
+	pyplugin_event_post(&(python_plugin_data->parted), pyplugin_args_parted,
+		evt->channel, NULL, NULL, evt->reason);
+} // pyplugin_event_onparted
 
-	PyObject *po_channel = pyplugin_channel_object(channel);
+/**
+ * Build argument list of channel message or notice: (channel, user, text)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_channel_message(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	Py_INCREF(po_channel);
+	return Py_BuildValue(
+		"(NNs)",
+		pyplugin_event_channel(snapshot),
+		pyplugin_event_user(&snapshot->user),
+		snapshot->text
+	);
+} // pyplugin_args_channel_message
 
-	PyObject *arglist = Py_BuildValue("(Os)", po_channel, evt->reason);
-	pyplugin_callback(&(python_plugin_data->parted), arglist);
-	Py_DECREF(arglist);
+/**
+ * Build argument list of private message or notice: (user, text)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_private_message(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	Py_DECREF(po_channel);
-} // pyplugin_event_onparted
+	return Py_BuildValue(
+		"(Ns)",
+		pyplugin_event_user(&snapshot->user),
+		snapshot->text
+	);
+} // pyplugin_args_private_message
 
 /**
  * onchannelmessage IRC event handler
@@ -196,37 +304,14 @@ void pyplugin_event_onparted(EVENT *event) {
 void pyplugin_event_onchannelmessage(EVENT *event) {
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		message->channel
-	);
-
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
-	);
-
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
-
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
-
-	PyObject *arglist = Py_BuildValue(
-		"(OOs)",
-		po_channel,
-		po_user,
-		message->message
-	);
-
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->channel_message),
-		arglist
+		pyplugin_args_channel_message,
+		message->channel,
+		message->address->nick,
+		NULL,
+		message->message
 	);
-
-	Py_DECREF(arglist);
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
 } // pyplugin_event_onchannelmessage
 
 /**
@@ -235,28 +320,14 @@ void pyplugin_event_onchannelmessage(EVENT *event) {
 void pyplugin_event_onprivatemessage(EVENT *event) {
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
-	);
-
-	PyObject *po_user = pyplugin_user_object(user);
-
-	Py_INCREF(po_user);
-
-	PyObject *arglist = Py_BuildValue(
-		"(Os)",
-		po_user,
-		message->message
-	);
-
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->private_message),
-		arglist
+		pyplugin_args_private_message,
+		NULL,
+		message->address->nick,
+		NULL,
+		message->message
 	);
-
-	Py_DECREF(arglist);
-	Py_DECREF(po_user);
 } // pyplugin_event_onprivatemessage
 
 /**
@@ -265,37 +336,14 @@ void pyplugin_event_onprivatemessage(EVENT *event) {
 void pyplugin_event_onchannelnotice(EVENT *event) {
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		message->channel
-	);
-
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
-	);
-
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
-
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
-
-	PyObject *arglist = Py_BuildValue(
-		"(OOs)",
-		po_channel,
-		po_user,
-		message->message
-	);
-
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->channel_notice),
-		arglist
+		pyplugin_args_channel_message,
+		message->channel,
+		message->address->nick,
+		NULL,
+		message->message
 	);
-
-	Py_DECREF(arglist);
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
 } // pyplugin_event_onchannelnotice
 
 /**
@@ -304,28 +352,14 @@ void pyplugin_event_onchannelnotice(EVENT *event) {
 void pyplugin_event_onprivatenotice(EVENT *event) {
 	IRCEvent_Message *message = (IRCEvent_Message *)event->customData;
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
-	);
-
-	PyObject *po_user = pyplugin_user_object(user);
-
-	Py_INCREF(po_user);
-
-	PyObject *arglist = Py_BuildValue(
-		"(Os)",
-		po_user,
-		message->message
-	);
-
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->private_notice),
-		arglist
+		pyplugin_args_private_message,
+		NULL,
+		message->address->nick,
+		NULL,
+		message->message
 	);
-
-	Py_DECREF(arglist);
-	Py_DECREF(po_user);
 } // pyplugin_event_onprivatenotice
 
 /**
@@ -406,136 +440,128 @@ void pyplugin_event_onmode(EVENT *event) {
 } // pyplugin_event_onmode
 
 /**
- * onkick IRC event handler
+ * Build argument list of kick event: (channel, user, kicked, reason)
+ * @param data Event snapshot
  */
-void pyplugin_event_onkick(EVENT *event) {
-	IRCEvent_Kick *message = (IRCEvent_Kick *)(event->customData);
-
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		message->channel
-	);
-
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
-	);
+static PyObject *pyplugin_args_kick(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	IRCLib_User kicked = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->nick
+	return Py_BuildValue(
+		"(NNNz)",
+		pyplugin_event_channel(snapshot),
+		pyplugin_event_user(&snapshot->user),
+		pyplugin_event_user(&snapshot->target),
+		snapshot->text
 	);
+} // pyplugin_args_kick
 
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
-	PyObject *po_kicked = pyplugin_user_object(kicked);
-
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
-	Py_INCREF(po_kicked);
-
-	PyObject *arglist = Py_BuildValue(
-		"(OOOs)",
-		po_channel,
-		po_user,
-		po_kicked,
-		message->reason
-	);
+/**
+ * onkick IRC event handler
+ */
+void pyplugin_event_onkick(EVENT *event) {
+	IRCEvent_Kick *message = (IRCEvent_Kick *)(event->customData);
 
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->kicked),
-		arglist
+		pyplugin_args_kick,
+		message->channel,
+		message->address->nick,
+		message->nick,
+		message->reason
 	);
 
 	// ToDo: Change user's belonging to channel in user's and channel object.
-
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
-	Py_DECREF(po_kicked);
-	Py_DECREF(arglist);
 } // pyplugin_event_onkick
 
 /**
- * onkicked IRC event handler
+ * Build argument list of kicked event: (channel, user, reason)
+ * @param data Event snapshot
  */
-void pyplugin_event_onkicked(EVENT *event) {
-	IRCEvent_Kick *message = (IRCEvent_Kick *)(event->customData);
-
-	IRCLib_Channel channel = irclib_find_channel(
-		python_plugin_data->info->irc->channelStorage,
-		message->channel
-	);
+static PyObject *pyplugin_args_kicked(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
+	return Py_BuildValue(
+		"(NNz)",
+		pyplugin_event_channel(snapshot),
+		pyplugin_event_user(&snapshot->user),
+		snapshot->text
 	);
+} // pyplugin_args_kicked
 
-	PyObject *po_channel = pyplugin_channel_object(channel);
-	PyObject *po_user = pyplugin_user_object(user);
-
-	Py_INCREF(po_channel);
-	Py_INCREF(po_user);
-
-	PyObject *arglist = Py_BuildValue(
-		"(OOs)",
-		po_channel,
-		po_user,
-		message->reason
-	);
+/**
+ * onkicked IRC event handler
+ */
+void pyplugin_event_onkicked(EVENT *event) {
+	IRCEvent_Kick *message = (IRCEvent_Kick *)(event->customData);
 
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->kicked),
-		arglist
+		pyplugin_args_kicked,
+		message->channel,
+		message->address->nick,
+		NULL,
+		message->reason
 	);
 
 	// ToDo: Change my belonging to channel in user's and channel object.
-
-	Py_DECREF(po_channel);
-	Py_DECREF(po_user);
-	Py_DECREF(arglist);
 } // pyplugin_event_onkicked
 
+/**
+ * Build argument list of my nick change: (oldnick, newnick)
+ * @param data Event snapshot
+ */
+static PyObject *pyplugin_args_nickchanged(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
+	return Py_BuildValue("(ss)", snapshot->user.nick, snapshot->text);
+} // pyplugin_args_nickchanged
+
 /**
  * onnickchanged IRC event handler
  */
 void pyplugin_event_onnickchanged(EVENT *event) {
 	IRCEvent_NickChange *evt = (IRCEvent_NickChange *)(event->customData);
 
-	PyObject *arglist = Py_BuildValue("(ss)", evt->address->nick, evt->newnick);
-	Py_INCREF(arglist);
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->nick_changed),
-		arglist
+		pyplugin_args_nickchanged,
+		NULL,
+		evt->address->nick,
+		NULL,
+		evt->newnick
 	);
-	Py_DECREF(arglist);
 
 	// ToDo: Change nick of me in user storage (if my object exists)
 
 } // pyplugin_event_onnickchanged
 
 /**
- * onnick IRC event handler
+ * Build argument list of user's nick change: (user, newnick)
+ * @param data Event snapshot
  */
-void pyplugin_event_onnick(EVENT *event) {
-	IRCEvent_NickChange *message = (IRCEvent_NickChange *)(event->customData);
+static PyObject *pyplugin_args_nick(void *data) {
+	pyplugin_snapshot snapshot = (pyplugin_snapshot)data;
 
-	IRCLib_User user = irclib_find_user(
-		python_plugin_data->info->irc->userStorage,
-		message->address->nick
+	return Py_BuildValue(
+		"(Ns)",
+		pyplugin_event_user(&snapshot->user),
+		snapshot->text
 	);
+} // pyplugin_args_nick
 
-	PyObject *po_user = pyplugin_user_object(user);
-	Py_INCREF(po_user);
+/**
+ * onnick IRC event handler
+ */
+void pyplugin_event_onnick(EVENT *event) {
+	IRCEvent_NickChange *message = (IRCEvent_NickChange *)(event->customData);
 
-	PyObject *arglist = Py_BuildValue("(Os)", po_user, message->newnick);
-	pyplugin_callback(
+	pyplugin_event_post(
 		&(python_plugin_data->nick_changed),
-		arglist
+		pyplugin_args_nick,
+		NULL,
+		message->address->nick,
+		NULL,
+		message->newnick
 	);
-	Py_DECREF(arglist);
 
 	// ToDo: Change nick of user in po_user object
-
-	Py_DECREF(po_user);
-} // pyplugin_event_onnick
\ No newline at end of file
+} // pyplugin_event_onnick
@@ -0,0 +1,278 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2008  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Tasks are generator based coroutines multiplexed by the bot's own main
+ * loop, so scripts can wait for sockets, pipes of subprocesses and timers
+ * without blocking the Python thread:
+ *
+ *   def fetch(sock):
+ *       yield ircbot.sleep(5)
+ *       yield ircbot.readable(sock)
+ *       data = sock.recv(4096)
+ *
+ *   ircbot.spawn(fetch(sock))
+ *
+ * The generator yields requests, main loop registers timer or watches the
+ * file descriptor in socketpool, and when it's ready, the task is resumed
+ * by the Python thread. Errors are thrown into the generator as IOError.
+ */
+
+// Python
+#include <Python.h>
+#include "structmember.h"
+
+// Plugins API
+#include <pluginapi.h>
+
+// This plugin interface
+#include "interface.h"
+
+// My libraries
+#include <toolbox/linkedlist.h>
+#include <timers.h>
+
+/**
+ * Remove task from list of tasks and free it. Must be called with
+ * interpreter lock of task's script held.
+ * @param task Task
+ */
+static void pyplugin_task_free(pyplugin_task task) {
+	pyplugin_tasks *tasks = &python_plugin_data->tasks;
+	ll_remove(tasks, task);
+
+	Py_DECREF(task->generator);
+	free(task);
+} // pyplugin_task_free
+
+/**
+ * Run task until it yields next request. Must be called with interpreter
+ * lock of task's script held.
+ * @param task Task
+ * @param error Error thrown into task or NULL
+ */
+static void pyplugin_task_step(pyplugin_task task, const char *error) {
+	PyObject *request;
+	if (error != NULL) {
+		request = PyObject_CallMethod(task->generator, "throw", "Os",
+			PyExc_IOError, error);
+	} else {
+		request = PyObject_CallMethod(task->generator, "send", "O",
+			Py_None);
+	}
+
+	// Task has ended
+	if (request == NULL) {
+		if (PyErr_ExceptionMatches(PyExc_StopIteration)) {
+			PyErr_Clear();
+		} else {
+			PyErr_Print();
+		}
+		pyplugin_task_free(task);
+		return;
+	}
+
+	long int type, value;
+	if (!PyTuple_Check(request) ||
+		!PyArg_ParseTuple(request, "ll", &type, &value) ||
+		(type != PYA_SLEEP && type != PYA_READABLE)) {
+
+		PyErr_Clear();
+		PyErr_SetString(PyExc_TypeError,
+			"Task must yield ircbot.sleep() or ircbot.readable().");
+		PyErr_Print();
+
+		Py_DECREF(request);
+		pyplugin_task_free(task);
+		return;
+	}
+	Py_DECREF(request);
+
+	// Request that failed while script is loading is thrown into the task
+	// right away, there is nobody else to resume it.
+	const char *failed = pyplugin_task_post(type, task, value);
+	if (failed != NULL) {
+		pyplugin_task_step(task, failed);
+	}
+} // pyplugin_task_step
+
+/**
+ * Resume task in Python thread. Task is freed when it ends.
+ * @param task Task
+ * @param error Error thrown into task or NULL
+ */
+void pyplugin_task_resume(pyplugin_task task, const char *error) {
+	plugin_PyObject *plugin = task->plugin;
+	PyThreadState *tstate = plugin->workerState;
+
+	PyEval_AcquireThread(tstate);
+	pyplugin_watchdog_enter(plugin, "task");
+	pyplugin_task_step(task, error);
+	pyplugin_watchdog_leave();
+	PyEval_ReleaseThread(tstate);
+} // pyplugin_task_resume
+
+/**
+ * Timer callback, task has slept long enough.
+ * @param timer Timer
+ * @return Always false, timer is used only once.
+ */
+static bool pyplugin_task_timeout(Timer timer) {
+	pyplugin_task task = timer->customData;
+	task->timer = NULL;
+
+	pyplugin_task_wake(task, NULL);
+	return false;
+} // pyplugin_task_timeout
+
+/**
+ * Socketpool callback, file descriptor the task waits for has data.
+ * @param socket Socket
+ */
+static void pyplugin_task_readable(Socket socket) {
+	pyplugin_task task = socket->customData;
+
+	// Socket would be reported until the task reads the data.
+	socketpool_remove(python_plugin_data->info->socketpool, socket->socketfd);
+	task->fd = -1;
+
+	pyplugin_task_wake(task, NULL);
+} // pyplugin_task_readable
+
+/**
+ * Register timer or file descriptor the task waits for. Called from main
+ * loop.
+ * @param action PYA_SLEEP or PYA_READABLE action
+ * @return NULL, or error which must be thrown into the task.
+ */
+const char *pyplugin_task_watch(pyplugin_action action) {
+	pyplugin_task task = action->task;
+	SocketPool pool = python_plugin_data->info->socketpool;
+
+	switch (action->type) {
+		case PYA_SLEEP:
+			task->timer = timers_add(TM_TIMEOUT, action->value,
+				pyplugin_task_timeout, task);
+			break;
+
+		case PYA_READABLE:
+			if (socketpool_lookup(pool, action->value) != NULL) {
+				return "File descriptor is already watched.";
+			}
+
+			task->fd = action->value;
+			socketpool_add(pool, task->fd, pyplugin_task_readable, NULL, NULL,
+				task);
+			break;
+
+		default:
+			break;
+	}
+
+	return NULL;
+} // pyplugin_task_watch
+
+/**
+ * Remove all tasks started by script. Must be called from main loop
+ * while Python thread isn't running, with interpreter lock of script held.
+ * @param plugin Script
+ */
+void pyplugin_remove_tasks(plugin_PyObject *plugin) {
+	pyplugin_tasks *tasks = &python_plugin_data->tasks;
+
+	ll_loop(tasks, task) {
+		if (task->plugin != plugin) continue;
+
+		if (task->timer != NULL) {
+			timers_remove(task->timer);
+		}
+		if (task->fd >= 0) {
+			socketpool_remove(python_plugin_data->info->socketpool,
+				task->fd);
+		}
+		pyplugin_task_free(task);
+	}
+} // pyplugin_remove_tasks
+
+/**
+ * Start task, it runs until it yields first request.
+ * API function ircbot.spawn(generator)
+ */
+PyObject *pyplugin_spawn(PyObject *self, PyObject *args) {
+	PyObject *generator;
+	if (!PyArg_ParseTuple(args, "O", &generator)) return NULL;
+
+	if (!PyGen_Check(generator)) {
+		PyErr_SetString(PyExc_TypeError, "spawn() argument must be generator.");
+		return NULL;
+	}
+
+	plugin_PyObject *plugin = pyplugin_getCurrent();
+	if (plugin == NULL) return NULL;
+
+	pyplugin_task task = malloc(sizeof(struct s_pyplugin_task));
+	Py_INCREF(generator);
+	task->generator = generator;
+	task->plugin = plugin;
+	task->timer = NULL;
+	task->fd = -1;
+
+	pyplugin_tasks *tasks = &python_plugin_data->tasks;
+	ll_append(tasks, task);
+
+	pyplugin_task_step(task, NULL);
+
+	Py_RETURN_NONE;
+	(void)self;
+} // pyplugin_spawn
+
+/**
+ * Create request that makes task sleep. Timers of bot have resolution of
+ * one second, so the time is rounded up.
+ * API function ircbot.sleep(seconds)
+ */
+PyObject *pyplugin_sleep(PyObject *self, PyObject *args) {
+	double seconds;
+	if (!PyArg_ParseTuple(args, "d", &seconds)) return NULL;
+
+	long int value = 0;
+	if (seconds > 0) {
+		value = (long int)seconds;
+		if (value < seconds) value++;
+	}
+
+	return Py_BuildValue("(ll)", (long int)PYA_SLEEP, value);
+	(void)self;
+} // pyplugin_sleep
+
+/**
+ * Create request that makes task wait for data on file descriptor
+ * API function ircbot.readable(fd)
+ * @param fd File descriptor or object with fileno() method.
+ */
+PyObject *pyplugin_readable(PyObject *self, PyObject *args) {
+	PyObject *file;
+	if (!PyArg_ParseTuple(args, "O", &file)) return NULL;
+
+	int fd = PyObject_AsFileDescriptor(file);
+	if (fd < 0) return NULL;
+
+	return Py_BuildValue("(ll)", (long int)PYA_READABLE, (long int)fd);
+	(void)self;
+} // pyplugin_readable
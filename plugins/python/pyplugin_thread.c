@@ -0,0 +1,956 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2008  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Python scripts run in their own thread, so slow script doesn't stall IRC
+ * connection, telnet and timers. Main loop passes events to the Python
+ * thread as immutable snapshots through bounded lock-free queue. Actions
+ * of scripts (sending messages and so on) are passed back through another
+ * queue, which is drained by main loop when it's woken up by pipe.
+ *
+ * Configuration:
+ *   python:queuesize - capacity of event queue (default 1024)
+ *   python:overflow - what to do when event queue is full: "dropoldest"
+ *     (default), "block" or "coalesce"
+ */
+
+// Python
+#include <Python.h>
+#include "structmember.h"
+
+// Standard libraries
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Plugins API
+#include <pluginapi.h>
+
+// This plugin interface
+#include "interface.h"
+
+// My libraries
+#include <toolbox/tb_string.h>
+#include <toolbox/linkedlist.h>
+#include <config/config.h>
+
+/**
+ * Default capacity of event queue
+ */
+#define PYPLUGIN_QUEUE_SIZE 1024
+
+/**
+ * Capacity of action queue
+ */
+#define PYPLUGIN_ACTION_QUEUE_SIZE 1024
+
+/**
+ * Maximal number of coalesced events waiting for space in queue, one for
+ * each kind of event.
+ */
+#define PYPLUGIN_PENDING_SIZE 32
+
+/**
+ * How long main loop or Python thread sleeps while waiting for space in
+ * full queue (microseconds).
+ */
+#define PYPLUGIN_WAIT_USEC 1000
+
+/**
+ * State of Python thread
+ */
+static struct {
+	pthread_t thread;			/**< Python thread */
+	bool running;				/**< Python thread has been started */
+	bool stopping;				/**< Python thread should end */
+	bool finished;				/**< Python thread has ended */
+
+	pyplugin_queue events;		/**< Events for Python thread */
+	pyplugin_queue actions;		/**< Actions for main loop */
+	sem_t eventsReady;			/**< Posted for each queued event */
+
+	int wakePipe[2];			/**< Pipe that wakes main loop */
+	bool wakeRequested;			/**< Main loop has been woken up and
+									 hasn't processed actions yet */
+
+	pyplugin_overflow overflow;	/**< Event queue overflow policy */
+	pyplugin_snapshot pending[PYPLUGIN_PENDING_SIZE]; /**< Coalesced events
+									 waiting for space in queue */
+	size_t pendingCount;		/**< Number of coalesced events */
+
+	pyplugin_queue_metrics stats;	/**< Event queue metrics */
+} pyThread = {
+	.running = false,
+	.wakePipe = { -1, -1 }
+};
+
+/**
+ * Initialize queue
+ * @param queue Queue
+ * @param size Requested capacity, rounded up to power of 2.
+ */
+static void pyplugin_queue_init(pyplugin_queue *queue, uint64_t size) {
+	uint64_t capacity = 1;
+	while (capacity < size) capacity <<= 1;
+
+	queue->slots = calloc(capacity, sizeof(void *));
+	queue->pinned = calloc(capacity, sizeof(bool));
+	queue->mask = capacity - 1;
+	queue->head = 0;
+	queue->tail = 0;
+} // pyplugin_queue_init
+
+/**
+ * Insert item to queue. Must be called only by queue's producer.
+ * @param queue Queue
+ * @param item Item
+ * @param pinned True if item must not be dropped by producer.
+ * @return False if queue is full.
+ */
+static bool pyplugin_queue_push(pyplugin_queue *queue, void *item,
+	bool pinned) {
+
+	uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if (tail - head > queue->mask) return false;
+
+	__atomic_store_n(&queue->slots[tail & queue->mask], item,
+		__ATOMIC_RELAXED);
+	__atomic_store_n(&queue->pinned[tail & queue->mask], pinned,
+		__ATOMIC_RELAXED);
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+} // pyplugin_queue_push
+
+/**
+ * Remove oldest item from queue. Can be called by consumer and producer.
+ * @param queue Queue
+ * @return Removed item or NULL if queue is empty.
+ */
+static void *pyplugin_queue_pop(pyplugin_queue *queue) {
+	uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	while (true) {
+		uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+		if (head == tail) return NULL;
+
+		// Item is used only if nobody has removed it meanwhile. Slot can't
+		// be reused before head moves.
+		void *item = __atomic_load_n(&queue->slots[head & queue->mask],
+			__ATOMIC_RELAXED);
+		if (__atomic_compare_exchange_n(&queue->head, &head, head + 1,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+
+			return item;
+		}
+	}
+} // pyplugin_queue_pop
+
+/**
+ * Get number of items in queue.
+ * @param queue Queue
+ */
+static uint64_t pyplugin_queue_depth(pyplugin_queue *queue) {
+	uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	return tail - head;
+} // pyplugin_queue_depth
+
+/**
+ * Free queue, items which are still in it are freed by free().
+ * @param queue Queue
+ */
+static void pyplugin_queue_free(pyplugin_queue *queue) {
+	void *item;
+	while ((item = pyplugin_queue_pop(queue)) != NULL) {
+		free(item);
+	}
+	free(queue->slots);
+	free(queue->pinned);
+	queue->slots = NULL;
+	queue->pinned = NULL;
+} // pyplugin_queue_free
+
+/**
+ * Increment event queue counter.
+ * @param counter Counter in pyThread.stats
+ */
+static inline void pyplugin_stats_inc(uint64_t *counter) {
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+} // pyplugin_stats_inc
+
+/**
+ * Copy string to snapshot data.
+ * @param pos Position in data, moved after the copied string.
+ * @param str String, may be NULL.
+ * @return Copy of string in data, NULL if str is NULL.
+ */
+static const char *pyplugin_snapshot_copy(char **pos, const char *str) {
+	if (str == NULL) return NULL;
+
+	size_t length = strlen(str) + 1;
+	char *result = memcpy(*pos, str, length);
+	*pos += length;
+	return result;
+} // pyplugin_snapshot_copy
+
+/**
+ * Returns size of string including terminating zero, 0 for NULL.
+ * @param str String
+ */
+static inline size_t pyplugin_snapshot_size(const char *str) {
+	return (str != NULL) ? strlen(str) + 1 : 0;
+} // pyplugin_snapshot_size
+
+/**
+ * Take snapshot of event data. Users and channel are looked up in IRCLib
+ * storages, so this must be called from main loop.
+ * @param callbacks Callbacks the event is dispatched to
+ * @param build Function that builds callback arguments from snapshot
+ * @param channel Channel name or NULL
+ * @param nick Nick of user that caused the event or NULL
+ * @param target Nick of user the event is targeted to or NULL
+ * @param text Message, reason or new nick, or NULL
+ * @return New snapshot, which must be freed by free().
+ */
+pyplugin_snapshot pyplugin_snapshot_create(pyplugin_event *callbacks,
+	pyplugin_args_builder build, const char *channel, const char *nick,
+	const char *target, const char *text) {
+
+	IRCLib_Connection *irc = python_plugin_data->info->irc;
+
+	IRCLib_Channel s_channel = (channel != NULL) ?
+		irclib_find_channel(irc->channelStorage, (char *)channel) : NULL;
+	IRCLib_User s_user = (nick != NULL) ?
+		irclib_find_user(irc->userStorage, (char *)nick) : NULL;
+	IRCLib_User s_target = (target != NULL) ?
+		irclib_find_user(irc->userStorage, (char *)target) : NULL;
+
+	channel = (s_channel != NULL) ? s_channel->name : NULL;
+
+	size_t size = pyplugin_snapshot_size(channel) +
+		pyplugin_snapshot_size(nick) + pyplugin_snapshot_size(target) +
+		pyplugin_snapshot_size(text);
+	if (s_user != NULL) {
+		size += pyplugin_snapshot_size(s_user->host->user) +
+			pyplugin_snapshot_size(s_user->host->host);
+	}
+	if (s_target != NULL) {
+		size += pyplugin_snapshot_size(s_target->host->user) +
+			pyplugin_snapshot_size(s_target->host->host);
+	}
+
+	pyplugin_snapshot snapshot =
+		malloc(sizeof(struct s_pyplugin_snapshot) + size);
+	char *pos = snapshot->data;
+
+	snapshot->callbacks = callbacks;
+	snapshot->build = build;
+	snapshot->task = NULL;
+	snapshot->channel = pyplugin_snapshot_copy(&pos, channel);
+	snapshot->channelId = s_channel;
+	snapshot->text = pyplugin_snapshot_copy(&pos, text);
+	snapshot->invalidate = false;
+
+	snapshot->user.id = s_user;
+	snapshot->user.nick = pyplugin_snapshot_copy(&pos, nick);
+	snapshot->user.known = (s_user != NULL);
+	snapshot->user.user = (s_user != NULL) ?
+		pyplugin_snapshot_copy(&pos, s_user->host->user) : NULL;
+	snapshot->user.host = (s_user != NULL) ?
+		pyplugin_snapshot_copy(&pos, s_user->host->host) : NULL;
+
+	snapshot->target.id = s_target;
+	snapshot->target.nick = pyplugin_snapshot_copy(&pos, target);
+	snapshot->target.known = (s_target != NULL);
+	snapshot->target.user = (s_target != NULL) ?
+		pyplugin_snapshot_copy(&pos, s_target->host->user) : NULL;
+	snapshot->target.host = (s_target != NULL) ?
+		pyplugin_snapshot_copy(&pos, s_target->host->host) : NULL;
+
+	return snapshot;
+} // pyplugin_snapshot_create
+
+/**
+ * Wake up main loop to process actions. Called from Python thread.
+ */
+static void pyplugin_thread_wake_main() {
+	if (!__atomic_exchange_n(&pyThread.wakeRequested, true,
+		__ATOMIC_ACQ_REL)) {
+
+		char ch = 0;
+		if (write(pyThread.wakePipe[1], &ch, 1) < 0) {
+			// Pipe is full, main loop will wake up anyway.
+		}
+	}
+} // pyplugin_thread_wake_main
+
+/**
+ * Move coalesced events to queue while there is space in it.
+ */
+static void pyplugin_thread_flush_pending() {
+	size_t flushed = 0;
+	while (flushed < pyThread.pendingCount &&
+		pyplugin_queue_push(&pyThread.events, pyThread.pending[flushed],
+		false)) {
+
+		flushed++;
+		sem_post(&pyThread.eventsReady);
+	}
+
+	if (flushed > 0) {
+		memmove(pyThread.pending, pyThread.pending + flushed,
+			(pyThread.pendingCount - flushed) * sizeof(pyplugin_snapshot));
+		__atomic_store_n(&pyThread.pendingCount,
+			pyThread.pendingCount - flushed, __ATOMIC_RELEASE);
+	}
+} // pyplugin_thread_flush_pending
+
+/**
+ * Keep event until there is space in queue, replacing older event of the
+ * same kind.
+ * @param snapshot Event snapshot
+ */
+static void pyplugin_thread_coalesce(pyplugin_snapshot snapshot) {
+	for (size_t i = 0; i < pyThread.pendingCount; i++) {
+		if (pyThread.pending[i]->callbacks == snapshot->callbacks) {
+			free(pyThread.pending[i]);
+			pyThread.pending[i] = snapshot;
+			pyplugin_stats_inc(&pyThread.stats.coalesced);
+			return;
+		}
+	}
+
+	if (pyThread.pendingCount < PYPLUGIN_PENDING_SIZE) {
+		pyThread.pending[pyThread.pendingCount] = snapshot;
+		__atomic_store_n(&pyThread.pendingCount, pyThread.pendingCount + 1,
+			__ATOMIC_RELEASE);
+	} else {
+		free(snapshot);
+		pyplugin_stats_inc(&pyThread.stats.dropped);
+	}
+} // pyplugin_thread_coalesce
+
+/**
+ * Perform action in main loop
+ * @param action Action
+ */
+static void pyplugin_action_perform(pyplugin_action action) {
+	IRCLib_Connection *irc = python_plugin_data->info->irc;
+	const char *text = (action->text != NULL) ? action->text : "";
+
+	switch (action->type) {
+		case PYA_RAW:
+			irclib_sendraw(irc, "%s", text);
+			break;
+
+		case PYA_MESSAGE:
+			irclib_message(irc, (char *)action->target, "%s", text);
+			break;
+
+		case PYA_ACTION:
+			irclib_action(irc, (char *)action->target, "%s", text);
+			break;
+
+		case PYA_NOTICE:
+			irclib_notice(irc, (char *)action->target, "%s", text);
+			break;
+
+		case PYA_KICK:
+			irclib_kick(irc, (char *)action->target, (char *)action->extra,
+				"%s", text);
+			break;
+
+		case PYA_MODE:
+			irclib_mode(irc, "%s %s", action->target, text);
+			break;
+
+		case PYA_PART:
+			irclib_part(irc, (char *)action->target, "%s", text);
+			break;
+
+		case PYA_FIND_USER:
+			action->reply = pyplugin_snapshot_create(NULL, NULL, NULL,
+				action->target, NULL, NULL);
+			break;
+
+		case PYA_FIND_CHANNEL:
+			action->reply = pyplugin_snapshot_create(NULL, NULL,
+				action->target, NULL, NULL, NULL);
+			break;
+
+		case PYA_SLEEP:
+		case PYA_READABLE: {
+			const char *error = pyplugin_task_watch(action);
+			if (error != NULL) {
+				pyplugin_task_wake(action->task, error);
+			}
+			break;
+		}
+	}
+
+	pyplugin_stats_inc(&pyThread.stats.actions);
+} // pyplugin_action_perform
+
+/**
+ * Perform actions queued by Python thread. Called from main loop.
+ */
+static void pyplugin_thread_process_actions() {
+	__atomic_store_n(&pyThread.wakeRequested, false, __ATOMIC_RELEASE);
+
+	pyplugin_action action;
+	while ((action = pyplugin_queue_pop(&pyThread.actions)) != NULL) {
+		pyplugin_action_perform(action);
+
+		// Query is freed by thread that waits for it's reply.
+		if (action->done != NULL) {
+			sem_post(action->done);
+		} else {
+			free(action);
+		}
+	}
+
+	if (pyThread.pendingCount > 0) {
+		pyplugin_thread_flush_pending();
+	}
+} // pyplugin_thread_process_actions
+
+/**
+ * Socketpool callback, Python thread wants main loop to process actions.
+ * @param socket Read end of wake pipe
+ */
+static void pyplugin_thread_wake(Socket socket) {
+	char buffer[64];
+	while (read(socket->socketfd, buffer, sizeof(buffer)) > 0);
+
+	pyplugin_thread_process_actions();
+} // pyplugin_thread_wake
+
+/**
+ * Returns true if caller runs in Python thread.
+ */
+static bool pyplugin_thread_current() {
+	return pyThread.running && pthread_equal(pthread_self(), pyThread.thread);
+} // pyplugin_thread_current
+
+/**
+ * Returns true if snapshot isn't IRC event, but a message which must not
+ * be dropped.
+ * @param snapshot Snapshot
+ */
+static inline bool pyplugin_snapshot_control(pyplugin_snapshot snapshot) {
+	return snapshot->task != NULL || snapshot->invalidate;
+} // pyplugin_snapshot_control
+
+/**
+ * Insert snapshot to event queue, wait until Python thread makes space
+ * for it if it's full.
+ * @param snapshot Snapshot
+ */
+static void pyplugin_thread_push_wait(pyplugin_snapshot snapshot) {
+	// Python thread may wait for answer of query meanwhile.
+	while (!pyplugin_queue_push(&pyThread.events, snapshot,
+		pyplugin_snapshot_control(snapshot))) {
+
+		pyplugin_thread_process_actions();
+		usleep(PYPLUGIN_WAIT_USEC);
+	}
+} // pyplugin_thread_push_wait
+
+/**
+ * Remove oldest snapshot from event queue if it's IRC event. Control
+ * messages are never dropped nor moved, because they must stay in order
+ * with events.
+ * @return False if oldest snapshot is a control message.
+ */
+static bool pyplugin_thread_drop_oldest() {
+	pyplugin_queue *queue = &pyThread.events;
+	uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	while (true) {
+		uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+		if (head == tail) return true;
+
+		// Same as pyplugin_queue_pop, but the item is checked before it's
+		// removed. Python thread may free the item meanwhile, so only the
+		// flag is read, which is written by us.
+		if (__atomic_load_n(&queue->pinned[head & queue->mask],
+			__ATOMIC_RELAXED)) {
+
+			return false;
+		}
+
+		pyplugin_snapshot oldest = __atomic_load_n(
+			&queue->slots[head & queue->mask], __ATOMIC_RELAXED);
+
+		if (__atomic_compare_exchange_n(&queue->head, &head, head + 1,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+
+			free(oldest);
+			pyplugin_stats_inc(&pyThread.stats.dropped);
+			return true;
+		}
+	}
+} // pyplugin_thread_drop_oldest
+
+/**
+ * Insert control message to event queue, waiting for space if needed.
+ * Coalesced events waiting in pending[] were posted before, so they are
+ * queued first.
+ * @param snapshot Control snapshot
+ */
+static void pyplugin_thread_push_control(pyplugin_snapshot snapshot) {
+	while (pyThread.pendingCount > 0) {
+		pyplugin_thread_flush_pending();
+		if (pyThread.pendingCount > 0) {
+			pyplugin_thread_process_actions();
+			usleep(PYPLUGIN_WAIT_USEC);
+		}
+	}
+
+	pyplugin_thread_push_wait(snapshot);
+	sem_post(&pyThread.eventsReady);
+} // pyplugin_thread_push_control
+
+/**
+ * Pass event to Python thread. Does nothing if event has no callbacks.
+ * Arguments are the same as of pyplugin_snapshot_create.
+ */
+void pyplugin_event_post(pyplugin_event *callbacks,
+	pyplugin_args_builder build, const char *channel, const char *nick,
+	const char *target, const char *text) {
+
+	// Callbacks are hooked by Python thread, but we only need to know if
+	// the list is empty.
+	if (!pyThread.running ||
+		__atomic_load_n(&callbacks->first, __ATOMIC_ACQUIRE) == NULL) {
+
+		return;
+	}
+
+	pyplugin_snapshot snapshot = pyplugin_snapshot_create(callbacks, build,
+		channel, nick, target, text);
+
+	// Keep order of events, coalesced events go first.
+	if (pyThread.pendingCount > 0) {
+		pyplugin_thread_flush_pending();
+	}
+
+	if (pyThread.pendingCount > 0 ||
+		!pyplugin_queue_push(&pyThread.events, snapshot, false)) {
+
+		switch (pyThread.overflow) {
+			case PYO_DROP_OLDEST: {
+				// Task wake-ups and cache invalidations can't be dropped.
+				// When one of them is the oldest, wait for Python thread.
+				while (!pyplugin_queue_push(&pyThread.events, snapshot,
+					false)) {
+
+					if (!pyplugin_thread_drop_oldest()) {
+						pyplugin_thread_push_wait(snapshot);
+						pyplugin_stats_inc(&pyThread.stats.blocked);
+						break;
+					}
+				}
+				break;
+			}
+
+			case PYO_BLOCK: {
+				pyplugin_stats_inc(&pyThread.stats.blocked);
+
+				pyplugin_thread_push_wait(snapshot);
+				break;
+			}
+
+			case PYO_COALESCE:
+				pyplugin_thread_coalesce(snapshot);
+				return;
+		}
+	}
+
+	pyplugin_stats_inc(&pyThread.stats.pushed);
+
+	uint64_t depth = pyplugin_queue_depth(&pyThread.events);
+	if (depth > pyThread.stats.maxDepth) {
+		__atomic_store_n(&pyThread.stats.maxDepth, depth, __ATOMIC_RELAXED);
+	}
+
+	sem_post(&pyThread.eventsReady);
+} // pyplugin_event_post
+
+/**
+ * Create action structure.
+ * @param type Action type
+ * @param target Nick or channel, may be NULL
+ * @param extra Another parameter, may be NULL
+ * @param text Text, may be NULL
+ */
+static pyplugin_action pyplugin_action_create(pyplugin_action_type type,
+	const char *target, const char *extra, const char *text) {
+
+	pyplugin_action action = malloc(sizeof(struct s_pyplugin_action) +
+		pyplugin_snapshot_size(target) + pyplugin_snapshot_size(extra) +
+		pyplugin_snapshot_size(text));
+	char *pos = action->data;
+
+	action->type = type;
+	action->target = pyplugin_snapshot_copy(&pos, target);
+	action->extra = pyplugin_snapshot_copy(&pos, extra);
+	action->text = pyplugin_snapshot_copy(&pos, text);
+	action->reply = NULL;
+	action->done = NULL;
+	action->task = NULL;
+	action->value = 0;
+
+	return action;
+} // pyplugin_action_create
+
+/**
+ * Pass action to main loop. Called from Python thread with interpreter
+ * lock held, which is released while waiting for space in queue.
+ * @param action Action
+ */
+static void pyplugin_action_queue(pyplugin_action action) {
+	if (!pyplugin_queue_push(&pyThread.actions, action, false)) {
+		Py_BEGIN_ALLOW_THREADS
+		do {
+			pyplugin_thread_wake_main();
+			usleep(PYPLUGIN_WAIT_USEC);
+		} while (!pyplugin_queue_push(&pyThread.actions, action, false));
+		Py_END_ALLOW_THREADS
+	}
+
+	pyplugin_thread_wake_main();
+} // pyplugin_action_queue
+
+/**
+ * Perform IRC action on behalf of Python script. When called from Python
+ * thread, action is passed to main loop and performed there.
+ * @param type Action type
+ * @param target Nick or channel, may be NULL
+ * @param extra Another parameter, may be NULL
+ * @param text Text, may be NULL
+ */
+void pyplugin_action_post(pyplugin_action_type type,
+	const char *target, const char *extra, const char *text) {
+
+	pyplugin_action action = pyplugin_action_create(type, target, extra,
+		text);
+
+	if (pyplugin_thread_current()) {
+		pyplugin_action_queue(action);
+	} else {
+		// Scripts are loaded in main loop.
+		pyplugin_action_perform(action);
+		free(action);
+	}
+} // pyplugin_action_post
+
+/**
+ * Find user or channel in IRCLib storage. When called from Python thread,
+ * the query is answered by main loop and the caller waits for it. Must be
+ * called with interpreter lock held.
+ * @param type PYA_FIND_USER or PYA_FIND_CHANNEL
+ * @param name Nick or channel name
+ * @return Snapshot with found user or channel, must be freed by free().
+ */
+pyplugin_snapshot pyplugin_query(pyplugin_action_type type,
+	const char *name) {
+
+	pyplugin_action action = pyplugin_action_create(type, name, NULL, NULL);
+
+	if (pyplugin_thread_current()) {
+		sem_t done;
+		sem_init(&done, 0, 0);
+		action->done = &done;
+
+		pyplugin_action_queue(action);
+
+		Py_BEGIN_ALLOW_THREADS
+		while (sem_wait(&done) < 0 && errno == EINTR);
+		Py_END_ALLOW_THREADS
+
+		sem_destroy(&done);
+	} else {
+		pyplugin_action_perform(action);
+	}
+
+	pyplugin_snapshot reply = action->reply;
+	free(action);
+	return reply;
+} // pyplugin_query
+
+/**
+ * Make task wait for timer or file descriptor. When called from Python
+ * thread, the request is passed to main loop.
+ * @param type PYA_SLEEP or PYA_READABLE
+ * @param task Task
+ * @param value Seconds or file descriptor
+ * @return NULL, or error which must be thrown into the task. Errors are
+ *   returned only while script is loading, Python thread gets them as task
+ *   wake-up.
+ */
+const char *pyplugin_task_post(pyplugin_action_type type,
+	pyplugin_task task, long int value) {
+
+	pyplugin_action action = pyplugin_action_create(type, NULL, NULL, NULL);
+	action->task = task;
+	action->value = value;
+
+	if (pyplugin_thread_current()) {
+		pyplugin_action_queue(action);
+		return NULL;
+	}
+
+	// Task has been spawned while loading script. Python thread may not
+	// run yet, so error can't be passed as wake-up.
+	const char *error = pyplugin_task_watch(action);
+	free(action);
+	return error;
+} // pyplugin_task_post
+
+/**
+ * Pass task to Python thread to be resumed. Called from main loop, task
+ * wake-ups are never dropped, because the task would wait forever.
+ * @param task Task
+ * @param error Error thrown into task or NULL
+ */
+void pyplugin_task_wake(pyplugin_task task, const char *error) {
+	if (!pyThread.running) return;
+
+	pyplugin_snapshot snapshot = pyplugin_snapshot_create(NULL, NULL, NULL,
+		NULL, NULL, error);
+	snapshot->task = task;
+
+	pyplugin_thread_push_control(snapshot);
+} // pyplugin_task_wake
+
+/**
+ * Ask Python thread to remove user and channel from object cache. Called
+ * from main loop, requests are never dropped, because address of freed
+ * user or channel may be reused by another one.
+ * @param user IRCLib user or NULL
+ * @param channel IRCLib channel or NULL
+ */
+void pyplugin_cache_post(const void *user, const void *channel) {
+	if (!pyThread.running) return;
+
+	pyplugin_snapshot snapshot = calloc(1,
+		sizeof(struct s_pyplugin_snapshot));
+	snapshot->invalidate = true;
+	snapshot->user.id = user;
+	snapshot->channelId = channel;
+
+	pyplugin_thread_push_control(snapshot);
+} // pyplugin_cache_post
+
+/**
+ * Remove freed user or channel from object cache. Called from Python
+ * thread.
+ * @param snapshot Cache invalidation request
+ */
+static void pyplugin_thread_invalidate(pyplugin_snapshot snapshot) {
+	// Cache is shared by all interpreters, any of them will do.
+	if (python_plugin_data->first == NULL) return;
+	PyThreadState *tstate = python_plugin_data->first->workerState;
+
+	PyEval_AcquireThread(tstate);
+	pyplugin_cache_invalidate(snapshot->user.id, snapshot->channelId);
+	PyEval_ReleaseThread(tstate);
+} // pyplugin_thread_invalidate
+
+/**
+ * Python thread main function, dispatches events to scripts.
+ * @param arg Not used
+ */
+static void *pyplugin_thread_main(void *arg) {
+	// Each interpreter needs thread state for this thread.
+	PyEval_AcquireLock();
+	ll_loop(python_plugin_data, plugin) {
+		plugin->workerState = PyThreadState_New(plugin->tstate->interp);
+	}
+	PyEval_ReleaseLock();
+
+	while (true) {
+		while (sem_wait(&pyThread.eventsReady) < 0 && errno == EINTR);
+
+		pyplugin_snapshot snapshot;
+		while ((snapshot = pyplugin_queue_pop(&pyThread.events)) != NULL) {
+			if (snapshot->task != NULL) {
+				pyplugin_task_resume(snapshot->task, snapshot->text);
+			} else if (snapshot->invalidate) {
+				pyplugin_thread_invalidate(snapshot);
+			} else {
+				pyplugin_callback(snapshot->callbacks, snapshot->build,
+					snapshot);
+			}
+			free(snapshot);
+		}
+
+		// Main loop has coalesced events waiting for space.
+		if (__atomic_load_n(&pyThread.pendingCount, __ATOMIC_ACQUIRE) > 0) {
+			pyplugin_thread_wake_main();
+		}
+
+		if (__atomic_load_n(&pyThread.stopping, __ATOMIC_ACQUIRE) &&
+			pyplugin_queue_depth(&pyThread.events) == 0) {
+
+			break;
+		}
+	}
+
+	PyEval_AcquireLock();
+	ll_loop(python_plugin_data, script) {
+		PyThreadState_Swap(script->workerState);
+		PyThreadState_Clear(script->workerState);
+		PyThreadState_Swap(NULL);
+		PyThreadState_Delete(script->workerState);
+		script->workerState = NULL;
+	}
+	PyEval_ReleaseLock();
+
+	__atomic_store_n(&pyThread.finished, true, __ATOMIC_RELEASE);
+	return NULL;
+	(void)arg;
+} // pyplugin_thread_main
+
+/**
+ * Start Python thread. Scripts must be loaded before.
+ */
+void pyplugin_thread_start() {
+	CONF_SECTION *config = python_plugin_data->info->config;
+
+	long int size = config_getvalue_int(config, "python:queuesize",
+		PYPLUGIN_QUEUE_SIZE);
+	if (size <= 0) size = PYPLUGIN_QUEUE_SIZE;
+
+	char *overflow = config_getvalue_string(config, "python:overflow",
+		"dropoldest");
+	if (eq(overflow, "block")) {
+		pyThread.overflow = PYO_BLOCK;
+	} else if (eq(overflow, "coalesce")) {
+		pyThread.overflow = PYO_COALESCE;
+	} else {
+		if (!eq(overflow, "dropoldest")) {
+			printError(PLUGIN_NAME, "Unknown python:overflow policy %s, "
+				"using dropoldest.", overflow);
+		}
+		pyThread.overflow = PYO_DROP_OLDEST;
+	}
+
+	pyplugin_queue_init(&pyThread.events, size);
+	pyplugin_queue_init(&pyThread.actions, PYPLUGIN_ACTION_QUEUE_SIZE);
+	sem_init(&pyThread.eventsReady, 0, 0);
+
+	memset(&pyThread.stats, 0, sizeof(pyThread.stats));
+	pyThread.stats.size = pyThread.events.mask + 1;
+	pyThread.pendingCount = 0;
+	pyThread.stopping = false;
+	pyThread.finished = false;
+	pyThread.wakeRequested = false;
+
+	if (pipe(pyThread.wakePipe) < 0) {
+		printError(PLUGIN_NAME, "Unable to create pipe: %s",
+			strerror(errno));
+		return;
+	}
+	fcntl(pyThread.wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(pyThread.wakePipe[1], F_SETFL, O_NONBLOCK);
+
+	socketpool_add(python_plugin_data->info->socketpool, pyThread.wakePipe[0],
+		pyplugin_thread_wake, NULL, NULL, NULL);
+
+	// Running must be set before thread checks it.
+	pyThread.running = true;
+	if (pthread_create(&pyThread.thread, NULL, pyplugin_thread_main,
+		NULL) != 0) {
+
+		pyThread.running = false;
+		printError(PLUGIN_NAME, "Unable to start Python thread: %s",
+			strerror(errno));
+		return;
+	}
+
+	pyplugin_watchdog_start(pyThread.thread);
+} // pyplugin_thread_start
+
+/**
+ * Stop Python thread, events that are still queued are dispatched first.
+ */
+void pyplugin_thread_stop() {
+	pyplugin_watchdog_stop();
+
+	if (pyThread.running) {
+		__atomic_store_n(&pyThread.stopping, true, __ATOMIC_RELEASE);
+		sem_post(&pyThread.eventsReady);
+
+		// Python thread may wait for answer of query meanwhile.
+		while (!__atomic_load_n(&pyThread.finished, __ATOMIC_ACQUIRE)) {
+			pyplugin_thread_process_actions();
+			usleep(PYPLUGIN_WAIT_USEC);
+		}
+		pthread_join(pyThread.thread, NULL);
+		pyThread.running = false;
+
+		pyplugin_thread_process_actions();
+	}
+
+	for (size_t i = 0; i < pyThread.pendingCount; i++) {
+		free(pyThread.pending[i]);
+	}
+	pyThread.pendingCount = 0;
+
+	if (pyThread.wakePipe[0] >= 0) {
+		socketpool_close(python_plugin_data->info->socketpool,
+			pyThread.wakePipe[0]);
+		close(pyThread.wakePipe[1]);
+		pyThread.wakePipe[0] = -1;
+		pyThread.wakePipe[1] = -1;
+	}
+
+	if (pyThread.events.slots != NULL) {
+		pyplugin_queue_free(&pyThread.events);
+		pyplugin_queue_free(&pyThread.actions);
+		sem_destroy(&pyThread.eventsReady);
+	}
+} // pyplugin_thread_stop
+
+/**
+ * Get event queue metrics
+ * @param stats Structure to fill in
+ */
+void pyplugin_thread_stats(pyplugin_queue_metrics *stats) {
+	stats->size = pyThread.stats.size;
+	stats->depth = (pyThread.events.slots != NULL) ?
+		pyplugin_queue_depth(&pyThread.events) : 0;
+	stats->maxDepth = __atomic_load_n(&pyThread.stats.maxDepth,
+		__ATOMIC_RELAXED);
+	stats->pushed = __atomic_load_n(&pyThread.stats.pushed, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&pyThread.stats.dropped,
+		__ATOMIC_RELAXED);
+	stats->coalesced = __atomic_load_n(&pyThread.stats.coalesced,
+		__ATOMIC_RELAXED);
+	stats->blocked = __atomic_load_n(&pyThread.stats.blocked,
+		__ATOMIC_RELAXED);
+	stats->actions = __atomic_load_n(&pyThread.stats.actions,
+		__ATOMIC_RELAXED);
+} // pyplugin_thread_stats
@@ -0,0 +1,321 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2008  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * CPU accounting of scripts and watchdog. CPU time of Python thread is
+ * measured around each callback and added to the script which owns the
+ * callback. Watchdog thread checks CPU time of running callback, and when
+ * it exceeds python:callbackbudget (milliseconds, 0 disables watchdog),
+ * KeyboardInterrupt is raised in the callback. Only Python code can be
+ * interrupted, callback blocked in C function is left running.
+ */
+
+// Python
+#include <Python.h>
+#include "structmember.h"
+
+// Standard libraries
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+// Plugins API
+#include <pluginapi.h>
+
+// This plugin interface
+#include "interface.h"
+
+// Telnet interface
+#include "../telnet/interface.h"
+
+// My libraries
+#include <tokenizer.h>
+#include <toolbox/tb_string.h>
+#include <toolbox/linkedlist.h>
+
+/**
+ * Shortest and longest interval between watchdog checks (milliseconds)
+ */
+#define PYPLUGIN_WATCHDOG_MIN_INTERVAL 10
+#define PYPLUGIN_WATCHDOG_MAX_INTERVAL 1000
+
+/**
+ * Callback that is currently running and watchdog state
+ */
+static struct {
+	plugin_PyObject *plugin;	/**< Script that is running, NULL if none */
+	const char *event;			/**< Event the script handles */
+	uint64_t start;				/**< CPU time of Python thread when the
+									 callback has started */
+	uint64_t seq;				/**< Incremented for each callback */
+	int depth;					/**< Nesting level of callbacks */
+	bool interrupted;			/**< Watchdog has interrupted the callback */
+
+	uint64_t budget;			/**< Maximal CPU time of callback (ns), 0 if
+									 watchdog is disabled */
+	clockid_t clock;			/**< CPU clock of Python thread */
+	pthread_t thread;			/**< Watchdog thread */
+	bool running;				/**< Watchdog thread has been started */
+	sem_t stop;					/**< Posted when watchdog should end */
+} pyWatchdog = {
+	.plugin = NULL,
+	.running = false
+};
+
+/**
+ * Read clock in nanoseconds.
+ * @param clock Clock ID
+ */
+static uint64_t pyplugin_watchdog_clock(clockid_t clock) {
+	struct timespec ts;
+	if (clock_gettime(clock, &ts) < 0) return 0;
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} // pyplugin_watchdog_clock
+
+/**
+ * Start measuring CPU time of script callback. Called from Python thread
+ * with interpreter lock held. Nested calls (task spawned from callback)
+ * are counted as part of the outermost one.
+ * @param plugin Script which is being called
+ * @param event Event name
+ */
+void pyplugin_watchdog_enter(plugin_PyObject *plugin, const char *event) {
+	if (pyWatchdog.depth++ > 0) return;
+
+	pyWatchdog.event = event;
+	pyWatchdog.interrupted = false;
+	__atomic_store_n(&pyWatchdog.start,
+		pyplugin_watchdog_clock(CLOCK_THREAD_CPUTIME_ID), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&pyWatchdog.seq, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&pyWatchdog.plugin, plugin, __ATOMIC_RELEASE);
+} // pyplugin_watchdog_enter
+
+/**
+ * Stop measuring CPU time of script callback. Called from Python thread
+ * with interpreter lock held.
+ */
+void pyplugin_watchdog_leave() {
+	if (--pyWatchdog.depth > 0) return;
+
+	plugin_PyObject *plugin = pyWatchdog.plugin;
+	uint64_t elapsed = pyplugin_watchdog_clock(CLOCK_THREAD_CPUTIME_ID) -
+		pyWatchdog.start;
+
+	__atomic_add_fetch(&plugin->cpuTime, elapsed, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&plugin->calls, 1, __ATOMIC_RELAXED);
+
+	// Callback may have ended before the exception has been raised, don't
+	// let it hit the next one.
+	if (pyWatchdog.interrupted) {
+		PyThreadState_SetAsyncExc(plugin->workerState->thread_id, NULL);
+	}
+
+	__atomic_store_n(&pyWatchdog.plugin, NULL, __ATOMIC_RELEASE);
+} // pyplugin_watchdog_leave
+
+/**
+ * Interrupt callback if it still runs and has exceeded the budget.
+ * @param plugin Script that has been running
+ * @param seq Sequence number of the callback
+ */
+static void pyplugin_watchdog_interrupt(plugin_PyObject *plugin,
+	uint64_t seq) {
+
+	// Python thread can't change the running callback while we hold the
+	// interpreter lock.
+	PyEval_AcquireThread(plugin->watchdogState);
+
+	if (pyWatchdog.plugin == plugin && pyWatchdog.seq == seq &&
+		!pyWatchdog.interrupted) {
+
+		pyWatchdog.interrupted = true;
+		__atomic_add_fetch(&plugin->timeouts, 1, __ATOMIC_RELAXED);
+
+		printError(PLUGIN_NAME, "Script %s exceeded time budget of %lu ms "
+			"in %s callback, interrupting.", plugin->fileName,
+			(unsigned long)(pyWatchdog.budget / 1000000),
+			pyWatchdog.event);
+
+		PyThreadState_SetAsyncExc(plugin->workerState->thread_id,
+			PyExc_KeyboardInterrupt);
+	}
+
+	PyEval_ReleaseThread(plugin->watchdogState);
+} // pyplugin_watchdog_interrupt
+
+/**
+ * Watchdog thread main function
+ * @param arg Not used
+ */
+static void *pyplugin_watchdog_main(void *arg) {
+	// Thread state is needed to raise exception in each interpreter.
+	PyEval_AcquireLock();
+	ll_loop(python_plugin_data, plugin) {
+		plugin->watchdogState = PyThreadState_New(plugin->tstate->interp);
+	}
+	PyEval_ReleaseLock();
+
+	uint64_t interval = pyWatchdog.budget / 4;
+	if (interval < PYPLUGIN_WATCHDOG_MIN_INTERVAL * 1000000ULL) {
+		interval = PYPLUGIN_WATCHDOG_MIN_INTERVAL * 1000000ULL;
+	}
+	if (interval > PYPLUGIN_WATCHDOG_MAX_INTERVAL * 1000000ULL) {
+		interval = PYPLUGIN_WATCHDOG_MAX_INTERVAL * 1000000ULL;
+	}
+
+	while (true) {
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		uint64_t nsec = until.tv_nsec + interval;
+		until.tv_sec += nsec / 1000000000ULL;
+		until.tv_nsec = nsec % 1000000000ULL;
+
+		if (sem_timedwait(&pyWatchdog.stop, &until) == 0) break;
+		if (errno != ETIMEDOUT) continue;
+
+		plugin_PyObject *plugin = __atomic_load_n(&pyWatchdog.plugin,
+			__ATOMIC_ACQUIRE);
+		if (plugin == NULL) continue;
+
+		uint64_t seq = __atomic_load_n(&pyWatchdog.seq, __ATOMIC_RELAXED);
+		uint64_t start = __atomic_load_n(&pyWatchdog.start,
+			__ATOMIC_RELAXED);
+
+		if (pyplugin_watchdog_clock(pyWatchdog.clock) - start >
+			pyWatchdog.budget) {
+
+			pyplugin_watchdog_interrupt(plugin, seq);
+		}
+	}
+
+	PyEval_AcquireLock();
+	ll_loop(python_plugin_data, script) {
+		PyThreadState_Swap(script->watchdogState);
+		PyThreadState_Clear(script->watchdogState);
+		PyThreadState_Swap(NULL);
+		PyThreadState_Delete(script->watchdogState);
+		script->watchdogState = NULL;
+	}
+	PyEval_ReleaseLock();
+
+	return NULL;
+	(void)arg;
+} // pyplugin_watchdog_main
+
+/**
+ * Start watchdog thread, which interrupts callbacks running longer than
+ * python:callbackbudget.
+ * @param thread Python thread
+ */
+void pyplugin_watchdog_start(pthread_t thread) {
+	long int budget = config_getvalue_int(python_plugin_data->info->config,
+		"python:callbackbudget", 0);
+	if (budget <= 0) return;
+
+	pyWatchdog.budget = (uint64_t)budget * 1000000ULL;
+
+	if (pthread_getcpuclockid(thread, &pyWatchdog.clock) != 0) {
+		printError(PLUGIN_NAME, "Unable to get CPU clock of Python thread, "
+			"watchdog is disabled.");
+		return;
+	}
+
+	sem_init(&pyWatchdog.stop, 0, 0);
+	if (pthread_create(&pyWatchdog.thread, NULL, pyplugin_watchdog_main,
+		NULL) != 0) {
+
+		printError(PLUGIN_NAME, "Unable to start watchdog thread: %s",
+			strerror(errno));
+		sem_destroy(&pyWatchdog.stop);
+		return;
+	}
+	pyWatchdog.running = true;
+} // pyplugin_watchdog_start
+
+/**
+ * Stop watchdog thread.
+ */
+void pyplugin_watchdog_stop() {
+	if (!pyWatchdog.running) return;
+
+	sem_post(&pyWatchdog.stop);
+	pthread_join(pyWatchdog.thread, NULL);
+	sem_destroy(&pyWatchdog.stop);
+	pyWatchdog.running = false;
+} // pyplugin_watchdog_stop
+
+/**
+ * ontelnetcmd event handler, provides `python *` commands.
+ * @param event Event data
+ */
+void pyplugin_telnet_commands(EVENT *event) {
+	Telnet_Command *command = (Telnet_Command *)event->customData;
+	TelnetClient client = command->client;
+
+	if (!eq(command->command, "python")) return;
+
+	TOKENS tok = tokenizer_tokenize(command->params, ' ');
+	char *subcommand = tokenizer_gettok(tok, 0);
+
+	// python stats
+	// CPU time used by each script
+	if (eq(subcommand, "stats")) {
+		if (pyWatchdog.running) {
+			telnet_send(client, "Callback time budget: %lu ms",
+				(unsigned long)(pyWatchdog.budget / 1000000));
+		} else {
+			telnet_send(client, "Watchdog is disabled.");
+		}
+
+		telnet_send(client, "Scripts:");
+		ll_loop(python_plugin_data, plugin) {
+			uint64_t cpuTime = __atomic_load_n(&plugin->cpuTime,
+				__ATOMIC_RELAXED);
+			uint64_t calls = __atomic_load_n(&plugin->calls,
+				__ATOMIC_RELAXED);
+			uint64_t timeouts = __atomic_load_n(&plugin->timeouts,
+				__ATOMIC_RELAXED);
+
+			telnet_send(client, "- %s: %llu.%03llu s CPU, %llu callbacks, "
+				"%llu interrupted", plugin->fileName,
+				(unsigned long long)(cpuTime / 1000000000ULL),
+				(unsigned long long)(cpuTime / 1000000ULL % 1000),
+				(unsigned long long)calls, (unsigned long long)timeouts);
+		}
+
+		command->handled = true;
+	}
+
+	// python help
+	if (eq(subcommand, "help")) {
+		telnet_send(client, "python stats ......................... "
+			"CPU time used by Python scripts.");
+		command->handled = true;
+	}
+
+	if (eq(subcommand, "")) {
+		telnet_cd(client, "python");
+		command->handled = true;
+	}
+
+	tokenizer_free(tok);
+} // pyplugin_telnet_commands
@@ -5,77 +5,201 @@
 #define PLUG_NAME "Last seen"
 
 #include <pluginapi.h>
+#include <plugins.h>
 #include <toolbox/tb_string.h>
 #include <sqlite3.h>
 #include <time.h>
+#include <ctype.h>
+#include <strings.h>
+#include <dynastring.h>
 
 #include "../commands/interface.h"
 
+#define SEEN_BUCKETS 256
+
+// Nick record waiting in the write-behind cache for next flush.
+typedef struct sSeenRecord SeenRecord;
+struct sSeenRecord {
+	char *nick;
+	char *address;
+	char *channel;		// NULL = keep channel already stored in db
+	char *action;
+	char *reason;
+	time_t time;
+
+	SeenRecord *next;	// Next record in the same bucket
+};
+
 typedef struct {
 	sqlite3 *db;
 	sqlite3_stmt *stmtQuery;
-	sqlite3_stmt *stmtInsert;
-	sqlite3_stmt *stmtUpdate;
+	sqlite3_stmt *stmtUpsert;
+	sqlite3_stmt *stmtPrefix;
+	sqlite3_stmt *stmtInfix;
+	int maxMatches;
+
+	SeenRecord *dirty[SEEN_BUCKETS];
+	size_t dirtyCount;
+	size_t flushMax;
+	bool flushFailing;	// Last flush failed, only the timer retries it
+
+	Timer flushTimer;
 
 	EVENT_HANDLER *onjoin;
 	EVENT_HANDLER *onpart;
 	EVENT_HANDLER *onquit;
-	EVENT_HANDLER *oncommand;
+	EVENT_HANDLER *oncommandsready;
 } SeenCustomData;
 
-void updateLastSeen(SeenCustomData *plugData, IRCLib_Host *address, char *channel, char *action, char *reason) {
-	sqlite3_bind_text(plugData->stmtQuery, 1, address->nick, -1, SQLITE_TRANSIENT);
-
-	char *host = irclib_construct_addr(address);
+// Case insensitive hash of nick, to match the COLLATE NOCASE in db.
+static unsigned int seen_hash(const char *nick) {
+	unsigned int hash = 5381;
+	while (*nick != '\0') {
+		hash = hash * 33 + tolower((unsigned char)*nick++);
+	}
+	return hash % SEEN_BUCKETS;
+}
 
-	int result;
-	if ((result = sqlite3_step(plugData->stmtQuery)) == SQLITE_ROW) {
-		// Got row, update it.
-		sqlite3_bind_int(plugData->stmtUpdate, 7, sqlite3_column_int(plugData->stmtQuery, 0)); // ID
-		sqlite3_bind_text(plugData->stmtUpdate, 1, address->nick, -1, SQLITE_TRANSIENT);
+static void seen_record_free(SeenRecord *rec) {
+	free(rec->nick);
+	free(rec->address);
+	free(rec->channel);
+	free(rec->action);
+	free(rec->reason);
+	free(rec);
+}
 
-		sqlite3_bind_text(plugData->stmtUpdate, 2, host, -1, SQLITE_TRANSIENT);
+SeenRecord *seen_cache_find(SeenCustomData *plugData, const char *nick) {
+	SeenRecord *rec = plugData->dirty[seen_hash(nick)];
+	while (rec != NULL) {
+		if (strcasecmp(rec->nick, nick) == 0) {
+			return rec;
+		}
+		rec = rec->next;
+	}
+	return NULL;
+}
 
-		if (channel != NULL) {
-			sqlite3_bind_text(plugData->stmtUpdate, 3, channel, -1, SQLITE_TRANSIENT);
-		} else {
-			// Bind last channel
-			sqlite3_bind_text(plugData->stmtUpdate, 3, (const char *)sqlite3_column_text(plugData->stmtQuery, 3), -1, SQLITE_TRANSIENT);
+// Free all records in the write-behind cache.
+static void seen_cache_clear(SeenCustomData *plugData) {
+	for (size_t i = 0; i < SEEN_BUCKETS; i++) {
+		SeenRecord *rec = plugData->dirty[i];
+		while (rec != NULL) {
+			SeenRecord *next = rec->next;
+			seen_record_free(rec);
+			rec = next;
 		}
+		plugData->dirty[i] = NULL;
+	}
+	plugData->dirtyCount = 0;
+}
 
-		sqlite3_bind_text(plugData->stmtUpdate, 4, action, -1, SQLITE_TRANSIENT);
-		sqlite3_bind_int64(plugData->stmtUpdate, 5, time(NULL));
-		sqlite3_bind_text(plugData->stmtUpdate, 6, reason, -1, SQLITE_TRANSIENT);
+// Write all dirty records to db in one transaction and empty the cache.
+// When the transaction fails, records stay cached and only the flush timer
+// retries, so errors are logged once until a flush succeeds.
+void seen_flush(SeenCustomData *plugData) {
+	if (plugData->dirtyCount == 0) return;
 
-		if (sqlite3_step(plugData->stmtUpdate) != SQLITE_DONE) {
+	bool ok = true;
+	if (sqlite3_exec(plugData->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+		if (!plugData->flushFailing) {
 			printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
 		}
-		sqlite3_reset(plugData->stmtUpdate);
-	} else if (result == SQLITE_DONE) {
-		// No row, insert new entry.
-		sqlite3_bind_text(plugData->stmtInsert, 1, address->nick, -1, SQLITE_TRANSIENT);
-		sqlite3_bind_text(plugData->stmtInsert, 2, host, -1, SQLITE_TRANSIENT);
-
-		if (channel != NULL) {
-			sqlite3_bind_text(plugData->stmtInsert, 3, channel, -1, SQLITE_TRANSIENT);
-		} else {
-			sqlite3_bind_null(plugData->stmtInsert, 3);
-		}
+		ok = false;
+	}
 
-		sqlite3_bind_text(plugData->stmtInsert, 4, action, -1, SQLITE_TRANSIENT);
-		sqlite3_bind_int64(plugData->stmtInsert, 5, time(NULL));
-		sqlite3_bind_text(plugData->stmtInsert, 6, reason, -1, SQLITE_TRANSIENT);
+	for (size_t i = 0; i < SEEN_BUCKETS && ok; i++) {
+		for (SeenRecord *rec = plugData->dirty[i]; rec != NULL && ok; rec = rec->next) {
+			sqlite3_bind_text(plugData->stmtUpsert, 1, rec->nick, -1, SQLITE_STATIC);
+			sqlite3_bind_text(plugData->stmtUpsert, 2, rec->address, -1, SQLITE_STATIC);
+			if (rec->channel != NULL) {
+				sqlite3_bind_text(plugData->stmtUpsert, 3, rec->channel, -1, SQLITE_STATIC);
+			} else {
+				sqlite3_bind_null(plugData->stmtUpsert, 3);
+			}
+			sqlite3_bind_text(plugData->stmtUpsert, 4, rec->action, -1, SQLITE_STATIC);
+			sqlite3_bind_int64(plugData->stmtUpsert, 5, rec->time);
+			sqlite3_bind_text(plugData->stmtUpsert, 6, rec->reason, -1, SQLITE_STATIC);
 
-		if (sqlite3_step(plugData->stmtInsert) != SQLITE_DONE) {
+			if (sqlite3_step(plugData->stmtUpsert) != SQLITE_DONE) {
+				if (!plugData->flushFailing) {
+					printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
+				}
+				ok = false;
+			}
+			sqlite3_reset(plugData->stmtUpsert);
+			sqlite3_clear_bindings(plugData->stmtUpsert);
+		}
+	}
+
+	if (ok && sqlite3_exec(plugData->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+		if (!plugData->flushFailing) {
 			printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
 		}
-		sqlite3_reset(plugData->stmtInsert);
-	} else {
-		printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
+		ok = false;
 	}
 
-	sqlite3_reset(plugData->stmtQuery);
-	free(host);
+	if (!ok) {
+		sqlite3_exec(plugData->db, "ROLLBACK", NULL, NULL, NULL);
+		if (!plugData->flushFailing) {
+			printError(PLUG_NAME, "Keeping %zu seen records, flush will be retried by timer.", plugData->dirtyCount);
+			plugData->flushFailing = true;
+		}
+		return;
+	}
+
+	if (plugData->flushFailing) {
+		printError(PLUG_NAME, "Seen records have been flushed again.");
+		plugData->flushFailing = false;
+	}
+
+	seen_cache_clear(plugData);
+}
+
+bool seen_flush_timer(Timer timer) {
+	seen_flush((SeenCustomData *)timer->customData);
+	return true;
+}
+
+void updateLastSeen(SeenCustomData *plugData, IRCLib_Host *address, char *channel, char *action, char *reason) {
+	SeenRecord *rec = seen_cache_find(plugData, address->nick);
+	if (rec == NULL) {
+		unsigned int bucket = seen_hash(address->nick);
+
+		rec = malloc(sizeof(SeenRecord));
+		rec->nick = NULL;
+		rec->address = NULL;
+		rec->channel = NULL;
+		rec->action = NULL;
+		rec->reason = NULL;
+		rec->next = plugData->dirty[bucket];
+		plugData->dirty[bucket] = rec;
+		plugData->dirtyCount++;
+	}
+
+	free(rec->nick);
+	rec->nick = strdup(address->nick);
+
+	free(rec->address);
+	rec->address = irclib_construct_addr(address);
+
+	// Without channel, keep the last known one.
+	if (channel != NULL) {
+		free(rec->channel);
+		rec->channel = strdup(channel);
+	}
+
+	free(rec->action);
+	rec->action = strdup(action);
+
+	free(rec->reason);
+	rec->reason = strdup((reason != NULL)?reason:"");
+
+	rec->time = time(NULL);
+
+	if (plugData->dirtyCount >= plugData->flushMax && !plugData->flushFailing) {
+		seen_flush(plugData);
+	}
 }
 
 // User joined
@@ -133,109 +257,272 @@ void seen_quit(EVENT *event) {
 	}
 }
 
-void seen_command(EVENT *event) {
-	SeenCustomData *plugData = (SeenCustomData *)event->handlerData;
-	Commands_Event *cmd = (Commands_Event *)event->customData;
-	IRCEvent_Message *message = cmd->replyData;
+void seen_reply(IRCEvent_Message *message, const char *nick, const char *channel, const char *action, const char *reason, time_t tajm) {
+	if (channel == NULL) channel = "?";
+
+	if (eq(action, "is on")) {
+		// This should not happen...
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: %s should be on %s right now, but I cannot see him there.",
+			message->address->nick,
+			nick,
+			channel
+		);
+	} else if (eq(action, "quit") || eq(action, "part")) {
+		struct tm *event_tm = localtime(&tajm);
+
+		char *msg;
+		if (eq(action, "quit")) {
+			msg = "quiting from";
+		} else {
+			msg = "parting";
+		}
+
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: %s was last seen %s %s stating \"%s\", %d.%d.%d %d:%02d:%02d.",
+			message->address->nick,
+			nick,
+			msg,
+			channel,
+			reason,
+			event_tm->tm_mday,
+			event_tm->tm_mon + 1,
+			event_tm->tm_year + 1900,
+			event_tm->tm_hour,
+			event_tm->tm_min,
+			event_tm->tm_sec
+		);
+	} else {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: I remember %s, but don't have an idea how he'd left (aka this should not happen).",
+			message->address->nick,
+			nick
+		);
+	}
+}
 
-	if (eq(cmd->command, "seen")) {
-		if (cmd->source != CMD_CHANNEL) return;
+// Convert user's wildcard into case folded GLOB pattern and return the
+// literal prefix before first wildcard in prefix (both must be freed).
+static char *seen_glob_pattern(const char *wildcard, char **prefix) {
+	// Worst case each char is [ which is escaped as [[]
+	char *glob = malloc(strlen(wildcard) * 3 + 1);
+	char *out = glob;
+
+	*prefix = NULL;
+	for (const char *c = wildcard; *c != '\0'; c++) {
+		if ((*c == '*' || *c == '?') && *prefix == NULL) {
+			*prefix = strndup(wildcard, c - wildcard);
+			strtolower(*prefix);
+		}
 
-		char *nick = cmd->params;
-		char *space = strstr(nick, " ");
-		if (space != NULL) *space = '\0';
+		if (*c == '[') {
+			*out++ = '[';
+			*out++ = '[';
+			*out++ = ']';
+		} else {
+			*out++ = tolower((unsigned char)*c);
+		}
+	}
+	*out = '\0';
 
-		// User asks for himself :)
-		if (eq(nick, message->address->nick)) {
-			irclib_message(
-				message->sender,
-				message->channel,
-				"%s: Yep, I can see you.",
-				message->address->nick
+	if (*prefix == NULL) {
+		*prefix = strdup("");
+	}
+
+	return glob;
+}
+
+// Smallest string greater than all strings starting with prefix, or NULL
+// when there is none (prefix consists of 0xFF bytes only). Trailing 0xFF
+// bytes can't be incremented, so the carry goes into the byte before them.
+static char *seen_prefix_upper(const char *prefix) {
+	char *upper = strdup(prefix);
+	size_t len = strlen(upper);
+
+	while (len > 0 && (unsigned char)upper[len - 1] == 0xFF) {
+		len--;
+	}
+	if (len == 0) {
+		free(upper);
+		return NULL;
+	}
+
+	upper[len - 1]++;
+	upper[len] = '\0';
+	return upper;
+}
+
+// List most recently seen nicks matching wildcard (nick*, *bot, ...)
+void seen_search(SeenCustomData *plugData, IRCEvent_Message *message, char *wildcard) {
+	// Pending records must be searchable as well, unless db is failing.
+	if (!plugData->flushFailing) {
+		seen_flush(plugData);
+	}
+
+	char *prefix;
+	char *glob = seen_glob_pattern(wildcard, &prefix);
+
+	sqlite3_stmt *stmt;
+	if (*prefix != '\0') {
+		// Prefix is range scan on nick_fold index: prefix <= nick < prefix+1
+		stmt = plugData->stmtPrefix;
+		sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_TRANSIENT);
+
+		char *upper = seen_prefix_upper(prefix);
+		if (upper != NULL) {
+			sqlite3_bind_text(stmt, 2, upper, -1, SQLITE_TRANSIENT);
+			free(upper);
+		} else {
+			sqlite3_bind_null(stmt, 2);
+		}
+	} else {
+		// Infix pattern is looked up using trigram index
+		stmt = plugData->stmtInfix;
+	}
+	sqlite3_bind_text(stmt, 3, glob, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int(stmt, 4, plugData->maxMatches);
+
+	string reply = dynastring_init();
+	int result;
+	while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char *nick = (const char *)sqlite3_column_text(stmt, 0);
+		const char *channel = (const char *)sqlite3_column_text(stmt, 1);
+		const char *action = (const char *)sqlite3_column_text(stmt, 2);
+		time_t tajm = sqlite3_column_int64(stmt, 3);
+
+		char *item;
+		if (eq(action, "is on")) {
+			asprintf(&item, "%s (on %s)", nick, (channel != NULL)?channel:"?");
+		} else {
+			struct tm *event_tm = localtime(&tajm);
+			asprintf(&item, "%s (%s %d.%d.%d %d:%02d)", nick, action,
+				event_tm->tm_mday,
+				event_tm->tm_mon + 1,
+				event_tm->tm_year + 1900,
+				event_tm->tm_hour,
+				event_tm->tm_min
 			);
-			return;
 		}
 
-		// Try to find user in active users.
-		IRCLib_User user = irclib_find_user(message->sender->userStorage, nick);
-		if (user != NULL && user->first != NULL) {
-			// User is online somewhere...
-			IRCLib_UserChannel chan = user->first;
+		if (dynastring_getlength(reply) > 0) {
+			dynastring_appendstring(reply, ", ");
+		}
+		dynastring_appendstring(reply, item);
+		free(item);
+	}
+
+	if (result != SQLITE_DONE) {
+		printError(PLUG_NAME, "SQLite: %s", sqlite3_errmsg(plugData->db));
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	if (dynastring_getlength(reply) > 0) {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: Recently seen: %s.",
+			message->address->nick,
+			dynastring_getstring(reply)
+		);
+	} else {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: I cannot remember seeing anyone like %s.",
+			message->address->nick,
+			wildcard
+		);
+	}
+
+	dynastring_free(reply);
+	free(glob);
+	free(prefix);
+}
+
+void seen_command(Commands_Event *cmd, void *customData) {
+	SeenCustomData *plugData = (SeenCustomData *)customData;
+	IRCEvent_Message *message = cmd->replyData;
+
+	if (cmd->source != CMD_CHANNEL) return;
+
+	char *nick = cmd->params;
+	char *space = strstr(nick, " ");
+	if (space != NULL) *space = '\0';
+
+	// User asks for himself :)
+	if (eq(nick, message->address->nick)) {
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: Yep, I can see you.",
+			message->address->nick
+		);
+		return;
+	}
+
+	if (strpbrk(nick, "*?") != NULL) {
+		seen_search(plugData, message, nick);
+		return;
+	}
+
+	// Try to find user in active users.
+	IRCLib_User user = irclib_find_user(message->sender->userStorage, nick);
+	if (user != NULL && user->first != NULL) {
+		// User is online somewhere...
+		IRCLib_UserChannel chan = user->first;
+		irclib_message(
+			message->sender,
+			message->channel,
+			"%s: %s is on %s right now.",
+			message->address->nick,
+			nick,
+			chan->channel->name
+		);
+
+	// User is not known on any channel. Pending records in the cache
+	// are newer than db, so look there first.
+	} else {
+		SeenRecord *rec = seen_cache_find(plugData, nick);
+		sqlite3_bind_text(plugData->stmtQuery, 1, nick, -1, SQLITE_TRANSIENT);
+		if (rec != NULL) {
+			const char *channel = rec->channel;
+			if (channel == NULL && sqlite3_step(plugData->stmtQuery) == SQLITE_ROW) {
+				channel = (const char *)sqlite3_column_text(plugData->stmtQuery, 3);
+			}
+			seen_reply(message, nick, channel, rec->action, rec->reason, rec->time);
+		} else if (sqlite3_step(plugData->stmtQuery) == SQLITE_ROW) {
+			seen_reply(
+				message,
+				nick,
+				(const char *)sqlite3_column_text(plugData->stmtQuery, 3),
+				(const char *)sqlite3_column_text(plugData->stmtQuery, 4),
+				(const char *)sqlite3_column_text(plugData->stmtQuery, 6),
+				sqlite3_column_int64(plugData->stmtQuery, 5)
+			);
+		} else {
 			irclib_message(
 				message->sender,
 				message->channel,
-				"%s: %s is on %s right now.",
+				"%s: I cannot remember seeing %s.",
 				message->address->nick,
-				nick,
-				chan->channel->name
+				nick
 			);
-
-		// User is not known on any channel. So query db.
-		} else {
-			sqlite3_bind_text(plugData->stmtQuery, 1, nick, -1, SQLITE_TRANSIENT);
-			if (sqlite3_step(plugData->stmtQuery) == SQLITE_ROW) {
-				const char *reason = (const char *)sqlite3_column_text(plugData->stmtQuery, 4);
-				if (eq(reason, "is on")) {
-					// This should not happen...
-					irclib_message(
-						message->sender,
-						message->channel,
-						"%s: %s should be on %s right now, but I cannot see him there.",
-						message->address->nick,
-						nick,
-						sqlite3_column_text(plugData->stmtQuery, 3)
-					);
-				} else if (eq(reason, "quit") || eq(reason, "part")) {
-					time_t tajm = sqlite3_column_int64(plugData->stmtQuery, 5);
-					struct tm *event_tm = localtime(&tajm);
-
-					char *msg;
-					if (eq(reason, "quit")) {
-						msg = "quiting from";
-					} else {
-						msg = "parting";
-					}
-
-					irclib_message(
-						message->sender,
-						message->channel,
-						"%s: %s was last seen %s %s stating \"%s\", %d.%d.%d %d:%02d:%02d.",
-						message->address->nick,
-						nick,
-						msg,
-						sqlite3_column_text(plugData->stmtQuery, 3),
-						sqlite3_column_text(plugData->stmtQuery, 6),
-						event_tm->tm_mday,
-						event_tm->tm_mon + 1,
-						event_tm->tm_year + 1900,
-						event_tm->tm_hour,
-						event_tm->tm_min,
-						event_tm->tm_sec
-
-					);
-				} else {
-					irclib_message(
-						message->sender,
-						message->channel,
-						"%s: I remember %s, but don't have an idea how he'd left (aka this should not happen).",
-						message->address->nick,
-						nick
-					);
-				}
-			} else {
-				irclib_message(
-					message->sender,
-					message->channel,
-					"%s: I cannot remember seeing %s.",
-					message->address->nick,
-					nick
-				);
-			}
-			sqlite3_reset(plugData->stmtQuery);
 		}
+		sqlite3_reset(plugData->stmtQuery);
 	}
 }
 
+void seen_commandsready(EVENT *event) {
+	commands_register("seen", seen_command, event->handlerData);
+}
+
 void PluginInit(PluginInfo *info) {
 	info->name = PLUG_NAME;
 	info->author = "Niximor";
@@ -249,27 +536,107 @@ void PluginInit(PluginInfo *info) {
 			printError(PLUG_NAME, "Cannot create table seen: %s", sqlite3_errmsg(plugData->db));
 		};
 
-		if (sqlite3_exec(plugData->db, "CREATE INDEX IF NOT EXISTS \"seen_nick_idx\" ON \"seen\" (\"nick\")", NULL, NULL, NULL) != SQLITE_OK) {
+		// WAL keeps readers and the periodic flush from blocking each other
+		// and needs only one fsync per checkpoint with synchronous=NORMAL.
+		if (sqlite3_exec(plugData->db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL", NULL, NULL, NULL) != SQLITE_OK) {
+			printError(PLUG_NAME, "Cannot switch seen db to WAL: %s", sqlite3_errmsg(plugData->db));
+		}
+
+		// Plain nick index can't be used for NOCASE compare, the unique one
+		// below replaces it.
+		sqlite3_exec(plugData->db, "DROP INDEX IF EXISTS \"seen_nick_idx\"", NULL, NULL, NULL);
+
+		// Case folded nick for wildcard searches. Column name must not be
+		// quoted here, unknown "nick_fold" would be taken as string literal.
+		sqlite3_stmt *stmtTest;
+		if (sqlite3_prepare_v2(plugData->db, "SELECT nick_fold FROM \"seen\" LIMIT 0", -1, &stmtTest, NULL) != SQLITE_OK) {
+			if (sqlite3_exec(plugData->db, "ALTER TABLE \"seen\" ADD COLUMN \"nick_fold\" TEXT; UPDATE \"seen\" SET \"nick_fold\" = lower(\"nick\")", NULL, NULL, NULL) != SQLITE_OK) {
+				printError(PLUG_NAME, "Cannot add nick_fold to seen: %s", sqlite3_errmsg(plugData->db));
+			}
+		}
+		sqlite3_finalize(stmtTest);
+
+		if (sqlite3_exec(plugData->db, "CREATE INDEX IF NOT EXISTS \"seen_nick_fold_idx\" ON \"seen\" (\"nick_fold\")", NULL, NULL, NULL) != SQLITE_OK) {
 			printError(PLUG_NAME, "Cannot create index on seen: %s", sqlite3_errmsg(plugData->db));
 		}
 
-		if (sqlite3_prepare(plugData->db, "SELECT \"id\", \"nick\", \"address\", \"channel\", \"action\", \"time\", \"reason\" FROM \"seen\" WHERE \"nick\" = ? COLLATE NOCASE", -1, &plugData->stmtQuery, NULL) != SQLITE_OK) {
+		// UPSERT needs unique nick. Old databases could contain nicks differing
+		// only in case, keep the most recent record of them.
+		if (sqlite3_exec(plugData->db, "CREATE UNIQUE INDEX IF NOT EXISTS \"seen_nick_nocase_idx\" ON \"seen\" (\"nick\" COLLATE NOCASE)", NULL, NULL, NULL) != SQLITE_OK) {
+			sqlite3_exec(plugData->db, "DELETE FROM \"seen\" WHERE EXISTS (SELECT 1 FROM \"seen\" AS \"s2\" WHERE \"s2\".\"nick\" = \"seen\".\"nick\" COLLATE NOCASE AND (\"s2\".\"time\" > \"seen\".\"time\" OR (\"s2\".\"time\" = \"seen\".\"time\" AND \"s2\".\"id\" > \"seen\".\"id\")))", NULL, NULL, NULL);
+
+			if (sqlite3_exec(plugData->db, "CREATE UNIQUE INDEX IF NOT EXISTS \"seen_nick_nocase_idx\" ON \"seen\" (\"nick\" COLLATE NOCASE)", NULL, NULL, NULL) != SQLITE_OK) {
+				printError(PLUG_NAME, "Cannot create index on seen: %s", sqlite3_errmsg(plugData->db));
+			}
+		}
+
+		// Trigram index over folded nicks for *infix* patterns, kept in sync
+		// with seen table by triggers.
+		bool trigram = true;
+		if (sqlite3_prepare_v2(plugData->db, "SELECT 1 FROM \"seen_trigram\" LIMIT 0", -1, &stmtTest, NULL) != SQLITE_OK) {
+			if (sqlite3_exec(plugData->db, "CREATE VIRTUAL TABLE \"seen_trigram\" USING fts5(\"nick_fold\", content='seen', content_rowid='id', tokenize='trigram'); INSERT INTO \"seen_trigram\" (\"seen_trigram\") VALUES ('rebuild')", NULL, NULL, NULL) != SQLITE_OK) {
+				printError(PLUG_NAME, "Trigram index not available, infix searches will scan: %s", sqlite3_errmsg(plugData->db));
+				trigram = false;
+			}
+		}
+		sqlite3_finalize(stmtTest);
+
+		if (trigram && sqlite3_exec(plugData->db,
+				"CREATE TRIGGER IF NOT EXISTS \"seen_trigram_ai\" AFTER INSERT ON \"seen\" BEGIN "
+					"INSERT INTO \"seen_trigram\" (\"rowid\", \"nick_fold\") VALUES (\"new\".\"id\", \"new\".\"nick_fold\"); "
+				"END; "
+				"CREATE TRIGGER IF NOT EXISTS \"seen_trigram_ad\" AFTER DELETE ON \"seen\" BEGIN "
+					"INSERT INTO \"seen_trigram\" (\"seen_trigram\", \"rowid\", \"nick_fold\") VALUES ('delete', \"old\".\"id\", \"old\".\"nick_fold\"); "
+				"END; "
+				"CREATE TRIGGER IF NOT EXISTS \"seen_trigram_au\" AFTER UPDATE OF \"nick_fold\" ON \"seen\" WHEN \"old\".\"nick_fold\" IS NOT \"new\".\"nick_fold\" BEGIN "
+					"INSERT INTO \"seen_trigram\" (\"seen_trigram\", \"rowid\", \"nick_fold\") VALUES ('delete', \"old\".\"id\", \"old\".\"nick_fold\"); "
+					"INSERT INTO \"seen_trigram\" (\"rowid\", \"nick_fold\") VALUES (\"new\".\"id\", \"new\".\"nick_fold\"); "
+				"END",
+				NULL, NULL, NULL) != SQLITE_OK) {
+			printError(PLUG_NAME, "Cannot create trigram triggers: %s", sqlite3_errmsg(plugData->db));
+		}
+
+		if (sqlite3_prepare_v2(plugData->db, "SELECT \"nick\", \"channel\", \"action\", \"time\" FROM \"seen\" WHERE \"nick_fold\" >= ?1 AND (?2 IS NULL OR \"nick_fold\" < ?2) AND \"nick_fold\" GLOB ?3 ORDER BY \"time\" DESC LIMIT ?4", -1, &plugData->stmtPrefix, NULL) != SQLITE_OK) {
 			printError(PLUG_NAME, "Query exception: %s", sqlite3_errmsg(plugData->db));
 		}
 
-		if (sqlite3_prepare(plugData->db, "INSERT INTO \"seen\" (\"nick\", \"address\", \"channel\", \"action\", \"time\", \"reason\") VALUES (?, ?, ?, ?, ?, ?)", -1, &plugData->stmtInsert, NULL) != SQLITE_OK) {
+		if (trigram) {
+			if (sqlite3_prepare_v2(plugData->db, "SELECT \"seen\".\"nick\", \"seen\".\"channel\", \"seen\".\"action\", \"seen\".\"time\" FROM \"seen_trigram\" JOIN \"seen\" ON \"seen\".\"id\" = \"seen_trigram\".\"rowid\" WHERE \"seen_trigram\".\"nick_fold\" GLOB ?3 ORDER BY \"seen\".\"time\" DESC LIMIT ?4", -1, &plugData->stmtInfix, NULL) != SQLITE_OK) {
+				printError(PLUG_NAME, "Query exception: %s", sqlite3_errmsg(plugData->db));
+			}
+		} else {
+			if (sqlite3_prepare_v2(plugData->db, "SELECT \"nick\", \"channel\", \"action\", \"time\" FROM \"seen\" WHERE \"nick_fold\" GLOB ?3 ORDER BY \"time\" DESC LIMIT ?4", -1, &plugData->stmtInfix, NULL) != SQLITE_OK) {
+				printError(PLUG_NAME, "Query exception: %s", sqlite3_errmsg(plugData->db));
+			}
+		}
+
+		plugData->maxMatches = config_getvalue_int(info->config, "seen:maxmatches", 5);
+
+		if (sqlite3_prepare(plugData->db, "SELECT \"id\", \"nick\", \"address\", \"channel\", \"action\", \"time\", \"reason\" FROM \"seen\" WHERE \"nick\" = ? COLLATE NOCASE", -1, &plugData->stmtQuery, NULL) != SQLITE_OK) {
 			printError(PLUG_NAME, "Query exception: %s", sqlite3_errmsg(plugData->db));
 		}
 
-		if (sqlite3_prepare(plugData->db, "UPDATE \"seen\" SET \"nick\" = ?, \"address\" = ?, \"channel\" = ?, \"action\" = ?, \"time\" = ?, \"reason\" = ? WHERE \"id\" = ?", -1, &plugData->stmtUpdate, NULL) != SQLITE_OK) {
+		if (sqlite3_prepare(plugData->db, "INSERT INTO \"seen\" (\"nick\", \"nick_fold\", \"address\", \"channel\", \"action\", \"time\", \"reason\") VALUES (?1, lower(?1), ?2, ?3, ?4, ?5, ?6) ON CONFLICT (\"nick\" COLLATE NOCASE) DO UPDATE SET \"nick\" = \"excluded\".\"nick\", \"address\" = \"excluded\".\"address\", \"channel\" = COALESCE(\"excluded\".\"channel\", \"seen\".\"channel\"), \"action\" = \"excluded\".\"action\", \"time\" = \"excluded\".\"time\", \"reason\" = \"excluded\".\"reason\"", -1, &plugData->stmtUpsert, NULL) != SQLITE_OK) {
 			printError(PLUG_NAME, "Query exception: %s", sqlite3_errmsg(plugData->db));
 		}
 
+		// Write-behind cache
+		for (size_t i = 0; i < SEEN_BUCKETS; i++) {
+			plugData->dirty[i] = NULL;
+		}
+		plugData->dirtyCount = 0;
+		plugData->flushFailing = false;
+		plugData->flushMax = config_getvalue_int(info->config, "seen:flushmax", 1000);
+		plugData->flushTimer = timers_add(TM_TIMEOUT, config_getvalue_int(info->config, "seen:flushinterval", 10), seen_flush_timer, plugData);
+
 		// Bind events
 		plugData->onjoin = events_addEventListener(info->events, "onjoin", seen_join, plugData);
 		plugData->onpart = events_addEventListener(info->events, "onpart", seen_part, plugData);
 		plugData->onquit = events_addEventListener(info->events, "onquited", seen_quit, plugData);
-		plugData->oncommand = events_addEventListener(info->events, "oncommand", seen_command, plugData);
+		plugData->oncommandsready = events_addEventListener(info->events, "oncommandsready", seen_commandsready, plugData);
+		if (plugins_getinfo("commands") != NULL) {
+			commands_register("seen", seen_command, plugData);
+		}
 		
 		info->customData = plugData;
 	} else {
@@ -278,19 +645,30 @@ void PluginInit(PluginInfo *info) {
 	}
 }
 
+void PluginBeforeUnload(PluginInfo *info) {
+	if (info->customData != NULL && plugins_getinfo("commands") != NULL) {
+		commands_unregister("seen");
+	}
+}
+
 void PluginDone(PluginInfo *info) {
 	if (info->customData != NULL) {
 		SeenCustomData *plugData = info->customData;
 
+		timers_remove(plugData->flushTimer);
+		seen_flush(plugData);
+		seen_cache_clear(plugData);
+
 		sqlite3_finalize(plugData->stmtQuery);
-		sqlite3_finalize(plugData->stmtInsert);
-		sqlite3_finalize(plugData->stmtUpdate);
+		sqlite3_finalize(plugData->stmtUpsert);
+		sqlite3_finalize(plugData->stmtPrefix);
+		sqlite3_finalize(plugData->stmtInfix);
 		sqlite3_close(plugData->db);
 
 		events_removeEventListener(plugData->onjoin);
 		events_removeEventListener(plugData->onpart);
 		events_removeEventListener(plugData->onquit);
-		events_removeEventListener(plugData->oncommand);
+		events_removeEventListener(plugData->oncommandsready);
 
 		free(plugData);
 	}
@@ -29,6 +29,7 @@
 
 // My libraries
 #include <htable/keyvalpair.h>
+#include <socketpool.h>
 
 // Forward
 typedef struct sTelnetClient *TelnetClient;
@@ -65,6 +66,9 @@ typedef enum {
 	KEY_F11,					/**< F11 */
 	KEY_F12,					/**< F12 */
 	KEY_BACKSPACE,				/**< Backspace key */
+	KEY_CANCEL,					/**< Interactive mode is being cancelled,
+									 callback must free it's data and must
+									 not disconnect client. */
 } KeyCode;
 
 /**
@@ -148,6 +152,16 @@ typedef enum {
  */
 typedef void (*TelnetSendData)(TelnetClient, void *, size_t);
 
+/**
+ * Function prototype used by telnet_broadcast to queue shared buffer to
+ * client without copying it. Drivers are not required to provide it.
+ * void TelnetSendBuffer(TelnetClient client, SocketBuffer buffer)
+ * @param client Telnet client structure
+ * @param buffer Shared buffer, function takes it's own reference if it
+ *   needs to keep it.
+ */
+typedef void (*TelnetSendBuffer)(TelnetClient, SocketBuffer);
+
 /**
  * Function prototype used by telnet_action to perform some terminal action
  * on host.
@@ -188,6 +202,18 @@ typedef enum {
 											 it's structure should be freed. */
 } TelnetClientState;
 
+/**
+ * Result of command executed by telnet_execute.
+ */
+typedef enum {
+	TE_HANDLED = 0,						/**< Command has been handled */
+	TE_UNKNOWN,							/**< No one has handled the command */
+	TE_BUSY,							/**< Client is not at prompt, command
+											 was not executed */
+	TE_DISCONNECTED						/**< Command has disconnected the
+											 client */
+} Telnet_ExecResult;
+
 /**
  * Struct that holds information about a connected client.
  */
@@ -201,7 +227,12 @@ struct sTelnetClient {
 									 store specific informations. */
 
 	// Callbacks
-	TelnetSendData send;		/**< Function to send data to client */
+	TelnetSendData send;		/**< Function to send data to client. Data
+									 are collected in sendbuffer while
+									 output is corked. */
+	TelnetSendData driverSend;	/**< Driver's function to send data */
+	TelnetSendBuffer sendBuffer; /**< Driver's function to queue shared
+									 buffer, NULL if not supported. */
 	TelnetPerformAction action;	/**< Function to perform action on client */
 	TelnetDisconnected disconnected; /**< Function to close client's
 								     connection */
@@ -209,6 +240,12 @@ struct sTelnetClient {
 	void *interactiveData;		/**< Interactive mode data pointer */
 
 	string recvbuffer;			/**< Receive buffer for client */
+	string sendbuffer;			/**< Output collected while corked */
+	unsigned int corked;		/**< Output cork nesting level, output is
+									 sent when it drops to zero. */
+	bool promptCleared;			/**< Prompt was cleared by corked output and
+									 must be drawn again. */
+	unsigned int batch;			/**< Command batch nesting level */
 	unsigned int opts;			/**< Client abilities */
 
 	TelnetClientState state;	/**< Client state */
@@ -242,6 +279,22 @@ extern void telnet_send(TelnetClient client, char *format, ...);
  */
 extern void telnet_broadcast(char *format, ...);
 
+/**
+ * Cork client's output. All data sent to client are collected and sent at
+ * once by telnet_uncork(). Messages sent while client is at prompt clear
+ * the prompt only once and it is drawn again at uncork. Corks can be
+ * nested.
+ * @param client Telnet client
+ */
+extern void telnet_cork(TelnetClient client);
+
+/**
+ * Uncork client's output. When last cork is removed, the prompt is drawn
+ * again if needed and collected output is sent to driver as single buffer.
+ * @param client Telnet client
+ */
+extern void telnet_uncork(TelnetClient client);
+
 /**
  * Perform an terminal action
  * @param client Telnet client
@@ -280,6 +333,52 @@ extern void telnet_prompt(TelnetClient client);
 extern TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
 	TelnetPerformAction action, TelnetDisconnected disconnected);
 
+/**
+ * Add new client to list of telnet clients. If user is given, client is
+ * treated as already logged in, which is meant for drivers whose
+ * connections are trusted.
+ * @param socketdata Client socket data
+ * @param send Send function
+ * @param user Name of user client is logged in as, or NULL.
+ */
+extern TelnetClient telnet_add_client_as(void *socketdata, TelnetSendData send,
+	TelnetPerformAction action, TelnetDisconnected disconnected,
+	const char *user);
+
+/**
+ * Execute command on behalf of client, as if client typed it at prompt.
+ * Output of the command is sent to client at once.
+ * @param client Telnet client
+ * @param command Command to execute, without line ending.
+ * @return Result of the command, see Telnet_ExecResult. If TE_DISCONNECTED
+ *   is returned, client structure has been freed.
+ */
+extern Telnet_ExecResult telnet_execute(TelnetClient client,
+	const char *command);
+
+/**
+ * Leave interactive mode without waiting for interactive callback to end it.
+ * Callback gets KEY_CANCEL, so it can free it's data. Used by drivers whose
+ * clients can't answer interactive prompts.
+ * @param client Telnet client
+ */
+extern void telnet_interactive_cancel(TelnetClient client);
+
+/**
+ * Start batch of commands. Until the batch is ended, command handlers may
+ * postpone expensive work (like saving of databases) and do it only once
+ * when ontelnetbatchend is fired. Batches can be nested, events are fired
+ * only for the outermost one.
+ * @param client Telnet client
+ */
+extern void telnet_batch_begin(TelnetClient client);
+
+/**
+ * End batch of commands started by telnet_batch_begin().
+ * @param client Telnet client
+ */
+extern void telnet_batch_end(TelnetClient client);
+
 /**
  * Handles incomming data from driver
  * @param client Telnet client
@@ -287,6 +386,16 @@ extern TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
  */
 extern void telnet_received(TelnetClient client, KeyCode ch);
 
+/**
+ * Handles run of plain printable characters received from driver, which is
+ * processed at once instead of char by char.
+ * @param client Telnet client
+ * @param text Received characters
+ * @param length Number of received characters
+ */
+extern void telnet_received_text(TelnetClient client, const char *text,
+	size_t length);
+
 /**
  * Process telnet key without echo
  * @param client Telnet client
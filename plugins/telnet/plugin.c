@@ -42,6 +42,82 @@
 # define PLUGIN_NAME "telnet"
 #endif
 
+/**
+ * Send data to client, or collect them if client's output is corked. Used
+ * as client's send function.
+ * @param client Telnet client
+ * @param buffer Data buffer
+ * @param buffersize Data buffer size
+ */
+static void telnet_client_send(TelnetClient client, void *buffer,
+	size_t buffersize) {
+
+	if (client->corked > 0) {
+		dynastring_appendn(client->sendbuffer, buffer, buffersize);
+	} else {
+		client->driverSend(client, buffer, buffersize);
+	}
+} // telnet_client_send
+
+/**
+ * Draw prompt again if it has been cleared by corked output.
+ * @param client Telnet client
+ */
+static void telnet_restore_prompt(TelnetClient client) {
+	if (client->promptCleared) {
+		client->promptCleared = false;
+		if (client->state == TCS_PROMPT) {
+			telnet_prompt(client);
+		}
+	}
+} // telnet_restore_prompt
+
+/**
+ * If client is currently on prompt, clear it. It is drawn again when output
+ * is uncorked. Client's output must be corked.
+ * @param client Telnet client
+ */
+static void telnet_clear_prompt(TelnetClient client) {
+	if (client->state == TCS_PROMPT && !client->promptCleared) {
+		telnet_action(client, TA_ClearLine, 0, 0);
+		client->promptCleared = true;
+	}
+} // telnet_clear_prompt
+
+/**
+ * Cork client's output. All data sent to client are collected and sent at
+ * once by telnet_uncork(). Messages sent while client is at prompt clear
+ * the prompt only once and it is drawn again at uncork. Corks can be
+ * nested.
+ * @param client Telnet client
+ */
+void telnet_cork(TelnetClient client) {
+	client->corked++;
+} // telnet_cork
+
+/**
+ * Uncork client's output. When last cork is removed, the prompt is drawn
+ * again if needed and collected output is sent to driver as single buffer.
+ * @param client Telnet client
+ */
+void telnet_uncork(TelnetClient client) {
+	if (client->corked == 0) return;
+	if (client->corked > 1) {
+		client->corked--;
+		return;
+	}
+
+	telnet_restore_prompt(client);
+	client->corked = 0;
+
+	size_t length = dynastring_getlength(client->sendbuffer);
+	if (length > 0) {
+		client->driverSend(client, dynastring_getstring(client->sendbuffer),
+			length);
+		dynastring_clear(client->sendbuffer);
+	}
+} // telnet_uncork
+
 /**
  * Sends message to telnet client.
  * @param client Telnet client
@@ -56,10 +132,8 @@ void telnet_vsend(TelnetClient client, char *format, va_list ap) {
 	vasprintf(&buffer, format, myap);
 	va_end(myap);
 
-	// If client is currently on prompt, clear it
-	if (client->state == TCS_PROMPT) {
-		telnet_action(client, TA_ClearLine, 0, 0);
-	}
+	telnet_cork(client);
+	telnet_clear_prompt(client);
 
 	// Write message
 	if (client->windowWidth > 0) {
@@ -72,10 +146,7 @@ void telnet_vsend(TelnetClient client, char *format, va_list ap) {
 		client->send(client, "\r\n", 2);
 	}
 
-	// If client was in prompt, send the prompt back
-	if (client->state == TCS_PROMPT) {
-		telnet_prompt(client);
-	}
+	telnet_uncork(client);
 
 	if (buffer) {
 		free(buffer);
@@ -95,28 +166,109 @@ void telnet_send(TelnetClient client, char *format, ...) {
 	va_end(ap);
 } // telnet_send
 
+/**
+ * Message wrapped to one window width, shared by all clients of that width
+ * during broadcast.
+ */
+typedef struct {
+	uint16_t width;				/**< Window width, 0 if not wrapped */
+	SocketBuffer buffer;		/**< Wrapped message with line endings */
+} TelnetWrapped;
+
+/**
+ * Wrap message to given window width and terminate lines by CRLF.
+ * @param message Message
+ * @param width Window width, 0 to not wrap the message
+ * @return Shared buffer with wrapped message
+ */
+static SocketBuffer telnet_wrap(char *message, uint16_t width) {
+	string out = dynastring_init();
+
+	if (width > 0) {
+		ww_start(message, width, outputOffset, outputLength);
+			dynastring_appendn(out, message + outputOffset, outputLength);
+			dynastring_appendn(out, "\r\n", 2);
+		ww_end();
+	} else {
+		dynastring_appendstring(out, message);
+		dynastring_appendn(out, "\r\n", 2);
+	}
+
+	SocketBuffer buffer = socketpool_buffer_create(dynastring_getstring(out),
+		dynastring_getlength(out));
+	dynastring_free(out);
+	return buffer;
+} // telnet_wrap
+
 /**
  * Broadcast message to all telnet clients. Variable arguments are formatted
- * by format, which uses standard printf formatting.
+ * by format, which uses standard printf formatting. Message is formatted
+ * once and wrapped once for each distinct window width, clients that
+ * support it get the same buffer queued without copying.
  * @param format Format of message.
  */
 void telnet_broadcast(char *format, ...) {
+	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
+	if (info == NULL) return;
+
+	TelnetPluginData *plugData = (TelnetPluginData *)info->customData;
+	if (plugData->firstClient == NULL) return;
+
+	char *message = NULL;
 	va_list ap;
 	va_start(ap, format);
+	if (vasprintf(&message, format, ap) < 0) {
+		message = NULL;
+	}
+	va_end(ap);
+	if (message == NULL) return;
 
-	// ToDo: Broadcast to all clients
-	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
-	if (info != NULL) {
-		TelnetPluginData *plugData = (TelnetPluginData *)info->customData;
+	TelnetWrapped *wrapped = NULL;
+	size_t wrappedCount = 0;
 
-		TelnetClient client = plugData->firstClient;
-		while (client != NULL) {
-			telnet_vsend(client, format, ap);
-			client = client->next;
+	TelnetClient client = plugData->firstClient;
+	while (client != NULL) {
+		// Find message wrapped to client's window width.
+		SocketBuffer buffer = NULL;
+		for (size_t i = 0; i < wrappedCount && buffer == NULL; i++) {
+			if (wrapped[i].width == client->windowWidth) {
+				buffer = wrapped[i].buffer;
+			}
 		}
+		if (buffer == NULL) {
+			buffer = telnet_wrap(message, client->windowWidth);
+			wrapped = realloc(wrapped, (wrappedCount + 1) *
+				sizeof(TelnetWrapped));
+			wrapped[wrappedCount].width = client->windowWidth;
+			wrapped[wrappedCount].buffer = buffer;
+			wrappedCount++;
+		}
+
+		telnet_cork(client);
+		telnet_clear_prompt(client);
+
+		if (client->sendBuffer != NULL) {
+			// Output collected so far must go first.
+			size_t length = dynastring_getlength(client->sendbuffer);
+			if (length > 0) {
+				client->driverSend(client,
+					dynastring_getstring(client->sendbuffer), length);
+				dynastring_clear(client->sendbuffer);
+			}
+			client->sendBuffer(client, buffer);
+		} else {
+			client->send(client, buffer->data, buffer->size);
+		}
+
+		telnet_uncork(client);
+		client = client->next;
 	}
 
-	va_end(ap);
+	for (size_t i = 0; i < wrappedCount; i++) {
+		socketpool_buffer_release(wrapped[i].buffer);
+	}
+	free(wrapped);
+	free(message);
 } // telnet_broadcast
 
 /**
@@ -168,6 +320,7 @@ void telnet_prompt(TelnetClient client) {
 		}
 	}
 	client->state = TCS_PROMPT;
+	client->promptCleared = false;
 } // telnet_prompt
 
 /**
@@ -197,6 +350,26 @@ void telnet_disconnect(TelnetClient client) {
 		return;
 	}
 
+	// Let interactive callback free it's data.
+	if (client->state == TCS_INTERACTIVE && client->dataCallback != NULL) {
+		Telnet_DataCallback callback = client->dataCallback;
+		client->dataCallback = NULL;
+		callback(client, KEY_CANCEL);
+	}
+
+	// Finish batch that is still running, so it's work is not lost.
+	if (client->batch > 0) {
+		client->batch = 1;
+		telnet_batch_end(client);
+	}
+
+	// Send output that is still corked.
+	if (dynastring_getlength(client->sendbuffer) > 0) {
+		client->driverSend(client, dynastring_getstring(client->sendbuffer),
+			dynastring_getlength(client->sendbuffer));
+	}
+	client->corked = 0;
+
 	client->disconnected(client);
 
 	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
@@ -215,6 +388,7 @@ void telnet_disconnect(TelnetClient client) {
 	}
 
 	dynastring_free(client->recvbuffer);
+	dynastring_free(client->sendbuffer);
 
 	// Double free protection
 	if (client->kvp) {
@@ -228,10 +402,14 @@ void telnet_disconnect(TelnetClient client) {
 /**
  * Process telnet command from string that is in receive buffer.
  * @param client Telnet client
+ * @return Result of the command, see Telnet_ExecResult.
  */
-void telnet_process_command(TelnetClient client) {
+static Telnet_ExecResult telnet_process_command(TelnetClient client) {
 	client->state = TCS_PROCESSING;
 
+	// Whole output of command is sent at once.
+	telnet_cork(client);
+
 	string cmd = dynastring_init();
 	HTVAL hCD = kvp_get(client->kvp, "cd");
 	if (hCD) {
@@ -271,7 +449,8 @@ void telnet_process_command(TelnetClient client) {
 		dynastring_clear(client->recvbuffer);
 		dynastring_free(cmd);
 		telnet_prompt(client);
-		return;
+		telnet_uncork(client);
+		return TE_HANDLED;
 	}
 
 	Telnet_Command evt = {
@@ -304,14 +483,96 @@ void telnet_process_command(TelnetClient client) {
 
 	if (client->state == TCS_DISCONNECTED) {
 		telnet_disconnect(client);
-		return;
+		return TE_DISCONNECTED;
 	}
 
 	if (client->state != TCS_INTERACTIVE) {
 		telnet_prompt(client);
 	}
+	telnet_uncork(client);
+
+	return evt.handled ? TE_HANDLED : TE_UNKNOWN;
 } // telnet_process_command
 
+/**
+ * Execute command on behalf of client, as if client typed it at prompt.
+ * Output of the command is sent to client at once.
+ * @param client Telnet client
+ * @param command Command to execute, without line ending.
+ * @return Result of the command, see Telnet_ExecResult. If TE_DISCONNECTED
+ *   is returned, client structure has been freed.
+ */
+Telnet_ExecResult telnet_execute(TelnetClient client, const char *command) {
+	if (client->state != TCS_PROMPT) {
+		return TE_BUSY;
+	}
+
+	dynastring_clear(client->recvbuffer);
+	dynastring_appendstring(client->recvbuffer, (char *)command);
+	return telnet_process_command(client);
+} // telnet_execute
+
+/**
+ * Leave interactive mode without waiting for interactive callback to end it.
+ * Callback gets KEY_CANCEL, so it can free it's data. Used by drivers whose
+ * clients can't answer interactive prompts.
+ * @param client Telnet client
+ */
+void telnet_interactive_cancel(TelnetClient client) {
+	if (client->state != TCS_INTERACTIVE) return;
+
+	Telnet_DataCallback callback = client->dataCallback;
+	client->dataCallback = NULL;
+	client->state = TCS_PROCESSING;
+	if (callback != NULL) {
+		callback(client, KEY_CANCEL);
+	}
+
+	dynastring_clear(client->recvbuffer);
+	telnet_prompt(client);
+} // telnet_interactive_cancel
+
+/**
+ * Fire batch event for client.
+ * @param client Telnet client
+ * @param event Event name
+ */
+static void telnet_batch_event(TelnetClient client, char *event) {
+	Telnet_Command evt = {
+		.client = client,
+		.command = NULL,
+		.params = NULL,
+		.setInteractive = false,
+		.callback = NULL,
+		.handled = false
+	};
+	events_fireEvent(client->plugData->info->events, event, &evt);
+} // telnet_batch_event
+
+/**
+ * Start batch of commands. Until the batch is ended, command handlers may
+ * postpone expensive work (like saving of databases) and do it only once
+ * when ontelnetbatchend is fired. Batches can be nested, events are fired
+ * only for the outermost one.
+ * @param client Telnet client
+ */
+void telnet_batch_begin(TelnetClient client) {
+	if (client->batch++ == 0) {
+		telnet_batch_event(client, "ontelnetbatchbegin");
+	}
+} // telnet_batch_begin
+
+/**
+ * End batch of commands started by telnet_batch_begin().
+ * @param client Telnet client
+ */
+void telnet_batch_end(TelnetClient client) {
+	if (client->batch == 0) return;
+	if (--client->batch == 0) {
+		telnet_batch_event(client, "ontelnetbatchend");
+	}
+} // telnet_batch_end
+
 /**
  * Process telnet key without echo
  * @param client Telnet client
@@ -460,12 +721,53 @@ void telnet_receiveWithEcho(TelnetClient client, KeyCode ch) {
 	}
 } // telnet_receivewithecho
 
+/**
+ * Handles run of plain printable characters received from driver. The text
+ * is inserted into receive buffer and echoed at once. In interactive mode,
+ * characters are passed to the interactive callback one by one.
+ * @param client Telnet client
+ * @param text Received characters
+ * @param length Number of received characters
+ */
+void telnet_received_text(TelnetClient client, const char *text,
+	size_t length) {
+
+	telnet_restore_prompt(client);
+
+	while (length > 0 && client->state == TCS_INTERACTIVE) {
+		telnet_received(client, (unsigned char)*text++);
+		length--;
+	}
+	if (length == 0) return;
+
+	string s = client->recvbuffer;
+	dynastring_appendn(s, text, length);
+
+	if (client->opts & TC_ECHO) {
+		client->send(client, (char *)text, length);
+
+		// Text was inserted in the middle, rewrite rest of the line and move
+		// cursor back.
+		if (dynastring_getpos(s) != dynastring_getlength(s)) {
+			size_t write_len = dynastring_getlength(s) - dynastring_getpos(s);
+			client->send(client,
+				dynastring_getstring(s) + dynastring_getpos(s), write_len);
+			char *move = malloc(write_len * sizeof(char));
+			memset(move, 8, write_len);
+			client->send(client, move, write_len);
+			free(move);
+		}
+	}
+} // telnet_received_text
+
 /**
  * Handles incomming data from driver
  * @param client Telnet client
  * @param ch Received char
  */
 void telnet_received(TelnetClient client, KeyCode ch) {
+	telnet_restore_prompt(client);
+
 	if (client->state == TCS_INTERACTIVE) {
 		if (client->dataCallback != NULL) {
 			// If data callback returns true, set client to normal state.
@@ -495,6 +797,23 @@ void telnet_received(TelnetClient client, KeyCode ch) {
 TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
 	TelnetPerformAction action, TelnetDisconnected disconnected) {
 
+	return telnet_add_client_as(socketdata, send, action, disconnected, NULL);
+} // telnet_add_client
+
+/**
+ * Add new client to list of telnet clients. If user is given, client is
+ * treated as already logged in, which is meant for drivers whose
+ * connections are trusted.
+ * @param socketdata Client socket data
+ * @param send Send function
+ * @param disconnected Function to properly close client's connection, which
+ *   must do the driver.
+ * @param user Name of user client is logged in as, or NULL.
+ */
+TelnetClient telnet_add_client_as(void *socketdata, TelnetSendData send,
+	TelnetPerformAction action, TelnetDisconnected disconnected,
+	const char *user) {
+
 	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
 	if (info) {
 		TelnetPluginData *plugData = (TelnetPluginData *)info->customData;
@@ -507,12 +826,18 @@ TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
 		client->socketdata = socketdata;
 
 		// Callbacks
-		client->send = send;
+		client->send = telnet_client_send;
+		client->driverSend = send;
+		client->sendBuffer = NULL;
 		client->action = action;
 		client->disconnected = disconnected;
 
 		client->opts = TC_NORMAL;
 		client->recvbuffer = dynastring_init();
+		client->sendbuffer = dynastring_init();
+		client->corked = 0;
+		client->promptCleared = false;
+		client->batch = 0;
 
 		// Add client to chain
 		client->next = NULL;
@@ -529,6 +854,9 @@ TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
 		client->windowHeight = 0;
 
 		client->kvp = kvp_init();
+		if (user != NULL) {
+			kvp_set(client->kvp, "user", htval_string((char *)user));
+		}
 
 		Telnet_Command evt = {
 			.client = client,
@@ -551,7 +879,7 @@ TelnetClient telnet_add_client(void *socketdata, TelnetSendData send,
 	} else {
 		return NULL;
 	}
-} // telnet_add_client
+} // telnet_add_client_as
 
 /**
  * Change current context to another directory.
@@ -571,6 +899,8 @@ void PluginInit(PluginInfo *info) {
 
 	events_addEvent(info->events, "ontelnetcmd");
 	events_addEvent(info->events, "ontelnetconnected");
+	events_addEvent(info->events, "ontelnetbatchbegin");
+	events_addEvent(info->events, "ontelnetbatchend");
 
 	TelnetPluginData *plugData = malloc(sizeof(TelnetPluginData));
 	plugData->info = info;
@@ -69,6 +69,15 @@ typedef enum {
 	TS_KEYCODE3
 } TelnetSocketRecvState;
 
+/**
+ * State of parsing ANSI escape sequence
+ */
+typedef enum {
+	TS_ESC_CODE = 0,			/**< Awaiting [ char */
+	TS_ESC_PARAM1,				/**< Awaiting first parameter or code */
+	TS_ESC_PARAM2				/**< Awaiting second parameter or code */
+} TelnetSocketEscState;
+
 /**
  * To use by telnet clients to hold information about connected client
  */
@@ -80,6 +89,10 @@ struct sTelnetSocketData {
 	uint32_t keycode;			/**< Key code from client */
 	bool hasTerm;				/**< Set to true if we forced client to use
 									 VT100 terminal. */
+	TelnetSocketEscState escState; /**< State of escape sequence parsing */
+	unsigned long int escParam1; /**< First escape sequence parameter */
+	unsigned long int escParam2; /**< Second escape sequence parameter */
+	char escCode;				/**< Escape sequence code */
 }; // sTelnetSocketData
 
 /**
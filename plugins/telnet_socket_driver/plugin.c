@@ -60,6 +60,22 @@
 # define ts_debug(...)
 #endif
 
+/**
+ * Size of buffer for data read from client at once.
+ */
+#define TS_RECV_BUFFER 4096
+
+/**
+ * Client whose data are being processed by telnet_socket_client_receive.
+ */
+static TelnetSocketData receivingData = NULL;
+
+/**
+ * Set to true if client whose data are being processed has been disconnected
+ * meanwhile, so it's structures must not be touched anymore.
+ */
+static bool receivingClosed = false;
+
 /**
  * Sets non-blocking flag to socket.
  * Idea: http://www.lowtek.com/sockets/select.html
@@ -91,6 +107,17 @@ void telnet_socket_send(TelnetClient client, void *buffer,
 		buffer, buffersize);
 } // telnet_send_over_socket
 
+/**
+ * Queue shared buffer to telnet client socket (telnet plugin callback)
+ * @param client Telnet client which is connected using socket
+ * @param buffer Shared buffer
+ */
+void telnet_socket_send_buffer(TelnetClient client, SocketBuffer buffer) {
+	TelnetSocketData socketdata = (TelnetSocketData)client->socketdata;
+	socketpool_send_buffer(client->plugData->info->socketpool,
+		socketdata->socketfd, buffer);
+} // telnet_socket_send_buffer
+
 /**
  * Perform action on client's terminal screen. Only does something when client
  * accepted VT100 terminal.
@@ -238,6 +265,11 @@ void telnet_socket_disconnect(TelnetClient client) {
 		TelnetSocketData sockdata =
 			(TelnetSocketData)client->socketdata;
 
+		// Client is disconnected while it's data are being processed.
+		if (sockdata == receivingData) {
+			receivingClosed = true;
+		}
+
 		socketpool_close(plugData->info->socketpool, sockdata->socketfd);
 
 		// Remove data handlers from socket - don't receive any data anymore.
@@ -274,343 +306,376 @@ void telnet_socket_disconnect(TelnetClient client) {
 } // telnet_socket_disconnect
 
 /**
- * Socketpool callback indicating that client sent some data that we need
- * to receive.
- * @param socket Socketpool socket
+ * Returns true if char is plain printable character, which can be passed to
+ * telnet together with other such chars.
+ * @param ch Received char
  */
-void telnet_socket_client_receive(Socket socket) {
-	unsigned char ch;
+static inline bool telnet_socket_isplain(unsigned char ch) {
+	return ch >= 32 && ch != 127 && ch != TS_IAC;
+} // telnet_socket_isplain
 
-	TelnetClient client = (TelnetClient)socket->customData;
+/**
+ * Run one received char through the telnet protocol and escape sequences
+ * state machine, and pass the key to telnet if it is not part of control
+ * sequence.
+ * @param client Telnet client
+ * @param ch Received char
+ */
+static void telnet_socket_parse(TelnetClient client, unsigned char ch) {
 	TelnetSocketData socketdata = (TelnetSocketData)client->socketdata;
 
-	enum {
-		ESC_CODE = 0,
-		ESC_PARAM1 = 1,
-		ESC_PARAM2 = 2
-	} escState = ESC_CODE;
-	unsigned long int escParam1 = 0;
-	unsigned long int escParam2 = 0;
-	char escCode = 0;
-
-	while (read(socketdata->socketfd, &ch, 1) > 0) {
-		// After each enter, 0 is send, which we don't need.
-		if (ch == 0) continue;
-
-		ts_debug("%d %x (%c) ", ch, ch, (ch >= 32 && ch < 127)?ch:' ');
-
-		switch (socketdata->state) {
-			// Normal state, receiving user input
-			case TS_NORMAL:
-				switch (ch) {
-					case TS_IAC:
-						ts_debug("IAC\n");
-						socketdata->state = TS_IAC;
-						continue;
-
-					case TS_ESC:
-						ts_debug("ESC\n");
-						socketdata->state = TS_ESC;
-						escState = ESC_CODE;
-						escParam1 = 0;
-						escParam2 = 0;
-						escCode = 0;
-						continue;
-
-					// No special char was entered, proceed normal processing
-					// by telnet.
-					default:
-						break;
-				}
-				break;
-
-			case TS_ESC: {
-				bool doContinue = true;
-				switch (escState) {
-					// Awaiting [ char
-					case ESC_CODE: {
-						if (ch == '[') {
-							escState = ESC_PARAM1;
-						} else {
-							doContinue = false;
-						}
-						break;
-					}
-
-					// Awaiting number or char
-					case ESC_PARAM1: {
-						if (ch >= '0' && ch <= '9') {
-							// Is digit, so it is parameter
-							escParam1 *= 10;
-							escParam1 += ch - '0';
-						} else if (ch == ';') {
-							escState = ESC_PARAM2;
-						} else {
-							// It is not digit, it is end of command
-							escCode = ch;
-						}
-						break;
-					}
+	// After each enter, 0 is send, which we don't need.
+	if (ch == 0) return;
+
+	ts_debug("%d %x (%c) ", ch, ch, (ch >= 32 && ch < 127)?ch:' ');
+
+	switch (socketdata->state) {
+		// Normal state, receiving user input
+		case TS_NORMAL:
+			switch (ch) {
+				case TS_IAC:
+					ts_debug("IAC\n");
+					socketdata->state = TS_IAC;
+					return;
+
+				case TS_ESC:
+					ts_debug("ESC\n");
+					socketdata->state = TS_ESC;
+					socketdata->escState = TS_ESC_CODE;
+					socketdata->escParam1 = 0;
+					socketdata->escParam2 = 0;
+					socketdata->escCode = 0;
+					return;
+
+				// No special char was entered, proceed normal processing
+				// by telnet.
+				default:
+					break;
+			}
+			break;
 
-					case ESC_PARAM2: {
-						if (ch >= '0' && ch <= '9') {
-							// It is digit
-							escParam2 *= 10;
-							escParam2 += ch - '0';
-						} else {
-							// Not digit, must be escape code
-							escCode = ch;
+		case TS_ESC: {
+			switch (socketdata->escState) {
+				// Awaiting [ char
+				case TS_ESC_CODE: {
+					if (ch == '[') {
+						socketdata->escState = TS_ESC_PARAM1;
+					} else {
+						// It wasn't a sequence, but escape key followed by
+						// another input.
+						socketdata->state = TS_NORMAL;
+						telnet_received(client, KEY_ESC);
+						if (!receivingClosed) {
+							telnet_socket_parse(client, ch);
 						}
+						return;
 					}
+					break;
 				}
 
-				if (escCode > 0) {
-					switch (escCode) {
-						case 'A':
-							telnet_received(client, KEY_UP);
-							break;
-
-						case 'B':
-							telnet_received(client, KEY_DOWN);
-							break;
-
-						case 'C':
-							telnet_received(client, KEY_RIGHT);
-							break;
-
-						case 'D':
-							telnet_received(client, KEY_LEFT);
-							break;
-
-
-
-						// Unknown code
-						default:
-							break;
+				// Awaiting number or char
+				case TS_ESC_PARAM1: {
+					if (ch >= '0' && ch <= '9') {
+						// Is digit, so it is parameter
+						socketdata->escParam1 *= 10;
+						socketdata->escParam1 += ch - '0';
+					} else if (ch == ';') {
+						socketdata->escState = TS_ESC_PARAM2;
+					} else {
+						// It is not digit, it is end of command
+						socketdata->escCode = ch;
 					}
+					break;
 				}
 
-				if (doContinue) {
-					continue;
-				} else {
-					socketdata->state = TS_NORMAL;
-					break;
+				case TS_ESC_PARAM2: {
+					if (ch >= '0' && ch <= '9') {
+						// It is digit
+						socketdata->escParam2 *= 10;
+						socketdata->escParam2 += ch - '0';
+					} else {
+						// Not digit, must be escape code
+						socketdata->escCode = ch;
+					}
 				}
 			}
 
-			case TS_IAC:
-				switch (ch) {
-					case TS_SB:
-						ts_debug("SB\n");
-						socketdata->state = TS_SB;
-						break;
-
-					case TS_WILL:
-						ts_debug("WILL\n");
-						socketdata->state = TS_WILL;
+			if (socketdata->escCode > 0) {
+				switch (socketdata->escCode) {
+					case 'A':
+						telnet_received(client, KEY_UP);
 						break;
 
-					case TS_WONT:
-						ts_debug("WONT\n");
-						socketdata->state = TS_WONT;
+					case 'B':
+						telnet_received(client, KEY_DOWN);
 						break;
 
-					case TS_DO:
-						ts_debug("DO\n");
-						socketdata->state = TS_DO;
-						break;
-
-					case TS_DONT:
-						ts_debug("DONT\n");
-						socketdata->state = TS_DONT;
-						break;
-				}
-				continue;
-
-			// IAC DO
-			case TS_DO:
-				switch (ch) {
-					case TS_ECHO: {
-						// Client accepted our local echo request, and will
-						// not do local echo.
-						ts_debug("ECHO\n");
-						client->opts |= TC_ECHO;
+					case 'C':
+						telnet_received(client, KEY_RIGHT);
 						break;
-					}
 
-					case TS_GOAHEAD: {
-						ts_debug("GOAHEAD\n");
-						client->opts |= TC_UNBUFFERED;
+					case 'D':
+						telnet_received(client, KEY_LEFT);
 						break;
-					}
 
+					// Unknown code
 					default:
-						ts_debug("IGNORE\n");
 						break;
 				}
-				socketdata->state = TS_NORMAL;
-				continue;
 
-			// IAC DONT
-			case TS_DONT:
-				ts_debug("IGNORE\n");
+				// Sequence is complete.
 				socketdata->state = TS_NORMAL;
-				continue;
-
-			// IAC WILL
-			case TS_WILL:
-				switch (ch) {
-					case TS_NAWS: {
-						// Client will send window size
-						ts_debug("NAWS\n");
-						break;
-					}
+				return;
+			}
 
-					case TS_TERMTYPE: {
-						// Client allowes us to send terminal type
-						ts_debug("TERMTYPE\n");
+			return;
+		}
 
-						// Send VT100 terminal type
-						char termtype[11] = { TS_IAC, TS_SB, TS_TERMTYPE, 0,
-							'V', 'T', '1', '0', '0', TS_IAC, TS_SE };
-						socketpool_send(socket->pool, socket->socketfd,
-							termtype, 11);
-						socketdata->hasTerm = true;
-						break;
-					}
+		case TS_IAC:
+			switch (ch) {
+				case TS_SB:
+					ts_debug("SB\n");
+					socketdata->state = TS_SB;
+					break;
 
-					default: {
-						ts_debug("IGNORE\n");
-						break;
-					}
+				case TS_WILL:
+					ts_debug("WILL\n");
+					socketdata->state = TS_WILL;
+					break;
+
+				case TS_WONT:
+					ts_debug("WONT\n");
+					socketdata->state = TS_WONT;
+					break;
+
+				case TS_DO:
+					ts_debug("DO\n");
+					socketdata->state = TS_DO;
+					break;
+
+				case TS_DONT:
+					ts_debug("DONT\n");
+					socketdata->state = TS_DONT;
+					break;
+			}
+			return;
+
+		// IAC DO
+		case TS_DO:
+			switch (ch) {
+				case TS_ECHO: {
+					// Client accepted our local echo request, and will
+					// not do local echo.
+					ts_debug("ECHO\n");
+					client->opts |= TC_ECHO;
+					break;
 				}
-				socketdata->state = TS_NORMAL;
-				continue;
 
-			// IAC WONT
-			case TS_WONT:
-				ts_debug("IGNORE\n");
-				socketdata->state = TS_NORMAL;
-				continue;
-
-			// IAC SB - Subnegotiation of parameters
-			case TS_SB:
-				socketdata->state = TS_IGNORE_TILL_SE;
-
-				switch (ch) {
-					case TS_NAWS:
-						ts_debug("NAWS\n");
-						client->windowWidth = 0;
-						client->windowHeight = 0;
-						socketdata->state = TS_NAWS_WIDTH_LSB;
-						break;
+				case TS_GOAHEAD: {
+					ts_debug("GOAHEAD\n");
+					client->opts |= TC_UNBUFFERED;
+					break;
+				}
 
-					default:
-						break;
+				default:
+					ts_debug("IGNORE\n");
+					break;
+			}
+			socketdata->state = TS_NORMAL;
+			return;
+
+		// IAC DONT
+		case TS_DONT:
+			ts_debug("IGNORE\n");
+			socketdata->state = TS_NORMAL;
+			return;
+
+		// IAC WILL
+		case TS_WILL:
+			switch (ch) {
+				case TS_NAWS: {
+					// Client will send window size
+					ts_debug("NAWS\n");
+					break;
 				}
-				continue;
-
-			case TS_NAWS_WIDTH_MSB:
-				client->windowWidth = 0xFF * ch;
-				socketdata->state = TS_NAWS_WIDTH_LSB;
-				continue;
-
-			case TS_NAWS_WIDTH_LSB:
-				client->windowWidth += ch;
-				socketdata->state = TS_NAWS_HEIGHT_LSB;
-				continue;
-
-			case TS_NAWS_HEIGHT_MSB:
-				client->windowHeight = 0xFF * ch;
-				socketdata->state = TS_NAWS_HEIGHT_LSB;
-				continue;
-
-			case TS_NAWS_HEIGHT_LSB:
-				client->windowHeight += ch;
-				client->opts |= TC_WINDOWSIZE;
-				socketdata->state = TS_IGNORE_TILL_SE;
-				continue;
-
-			case TS_IGNORE:
-				ts_debug("IGNORE\n");
-				socketdata->state = TS_NORMAL;
-				continue;
 
-			case TS_IGNORE_TILL_SE:
-				switch (ch) {
-					case TS_SE:
-						ts_debug("SE\n");
-						socketdata->state = TS_NORMAL;
-						break;
+				case TS_TERMTYPE: {
+					// Client allowes us to send terminal type
+					ts_debug("TERMTYPE\n");
 
-					default:
-						ts_debug("IGNORE TILL SE\n");
-						break;
+					// Send VT100 terminal type
+					char termtype[11] = { TS_IAC, TS_SB, TS_TERMTYPE, 0,
+						'V', 'T', '1', '0', '0', TS_IAC, TS_SE };
+					socketpool_send(client->plugData->info->socketpool,
+						socketdata->socketfd, termtype, 11);
+					socketdata->hasTerm = true;
+					break;
 				}
-				continue;
 
-			case TS_KEYCODE1:
-				if (ch == '[') {
-					ts_debug("CONTROL\n");
-					socketdata->keycode = ch << 8;
-					socketdata->state = TS_KEYCODE2;
-				} else {
-					ts_debug("NORMAL\n");
+				default: {
+					ts_debug("IGNORE\n");
+					break;
 				}
-				continue;
+			}
+			socketdata->state = TS_NORMAL;
+			return;
 
-			case TS_KEYCODE2:
-				ts_debug("KEYCODE2\n");
-				socketdata->keycode |= ch;
+		// IAC WONT
+		case TS_WONT:
+			ts_debug("IGNORE\n");
+			socketdata->state = TS_NORMAL;
+			return;
+
+		// IAC SB - Subnegotiation of parameters
+		case TS_SB:
+			socketdata->state = TS_IGNORE_TILL_SE;
+
+			switch (ch) {
+				case TS_NAWS:
+					ts_debug("NAWS\n");
+					client->windowWidth = 0;
+					client->windowHeight = 0;
+					socketdata->state = TS_NAWS_WIDTH_LSB;
+					break;
 
-				// 0x5b3* has 3 bytes (??)
-				if ((socketdata->keycode & 0x7ff0) == 0x5b30) {
-					socketdata->keycode = socketdata->keycode << 8;
-					socketdata->state = TS_KEYCODE3;
-				} else {
-					//telnet_socket_keycode(client);
+				default:
+					break;
+			}
+			return;
+
+		case TS_NAWS_WIDTH_MSB:
+			client->windowWidth = 0xFF * ch;
+			socketdata->state = TS_NAWS_WIDTH_LSB;
+			return;
+
+		case TS_NAWS_WIDTH_LSB:
+			client->windowWidth += ch;
+			socketdata->state = TS_NAWS_HEIGHT_LSB;
+			return;
+
+		case TS_NAWS_HEIGHT_MSB:
+			client->windowHeight = 0xFF * ch;
+			socketdata->state = TS_NAWS_HEIGHT_LSB;
+			return;
+
+		case TS_NAWS_HEIGHT_LSB:
+			client->windowHeight += ch;
+			client->opts |= TC_WINDOWSIZE;
+			socketdata->state = TS_IGNORE_TILL_SE;
+			return;
+
+		case TS_IGNORE:
+			ts_debug("IGNORE\n");
+			socketdata->state = TS_NORMAL;
+			return;
+
+		case TS_IGNORE_TILL_SE:
+			switch (ch) {
+				case TS_SE:
+					ts_debug("SE\n");
 					socketdata->state = TS_NORMAL;
-				}
-				continue;
+					break;
+
+				default:
+					ts_debug("IGNORE TILL SE\n");
+					break;
+			}
+			return;
+
+		case TS_KEYCODE1:
+			if (ch == '[') {
+				ts_debug("CONTROL\n");
+				socketdata->keycode = ch << 8;
+				socketdata->state = TS_KEYCODE2;
+			} else {
+				ts_debug("NORMAL\n");
+			}
+			return;
+
+		case TS_KEYCODE2:
+			ts_debug("KEYCODE2\n");
+			socketdata->keycode |= ch;
 
-			case TS_KEYCODE3:
-				ts_debug("KEYCODE3\n");
-				socketdata->keycode |= ch;
+			// 0x5b3* has 3 bytes (??)
+			if ((socketdata->keycode & 0x7ff0) == 0x5b30) {
+				socketdata->keycode = socketdata->keycode << 8;
+				socketdata->state = TS_KEYCODE3;
+			} else {
 				//telnet_socket_keycode(client);
 				socketdata->state = TS_NORMAL;
-				continue;
+			}
+			return;
 
-			default:
-				// Nothing special, unknown state...
-				socketdata->state = TS_NORMAL;
-				break;
-		}
+		case TS_KEYCODE3:
+			ts_debug("KEYCODE3\n");
+			socketdata->keycode |= ch;
+			//telnet_socket_keycode(client);
+			socketdata->state = TS_NORMAL;
+			return;
 
-		if (ch == 127) {
-			telnet_received(client, KEY_BACKSPACE);
-		} else if (ch == TS_ESC) {
-			telnet_received(client, KEY_ESC);
-		} else {
-			telnet_received(client, ch);
+		default:
+			// Nothing special, unknown state...
+			socketdata->state = TS_NORMAL;
+			break;
+	}
 
-			// Don't read any more data, if command was completed.
-			if (ch == KEY_ENTER) {
-				break;
-			}
+	if (ch == 127) {
+		telnet_received(client, KEY_BACKSPACE);
+	} else if (ch == TS_ESC) {
+		telnet_received(client, KEY_ESC);
+	} else {
+		telnet_received(client, ch);
+	}
+} // telnet_socket_parse
+
+/**
+ * Socketpool callback indicating that client sent some data that we need
+ * to receive.
+ * @param socket Socketpool socket
+ */
+void telnet_socket_client_receive(Socket socket) {
+	unsigned char buffer[TS_RECV_BUFFER];
+
+	TelnetClient client = (TelnetClient)socket->customData;
+	TelnetSocketData socketdata = (TelnetSocketData)client->socketdata;
+
+	ssize_t length = read(socketdata->socketfd, buffer, sizeof(buffer));
+	if (length <= 0) return;
+
+	receivingData = socketdata;
+	receivingClosed = false;
+
+	// Output produced by processing the whole block is sent at once.
+	telnet_cork(client);
+
+	ssize_t i = 0;
+	while (i < length && !receivingClosed) {
+		// Plain text typed or pasted at prompt is passed at once. In
+		// interactive mode, the callback can change client's state after
+		// any char, so it gets them one by one.
+		if (socketdata->state == TS_NORMAL &&
+			client->state != TCS_INTERACTIVE &&
+			telnet_socket_isplain(buffer[i])) {
+
+			ssize_t end = i + 1;
+			while (end < length && telnet_socket_isplain(buffer[end])) end++;
+
+			telnet_received_text(client, (char *)buffer + i, end - i);
+			i = end;
+		} else {
+			telnet_socket_parse(client, buffer[i++]);
 		}
 	}
 
-	// If we are inside escape sequence, cancel it and treat this as escape
-	// key. And don't care about sockets marked for closing, because they
+	// Escape sequence split between two reads continues with the next
+	// block. Escape key alone is reported when next input shows that no
+	// sequence follows. Don't care about disconnected clients, because they
 	// should not receive any more data.
-	if (!socket->shouldBeClosed) {
-		if (socketdata->state == TS_ESC) {
-			if (escState == ESC_CODE) {
-				telnet_received(client, KEY_ESC);
-			}
-			socketdata->state = TS_NORMAL;
-		}
+	if (!receivingClosed) {
+		telnet_uncork(client);
 	}
+
+	receivingData = NULL;
 } // telnet_client_receive
 
 /**
@@ -637,6 +702,10 @@ void telnet_socket_accept_client(Socket socket) {
 
 	// No terminal by default
 	socketdata->hasTerm = false;
+	socketdata->escState = TS_ESC_CODE;
+	socketdata->escParam1 = 0;
+	socketdata->escParam2 = 0;
+	socketdata->escCode = 0;
 
 	// New client is connected.
 	printError(PLUGIN_NAME, "New client connected from IP %s.",
@@ -665,6 +734,7 @@ void telnet_socket_accept_client(Socket socket) {
 		printError(PLUGIN_NAME, "Telnet has refused our client.");
 		return;
 	} else {
+		client->sendBuffer = telnet_socket_send_buffer;
 		kvp_set(client->kvp, "driver", htval_string("socket"));
 		kvp_set(client->kvp, "ip",
 			htval_string(inet_ntoa(socketdata->address.sin_addr)));
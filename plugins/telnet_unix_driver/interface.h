@@ -0,0 +1,73 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _TELNET_UNIX_DRIVER_INTERFACE
+#define _TELNET_UNIX_DRIVER_INTERFACE 1
+
+// Standard headers
+#include <stdbool.h>
+
+// My libraries
+#include <dynastring.h>
+
+// Include telnet interface
+#include "../telnet/interface.h"
+
+// Forward
+typedef struct sTelnetUnixData *TelnetUnixData;
+
+/**
+ * Holds information about client connected to the control socket
+ */
+struct sTelnetUnixData {
+	int socketfd;				/**< Client socket file descriptor */
+	TelnetClient client;		/**< Telnet client */
+	string recvbuffer;			/**< Received data not forming whole line
+									 yet */
+	string output;				/**< Output of command being executed */
+	bool executing;				/**< Output is collected as response to
+									 request, not sent as message. */
+	TelnetUnixData prev;		/**< Previous connected client */
+	TelnetUnixData next;		/**< Next connected client */
+}; // sTelnetUnixData
+
+/**
+ * Request parsed from one line sent by client
+ */
+typedef struct {
+	char *id;					/**< Request id as raw JSON value, NULL if
+									 request has no id */
+	char *command;				/**< Single command, NULL for batch */
+	char **batch;				/**< Commands of batch */
+	size_t batchCount;			/**< Number of commands in batch */
+	bool isBatch;				/**< Request is batch of commands */
+} TelnetUnixRequest;
+
+/**
+ * Data structures for telnet unix socket driver
+ */
+typedef struct {
+	PluginInfo *info;			/**< PluginInfo */
+	int serverSocket;			/**< Server socket file descriptor */
+	char *path;					/**< Path of server socket */
+	TelnetUnixData firstClient; /**< First client connected to server */
+	TelnetUnixData lastClient;	/**< Last client connected to server */
+} TelnetUnixDriverPluginData;
+
+#endif
@@ -0,0 +1,952 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Driver for telnet that provides control socket for scripts. Client
+ * connected to unix domain socket is logged in as user set in
+ * telnet_unix_driver:user, so access is controled by permissions of the
+ * socket file only.
+ *
+ * Each line sent by client is one JSON request, which is either single
+ * command:
+ *   {"id": 1, "command": "users list"}
+ * or batch of commands:
+ *   {"id": 2, "batch": ["users add bob", "users addhost bob *!*@host"]}
+ *
+ * Commands are executed as if they were typed at telnet prompt. Requests
+ * can be pipelined, each request gets one response line in the same order:
+ *   {"id": 1, "ok": true, "output": ["line", ...]}
+ *   {"id": 2, "ok": true, "results": [{"ok": true, "output": []}, ...],
+ *     "output": []}
+ * Commands of batch are executed as telnet command batch, so changes they
+ * do are saved at once when the batch ends. Command that has left client
+ * waiting for interactive input is cancelled by next request, because
+ * the input can't be sent over the socket. Output produced outside of
+ * requests (for example broadcasts) is sent as:
+ *   {"event": "message", "output": ["line", ...]}
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+// Standard libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Sockets-related includes
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Plugins API
+#include <pluginapi.h>
+
+// My includes
+#include <io.h>
+#include <plugins.h>
+#include <htable/keyvalpair.h>
+#include <toolbox/tb_string.h>
+
+// Include telnet interface
+#include "../telnet/interface.h"
+
+// This plugin interface
+#include "interface.h"
+
+#ifndef PLUGIN_NAME
+# define PLUGIN_NAME "telnet_unix_driver"
+#endif
+
+/**
+ * Size of buffer for data read from client at once.
+ */
+#define TU_RECV_BUFFER 4096
+
+/**
+ * Maximal length of one request line. Client that sends longer line is
+ * disconnected.
+ */
+#define TU_MAX_LINE (1024 * 1024)
+
+/**
+ * Maximal nesting of JSON values in request.
+ */
+#define TU_MAX_DEPTH 32
+
+/**
+ * Client whose data are being processed by telnet_unix_client_receive.
+ */
+static TelnetUnixData receivingData = NULL;
+
+/**
+ * Set to true if client whose data are being processed has been disconnected
+ * meanwhile, so it's structures must be freed after processing.
+ */
+static bool receivingClosed = false;
+
+/**
+ * Skip JSON whitespace.
+ * @param p Position in text
+ * @return First non-whitespace position.
+ */
+static const char *telnet_unix_json_ws(const char *p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+	return p;
+} // telnet_unix_json_ws
+
+/**
+ * Parse four hex digits of JSON \u escape.
+ * @param s Position of first digit. Stops at first character that is not
+ *   hex digit, so it never reads past end of string.
+ * @param code Decoded value
+ * @return True if all four characters are hex digits.
+ */
+static bool telnet_unix_json_hex(const char *s, unsigned int *code) {
+	*code = 0;
+	for (int i = 0; i < 4; i++, s++) {
+		*code <<= 4;
+		if (*s >= '0' && *s <= '9') *code |= *s - '0';
+		else if (*s >= 'a' && *s <= 'f') *code |= *s - 'a' + 10;
+		else if (*s >= 'A' && *s <= 'F') *code |= *s - 'A' + 10;
+		else return false;
+	}
+	return true;
+} // telnet_unix_json_hex
+
+/**
+ * Parse JSON string value.
+ * @param p Position in text, must point to opening quote. Is moved after
+ *   the string.
+ * @return Decoded string in newly allocated memory, NULL if string is not
+ *   valid.
+ */
+static char *telnet_unix_json_string(const char **p) {
+	const char *s = *p;
+	if (*s++ != '"') return NULL;
+
+	string out = dynastring_init();
+	while (*s != '"') {
+		unsigned char ch = *s++;
+
+		if (ch == '\0' || ch < 0x20) {
+			dynastring_free(out);
+			return NULL;
+		}
+
+		if (ch != '\\') {
+			dynastring_appendchar(out, ch);
+			continue;
+		}
+
+		switch (*s++) {
+			case '"': dynastring_appendchar(out, '"'); break;
+			case '\\': dynastring_appendchar(out, '\\'); break;
+			case '/': dynastring_appendchar(out, '/'); break;
+			case 'b': dynastring_appendchar(out, '\b'); break;
+			case 'f': dynastring_appendchar(out, '\f'); break;
+			case 'n': dynastring_appendchar(out, '\n'); break;
+			case 'r': dynastring_appendchar(out, '\r'); break;
+			case 't': dynastring_appendchar(out, '\t'); break;
+			case 'u': {
+				unsigned int code;
+				if (!telnet_unix_json_hex(s, &code)) {
+					dynastring_free(out);
+					return NULL;
+				}
+				s += 4;
+
+				// Surrogate pair
+				unsigned int low;
+				if (code >= 0xD800 && code <= 0xDBFF && s[0] == '\\' &&
+					s[1] == 'u' && telnet_unix_json_hex(s + 2, &low) &&
+					low >= 0xDC00 && low <= 0xDFFF) {
+
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					s += 6;
+				}
+
+				// Encode code point as UTF-8, zero char is not allowed in
+				// commands.
+				if (code == 0) {
+					dynastring_free(out);
+					return NULL;
+				} else if (code < 0x80) {
+					dynastring_appendchar(out, code);
+				} else if (code < 0x800) {
+					dynastring_appendchar(out, 0xC0 | (code >> 6));
+					dynastring_appendchar(out, 0x80 | (code & 0x3F));
+				} else if (code < 0x10000) {
+					dynastring_appendchar(out, 0xE0 | (code >> 12));
+					dynastring_appendchar(out, 0x80 | ((code >> 6) & 0x3F));
+					dynastring_appendchar(out, 0x80 | (code & 0x3F));
+				} else {
+					dynastring_appendchar(out, 0xF0 | (code >> 18));
+					dynastring_appendchar(out, 0x80 | ((code >> 12) & 0x3F));
+					dynastring_appendchar(out, 0x80 | ((code >> 6) & 0x3F));
+					dynastring_appendchar(out, 0x80 | (code & 0x3F));
+				}
+				break;
+			}
+
+			default:
+				dynastring_free(out);
+				return NULL;
+		}
+	}
+
+	*p = s + 1;
+	char *result = strdup(dynastring_getstring(out));
+	dynastring_free(out);
+	return result;
+} // telnet_unix_json_string
+
+/**
+ * Skip any JSON value.
+ * @param p Position in text, is moved after the value.
+ * @param depth Current nesting level
+ * @return True if value is valid.
+ */
+static bool telnet_unix_json_skip(const char **p, int depth) {
+	const char *s = telnet_unix_json_ws(*p);
+
+	if (depth > TU_MAX_DEPTH) return false;
+
+	switch (*s) {
+		case '"': {
+			char *str = telnet_unix_json_string(&s);
+			if (str == NULL) return false;
+			free(str);
+			break;
+		}
+
+		case '{':
+		case '[': {
+			char close = (*s == '{') ? '}' : ']';
+			bool object = (*s == '{');
+
+			s = telnet_unix_json_ws(s + 1);
+			if (*s == close) {
+				s++;
+				break;
+			}
+
+			while (true) {
+				if (object) {
+					s = telnet_unix_json_ws(s);
+					char *key = telnet_unix_json_string(&s);
+					if (key == NULL) return false;
+					free(key);
+
+					s = telnet_unix_json_ws(s);
+					if (*s++ != ':') return false;
+				}
+
+				if (!telnet_unix_json_skip(&s, depth + 1)) return false;
+
+				s = telnet_unix_json_ws(s);
+				if (*s == ',') {
+					s++;
+				} else if (*s == close) {
+					s++;
+					break;
+				} else {
+					return false;
+				}
+			}
+			break;
+		}
+
+		default: {
+			// Number or literal
+			if (strncmp(s, "true", 4) == 0) {
+				s += 4;
+			} else if (strncmp(s, "false", 5) == 0) {
+				s += 5;
+			} else if (strncmp(s, "null", 4) == 0) {
+				s += 4;
+			} else {
+				char *end;
+				strtod(s, &end);
+				if (end == s) return false;
+				s = end;
+			}
+		}
+	}
+
+	*p = s;
+	return true;
+} // telnet_unix_json_skip
+
+/**
+ * Free request structure members.
+ * @param request Request
+ */
+static void telnet_unix_request_free(TelnetUnixRequest *request) {
+	free(request->id);
+	free(request->command);
+	for (size_t i = 0; i < request->batchCount; i++) {
+		free(request->batch[i]);
+	}
+	free(request->batch);
+} // telnet_unix_request_free
+
+/**
+ * Parse request line.
+ * @param line Line received from client
+ * @param request Request structure to fill in. Must be freed by
+ *   telnet_unix_request_free even if parsing fails.
+ * @return NULL on success, error message otherwise.
+ */
+static const char *telnet_unix_request_parse(const char *line,
+	TelnetUnixRequest *request) {
+
+	request->id = NULL;
+	request->command = NULL;
+	request->batch = NULL;
+	request->batchCount = 0;
+	request->isBatch = false;
+
+	const char *s = telnet_unix_json_ws(line);
+	if (*s++ != '{') return "Request must be JSON object.";
+
+	s = telnet_unix_json_ws(s);
+	if (*s == '}') return "Request has no command.";
+
+	while (true) {
+		s = telnet_unix_json_ws(s);
+		char *key = telnet_unix_json_string(&s);
+		if (key == NULL) return "Invalid JSON.";
+
+		s = telnet_unix_json_ws(s);
+		if (*s++ != ':') {
+			free(key);
+			return "Invalid JSON.";
+		}
+		s = telnet_unix_json_ws(s);
+
+		if (eq(key, "id")) {
+			// Id is returned to client as it was sent.
+			const char *start = s;
+			if (!telnet_unix_json_skip(&s, 0)) {
+				free(key);
+				return "Invalid JSON.";
+			}
+			free(request->id);
+			request->id = strndup(start, s - start);
+		} else if (eq(key, "command")) {
+			free(request->command);
+			request->command = telnet_unix_json_string(&s);
+			if (request->command == NULL) {
+				free(key);
+				return "Command must be string.";
+			}
+		} else if (eq(key, "batch")) {
+			if (*s++ != '[' || request->isBatch) {
+				free(key);
+				return "Batch must be array of strings.";
+			}
+			request->isBatch = true;
+
+			s = telnet_unix_json_ws(s);
+			if (*s == ']') {
+				s++;
+			} else {
+				while (true) {
+					s = telnet_unix_json_ws(s);
+					char *command = telnet_unix_json_string(&s);
+					if (command == NULL) {
+						free(key);
+						return "Batch must be array of strings.";
+					}
+
+					request->batch = realloc(request->batch,
+						(request->batchCount + 1) * sizeof(char *));
+					request->batch[request->batchCount++] = command;
+
+					s = telnet_unix_json_ws(s);
+					if (*s == ',') {
+						s++;
+					} else if (*s == ']') {
+						s++;
+						break;
+					} else {
+						free(key);
+						return "Batch must be array of strings.";
+					}
+				}
+			}
+		} else {
+			// Unknown keys are ignored.
+			if (!telnet_unix_json_skip(&s, 0)) {
+				free(key);
+				return "Invalid JSON.";
+			}
+		}
+		free(key);
+
+		s = telnet_unix_json_ws(s);
+		if (*s == ',') {
+			s++;
+		} else if (*s == '}') {
+			s++;
+			break;
+		} else {
+			return "Invalid JSON.";
+		}
+	}
+
+	if (*telnet_unix_json_ws(s) != '\0') return "Invalid JSON.";
+	if (request->command != NULL && request->isBatch) {
+		return "Request can't have both command and batch.";
+	}
+	if (request->command == NULL && !request->isBatch) {
+		return "Request has no command.";
+	}
+
+	return NULL;
+} // telnet_unix_request_parse
+
+/**
+ * Append string to JSON output as quoted and escaped JSON string.
+ * @param out Output string
+ * @param str String
+ * @param length Length of string
+ */
+static void telnet_unix_json_append(string out, const char *str,
+	size_t length) {
+
+	dynastring_appendchar(out, '"');
+
+	size_t start = 0;
+	for (size_t i = 0; i < length; i++) {
+		unsigned char ch = str[i];
+		if (ch >= 0x20 && ch != '"' && ch != '\\' && ch != 127) continue;
+
+		dynastring_appendn(out, str + start, i - start);
+		start = i + 1;
+
+		switch (ch) {
+			case '"': dynastring_appendstring(out, "\\\""); break;
+			case '\\': dynastring_appendstring(out, "\\\\"); break;
+			case '\n': dynastring_appendstring(out, "\\n"); break;
+			case '\r': dynastring_appendstring(out, "\\r"); break;
+			case '\t': dynastring_appendstring(out, "\\t"); break;
+			default: {
+				char escape[7];
+				snprintf(escape, sizeof(escape), "\\u%04x", ch);
+				dynastring_appendstring(out, escape);
+			}
+		}
+	}
+	dynastring_appendn(out, str + start, length - start);
+
+	dynastring_appendchar(out, '"');
+} // telnet_unix_json_append
+
+/**
+ * Append collected telnet output to JSON output as array of lines, and
+ * clear it.
+ * @param out Output string
+ * @param output Collected telnet output
+ */
+static void telnet_unix_json_lines(string out, string output) {
+	const char *str = dynastring_getstring(output);
+	size_t length = dynastring_getlength(output);
+
+	dynastring_appendchar(out, '[');
+
+	size_t start = 0;
+	bool first = true;
+	while (start < length) {
+		const char *eol = memchr(str + start, '\n', length - start);
+		size_t end = (eol != NULL) ? (size_t)(eol - str) : length;
+		size_t next = end + 1;
+
+		// Lines are terminated by CRLF.
+		if (end > start && str[end - 1] == '\r') end--;
+
+		if (!first) dynastring_appendchar(out, ',');
+		telnet_unix_json_append(out, str + start, end - start);
+		first = false;
+
+		start = next;
+	}
+
+	dynastring_appendchar(out, ']');
+	dynastring_clear(output);
+} // telnet_unix_json_lines
+
+/**
+ * Send one response line to client.
+ * @param data Client data
+ * @param out Response without line ending
+ */
+static void telnet_unix_respond(TelnetUnixData data, string out) {
+	dynastring_appendchar(out, '\n');
+
+	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
+	socketpool_send(info->socketpool, data->socketfd,
+		dynastring_getstring(out), dynastring_getlength(out));
+} // telnet_unix_respond
+
+/**
+ * Execute one command and append it's result object to response.
+ * @param data Client data
+ * @param out Response
+ * @param command Command to execute
+ * @param ok Set to false if command fails.
+ * @return False if client has been disconnected by the command.
+ */
+static bool telnet_unix_execute(TelnetUnixData data, string out,
+	const char *command, bool *ok) {
+
+	data->executing = true;
+	telnet_interactive_cancel(data->client);
+	Telnet_ExecResult result = telnet_execute(data->client, command);
+	if (receivingClosed) return false;
+	data->executing = false;
+
+	switch (result) {
+		case TE_HANDLED:
+			dynastring_appendstring(out, "\"ok\":true,\"output\":");
+			break;
+
+		case TE_BUSY:
+			*ok = false;
+			dynastring_appendstring(out, "\"ok\":false,\"error\":"
+				"\"Client is busy.\",\"output\":");
+			break;
+
+		default:
+			*ok = false;
+			dynastring_appendstring(out, "\"ok\":false,\"output\":");
+	}
+	telnet_unix_json_lines(out, data->output);
+
+	return true;
+} // telnet_unix_execute
+
+/**
+ * Process one request line received from client and send response.
+ * @param data Client data
+ * @param line Request line
+ * @return False if client has been disconnected while processing the
+ *   request.
+ */
+static bool telnet_unix_request(TelnetUnixData data, const char *line) {
+	TelnetUnixRequest request;
+	const char *error = telnet_unix_request_parse(line, &request);
+
+	string out = dynastring_init();
+	dynastring_appendstring(out, "{\"id\":");
+	dynastring_appendstring(out, (request.id != NULL) ? request.id : "null");
+	dynastring_appendchar(out, ',');
+
+	if (error != NULL) {
+		dynastring_appendstring(out, "\"ok\":false,\"error\":");
+		telnet_unix_json_append(out, error, strlen(error));
+	} else if (!request.isBatch) {
+		bool ok = true;
+		if (!telnet_unix_execute(data, out, request.command, &ok)) {
+			telnet_unix_request_free(&request);
+			dynastring_free(out);
+			return false;
+		}
+	} else {
+		// Result of batch is known after all commands are executed, so
+		// results are collected separately.
+		string results = dynastring_init();
+		bool ok = true;
+
+		telnet_batch_begin(data->client);
+		for (size_t i = 0; i < request.batchCount; i++) {
+			dynastring_appendstring(results, (i == 0) ? "{" : ",{");
+			if (!telnet_unix_execute(data, results, request.batch[i], &ok)) {
+				dynastring_free(results);
+				telnet_unix_request_free(&request);
+				dynastring_free(out);
+				return false;
+			}
+			dynastring_appendchar(results, '}');
+		}
+
+		// Output of batch end, for example errors of saving changes.
+		data->executing = true;
+		telnet_batch_end(data->client);
+		data->executing = false;
+
+		dynastring_appendstring(out, ok ? "\"ok\":true" : "\"ok\":false");
+		dynastring_appendstring(out, ",\"results\":[");
+		dynastring_append(out, results);
+		dynastring_appendstring(out, "],\"output\":");
+		telnet_unix_json_lines(out, data->output);
+		dynastring_free(results);
+	}
+
+	dynastring_appendchar(out, '}');
+	telnet_unix_respond(data, out);
+
+	dynastring_free(out);
+	telnet_unix_request_free(&request);
+	return true;
+} // telnet_unix_request
+
+/**
+ * Collect output of telnet client (telnet plugin callback). Output that is
+ * not response to request is sent to client as message event.
+ * @param client Telnet client connected using unix socket
+ * @param buffer Data buffer
+ * @param buffersize Data buffer size
+ */
+void telnet_unix_send(TelnetClient client, void *buffer, size_t buffersize) {
+	TelnetUnixData data = (TelnetUnixData)client->socketdata;
+	dynastring_appendn(data->output, buffer, buffersize);
+
+	if (!data->executing) {
+		string out = dynastring_init();
+		dynastring_appendstring(out, "{\"event\":\"message\",\"output\":");
+		telnet_unix_json_lines(out, data->output);
+		dynastring_appendchar(out, '}');
+		telnet_unix_respond(data, out);
+		dynastring_free(out);
+	}
+} // telnet_unix_send
+
+/**
+ * Perform action on client's terminal. Control socket has no terminal, so
+ * no action is supported.
+ */
+bool telnet_unix_action(TelnetClient client, Telnet_Action action,
+	int param1, int param2) {
+
+	(void)client;
+	(void)action;
+	(void)param1;
+	(void)param2;
+
+	return false;
+} // telnet_unix_action
+
+/**
+ * Free client data.
+ * @param data Client data
+ */
+static void telnet_unix_free(TelnetUnixData data) {
+	dynastring_free(data->recvbuffer);
+	dynastring_free(data->output);
+	free(data);
+} // telnet_unix_free
+
+/**
+ * Disconnect telnet client.
+ * @param client Telnet client
+ */
+void telnet_unix_disconnect(TelnetClient client) {
+	PluginInfo *info = plugins_getinfo(PLUGIN_NAME);
+	if (info != NULL) {
+		TelnetUnixDriverPluginData *plugData =
+			(TelnetUnixDriverPluginData *)info->customData;
+
+		TelnetUnixData data = (TelnetUnixData)client->socketdata;
+
+		// Remove data handlers from socket - don't receive any data anymore,
+		// and close it when remaining responses are sent.
+		socketpool_add(info->socketpool, data->socketfd,
+			NULL, NULL, NULL, NULL);
+		socketpool_close(info->socketpool, data->socketfd);
+
+		// Remove client from chain
+		if (data->prev != NULL) {
+			data->prev->next = data->next;
+		} else {
+			plugData->firstClient = data->next;
+		}
+		if (data->next != NULL) {
+			data->next->prev = data->prev;
+		} else {
+			plugData->lastClient = data->prev;
+		}
+
+		// Client is disconnected while it's data are being processed, data
+		// are freed when processing ends.
+		if (data == receivingData) {
+			receivingClosed = true;
+		} else {
+			telnet_unix_free(data);
+		}
+	}
+} // telnet_unix_disconnect
+
+/**
+ * Socketpool callback indicating that client sent some data that we need
+ * to receive.
+ * @param socket Socketpool socket
+ */
+void telnet_unix_client_receive(Socket socket) {
+	char buffer[TU_RECV_BUFFER];
+
+	TelnetClient client = (TelnetClient)socket->customData;
+	TelnetUnixData data = (TelnetUnixData)client->socketdata;
+
+	ssize_t length = read(data->socketfd, buffer, sizeof(buffer));
+	if (length < 0 && (errno == EAGAIN || errno == EINTR)) return;
+	if (length <= 0) {
+		telnet_disconnect(client);
+		return;
+	}
+
+	dynastring_appendn(data->recvbuffer, buffer, length);
+
+	receivingData = data;
+	receivingClosed = false;
+
+	// Process all complete lines
+	char *str = dynastring_getstring(data->recvbuffer);
+	size_t total = dynastring_getlength(data->recvbuffer);
+	size_t start = 0;
+	char *eol;
+	while (!receivingClosed &&
+		(eol = memchr(str + start, '\n', total - start)) != NULL) {
+
+		*eol = '\0';
+		if (eol > str + start && eol[-1] == '\r') eol[-1] = '\0';
+
+		if (str[start] != '\0') {
+			telnet_unix_request(data, str + start);
+		}
+
+		start = eol - str + 1;
+	}
+
+	receivingData = NULL;
+	if (receivingClosed) {
+		telnet_unix_free(data);
+		return;
+	}
+
+	// Keep only incomplete line
+	dynastring_seek(data->recvbuffer, start, SEEK_SET);
+	dynastring_delete(data->recvbuffer, -(int)start);
+	dynastring_seek(data->recvbuffer, 0, SEEK_END);
+
+	if (dynastring_getlength(data->recvbuffer) > TU_MAX_LINE) {
+		printError(PLUGIN_NAME, "Client has sent too long request.");
+		telnet_disconnect(client);
+	}
+} // telnet_unix_client_receive
+
+/**
+ * Socketpool callback indicating that server has client that wants to be
+ * connected.
+ * @param socket Socketpool socket
+ */
+void telnet_unix_accept_client(Socket socket) {
+	TelnetUnixDriverPluginData *plugData =
+		(TelnetUnixDriverPluginData *)socket->customData;
+
+	int fd = accept(socket->socketfd, NULL, NULL);
+	if (fd < 0) {
+		printError(PLUGIN_NAME, "Failed to accept new client: %s",
+			strerror(errno));
+		return;
+	}
+
+	// Sets client socket to non-blocking mode to prevent stuck in
+	// receive function.
+	int opts = fcntl(fd, F_GETFL);
+	if (opts >= 0) {
+		fcntl(fd, F_SETFL, opts | O_NONBLOCK);
+	}
+
+	TelnetUnixData data = malloc(sizeof(struct sTelnetUnixData));
+	data->socketfd = fd;
+	data->recvbuffer = dynastring_init();
+	data->output = dynastring_init();
+	data->client = NULL;
+
+	// Welcome message is not response to any request.
+	data->executing = true;
+
+	socketpool_add(plugData->info->socketpool, fd, NULL, NULL, NULL, NULL);
+
+	TelnetClient client = telnet_add_client_as(data, telnet_unix_send,
+		telnet_unix_action, telnet_unix_disconnect,
+		config_getvalue_string(plugData->info->config, PLUGIN_NAME":user",
+			"admin"));
+
+	if (client == NULL) {
+		socketpool_close(plugData->info->socketpool, fd);
+		telnet_unix_free(data);
+		printError(PLUGIN_NAME, "Telnet has refused our client.");
+		return;
+	}
+
+	data->client = client;
+	kvp_set(client->kvp, "driver", htval_string("unix"));
+	client->opts = TC_NOPROMPT;
+
+	dynastring_clear(data->output);
+	data->executing = false;
+
+	socketpool_add(plugData->info->socketpool, fd,
+		telnet_unix_client_receive, NULL, NULL, client);
+
+	// Add client to linked list of clients
+	data->next = NULL;
+	data->prev = plugData->lastClient;
+	plugData->lastClient = data;
+
+	if (data->prev != NULL) {
+		data->prev->next = data;
+	} else {
+		plugData->firstClient = data;
+	}
+
+	printError(PLUGIN_NAME, "New client connected to control socket.");
+} // telnet_unix_accept_client
+
+/**
+ * Initialize plugin.
+ * @param info Plugin info, where this function must fill in some informations
+ */
+void PluginInit(PluginInfo *info) {
+	info->name = "Telnet unix socket driver";
+	info->author = "Niximor";
+	info->version = "1.0.0";
+
+	TelnetUnixDriverPluginData *plugData =
+		malloc(sizeof(TelnetUnixDriverPluginData));
+
+	plugData->info = info;
+	info->customData = plugData;
+
+	plugData->lastClient = NULL;
+	plugData->firstClient = NULL;
+	plugData->path = strdup(config_getvalue_string(info->config,
+		PLUGIN_NAME":path", "./prebot.sock"));
+
+	// Start server
+	plugData->serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (plugData->serverSocket < 0) {
+		printError(PLUGIN_NAME, "Unable to create socket: %s",
+			strerror(errno));
+		return;
+	}
+
+	struct sockaddr_un bindAddress = {
+		.sun_family = AF_UNIX
+	};
+	if (strlen(plugData->path) >= sizeof(bindAddress.sun_path)) {
+		printError(PLUGIN_NAME, "Socket path %s is too long.", plugData->path);
+		close(plugData->serverSocket);
+		plugData->serverSocket = -1;
+		return;
+	}
+	strcpy(bindAddress.sun_path, plugData->path);
+
+	// Remove stale socket left by previous run. Socket nobody listens on
+	// refuses connection, anything else means it belongs to a running
+	// instance, which must keep it.
+	struct stat st;
+	if (lstat(plugData->path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		bool stale = (probe >= 0 && connect(probe,
+			(struct sockaddr *)&bindAddress, sizeof(bindAddress)) < 0 &&
+			errno == ECONNREFUSED);
+		if (probe >= 0) close(probe);
+
+		if (!stale) {
+			printError(PLUGIN_NAME, "Socket %s is in use by another "
+				"instance.", plugData->path);
+			close(plugData->serverSocket);
+			plugData->serverSocket = -1;
+			return;
+		}
+		unlink(plugData->path);
+	}
+
+	// Only owner of the bot is allowed to connect.
+	mode_t mask = umask(0077);
+	int bound = bind(plugData->serverSocket,
+		(struct sockaddr *)&bindAddress, sizeof(bindAddress));
+	umask(mask);
+
+	if (bound < 0) {
+		printError(PLUGIN_NAME, "Unable to bind socket to %s: %s",
+			plugData->path, strerror(errno));
+		close(plugData->serverSocket);
+		plugData->serverSocket = -1;
+		return;
+	}
+
+	if (listen(plugData->serverSocket, 10) < 0) {
+		printError(PLUGIN_NAME, "Unable to start listening: %s",
+			strerror(errno));
+		close(plugData->serverSocket);
+		plugData->serverSocket = -1;
+		return;
+	}
+
+	socketpool_add(info->socketpool, plugData->serverSocket,
+		telnet_unix_accept_client, NULL, NULL, plugData);
+	printError(PLUGIN_NAME, "Server startup successful. Listening on %s",
+		plugData->path);
+} // PluginInit
+
+/**
+ * Close plugin
+ * @param info Plugin info, which this function may use to get some
+ *   informations it may need.
+ */
+void PluginDone(PluginInfo *info) {
+	TelnetUnixDriverPluginData *plugData =
+		(TelnetUnixDriverPluginData *)info->customData;
+
+	// Close server socket
+	if (plugData->serverSocket >= 0) {
+		socketpool_close(plugData->info->socketpool, plugData->serverSocket);
+		unlink(plugData->path);
+	}
+
+	// Close client's sockets.
+	TelnetUnixData data = plugData->firstClient;
+	TelnetUnixData next;
+	while (data != NULL) {
+		next = data->next;
+		telnet_disconnect(data->client);
+		data = next;
+	}
+
+	free(plugData->path);
+	free(plugData);
+} // PluginDone
+
+/**
+ * Get list of dependencies
+ * @param deps Dependencies
+ */
+void PluginDeps(char **deps) {
+	*deps = "telnet"; // Depends on telnet
+} // PluginDeps
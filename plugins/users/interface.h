@@ -25,11 +25,16 @@
 #include <stdbool.h>
 #include <events.h>
 #include <config/config.h>
+#include <timers.h>
+#include <toolbox/wildcard.h>
 #include "../telnet/interface.h"
 
 // Forward
 typedef struct sUsersList *UsersList;
 typedef struct sUsersListUser *UsersListUser;
+typedef struct sUsersHostMask *UsersHostMask;
+typedef struct sUsersHostIndex *UsersHostIndex;
+typedef struct sUsersPrivs *UsersPrivs;
 
 /**
  * Users plugin data
@@ -40,8 +45,73 @@ typedef struct {
 	EVENT_HANDLER *ontelnetcmd;	/**< Event handler */
 	EVENT_HANDLER *ontelnetconnected; /**< Event handler */
 	EVENT_HANDLER *onjoin;		/**< Event handler */
+	EVENT_HANDLER *ontelnetbatchbegin; /**< Event handler */
+	EVENT_HANDLER *ontelnetbatchend; /**< Event handler */
+	Timer saveTimer;			/**< Pending save of users database, NULL if
+									 there is none. */
+	unsigned int batch;			/**< Number of running telnet command
+									 batches */
+	bool savePending;			/**< Database has been changed during batch
+									 and must be saved when it ends. */
 } UsersPluginData;
 
+/**
+ * Compiled host mask of one user in host index.
+ */
+struct sUsersHostMask {
+	CONF_SECTION *user;			/**< User's entry in users db */
+	Wildcard pattern;			/**< Compiled host mask */
+	UsersHostMask next;			/**< Next mask in the same bucket */
+};
+
+/**
+ * Host masks of one user in host index.
+ */
+typedef struct {
+	CONF_SECTION *user;			/**< User's entry in users db */
+	size_t masksCount;			/**< Number of user's host masks */
+	struct sUsersHostMask *masks; /**< Array of user's host masks */
+} USERS_HOSTINDEX_USER;
+
+/**
+ * Index of host masks of all users. Masks are bucketed by their literal
+ * suffix or prefix, so matching a host only tests masks that can possibly
+ * match it.
+ */
+struct sUsersHostIndex {
+	CONF_SECTION *usersdb;		/**< Indexed users database */
+	unsigned long generation;	/**< Generation of usersdb when index was
+									 last updated. */
+	size_t usersCount;			/**< Number of indexed users */
+	USERS_HOSTINDEX_USER *users; /**< Indexed users, sorted by address of
+									 their entry. */
+	size_t bucketsCount;		/**< Number of buckets, power of two */
+	UsersHostMask *suffixBuckets; /**< Masks ending with literal text */
+	UsersHostMask *prefixBuckets; /**< Masks starting with literal text */
+	UsersHostMask generic;		/**< Masks without usable literal part */
+};
+
+/**
+ * Resolved privilege value.
+ */
+typedef struct {
+	const char *name;			/**< Privilege name, points to users db */
+	int value;					/**< Privilege value */
+} USERS_PRIV;
+
+/**
+ * Privileges of one user in one channel, with channel specific values
+ * already overriding global ones. Stored in privileges cache.
+ */
+struct sUsersPrivs {
+	CONF_SECTION *user;			/**< User's entry in users db */
+	char *channel;				/**< Channel name, NULL for global
+									 privileges only. */
+	size_t count;				/**< Number of privileges */
+	USERS_PRIV *privs;			/**< Array of privileges */
+	UsersPrivs next;			/**< Next item in the same bucket */
+};
+
 /**
  * Event data for onusersdbchanged event.
  */
@@ -101,6 +171,35 @@ extern bool users_telnetloginreceive(TelnetClient client, KeyCode key);
  */
 extern void users_telnetconnected(EVENT *event);
 
+/**
+ * Save users database into it's file now.
+ * @param plugData Plugin data
+ * @return True if database has been saved.
+ */
+extern bool users_save(UsersPluginData *plugData);
+
+/**
+ * Request save of users database. Changes made within users:savedelay
+ * seconds are written together by one save. Changes made by telnet command
+ * batch are saved once when the batch ends.
+ * @param plugData Plugin data
+ * @return False if saving immediately (users:savedelay = 0) has failed,
+ *   true otherwise.
+ */
+extern bool users_schedule_save(UsersPluginData *plugData);
+
+/**
+ * Handles ontelnetbatchbegin event
+ * @param event Event data
+ */
+extern void users_telnetbatchbegin(EVENT *event);
+
+/**
+ * Handles ontelnetbatchend event, saves changes made during the batch.
+ * @param event Event data
+ */
+extern void users_telnetbatchend(EVENT *event);
+
 /**
  * Verify username and password against users database and return true if
  * username is verified, false if not.
@@ -126,6 +225,56 @@ extern bool users_match_user_host(CONF_SECTION *user, char *host);
  */
 extern UsersList users_match_host(CONF_SECTION *usersdb, char *host);
 
+/**
+ * Build host index of users database. Used by users_match_host.
+ * @param usersdb Users database
+ */
+extern void users_hostindex_init(CONF_SECTION *usersdb);
+
+/**
+ * Update host index after change of users database. Only users whose entry
+ * has been changed have their host masks compiled again.
+ */
+extern void users_hostindex_update();
+
+/**
+ * Free host index.
+ */
+extern void users_hostindex_free();
+
+/**
+ * Match host against host index and append matching users to the list, in
+ * order in which they are defined in users database.
+ * @param usersdb Users database
+ * @param host Hostname in nick!user@host form
+ * @param list List where to add matching users
+ * @return False if usersdb isn't indexed, true otherwise.
+ */
+extern bool users_hostindex_match(CONF_SECTION *usersdb, const char *host,
+	UsersList list);
+
+/**
+ * Get resolved privileges of user in channel from privileges cache. Cache is
+ * dropped when users database revision changes.
+ * @param user User's entry in users database
+ * @param channel Channel name, NULL for global privileges only
+ * @return Resolved privileges
+ */
+extern UsersPrivs users_privcache_get(CONF_SECTION *user, const char *channel);
+
+/**
+ * Find privilege in resolved privileges.
+ * @param privs Resolved privileges
+ * @param privname Name of privilege
+ * @return Privilege or NULL if user doesn't have it set.
+ */
+extern USERS_PRIV *users_privs_find(UsersPrivs privs, const char *privname);
+
+/**
+ * Free privileges cache.
+ */
+extern void users_privcache_free();
+
 /**
  * Get user's privilege value. If users list contains more than one user, it
  * scans all users in that list. The priority of privilege value is:
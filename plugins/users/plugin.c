@@ -19,6 +19,7 @@
 
 // Standard libraries
 #include <string.h>
+#include <errno.h>
 
 // Plugins API
 #include <pluginapi.h>
@@ -28,6 +29,7 @@
 
 // My libraries
 #include <irclib/irclib.h>
+#include <io.h>
 
 #ifndef PLUGIN_NAME
 # define PLUGIN_NAME "users"
@@ -59,6 +61,96 @@ void users_ircjoin(EVENT *event) {
 	free(host);
 } // users_ircjoin
 
+/**
+ * Save users database into it's file now.
+ * @param plugData Plugin data
+ * @return True if database has been saved.
+ */
+bool users_save(UsersPluginData *plugData) {
+	char *fileName = config_getvalue_string(plugData->info->config,
+		"users:dbfile", "./users.db");
+
+	if (!config_save_file(plugData->usersdb, fileName)) {
+		printError(PLUGIN_NAME, "Unable to save users database to %s: %s",
+			fileName, strerror(errno));
+		return false;
+	}
+	return true;
+} // users_save
+
+/**
+ * Timer callback that writes pending changes of users database.
+ * @param timer Timer
+ * @return Always false, the timer is one-shot.
+ */
+static bool users_save_timer(Timer timer) {
+	UsersPluginData *plugData = (UsersPluginData *)timer->customData;
+	plugData->saveTimer = NULL;
+	users_save(plugData);
+	return false;
+} // users_save_timer
+
+/**
+ * Request save of users database. Changes made within users:savedelay
+ * seconds are written together by one save. Changes made by telnet command
+ * batch are saved once when the batch ends.
+ * @param plugData Plugin data
+ * @return False if saving immediately (users:savedelay = 0) has failed,
+ *   true otherwise.
+ */
+bool users_schedule_save(UsersPluginData *plugData) {
+	if (plugData->batch > 0) {
+		plugData->savePending = true;
+		return true;
+	}
+
+	long int delay = config_getvalue_int(plugData->info->config,
+		"users:savedelay", 2);
+
+	if (delay <= 0) {
+		return users_save(plugData);
+	}
+
+	if (plugData->saveTimer == NULL) {
+		plugData->saveTimer = timers_add(TM_TIMEOUT, delay, users_save_timer,
+			plugData);
+	}
+	return true;
+} // users_schedule_save
+
+/**
+ * Handles ontelnetbatchbegin event
+ * @param event Event data
+ */
+void users_telnetbatchbegin(EVENT *event) {
+	UsersPluginData *plugData = (UsersPluginData *)event->handlerData;
+	plugData->batch++;
+} // users_telnetbatchbegin
+
+/**
+ * Handles ontelnetbatchend event, saves changes made during the batch.
+ * @param event Event data
+ */
+void users_telnetbatchend(EVENT *event) {
+	UsersPluginData *plugData = (UsersPluginData *)event->handlerData;
+	Telnet_Command *eventData = (Telnet_Command *)event->customData;
+
+	if (plugData->batch == 0 || --plugData->batch > 0) return;
+	if (!plugData->savePending) return;
+	plugData->savePending = false;
+
+	// Batch contains all changes the scheduled save would write.
+	if (plugData->saveTimer != NULL) {
+		timers_remove(plugData->saveTimer);
+		plugData->saveTimer = NULL;
+	}
+
+	if (!users_save(plugData)) {
+		telnet_send(eventData->client, "Unable to save user's database "
+			"file, changes hasn't been saved.");
+	}
+} // users_telnetbatchend
+
 /**
  * Initialize plugin.
  * @param info Plugin info, where this function must fill in some informations
@@ -70,17 +162,26 @@ void PluginInit(PluginInfo *info) {
 
 	UsersPluginData *plugData = malloc(sizeof(UsersPluginData));
 	plugData->info = info;
+	plugData->saveTimer = NULL;
+	plugData->batch = 0;
+	plugData->savePending = false;
 
-	plugData->usersdb = config_parse(
+	plugData->usersdb = config_load(
 		config_getvalue_string(info->config, "users:dbfile", "./users.db"));
 
 	if (plugData->usersdb != NULL) {
+		users_hostindex_init(plugData->usersdb);
+
 		plugData->ontelnetcmd = events_addEventListener(info->events,
 			"ontelnetcmd", users_telnetcommands, plugData);
 		plugData->ontelnetconnected = events_addEventListener(info->events,
 			"ontelnetconnected", users_telnetconnected, plugData);
 		plugData->onjoin = events_addEventListener(info->events,
 			"onjoin", users_ircjoin, plugData);
+		plugData->ontelnetbatchbegin = events_addEventListener(info->events,
+			"ontelnetbatchbegin", users_telnetbatchbegin, plugData);
+		plugData->ontelnetbatchend = events_addEventListener(info->events,
+			"ontelnetbatchend", users_telnetbatchend, plugData);
 	}
 
 	events_addEvent(info->events, "onusersdbchanged");
@@ -99,6 +200,18 @@ void PluginDone(PluginInfo *info) {
 	events_removeEventListener(plugData->ontelnetcmd);
 	events_removeEventListener(plugData->ontelnetconnected);
 	events_removeEventListener(plugData->onjoin);
+	events_removeEventListener(plugData->ontelnetbatchbegin);
+	events_removeEventListener(plugData->ontelnetbatchend);
+
+	// Write changes that are still waiting for save.
+	if (plugData->saveTimer != NULL) {
+		timers_remove(plugData->saveTimer);
+		users_save(plugData);
+	} else if (plugData->savePending) {
+		users_save(plugData);
+	}
+	users_hostindex_free();
+	users_privcache_free();
 	config_free(plugData->usersdb);
 
 	free(plugData);
@@ -0,0 +1,381 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+// Standard libraries
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// My libraries
+#include <toolbox/tb_string.h>
+#include <toolbox/wildcard.h>
+#include <toolbox/linkedlist.h>
+#include <config/config.h>
+
+// This plugin interface
+#include "interface.h"
+
+/**
+ * Lengths of literal text used as bucket key, from the longest. Mask is
+ * bucketed by the longest key it's literal suffix or prefix has, masks with
+ * shorter literal parts are tested for every host.
+ */
+static const size_t users_hostindex_keys[] = { 16, 8, 4 };
+
+/**
+ * Number of key lengths.
+ */
+#define USERS_HOSTINDEX_KEYS \
+	(sizeof(users_hostindex_keys) / sizeof(users_hostindex_keys[0]))
+
+/**
+ * Longest key length.
+ */
+#define USERS_HOSTINDEX_MAXKEY 16
+
+/**
+ * Host index of users database of this plugin.
+ */
+static UsersHostIndex hostIndex = NULL;
+
+/**
+ * Case fold character the same way as case insensitive wildcard does.
+ */
+static inline char users_hostindex_fold(char c) {
+	return (c >= 'A' && c <= 'Z')?(c + ('a' - 'A')):c;
+} // users_hostindex_fold
+
+/**
+ * Compute bucket of key.
+ * @param key Key, must be already case folded
+ * @param length Length of the key
+ * @return Bucket number
+ */
+static inline size_t users_hostindex_hash(const char *key, size_t length) {
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+	}
+	return hash & (hostIndex->bucketsCount - 1);
+} // users_hostindex_hash
+
+/**
+ * Add mask to bucket by it's literal suffix, or prefix if the suffix is too
+ * short, or to the list of generic masks if none of them is long enough.
+ * @param mask Mask to add
+ */
+static void users_hostindex_link(UsersHostMask mask) {
+	Wildcard pattern = mask->pattern;
+	UsersHostMask *bucket = &hostIndex->generic;
+
+	if (pattern->segmentsCount > 0) {
+		WILDCARD_SEGMENT *last = &pattern->segments[pattern->segmentsCount - 1];
+		WILDCARD_SEGMENT *first = &pattern->segments[0];
+
+		// Number of characters without ? at end of last segment and at
+		// start of first segment.
+		size_t suffix = 0;
+		if (!pattern->trailingStar) {
+			while (suffix < last->length &&
+				last->text[last->length - suffix - 1] != '?') suffix++;
+		}
+
+		size_t prefix = 0;
+		if (!pattern->leadingStar) {
+			while (prefix < first->length && first->text[prefix] != '?') {
+				prefix++;
+			}
+		}
+
+		for (size_t k = 0; k < USERS_HOSTINDEX_KEYS; k++) {
+			size_t key = users_hostindex_keys[k];
+			if (suffix >= key) {
+				bucket = &hostIndex->suffixBuckets[users_hostindex_hash(
+					last->text + last->length - key, key)];
+				break;
+			}
+			if (prefix >= key) {
+				bucket = &hostIndex->prefixBuckets[users_hostindex_hash(
+					first->text, key)];
+				break;
+			}
+		}
+	}
+
+	mask->next = *bucket;
+	*bucket = mask;
+} // users_hostindex_link
+
+/**
+ * Compile host masks of one user.
+ * @param item Index item to fill
+ * @param user User's entry in users database
+ */
+static void users_hostindex_compile(USERS_HOSTINDEX_USER *item,
+	CONF_SECTION *user) {
+
+	item->user = user;
+	item->masksCount = 0;
+	item->masks = NULL;
+
+	for (size_t i = 0; i < user->valuesCount; i++) {
+		if (!eq(user->values[i]->name, "host")) continue;
+
+		Wildcard pattern = wildcard_compile(
+			htval_get_string(user->values[i]->value), false);
+		if (pattern == NULL) continue;
+
+		item->masks = realloc(item->masks,
+			(item->masksCount + 1) * sizeof(struct sUsersHostMask));
+		item->masks[item->masksCount].user = user;
+		item->masks[item->masksCount].pattern = pattern;
+		item->masks[item->masksCount].next = NULL;
+		item->masksCount++;
+	}
+} // users_hostindex_compile
+
+/**
+ * Free compiled host masks of one user.
+ * @param item Index item
+ */
+static void users_hostindex_free_user(USERS_HOSTINDEX_USER *item) {
+	for (size_t i = 0; i < item->masksCount; i++) {
+		wildcard_free(item->masks[i].pattern);
+	}
+	free(item->masks);
+	item->masks = NULL;
+	item->masksCount = 0;
+} // users_hostindex_free_user
+
+/**
+ * Compare two index items by address of user's entry.
+ */
+static int users_hostindex_cmp_user(const void *a, const void *b) {
+	const USERS_HOSTINDEX_USER *ua = a;
+	const USERS_HOSTINDEX_USER *ub = b;
+	return (ua->user > ub->user) - (ua->user < ub->user);
+} // users_hostindex_cmp_user
+
+/**
+ * Rebuild the index from users database. Masks of users that weren't
+ * changed since last rebuild are reused, unless force is set.
+ * @param force Compile masks of all users again.
+ */
+static void users_hostindex_rebuild(bool force) {
+	CONF_SECTION *usersdb = hostIndex->usersdb;
+
+	size_t oldCount = hostIndex->usersCount;
+	USERS_HOSTINDEX_USER *old = hostIndex->users;
+
+	hostIndex->usersCount = usersdb->subSectionsCount;
+	hostIndex->users = malloc(hostIndex->usersCount *
+		sizeof(USERS_HOSTINDEX_USER) + 1);
+
+	size_t masksCount = 0;
+	for (size_t i = 0; i < usersdb->subSectionsCount; i++) {
+		CONF_SECTION *user = usersdb->subSections[i];
+		USERS_HOSTINDEX_USER key = { .user = user };
+		USERS_HOSTINDEX_USER *found = NULL;
+
+		if (!force && !user->changed) {
+			found = bsearch(&key, old, oldCount, sizeof(USERS_HOSTINDEX_USER),
+				users_hostindex_cmp_user);
+		}
+
+		if (found != NULL) {
+			hostIndex->users[i] = *found;
+			found->masks = NULL;
+			found->masksCount = 0;
+		} else {
+			users_hostindex_compile(&hostIndex->users[i], user);
+		}
+		masksCount += hostIndex->users[i].masksCount;
+	}
+
+	// Masks of users that were removed or changed.
+	for (size_t i = 0; i < oldCount; i++) {
+		users_hostindex_free_user(&old[i]);
+	}
+	free(old);
+
+	qsort(hostIndex->users, hostIndex->usersCount,
+		sizeof(USERS_HOSTINDEX_USER), users_hostindex_cmp_user);
+
+	// Buckets are cheap to rebuild, so link all masks again.
+	size_t buckets = 16;
+	while (buckets < masksCount * 2) buckets *= 2;
+
+	free(hostIndex->suffixBuckets);
+	free(hostIndex->prefixBuckets);
+	hostIndex->bucketsCount = buckets;
+	hostIndex->suffixBuckets = calloc(buckets, sizeof(UsersHostMask));
+	hostIndex->prefixBuckets = calloc(buckets, sizeof(UsersHostMask));
+	hostIndex->generic = NULL;
+
+	for (size_t i = 0; i < hostIndex->usersCount; i++) {
+		for (size_t m = 0; m < hostIndex->users[i].masksCount; m++) {
+			users_hostindex_link(&hostIndex->users[i].masks[m]);
+		}
+	}
+
+	hostIndex->generation = usersdb->generation;
+} // users_hostindex_rebuild
+
+/**
+ * Build host index of users database. Used by users_match_host.
+ * @param usersdb Users database
+ */
+void users_hostindex_init(CONF_SECTION *usersdb) {
+	users_hostindex_free();
+
+	hostIndex = malloc(sizeof(struct sUsersHostIndex));
+	hostIndex->usersdb = usersdb;
+	hostIndex->usersCount = 0;
+	hostIndex->users = NULL;
+	hostIndex->bucketsCount = 0;
+	hostIndex->suffixBuckets = NULL;
+	hostIndex->prefixBuckets = NULL;
+	hostIndex->generic = NULL;
+
+	users_hostindex_rebuild(true);
+} // users_hostindex_init
+
+/**
+ * Update host index after change of users database. Only users whose entry
+ * has been changed have their host masks compiled again.
+ */
+void users_hostindex_update() {
+	if (hostIndex != NULL) {
+		users_hostindex_rebuild(false);
+	}
+} // users_hostindex_update
+
+/**
+ * Free host index.
+ */
+void users_hostindex_free() {
+	if (hostIndex == NULL) return;
+
+	for (size_t i = 0; i < hostIndex->usersCount; i++) {
+		users_hostindex_free_user(&hostIndex->users[i]);
+	}
+	free(hostIndex->users);
+	free(hostIndex->suffixBuckets);
+	free(hostIndex->prefixBuckets);
+	free(hostIndex);
+	hostIndex = NULL;
+} // users_hostindex_free
+
+/**
+ * Compare two users by their position in users database.
+ */
+static int users_hostindex_cmp_order(const void *a, const void *b) {
+	const CONF_SECTION *ua = *(CONF_SECTION * const *)a;
+	const CONF_SECTION *ub = *(CONF_SECTION * const *)b;
+	return (ua->index > ub->index) - (ua->index < ub->index);
+} // users_hostindex_cmp_order
+
+/**
+ * Test all masks in bucket and remember users that match.
+ * @param mask First mask in bucket
+ * @param host Host to match
+ * @param length Length of host
+ * @param matched Array of matched users
+ * @param count Number of matched users
+ */
+static void users_hostindex_match_bucket(UsersHostMask mask, const char *host,
+	size_t length, CONF_SECTION ***matched, size_t *count) {
+
+	for (; mask != NULL; mask = mask->next) {
+		// Mask of user that already matches doesn't need to be tested.
+		bool known = false;
+		for (size_t i = 0; i < *count && !known; i++) {
+			known = ((*matched)[i] == mask->user);
+		}
+
+		if (!known && wildcard_matchn(mask->pattern, host, length)) {
+			*matched = realloc(*matched, (*count + 1) * sizeof(CONF_SECTION *));
+			(*matched)[(*count)++] = mask->user;
+		}
+	}
+} // users_hostindex_match_bucket
+
+/**
+ * Match host against host index and append matching users to the list, in
+ * order in which they are defined in users database.
+ * @param usersdb Users database
+ * @param host Hostname in nick!user@host form
+ * @param list List where to add matching users
+ * @return False if usersdb isn't indexed, true otherwise.
+ */
+bool users_hostindex_match(CONF_SECTION *usersdb, const char *host,
+	UsersList list) {
+
+	if (hostIndex == NULL || hostIndex->usersdb != usersdb) return false;
+
+	// Structure of database was changed without index being updated.
+	if (hostIndex->generation != usersdb->generation) {
+		users_hostindex_rebuild(true);
+	}
+
+	size_t length = strlen(host);
+	CONF_SECTION **matched = NULL;
+	size_t count = 0;
+
+	// Folded start and end of the host, used to compute keys.
+	char start[USERS_HOSTINDEX_MAXKEY];
+	char end[USERS_HOSTINDEX_MAXKEY];
+	size_t keyLength = (length < USERS_HOSTINDEX_MAXKEY)?length:
+		USERS_HOSTINDEX_MAXKEY;
+	for (size_t i = 0; i < keyLength; i++) {
+		start[i] = users_hostindex_fold(host[i]);
+		end[i] = users_hostindex_fold(host[length - keyLength + i]);
+	}
+
+	for (size_t k = 0; k < USERS_HOSTINDEX_KEYS; k++) {
+		size_t key = users_hostindex_keys[k];
+		if (key > length) continue;
+
+		users_hostindex_match_bucket(
+			hostIndex->suffixBuckets[users_hostindex_hash(
+				end + keyLength - key, key)],
+			host, length, &matched, &count);
+		users_hostindex_match_bucket(
+			hostIndex->prefixBuckets[users_hostindex_hash(start, key)],
+			host, length, &matched, &count);
+	}
+
+	users_hostindex_match_bucket(hostIndex->generic, host, length,
+		&matched, &count);
+
+	if (count > 1) {
+		qsort(matched, count, sizeof(CONF_SECTION *),
+			users_hostindex_cmp_order);
+	}
+	for (size_t i = 0; i < count; i++) {
+		users_add_to_list(list, matched[i]);
+	}
+	free(matched);
+
+	return true;
+} // users_hostindex_match
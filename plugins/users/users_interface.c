@@ -79,6 +79,11 @@ bool users_match_user_host(CONF_SECTION *user, char *host) {
 UsersList users_match_host(CONF_SECTION *usersdb, char *host) {
 	UsersList result = users_init_list();
 
+	if (users_hostindex_match(usersdb, host, result)) {
+		return result;
+	}
+
+	// Database isn't indexed, test all users.
 	for (size_t i = 0; i < usersdb->subSectionsCount; i++) {
 		if (users_match_user_host(usersdb->subSections[i], host)) {
 			users_add_to_list(result, usersdb->subSections[i]);
@@ -105,29 +110,15 @@ int users_get_priv(UsersList list, char *section, char *privname) {
 	int privValue = 0;
 	if (list == NULL) return privValue;
 
-	char *globalname = NULL;
-	char *sectionname = NULL;
-	asprintf(&globalname, "privileges:%s", privname);
-	if (section != NULL) {
-		asprintf(&sectionname, "privileges:%s:%s", section, privname);
-	}
-
 	ll_loop(list, user) {
-		// First, try user's section privilege, if exists, use it, otherwise
-		// try global value.
-		if (sectionname != NULL && config_lookup(user->user, sectionname, false)) {
-			privValue = config_getvalue_int(user->user, sectionname, 0);
-		} else if (config_lookup(user->user, globalname, false)) {
-			privValue = config_getvalue_int(user->user, globalname, 0);
+		// Resolved privileges already prefer user's section privilege over
+		// global value.
+		UsersPrivs privs = users_privcache_get(user->user, section);
+		USERS_PRIV *priv = users_privs_find(privs, privname);
+		if (priv != NULL) {
+			privValue = priv->value;
 		}
 	}
 
-	if (globalname) {
-		free(globalname);
-	}
-	if (sectionname) {
-		free(sectionname);
-	}
-
 	return privValue;
 } // users_get_priv
@@ -0,0 +1,195 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+// Standard libraries
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// My libraries
+#include <config/config.h>
+
+// This plugin interface
+#include "interface.h"
+
+/**
+ * Number of buckets of privileges cache.
+ */
+#define USERS_PRIVCACHE_BUCKETS 256
+
+/**
+ * Maximum number of cached items, whole cache is dropped when it is
+ * reached.
+ */
+#define USERS_PRIVCACHE_MAX 4096
+
+/**
+ * Cache of resolved privileges.
+ */
+static struct {
+	CONF_SECTION *usersdb;		/**< Users db of cached users */
+	unsigned long revision;		/**< Revision of usersdb when cache has been
+									 filled. */
+	size_t count;				/**< Number of cached items */
+	UsersPrivs buckets[USERS_PRIVCACHE_BUCKETS]; /**< Cached items */
+} privCache;
+
+/**
+ * Compute bucket for user and channel.
+ */
+static size_t users_privcache_hash(CONF_SECTION *user, const char *channel) {
+	size_t hash = 2166136261u ^ (size_t)user;
+	if (channel != NULL) {
+		for (const char *c = channel; *c != '\0'; c++) {
+			hash = (hash ^ (unsigned char)*c) * 16777619u;
+		}
+	}
+	return (hash ^ (hash >> 16)) % USERS_PRIVCACHE_BUCKETS;
+} // users_privcache_hash
+
+/**
+ * Drop all cached items.
+ */
+static void users_privcache_clear() {
+	for (size_t i = 0; i < USERS_PRIVCACHE_BUCKETS; i++) {
+		UsersPrivs item = privCache.buckets[i];
+		while (item != NULL) {
+			UsersPrivs next = item->next;
+			free(item->channel);
+			free(item->privs);
+			free(item);
+			item = next;
+		}
+		privCache.buckets[i] = NULL;
+	}
+	privCache.count = 0;
+} // users_privcache_clear
+
+/**
+ * Add values of privileges section to resolved privileges, replacing
+ * privileges that are already there.
+ * @param privs Resolved privileges
+ * @param section Privileges section, may be NULL
+ */
+static void users_privs_add(UsersPrivs privs, CONF_SECTION *section) {
+	if (section == NULL) return;
+
+	for (size_t i = 0; i < section->valuesCount; i++) {
+		CONF_VALUE *value = section->values[i];
+
+		// Only first value of the name is found by lookup.
+		bool first = true;
+		for (size_t j = 0; j < i && first; j++) {
+			first = (strcmp(section->values[j]->name, value->name) != 0);
+		}
+		if (!first) continue;
+
+		USERS_PRIV *priv = users_privs_find(privs, value->name);
+		if (priv == NULL) {
+			privs->privs = realloc(privs->privs,
+				(privs->count + 1) * sizeof(USERS_PRIV));
+			priv = &privs->privs[privs->count++];
+			priv->name = value->name;
+		}
+		priv->value = htval_get_int(value->value);
+	}
+} // users_privs_add
+
+/**
+ * Get resolved privileges of user in channel from privileges cache. Cache is
+ * dropped when users database revision changes.
+ * @param user User's entry in users database
+ * @param channel Channel name, NULL for global privileges only
+ * @return Resolved privileges
+ */
+UsersPrivs users_privcache_get(CONF_SECTION *user, const char *channel) {
+	CONF_SECTION *usersdb = (user->parent != NULL)?user->parent:user;
+
+	if (privCache.usersdb != usersdb ||
+		privCache.revision != usersdb->revision ||
+		privCache.count >= USERS_PRIVCACHE_MAX) {
+
+		users_privcache_clear();
+		privCache.usersdb = usersdb;
+		privCache.revision = usersdb->revision;
+	}
+
+	size_t bucket = users_privcache_hash(user, channel);
+	for (UsersPrivs item = privCache.buckets[bucket]; item != NULL;
+		item = item->next) {
+
+		if (item->user == user && (item->channel == channel ||
+			(item->channel != NULL && channel != NULL &&
+				strcmp(item->channel, channel) == 0))) {
+
+			return item;
+		}
+	}
+
+	UsersPrivs item = malloc(sizeof(struct sUsersPrivs));
+	item->user = user;
+	item->channel = (channel != NULL)?strdup(channel):NULL;
+	item->count = 0;
+	item->privs = NULL;
+
+	// Global privileges first, channel specific ones replace them.
+	CONF_SECTION *privileges = config_lookup_section(user, "privileges",
+		false);
+	if (privileges != NULL) {
+		users_privs_add(item, privileges);
+		if (channel != NULL) {
+			users_privs_add(item, config_lookup_section(privileges,
+				(char *)channel, false));
+		}
+	}
+
+	item->next = privCache.buckets[bucket];
+	privCache.buckets[bucket] = item;
+	privCache.count++;
+
+	return item;
+} // users_privcache_get
+
+/**
+ * Find privilege in resolved privileges.
+ * @param privs Resolved privileges
+ * @param privname Name of privilege
+ * @return Privilege or NULL if user doesn't have it set.
+ */
+USERS_PRIV *users_privs_find(UsersPrivs privs, const char *privname) {
+	for (size_t i = 0; i < privs->count; i++) {
+		if (strcmp(privs->privs[i].name, privname) == 0) {
+			return &privs->privs[i];
+		}
+	}
+	return NULL;
+} // users_privs_find
+
+/**
+ * Free privileges cache.
+ */
+void users_privcache_free() {
+	users_privcache_clear();
+	privCache.usersdb = NULL;
+	privCache.revision = 0;
+} // users_privcache_free
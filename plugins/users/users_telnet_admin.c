@@ -47,6 +47,7 @@ void users_telnetcommands(EVENT *event) {
 	CONF_SECTION *usersdb = plugData->usersdb;
 
 	if (eq(command->command, "users") || eq(command->command, "user")) {
+		unsigned long revision = usersdb->revision;
 		TOKENS tok = tokenizer_tokenize(command->params, ' ');
 		char *subcommand = tokenizer_gettok(tok, 0);
 
@@ -217,14 +218,13 @@ void users_telnetcommands(EVENT *event) {
 				if (config_validate_section(name)) {
 					char *newname = tokenizer_gettok(tok, 2);
 
-					if (config_validate_section(name)) {
+					if (config_validate_section(newname)) {
 						CONF_SECTION *user = config_lookup_section(usersdb,
 							name, false);
 
 						// User found, rename.
 						if (user != NULL) {
-							free(user->name);
-							user->name = strdup(newname);
+							config_rename_section(user, newname);
 							telnet_send(client, "User '%s' has been renamed "
 								"to '%s'.", name, newname);
 						} else {
@@ -261,6 +261,8 @@ void users_telnetcommands(EVENT *event) {
 
 							temp->index++;
 							usersdb->subSections[i-1]->index--;
+							config_structure_changed(usersdb);
+							config_set_changed(usersdb);
 
 							telnet_send(client, "User '%s' has been moved.",
 								name);
@@ -299,6 +301,8 @@ void users_telnetcommands(EVENT *event) {
 
 							temp->index--;
 							usersdb->subSections[i+1]->index++;
+							config_structure_changed(usersdb);
+							config_set_changed(usersdb);
 
 
 							telnet_send(client, "User '%s' has been moved.");
@@ -594,9 +598,13 @@ void users_telnetcommands(EVENT *event) {
 
 		_users_telnet_handled:
 
-		// Fire users db changed event and save the database if the event was
-		// not canceled.
-		if (usersdb->changed) {
+		// Update host index, fire users db changed event and save the
+		// database if the event was not canceled. Changed flag stays set
+		// until delayed save is done, so only revision tells whether this
+		// command has changed something.
+		if (usersdb->revision != revision) {
+			users_hostindex_update();
+
 			Users_DbChangedEvent evt = {
 				.usersdb = usersdb
 			};
@@ -604,13 +612,8 @@ void users_telnetcommands(EVENT *event) {
 			if (events_fireEvent(plugData->info->events,
 				"onusersdbchanged", &evt)) {
 
-				FILE *f = fopen(config_getvalue_string(plugData->info->config,
-					"users:dbfile", "./users.db"), "w");
-				if (f) {
-					config_save(usersdb, f);
-					fclose(f);
-				} else {
-					telnet_send(client, "Unable to open user's database file, "
+				if (!users_schedule_save(plugData)) {
+					telnet_send(client, "Unable to save user's database file, "
 						"changes hasn't been saved.");
 				}
 			}
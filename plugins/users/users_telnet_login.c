@@ -34,12 +34,32 @@
 #include <config/config.h>
 #include <htable/keyvalpair.h>
 
+/**
+ * Free login data of client.
+ * @param client Telnet client
+ */
+static void users_telnetlogin_free(TelnetClient client) {
+	Users_TelnetLoginData *loginData =
+		(Users_TelnetLoginData *)client->interactiveData;
+	if (loginData == NULL) return;
+
+	free(loginData->login);
+	free(loginData->password);
+	free(loginData);
+	client->interactiveData = NULL;
+} // users_telnetlogin_free
+
 /**
  * Process telnet password
  * @param client Client that sent key
  * @param key Key code
  */
 bool users_telnetpasswreceive(TelnetClient client, KeyCode key) {
+	if (key == KEY_CANCEL) {
+		users_telnetlogin_free(client);
+		return true;
+	}
+
 	if (key == KEY_ENTER) {
 		client->send(client, "\r\n", 2);
 
@@ -55,19 +75,12 @@ bool users_telnetpasswreceive(TelnetClient client, KeyCode key) {
 			// ToDo: Check user's telnet privilege
 
 			kvp_set(client->kvp, "user", htval_string(loginData->login));
-
-			free(loginData->login);
-			free(loginData->password);
-			free(loginData);
-			client->interactiveData = NULL;
+			users_telnetlogin_free(client);
 
 			// If username and password is valid...
 			telnet_motd(client);
 		} else {
-			free(loginData->login);
-			free(loginData->password);
-			free(loginData);
-			client->interactiveData = NULL;
+			users_telnetlogin_free(client);
 
 			// ...and Invalid
 			telnet_send(client, "Unknown username or password. Bye.");
@@ -86,6 +99,11 @@ bool users_telnetpasswreceive(TelnetClient client, KeyCode key) {
  * @param key Key code
  */
 bool users_telnetloginreceive(TelnetClient client, KeyCode key) {
+	if (key == KEY_CANCEL) {
+		users_telnetlogin_free(client);
+		return true;
+	}
+
 	if (key == KEY_ENTER) {
 		client->dataCallback = users_telnetpasswreceive;
 		Users_TelnetLoginData *loginData =
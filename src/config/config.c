@@ -22,6 +22,9 @@
 #include <string.h>
 #include <stdbool.h>
 
+// Linux libraries
+#include <sys/mman.h>
+
 // This library interface
 #include "config.h"
 
@@ -38,8 +41,17 @@ const char *config_identifierAllowed =
  * @return Created section
  */
 CONF_SECTION *config_new_section(char *name) {
+	return config_new_section_name(strdup(name));
+} // config_new_section
+
+/**
+ * Create new configuration section without copying it's name.
+ * @param name Section name, either allocated by malloc or stored in arena.
+ * @return Created section
+ */
+CONF_SECTION *config_new_section_name(char *name) {
 	CONF_SECTION *section = malloc(sizeof(CONF_SECTION));
-	section->name = strdup(name);
+	section->name = name;
 	section->parent = NULL;
 	section->index = 0;
 	section->changed = false;
@@ -49,9 +61,17 @@ CONF_SECTION *config_new_section(char *name) {
 	section->valuesCount = 0;
 	section->valuesAllocated = 0;
 	section->values = NULL;
+	section->nameIndex = NULL;
+	section->pathCache = NULL;
+	section->generation = 0;
+	section->revision = 0;
+	section->arena = NULL;
+	section->sourceOffset = 0;
+	section->sourceLength = 0;
+	section->source = NULL;
 
 	return section;
-} // config_new_section
+} // config_new_section_name
 
 /**
  * Create new value
@@ -59,14 +79,36 @@ CONF_SECTION *config_new_section(char *name) {
  * @return Created section
  */
 CONF_VALUE *config_new_value(char *name) {
+	return config_new_value_name(strdup(name));
+} // config_new_value
+
+/**
+ * Create new value without copying it's name.
+ * @param name Value name, either allocated by malloc or stored in arena.
+ * @return Created value
+ */
+CONF_VALUE *config_new_value_name(char *name) {
 	CONF_VALUE *value = malloc(sizeof(CONF_VALUE));
-	value->name = strdup(name);
+	value->name = name;
 	value->value = htval_null();
 	value->section = NULL;
 	value->index = 0;
 
 	return value;
-} // config_new_value
+} // config_new_value_name
+
+/**
+ * Free name of section or value, unless it is stored in tree's arena.
+ * @param arena Arena of configuration tree
+ * @param name Name to free
+ */
+static void config_free_name(CONF_ARENA *arena, char *name) {
+	if (arena != NULL && name >= arena->data
+		&& name < arena->data + arena->size) {
+		return;
+	}
+	free(name);
+} // config_free_name
 
 /**
  * Insert new section into dynamic array of sections
@@ -90,9 +132,14 @@ void config_insert_section(CONF_SECTION *section, CONF_SECTION *newSection) {
 
 	newSection->parent = section;
 	newSection->index = section->subSectionsCount;
+	if (newSection->arena == NULL) {
+		newSection->arena = section->arena;
+	}
 
 	section->subSections[section->subSectionsCount] = newSection;
 	section->subSectionsCount++;
+
+	config_structure_changed(section);
 } // config_insert_section
 
 /**
@@ -120,6 +167,8 @@ void config_insert_value(CONF_SECTION *section, CONF_VALUE *value) {
 
 	section->values[section->valuesCount] = value;
 	section->valuesCount++;
+
+	config_structure_changed(section);
 } // config_insert_value
 
 /**
@@ -147,6 +196,17 @@ CONF_VALUE *config_create_value(CONF_SECTION *section, char *name) {
 	return value;
 } // config_create_section
 
+/**
+ * Free value that is not part of section's values array anymore.
+ * @param section Section the value belonged to
+ * @param value Value to free
+ */
+void config_free_value(CONF_SECTION *section, CONF_VALUE *value) {
+	config_free_name(section->arena, value->name);
+	htval_free(value->value);
+	free(value);
+} // config_free_value
+
 /**
  * Free configuration structures
  * @param config CONF_SECTION pointer
@@ -154,7 +214,7 @@ CONF_VALUE *config_create_value(CONF_SECTION *section, char *name) {
 void config_free(CONF_SECTION *config) {
 	if (config == NULL) return;
 
-	free(config->name);
+	config_free_name(config->arena, config->name);
 
 	// Free subsections
 	for (size_t i = 0; i < config->subSectionsCount; i++) {
@@ -166,14 +226,25 @@ void config_free(CONF_SECTION *config) {
 
 	// Free values
 	for (size_t i = 0; i < config->valuesCount; i++) {
-		free(config->values[i]->name);
-		htval_free(config->values[i]->value);
-		free(config->values[i]);
+		config_free_value(config, config->values[i]);
 	}
 	if (config->values != NULL) {
 		free(config->values);
 	}
 
+	config_index_free(config);
+
+	// Arena is owned by root section.
+	if (config->parent == NULL && config->arena != NULL) {
+		if (config->arena->mapped) {
+			munmap(config->arena->data, config->arena->size);
+		} else {
+			free(config->arena->data);
+		}
+		free(config->arena);
+	}
+	free(config->source);
+
 	free(config);
 } // config_free
 
@@ -247,8 +318,10 @@ void config_remove_subsection(CONF_SECTION *section, size_t index) {
 		// Make the array compact again
 		for (size_t i = index; i < section->subSectionsCount-1; i++) {
 			section->subSections[i] = section->subSections[i+1];
+			section->subSections[i]->index = i;
 		}
 		section->subSectionsCount--;
+		config_structure_changed(section);
 		config_set_changed(section);
 	}
 } // config_remove_subsection
@@ -261,15 +334,15 @@ void config_remove_subsection(CONF_SECTION *section, size_t index) {
 void config_remove_value(CONF_SECTION *section, size_t index) {
 	if (index < section->valuesCount) {
 		// Free deleted value
-		free(section->values[index]->name);
-		htval_free(section->values[index]->value);
-		free(section->values[index]);
+		config_free_value(section, section->values[index]);
 
 		// Make the array compact again
 		for (size_t i = index; i < section->valuesCount-1; i++) {
 			section->values[i] = section->values[i+1];
+			section->values[i]->index = i;
 		}
 		section->valuesCount--;
+		config_structure_changed(section);
 		config_set_changed(section);
 	}
 } // config_remove_value
@@ -290,12 +363,33 @@ bool config_remove(CONF_SECTION *config, char *path) {
 } // config_remove
 
 /**
- * Set changed flag. Also set flag to all parent sections.
+ * Rename section. Old name is released the same way config_free releases
+ * it, so this must be used instead of writing section name directly.
+ * Name index of parent section points to the old name, so it is dropped
+ * together with path caches. Section is marked changed, so it isn't copied
+ * from source file with the old name when saved.
+ * @param section Section to rename
+ * @param name New name, which is copied.
+ */
+void config_rename_section(CONF_SECTION *section, const char *name) {
+	if (section->parent != NULL) {
+		config_structure_changed(section->parent);
+	}
+
+	config_free_name(section->arena, section->name);
+	section->name = strdup(name);
+	config_set_changed(section);
+} // config_rename_section
+
+/**
+ * Set changed flag and increment revision. Also do that for all parent
+ * sections.
  * @param section Section which change.
  */
 void config_set_changed(CONF_SECTION *section) {
-	while (section != NULL && !section->changed) {
+	while (section != NULL) {
 		section->changed = true;
+		section->revision++;
 		section = section->parent;
 	}
 } // config_set_changed
@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
 #include <htable/htval.h>
 
 /**
@@ -32,12 +34,44 @@ extern const char *config_identifierAllowed;
 // Forward
 typedef struct sCONF_SECTION CONF_SECTION;
 typedef struct sCONF_VALUE CONF_VALUE;
+typedef struct sCONF_INDEX CONF_INDEX;
+typedef struct sCONF_PATH_CACHE CONF_PATH_CACHE;
+typedef struct sCONF_ARENA CONF_ARENA;
+typedef struct sCONF_SOURCE CONF_SOURCE;
+
+/**
+ * Memory block holding names of sections and values loaded from file. Arena
+ * is shared by whole configuration tree and freed together with root
+ * section.
+ */
+struct sCONF_ARENA {
+	char *data;						/**< Arena memory */
+	size_t size;					/**< Size of arena */
+	size_t used;					/**< Number of used bytes */
+	bool mapped;					/**< Data is mapped snapshot file, not
+										 allocated memory. */
+}; // sCONF_ARENA
+
+/**
+ * Identity of file the configuration tree was last loaded from or saved
+ * into. Used to check that byte ranges of sections still describe the file
+ * on disk.
+ */
+struct sCONF_SOURCE {
+	dev_t device;					/**< Device of the file */
+	ino_t inode;					/**< Inode of the file */
+	off_t size;						/**< Size of the file */
+	struct timespec modified;		/**< Last modification time */
+}; // sCONF_SOURCE
 
 /**
  * Config value
  */
 struct sCONF_VALUE {
-	char *name;						/**< Name of value */
+	char *name;						/**< Name of value. May point into
+										 arena, which can be read-only
+										 mapped snapshot, so never write
+										 or free it directly. */
 	HTVAL value;					/**< Value of value */
 
 	CONF_SECTION *section;			/**< Section that this value belongs to */
@@ -48,7 +82,9 @@ struct sCONF_VALUE {
  * Configuration section
  */
 struct sCONF_SECTION {
-	char *name;						/**< Section name */
+	char *name;						/**< Section name. May point into
+										 arena, use config_rename_section
+										 to change it. */
 	CONF_SECTION *parent;			/**< Parent section */
 	size_t index;					/**< Index in parent section array */
 	bool changed;					/**< Identifies whether section's content
@@ -64,8 +100,81 @@ struct sCONF_SECTION {
 	size_t valuesAllocated;			/**< Number of allocated space
 										 for values */
 	CONF_VALUE **values;			/**< Array containing values */
+
+	CONF_INDEX *nameIndex;			/**< Hash index of subsection and value
+										 names, built on first lookup. */
+	CONF_PATH_CACHE *pathCache;		/**< Cache of paths resolved from this
+										 section. */
+	unsigned long generation;		/**< Incremented each time structure of
+										 this section or any of it's
+										 subsections changes. */
+	unsigned long revision;			/**< Incremented each time content of
+										 this section or any of it's
+										 subsections changes. */
+
+	CONF_ARENA *arena;				/**< Arena of the tree, NULL if tree
+										 wasn't loaded from file. */
+
+	off_t sourceOffset;				/**< Offset of section's name in
+										 source file */
+	size_t sourceLength;			/**< Length of section's text in source
+										 file, up to and including closing
+										 brace. 0 if unknown. */
+	CONF_SOURCE *source;			/**< Source file identity, only set in
+										 root section. */
 }; // sCONF_SECTION
 
+/**
+ * Item of section name index
+ */
+typedef struct {
+	const char *name;				/**< Name (points to section or value
+										 name) */
+	size_t length;					/**< Length of name */
+	CONF_SECTION *section;			/**< First subsection of that name */
+	CONF_VALUE *value;				/**< First value of that name */
+} CONF_INDEX_ITEM;
+
+/**
+ * Hash index of names in one section
+ */
+struct sCONF_INDEX {
+	size_t size;					/**< Number of slots, power of two */
+	CONF_INDEX_ITEM *items;			/**< Slots */
+}; // sCONF_INDEX
+
+/**
+ * Resolved path in path cache
+ */
+typedef struct {
+	char *path;						/**< Full path, NULL for empty slot */
+	size_t hash;					/**< Hash of path */
+	int itemIndex;					/**< Item index, -1 if index is part of
+										 path */
+	CONF_VALUE *value;				/**< Resolved value, NULL if path
+										 doesn't exist. */
+} CONF_PATH_CACHE_ITEM;
+
+/**
+ * Cache of resolved paths
+ */
+struct sCONF_PATH_CACHE {
+	unsigned long generation;		/**< Section generation the cache is
+										 valid for */
+	size_t size;					/**< Number of slots, power of two */
+	size_t count;					/**< Number of used slots */
+	CONF_PATH_CACHE_ITEM *items;	/**< Slots */
+}; // sCONF_PATH_CACHE
+
+/**
+ * List of paths changed by config_merge
+ */
+typedef struct {
+	size_t count;					/**< Number of changed paths */
+	size_t allocated;				/**< Allocated space for paths */
+	char **paths;					/**< Changed paths */
+} CONF_CHANGES;
+
 /**
  * Loads configuration from file. If error occures during parsing,
  * NULL is returned and error message is printed using printError from io
@@ -75,12 +184,48 @@ struct sCONF_SECTION {
  */
 extern CONF_SECTION *config_parse(char *fileName);
 
+/**
+ * Loads configuration from file, using it's binary snapshot (fileName.snap)
+ * when the snapshot was made from current version of the file. Otherwise the
+ * file is parsed by config_parse and new snapshot is written.
+ * @param fileName Path and name of file with configuration
+ * @return Configuration or NULL if error has occured during parsing.
+ */
+extern CONF_SECTION *config_load(char *fileName);
+
+/**
+ * Load configuration from binary snapshot of file.
+ * @param fileName Path and name of file with configuration (not of the
+ *   snapshot)
+ * @return Configuration, or NULL if there is no snapshot, it is invalid or
+ *   it was made from different version of the file.
+ */
+extern CONF_SECTION *config_snapshot_load(char *fileName);
+
+/**
+ * Write binary snapshot of configuration loaded from file. Snapshot holds
+ * whole tree including name indexes and can be mapped back into memory
+ * without parsing.
+ * @param config Root section returned by config_parse
+ * @param fileName Path and name of file with configuration (not of the
+ *   snapshot)
+ * @return True if snapshot has been written.
+ */
+extern bool config_snapshot_write(CONF_SECTION *config, char *fileName);
+
 /**
  * Free configuration structures
  * @param config CONF_SECTION pointer
  */
 extern void config_free(CONF_SECTION *config);
 
+/**
+ * Free value that is not part of section's values array anymore.
+ * @param section Section the value belonged to
+ * @param value Value to free
+ */
+extern void config_free_value(CONF_SECTION *section, CONF_VALUE *value);
+
 /**
  * Get value of configuration item as integer
  * @param config CONF_SECTION pointer
@@ -182,7 +327,8 @@ extern bool config_getvalue_array_bool(CONF_SECTION *config, char *path,
 	int num, bool notexists);
 
 /**
- * Lookup section and create path elements if create is true.
+ * Lookup section and create path elements if create is true. Empty path
+ * elements are skipped.
  * @param config Root section
  * @param path Path to section
  * @param create If set to true, create path elements if they doesn't exists.
@@ -253,6 +399,13 @@ extern CONF_VALUE *config_lookup_array(CONF_SECTION *config, char *path,
  */
 extern CONF_SECTION *config_new_section(char *name);
 
+/**
+ * Create new configuration section without copying it's name.
+ * @param name Section name, either allocated by malloc or stored in arena.
+ * @return Created section
+ */
+extern CONF_SECTION *config_new_section_name(char *name);
+
 /**
  * Create new value
  * @param name Value name
@@ -260,6 +413,13 @@ extern CONF_SECTION *config_new_section(char *name);
  */
 extern CONF_VALUE *config_new_value(char *name);
 
+/**
+ * Create new value without copying it's name.
+ * @param name Value name, either allocated by malloc or stored in arena.
+ * @return Created value
+ */
+extern CONF_VALUE *config_new_value_name(char *name);
+
 /**
  * Insert new section into dynamic array of sections
  * @param section Section to insert to.
@@ -342,6 +502,19 @@ extern void config_save_section(CONF_SECTION *section, int indent,
  */
 #define config_save(config, stream) config_save_section(config, 0, stream)
 
+/**
+ * Save configuration into file. Configuration is written into temporary
+ * file which then atomically replaces the original one, so the file is
+ * never left half written. If the file wasn't modified since it was loaded
+ * or last saved, text of unchanged sections is copied from it instead of
+ * being formatted again.
+ * @param config Root configuration section
+ * @param fileName Path to the file
+ * @return True if configuration has been saved, false on error (errno is
+ *   set).
+ */
+extern bool config_save_file(CONF_SECTION *config, char *fileName);
+
 /**
  * Validate section name.
  * @param name Name of section
@@ -372,6 +545,13 @@ extern void config_remove_subsection(CONF_SECTION *section, size_t index);
  */
 extern void config_remove_value(CONF_SECTION *section, size_t index);
 
+/**
+ * Rename section.
+ * @param section Section to rename
+ * @param name New name, which is copied.
+ */
+extern void config_rename_section(CONF_SECTION *section, const char *name);
+
 /**
  * Remove value from configuration file, specified by path to that value.
  * @param config Configuration instance
@@ -381,9 +561,90 @@ extern void config_remove_value(CONF_SECTION *section, size_t index);
 extern bool config_remove(CONF_SECTION *config, char *path);
 
 /**
- * Set changed flag. Also set flag to all parent sections.
+ * Merge newly loaded configuration into live configuration tree. Only items
+ * that differ are modified, so pointers to unchanged sections and values
+ * stay valid.
+ * @param live Live configuration
+ * @param loaded Newly loaded configuration, it's content is not modified.
+ * @param changes Paths of changed values, and of added or removed sections,
+ *   are appended here. Must be initialized to zeros.
+ */
+extern void config_merge(CONF_SECTION *live, CONF_SECTION *loaded,
+	CONF_CHANGES *changes);
+
+/**
+ * Free list of changes.
+ * @param changes List of changes
+ */
+extern void config_changes_free(CONF_CHANGES *changes);
+
+/**
+ * Set changed flag and increment revision. Also do that for all parent
+ * sections.
  * @param section Section which change.
  */
 extern void config_set_changed(CONF_SECTION *section);
 
+/**
+ * Notify that subsections or values were added to or removed from section.
+ * Drops section's name index and invalidates path caches of the section and
+ * all it's parents.
+ * @param section Section whose structure has changed.
+ */
+extern void config_structure_changed(CONF_SECTION *section);
+
+/**
+ * Find first subsection of given name using section's name index.
+ * @param section Section to look in
+ * @param name Name of subsection, doesn't need to be zero terminated.
+ * @param length Length of name
+ * @return Subsection or NULL if not found.
+ */
+extern CONF_SECTION *config_index_section(CONF_SECTION *section,
+	const char *name, size_t length);
+
+/**
+ * Find first value of given name using section's name index.
+ * @param section Section to look in
+ * @param name Name of value, doesn't need to be zero terminated.
+ * @param length Length of name
+ * @return Value or NULL if not found.
+ */
+extern CONF_VALUE *config_index_value(CONF_SECTION *section,
+	const char *name, size_t length);
+
+/**
+ * Free section's name index and path cache.
+ * @param section Configuration section
+ */
+extern void config_index_free(CONF_SECTION *section);
+
+/**
+ * Get section's name index, build it if it doesn't exist yet.
+ * @param section Configuration section
+ * @return Name index
+ */
+extern CONF_INDEX *config_index_get(CONF_SECTION *section);
+
+/**
+ * Find path in section's path cache.
+ * @param section Section where the lookup starts
+ * @param path Path to value
+ * @param itemIndex Item index, -1 if index is part of path
+ * @param value Resolved value is stored here if path is cached.
+ * @return True if path was found in cache.
+ */
+extern bool config_pathcache_get(CONF_SECTION *section, char *path,
+	int itemIndex, CONF_VALUE **value);
+
+/**
+ * Store resolved path to section's path cache.
+ * @param section Section where the lookup started
+ * @param path Path to value
+ * @param itemIndex Item index, -1 if index is part of path
+ * @param value Resolved value, NULL if path doesn't exist.
+ */
+extern void config_pathcache_set(CONF_SECTION *section, char *path,
+	int itemIndex, CONF_VALUE *value);
+
 #endif
@@ -0,0 +1,322 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Standard libraries
+#include <stdlib.h>
+#include <string.h>
+
+// This library interface
+#include "config.h"
+
+/**
+ * Maximum number of paths held in one path cache. When cache is full, it is
+ * cleared and starts over.
+ */
+#define CONFIG_PATHCACHE_MAX 1024
+
+/**
+ * Compute hash of string.
+ * @param str String, doesn't need to be zero terminated.
+ * @param length Length of string
+ * @return Hash
+ */
+static size_t config_hash(const char *str, size_t length) {
+	size_t hash = 5381;
+	for (size_t i = 0; i < length; i++) {
+		hash = ((hash << 5) + hash) + (unsigned char)str[i];
+	}
+	return hash;
+} // config_hash
+
+/**
+ * Find slot for name in name index.
+ * @param index Name index
+ * @param name Name
+ * @param length Length of name
+ * @return Slot with that name, or empty slot where the name belongs.
+ */
+static CONF_INDEX_ITEM *config_index_slot(CONF_INDEX *index, const char *name,
+	size_t length) {
+
+	size_t mask = index->size - 1;
+	size_t i = config_hash(name, length) & mask;
+
+	while (index->items[i].name != NULL) {
+		CONF_INDEX_ITEM *item = &index->items[i];
+		if (item->length == length && memcmp(item->name, name, length) == 0) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return &index->items[i];
+} // config_index_slot
+
+/**
+ * Build name index of section.
+ * @param section Configuration section
+ */
+static void config_index_build(CONF_SECTION *section) {
+	CONF_INDEX *index = malloc(sizeof(CONF_INDEX));
+
+	// Keep load factor under 1/2.
+	index->size = 8;
+	while (index->size < 2 * (section->subSectionsCount +
+		section->valuesCount)) {
+		index->size *= 2;
+	}
+	index->items = calloc(index->size, sizeof(CONF_INDEX_ITEM));
+
+	// Only the first section and value of each name is indexed, so walk
+	// arrays in order and don't overwrite existing items.
+	for (size_t i = 0; i < section->subSectionsCount; i++) {
+		CONF_SECTION *sub = section->subSections[i];
+		size_t length = strlen(sub->name);
+		CONF_INDEX_ITEM *item = config_index_slot(index, sub->name, length);
+		if (item->name == NULL) {
+			item->name = sub->name;
+			item->length = length;
+		}
+		if (item->section == NULL) {
+			item->section = sub;
+		}
+	}
+
+	for (size_t i = 0; i < section->valuesCount; i++) {
+		CONF_VALUE *value = section->values[i];
+		size_t length = strlen(value->name);
+		CONF_INDEX_ITEM *item = config_index_slot(index, value->name, length);
+		if (item->name == NULL) {
+			item->name = value->name;
+			item->length = length;
+		}
+		if (item->value == NULL) {
+			item->value = value;
+		}
+	}
+
+	section->nameIndex = index;
+} // config_index_build
+
+/**
+ * Get section's name index, build it if it doesn't exist yet.
+ * @param section Configuration section
+ * @return Name index
+ */
+CONF_INDEX *config_index_get(CONF_SECTION *section) {
+	if (section->nameIndex == NULL) {
+		config_index_build(section);
+	}
+	return section->nameIndex;
+} // config_index_get
+
+/**
+ * Find first subsection of given name using section's name index.
+ * @param section Section to look in
+ * @param name Name of subsection, doesn't need to be zero terminated.
+ * @param length Length of name
+ * @return Subsection or NULL if not found.
+ */
+CONF_SECTION *config_index_section(CONF_SECTION *section, const char *name,
+	size_t length) {
+
+	if (section->nameIndex == NULL) {
+		config_index_build(section);
+	}
+
+	return config_index_slot(section->nameIndex, name, length)->section;
+} // config_index_section
+
+/**
+ * Find first value of given name using section's name index.
+ * @param section Section to look in
+ * @param name Name of value, doesn't need to be zero terminated.
+ * @param length Length of name
+ * @return Value or NULL if not found.
+ */
+CONF_VALUE *config_index_value(CONF_SECTION *section, const char *name,
+	size_t length) {
+
+	if (section->nameIndex == NULL) {
+		config_index_build(section);
+	}
+
+	return config_index_slot(section->nameIndex, name, length)->value;
+} // config_index_value
+
+/**
+ * Remove all paths from path cache.
+ * @param cache Path cache
+ */
+static void config_pathcache_clear(CONF_PATH_CACHE *cache) {
+	for (size_t i = 0; i < cache->size; i++) {
+		if (cache->items[i].path != NULL) {
+			free(cache->items[i].path);
+			cache->items[i].path = NULL;
+		}
+	}
+	cache->count = 0;
+} // config_pathcache_clear
+
+/**
+ * Free section's name index and path cache.
+ * @param section Configuration section
+ */
+void config_index_free(CONF_SECTION *section) {
+	if (section->nameIndex != NULL) {
+		free(section->nameIndex->items);
+		free(section->nameIndex);
+		section->nameIndex = NULL;
+	}
+
+	if (section->pathCache != NULL) {
+		config_pathcache_clear(section->pathCache);
+		free(section->pathCache->items);
+		free(section->pathCache);
+		section->pathCache = NULL;
+	}
+} // config_index_free
+
+/**
+ * Notify that subsections or values were added to or removed from section.
+ * Drops section's name index and invalidates path caches of the section and
+ * all it's parents.
+ * @param section Section whose structure has changed.
+ */
+void config_structure_changed(CONF_SECTION *section) {
+	if (section->nameIndex != NULL) {
+		free(section->nameIndex->items);
+		free(section->nameIndex);
+		section->nameIndex = NULL;
+	}
+
+	while (section != NULL) {
+		section->generation++;
+		section = section->parent;
+	}
+} // config_structure_changed
+
+/**
+ * Find slot for path in path cache.
+ * @param cache Path cache
+ * @param path Path
+ * @param hash Hash of path
+ * @param itemIndex Item index
+ * @return Slot with that path, or empty slot where the path belongs.
+ */
+static CONF_PATH_CACHE_ITEM *config_pathcache_slot(CONF_PATH_CACHE *cache,
+	char *path, size_t hash, int itemIndex) {
+
+	size_t mask = cache->size - 1;
+	size_t i = hash & mask;
+
+	while (cache->items[i].path != NULL) {
+		CONF_PATH_CACHE_ITEM *item = &cache->items[i];
+		if (item->hash == hash && item->itemIndex == itemIndex
+			&& strcmp(item->path, path) == 0) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return &cache->items[i];
+} // config_pathcache_slot
+
+/**
+ * Find path in section's path cache.
+ * @param section Section where the lookup starts
+ * @param path Path to value
+ * @param itemIndex Item index, -1 if index is part of path
+ * @param value Resolved value is stored here if path is cached.
+ * @return True if path was found in cache.
+ */
+bool config_pathcache_get(CONF_SECTION *section, char *path, int itemIndex,
+	CONF_VALUE **value) {
+
+	CONF_PATH_CACHE *cache = section->pathCache;
+	if (cache == NULL || cache->count == 0) return false;
+
+	if (cache->generation != section->generation) {
+		config_pathcache_clear(cache);
+		return false;
+	}
+
+	CONF_PATH_CACHE_ITEM *item = config_pathcache_slot(cache, path,
+		config_hash(path, strlen(path)), itemIndex);
+
+	if (item->path == NULL) return false;
+
+	*value = item->value;
+	return true;
+} // config_pathcache_get
+
+/**
+ * Store resolved path to section's path cache.
+ * @param section Section where the lookup started
+ * @param path Path to value
+ * @param itemIndex Item index, -1 if index is part of path
+ * @param value Resolved value, NULL if path doesn't exist.
+ */
+void config_pathcache_set(CONF_SECTION *section, char *path, int itemIndex,
+	CONF_VALUE *value) {
+
+	CONF_PATH_CACHE *cache = section->pathCache;
+	if (cache == NULL) {
+		cache = malloc(sizeof(CONF_PATH_CACHE));
+		cache->size = 16;
+		cache->count = 0;
+		cache->generation = section->generation;
+		cache->items = calloc(cache->size, sizeof(CONF_PATH_CACHE_ITEM));
+		section->pathCache = cache;
+	}
+
+	if (cache->generation != section->generation
+		|| cache->count >= CONFIG_PATHCACHE_MAX) {
+		config_pathcache_clear(cache);
+	}
+	cache->generation = section->generation;
+
+	// Grow when load factor reaches 3/4.
+	if (4 * (cache->count + 1) > 3 * cache->size) {
+		CONF_PATH_CACHE_ITEM *old = cache->items;
+		size_t oldSize = cache->size;
+
+		cache->size *= 2;
+		cache->items = calloc(cache->size, sizeof(CONF_PATH_CACHE_ITEM));
+		for (size_t i = 0; i < oldSize; i++) {
+			if (old[i].path != NULL) {
+				*config_pathcache_slot(cache, old[i].path, old[i].hash,
+					old[i].itemIndex) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	size_t hash = config_hash(path, strlen(path));
+	CONF_PATH_CACHE_ITEM *item = config_pathcache_slot(cache, path, hash,
+		itemIndex);
+
+	if (item->path == NULL) {
+		item->path = strdup(path);
+		item->hash = hash;
+		item->itemIndex = itemIndex;
+		cache->count++;
+	}
+	item->value = value;
+} // config_pathcache_set
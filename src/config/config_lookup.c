@@ -100,7 +100,9 @@ int config_parse_value_name(char *valueName) {
 } // config_parse_value_name
 
 /**
- * Lookup section and create path elements if create is true.
+ * Lookup section and create path elements if create is true. Empty path
+ * elements (doubled or trailing colons) are skipped, so nameless sections
+ * are never looked up nor created.
  * @param config Root section
  * @param path Path to section
  * @param create If set to true, create path elements if they doesn't exists.
@@ -109,32 +111,30 @@ int config_parse_value_name(char *valueName) {
 CONF_SECTION *config_lookup_section(CONF_SECTION *config, char *path,
 	bool create) {
 
-	TOKENS tok = tokenizer_tokenize(path, ':');
-	for (size_t i = 0; i < tok->count; i++) {
-		if (config == NULL) break;
+	TOK_ITER it;
+	tok_init(&it, path);
+	while (config != NULL && tok_rest(&it) != NULL) {
+		TOK_SLICE sectionName = tok_next(&it, ':');
+		if (sectionName.length == 0) continue;
 
-		char *sectionName = tokenizer_gettok(tok, i);
 		// Scan for this section in actual section
-		CONF_SECTION *oldSection = config;
-		for (size_t s = 0; s < config->subSectionsCount; s++) {
-			if (strcmp(config->subSections[s]->name, sectionName) == 0) {
-				config = config->subSections[s];
-				break;
-			}
-		}
+		CONF_SECTION *section = config_index_section(config, sectionName.str,
+			sectionName.length);
+
 		// New section was not found.
-		if (oldSection == config) {
+		if (section == NULL) {
 			if (create) {
 				// Create section if user wants to (create is true)
-				config = config_create_section(config, sectionName);
+				char *name = strndup(sectionName.str, sectionName.length);
+				section = config_create_section(config, name);
+				free(name);
 			} else {
 				// Don't create section, return NULL as not found.
-				config = NULL;
-				break;
+				return NULL;
 			}
 		}
+		config = section;
 	}
-	tokenizer_free(tok);
 	return config;
 } // config_lookup_section
 
@@ -164,9 +164,13 @@ size_t config_getvalue_count(CONF_SECTION *config, char *path) {
 
 	if (config != NULL) {
 		size_t result = 0;
-		for (size_t i = 0; i < config->valuesCount; i++) {
-			if (strcmp(config->values[i]->name, valueName) == 0) {
-				result++;
+		CONF_VALUE *first = config_index_value(config, valueName,
+			strlen(valueName));
+		if (first != NULL) {
+			for (size_t i = first->index; i < config->valuesCount; i++) {
+				if (strcmp(config->values[i]->name, valueName) == 0) {
+					result++;
+				}
 			}
 		}
 		free(mypath);
@@ -195,8 +199,13 @@ CONF_VALUE *config_lookup_value_array(CONF_SECTION *section, char *valueName,
 
 	// If itemIndex == -1 (which means value name foo[]), create new value
 	// always
+	CONF_VALUE *first = NULL;
 	if (itemIndex >= 0) {
-		for (size_t i = 0; i < section->valuesCount; i++) {
+		first = config_index_value(section, valueName, strlen(valueName));
+	}
+
+	if (first != NULL) {
+		for (size_t i = first->index; i < section->valuesCount; i++) {
 			if (strcmp(valueName, section->values[i]->name) == 0) {
 				if (itemIndex-- == 0) {
 					return section->values[i];
@@ -245,6 +254,12 @@ CONF_VALUE *config_lookup_value(CONF_SECTION *section, char *value,
  *   if set to false, if something in path doesn't exists, NULL is returned.
  */
 CONF_VALUE *config_lookup(CONF_SECTION *config, char *path, bool create) {
+	CONF_VALUE *value = NULL;
+	if (!create && config_pathcache_get(config, path, -1, &value)) {
+		return value;
+	}
+
+	CONF_SECTION *root = config;
 	char *mypath = strdup(path);
 
 	char *sectionName = mypath;
@@ -263,13 +278,14 @@ CONF_VALUE *config_lookup(CONF_SECTION *config, char *path, bool create) {
 	}
 
 	if (config != NULL) {
-		CONF_VALUE *value = config_lookup_value(config, valueName, create);
-		free(mypath);
-		return value;
-	} else {
-		free(mypath);
-		return NULL;
+		value = config_lookup_value(config, valueName, create);
+	}
+	free(mypath);
+
+	if (!create) {
+		config_pathcache_set(root, path, -1, value);
 	}
+	return value;
 } // config_lookup
 
 /**
@@ -283,6 +299,13 @@ CONF_VALUE *config_lookup(CONF_SECTION *config, char *path, bool create) {
 CONF_VALUE *config_lookup_array(CONF_SECTION *config, char *path,
 	int itemIndex, bool create) {
 
+	CONF_VALUE *result = NULL;
+	bool cacheable = !create && itemIndex >= 0;
+	if (cacheable && config_pathcache_get(config, path, itemIndex, &result)) {
+		return result;
+	}
+
+	CONF_SECTION *root = config;
 	char *mypath = strdup(path);
 	char *sectionName = mypath;
 	char *valueName = strrchr(mypath, ':');
@@ -300,12 +323,13 @@ CONF_VALUE *config_lookup_array(CONF_SECTION *config, char *path,
 	}
 
 	if (config != NULL) {
-		CONF_VALUE *result =
+		result =
 			config_lookup_value_array(config, valueName, itemIndex, create);
-		free(mypath);
-		return result;
-	} else {
-		free(mypath);
-		return NULL;
 	}
+	free(mypath);
+
+	if (cacheable) {
+		config_pathcache_set(root, path, itemIndex, result);
+	}
+	return result;
 } // config_lookup_array
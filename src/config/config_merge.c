@@ -0,0 +1,432 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Standard libraries
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// This library interface
+#include "config.h"
+
+/**
+ * Add path to list of changes.
+ * @param changes List of changes
+ * @param prefix Path of section
+ * @param name Name of changed item
+ */
+static void config_changes_add(CONF_CHANGES *changes, char *prefix,
+	char *name) {
+
+	if (changes->count == changes->allocated) {
+		changes->allocated = (changes->allocated > 0) ?
+			changes->allocated * 2 : 16;
+		changes->paths = realloc(changes->paths,
+			changes->allocated * sizeof(char *));
+	}
+
+	char *path;
+	if (*prefix != '\0') {
+		asprintf(&path, "%s:%s", prefix, name);
+	} else {
+		path = strdup(name);
+	}
+
+	changes->paths[changes->count++] = path;
+} // config_changes_add
+
+/**
+ * Remove duplicate paths from list of changes, keeping the first
+ * occurrence. Arrays may change in more than one item, but should be
+ * reported only once.
+ * @param changes List of changes
+ */
+static void config_changes_unique(CONF_CHANGES *changes) {
+	if (changes->count < 2) return;
+
+	size_t size = 1;
+	while (size < changes->count * 2) size <<= 1;
+	char **slots = calloc(size, sizeof(char *));
+
+	size_t count = 0;
+	for (size_t i = 0; i < changes->count; i++) {
+		char *path = changes->paths[i];
+
+		size_t hash = 5381;
+		for (char *c = path; *c != '\0'; c++) {
+			hash = ((hash << 5) + hash) + (unsigned char)*c;
+		}
+
+		size_t slot = hash & (size - 1);
+		while (slots[slot] != NULL && strcmp(slots[slot], path) != 0) {
+			slot = (slot + 1) & (size - 1);
+		}
+
+		if (slots[slot] != NULL) {
+			free(path);
+		} else {
+			slots[slot] = path;
+			changes->paths[count++] = path;
+		}
+	}
+	changes->count = count;
+
+	free(slots);
+} // config_changes_unique
+
+/**
+ * Free list of changes.
+ * @param changes List of changes
+ */
+void config_changes_free(CONF_CHANGES *changes) {
+	for (size_t i = 0; i < changes->count; i++) {
+		free(changes->paths[i]);
+	}
+	free(changes->paths);
+
+	changes->paths = NULL;
+	changes->count = 0;
+	changes->allocated = 0;
+} // config_changes_free
+
+/**
+ * Test whether string contains exactly given number.
+ * @param str String
+ * @param number Number to compare with
+ * @return True if string is the number.
+ */
+static bool config_string_is(char *str, double number) {
+	char *rest;
+	double value = strtod(str, &rest);
+	return *str != '\0' && *rest == '\0' && value == number;
+} // config_string_is
+
+/**
+ * Compare two values. Values read by config_getvalue_* may have been
+ * converted to other type, so compare them by meaning, not by type.
+ * @param a First value
+ * @param b Second value
+ * @return True if values are equal.
+ */
+static bool config_value_equal(HTVAL a, HTVAL b) {
+	HTVAL_Type ta = htval_type(a);
+	HTVAL_Type tb = htval_type(b);
+
+	// Make sure that string, if any, is in b.
+	if (ta == HT_STRING && tb != HT_STRING) {
+		HTVAL tmp = a; a = b; b = tmp;
+		HTVAL_Type ttmp = ta; ta = tb; tb = ttmp;
+	}
+
+	switch (ta) {
+		case HT_NULL:
+			return tb == HT_NULL;
+
+		case HT_INT:
+			if (tb == HT_INT) return a->value.ival == b->value.ival;
+			if (tb == HT_FLOAT) return a->value.ival == b->value.fval;
+			if (tb == HT_STRING) {
+				return config_string_is(b->value.sval, a->value.ival);
+			}
+			return false;
+
+		case HT_FLOAT:
+			if (tb == HT_INT) return a->value.fval == b->value.ival;
+			if (tb == HT_FLOAT) return a->value.fval == b->value.fval;
+			if (tb == HT_STRING) {
+				return config_string_is(b->value.sval, a->value.fval);
+			}
+			return false;
+
+		case HT_STRING:
+			return strcmp(a->value.sval, b->value.sval) == 0;
+
+		default:
+			// Arrays are never produced by parser.
+			return false;
+	}
+} // config_value_equal
+
+/**
+ * Copy value of one item to another.
+ * @param src Source value
+ * @param dst Value to overwrite
+ * @return Overwritten value.
+ */
+static HTVAL config_value_copy(HTVAL src, HTVAL dst) {
+	switch (htval_type(src)) {
+		case HT_INT:
+			return htval_inte(src->value.ival, dst);
+
+		case HT_FLOAT:
+			return htval_floate(src->value.fval, dst);
+
+		case HT_STRING:
+			return htval_stringe(src->value.sval, dst);
+
+		default:
+			return htval_nulle(dst);
+	}
+} // config_value_copy
+
+/**
+ * Create deep copy of section and insert it into parent.
+ * @param parent Parent section
+ * @param section Section to copy
+ */
+static void config_copy_section(CONF_SECTION *parent, CONF_SECTION *section) {
+	CONF_SECTION *copy = config_create_section(parent, section->name);
+
+	for (size_t i = 0; i < section->valuesCount; i++) {
+		CONF_VALUE *value = config_create_value(copy,
+			section->values[i]->name);
+		value->value = config_value_copy(section->values[i]->value,
+			value->value);
+	}
+
+	for (size_t i = 0; i < section->subSectionsCount; i++) {
+		config_copy_section(copy, section->subSections[i]);
+	}
+} // config_copy_section
+
+/**
+ * Find n-th value of given name in section.
+ * @param section Section
+ * @param name Value name
+ * @param n Occurrence of the value
+ * @return Value or NULL if section has less values of that name.
+ */
+static CONF_VALUE *config_nth_value(CONF_SECTION *section, char *name,
+	size_t n) {
+
+	CONF_VALUE *first = config_index_value(section, name, strlen(name));
+	if (first == NULL) return NULL;
+
+	for (size_t i = first->index; i < section->valuesCount; i++) {
+		if (strcmp(section->values[i]->name, name) == 0 && n-- == 0) {
+			return section->values[i];
+		}
+	}
+	return NULL;
+} // config_nth_value
+
+/**
+ * Find n-th subsection of given name in section.
+ * @param section Section
+ * @param name Subsection name
+ * @param n Occurrence of the subsection
+ * @return Subsection or NULL if section has less subsections of that name.
+ */
+static CONF_SECTION *config_nth_section(CONF_SECTION *section, char *name,
+	size_t n) {
+
+	CONF_SECTION *first = config_index_section(section, name, strlen(name));
+	if (first == NULL) return NULL;
+
+	for (size_t i = first->index; i < section->subSectionsCount; i++) {
+		if (strcmp(section->subSections[i]->name, name) == 0 && n-- == 0) {
+			return section->subSections[i];
+		}
+	}
+	return NULL;
+} // config_nth_section
+
+/**
+ * Count values before given index that have the same name.
+ * @param section Section
+ * @param index Index of value
+ * @return Occurrence of the value among values of the same name.
+ */
+static size_t config_value_occurrence(CONF_SECTION *section, size_t index) {
+	char *name = section->values[index]->name;
+	size_t n = 0;
+	for (size_t i = config_index_value(section, name, strlen(name))->index;
+		i < index; i++) {
+		if (strcmp(section->values[i]->name, name) == 0) n++;
+	}
+	return n;
+} // config_value_occurrence
+
+/**
+ * Count subsections before given index that have the same name.
+ * @param section Section
+ * @param index Index of subsection
+ * @return Occurrence of the subsection among subsections of the same name.
+ */
+static size_t config_section_occurrence(CONF_SECTION *section, size_t index) {
+	char *name = section->subSections[index]->name;
+	size_t n = 0;
+	for (size_t i = config_index_section(section, name, strlen(name))->index;
+		i < index; i++) {
+		if (strcmp(section->subSections[i]->name, name) == 0) n++;
+	}
+	return n;
+} // config_section_occurrence
+
+/**
+ * Remove values and subsections of live section that are no longer in
+ * loaded section. Items to remove are found first and removed in one pass
+ * afterwards, so name index of live section is built only once and
+ * invalidated only once.
+ * @param live Live section
+ * @param loaded Loaded section
+ * @param path Path of the section
+ * @param changes List of changes to fill in
+ */
+static void config_merge_remove(CONF_SECTION *live, CONF_SECTION *loaded,
+	char *path, CONF_CHANGES *changes) {
+
+	bool *removeValues = malloc(live->valuesCount * sizeof(bool));
+	bool *removeSections = malloc(live->subSectionsCount * sizeof(bool));
+	bool removed = false;
+
+	for (size_t i = 0; i < live->valuesCount; i++) {
+		removeValues[i] = (config_nth_value(loaded, live->values[i]->name,
+			config_value_occurrence(live, i)) == NULL);
+		removed |= removeValues[i];
+	}
+
+	for (size_t i = 0; i < live->subSectionsCount; i++) {
+		removeSections[i] = (config_nth_section(loaded,
+			live->subSections[i]->name,
+			config_section_occurrence(live, i)) == NULL);
+		removed |= removeSections[i];
+	}
+
+	if (removed) {
+		size_t count = 0;
+		for (size_t i = 0; i < live->valuesCount; i++) {
+			CONF_VALUE *value = live->values[i];
+			if (removeValues[i]) {
+				config_changes_add(changes, path, value->name);
+				config_free_value(live, value);
+			} else {
+				value->index = count;
+				live->values[count++] = value;
+			}
+		}
+		live->valuesCount = count;
+
+		count = 0;
+		for (size_t i = 0; i < live->subSectionsCount; i++) {
+			CONF_SECTION *section = live->subSections[i];
+			if (removeSections[i]) {
+				config_changes_add(changes, path, section->name);
+				config_free(section);
+			} else {
+				section->index = count;
+				live->subSections[count++] = section;
+			}
+		}
+		live->subSectionsCount = count;
+
+		config_structure_changed(live);
+		config_set_changed(live);
+	}
+
+	free(removeValues);
+	free(removeSections);
+} // config_merge_remove
+
+/**
+ * Merge section of loaded configuration into live section.
+ * @param live Live section
+ * @param loaded Loaded section
+ * @param path Path of the section
+ * @param changes List of changes to fill in
+ */
+static void config_merge_section(CONF_SECTION *live, CONF_SECTION *loaded,
+	char *path, CONF_CHANGES *changes) {
+
+	config_merge_remove(live, loaded, path, changes);
+
+	// Pair loaded items with live ones before anything is added to live
+	// section. Adding invalidates the name index, and looking up after each
+	// addition would rebuild it over and over.
+	CONF_VALUE **liveValues = malloc(loaded->valuesCount *
+		sizeof(CONF_VALUE *));
+	for (size_t i = 0; i < loaded->valuesCount; i++) {
+		liveValues[i] = config_nth_value(live, loaded->values[i]->name,
+			config_value_occurrence(loaded, i));
+	}
+
+	CONF_SECTION **liveSections = malloc(loaded->subSectionsCount *
+		sizeof(CONF_SECTION *));
+	for (size_t i = 0; i < loaded->subSectionsCount; i++) {
+		liveSections[i] = config_nth_section(live,
+			loaded->subSections[i]->name,
+			config_section_occurrence(loaded, i));
+	}
+
+	// Update existing values and add new ones.
+	for (size_t i = 0; i < loaded->valuesCount; i++) {
+		CONF_VALUE *value = loaded->values[i];
+		CONF_VALUE *liveValue = liveValues[i];
+
+		if (liveValue == NULL) {
+			liveValue = config_create_value(live, value->name);
+		} else if (config_value_equal(liveValue->value, value->value)) {
+			continue;
+		}
+
+		liveValue->value = config_value_copy(value->value, liveValue->value);
+		config_set_changed(live);
+		config_changes_add(changes, path, value->name);
+	}
+
+	// Merge subsections.
+	for (size_t i = 0; i < loaded->subSectionsCount; i++) {
+		CONF_SECTION *section = loaded->subSections[i];
+		CONF_SECTION *liveSection = liveSections[i];
+
+		if (liveSection == NULL) {
+			config_copy_section(live, section);
+			config_changes_add(changes, path, section->name);
+		} else {
+			char *subpath;
+			if (*path != '\0') {
+				asprintf(&subpath, "%s:%s", path, section->name);
+			} else {
+				subpath = strdup(section->name);
+			}
+			config_merge_section(liveSection, section, subpath, changes);
+			free(subpath);
+		}
+	}
+
+	free(liveValues);
+	free(liveSections);
+} // config_merge_section
+
+/**
+ * Merge newly loaded configuration into live configuration tree. Only items
+ * that differ are modified, so pointers to unchanged sections and values
+ * stay valid.
+ * @param live Live configuration
+ * @param loaded Newly loaded configuration, it's content is not modified.
+ * @param changes Paths of changed values, and of added or removed sections,
+ *   are appended here. Must be initialized to zeros.
+ */
+void config_merge(CONF_SECTION *live, CONF_SECTION *loaded,
+	CONF_CHANGES *changes) {
+
+	config_merge_section(live, loaded, "", changes);
+	config_changes_unique(changes);
+} // config_merge
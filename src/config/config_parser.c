@@ -19,544 +19,452 @@
 
 // Standard libraries
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
 
+// Linux libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 // This library interface
 #include "config.h"
 
 // My libraries
 #include <htable/htval.h>
-#include <dynastring.h>
 #include <io.h>
 
 /**
- * Config finite state machine states and return values
+ * Parser state
  */
-enum CFSM_STATE {
-	CFSM_WHITESPACE = 0,			/**< White space before identifier */
-	CFSM_COMMENT_1,					/**< Maybe comment? */
-	CFSM_COMMENT,					/**< Comment to the end of line */
-	CFSM_IDENTIFIER,				/**< Inside identifier */
-	CFSM_AFTER_IDENTIFIER,			/**< White space after identifier,
-									     expecting { or = chars */
-	CFSM_VALUE_WHITESPACE,			/**< White space after =, expecting
-									     value */
-	CFSM_VALUE_DIGIT,				/**< Expecting digit or . */
-	CFSM_VALUE_DIGIT_END,			/**< Expecting ; */
-	CFSM_VALUE_STRING,				/**< Expecting any character, " ends
-									     this mode. */
-	CFSM_VALUE_STRING_WHITESPACE,	/**< Expecting " or ; */
-	CFSM_VALUE_BOOL_TRUE_1,			/**< Received T, expecting R */
-	CFSM_VALUE_BOOL_TRUE_2,			/**< Received TR, expecting U */
-	CFSM_VALUE_BOOL_TRUE_3,			/**< Received TRU, expecting E */
-	CFSM_VALUE_BOOL_FALSE_1,		/**< Received F, expecting A */
-	CFSM_VALUE_BOOL_FALSE_2,		/**< Received FA, expecting L */
-	CFSM_VALUE_BOOL_FALSE_3,		/**< Received FAL, expecting S */
-	CFSM_VALUE_BOOL_FALSE_4,		/**< Received FALS, expecting E */
-	CFSM_VALUE_BOOL_END,			/**< Expecting ; */
-
-	// Return values
-	CFSM_NO_ACTION = 1000,			/**< No action, we are inside
-									     something */
-	CFSM_ERROR,						/**< Error, stop parsing */
-	CFSM_BEGIN_IDENTIFIER,			/**< We have identifier name in
-									     retval */
-	CFSM_BEGIN_SECTION,				/**< We have section name in retval */
-	CFSM_END_SECTION,
-	CFSM_PROCESS_VALUE_DIGIT,		/**< We have digit value to process */
-	CFSM_PROCESS_VALUE_STRING,		/**< We have string value to process */
-	CFSM_PROCESS_VALUE_BOOL			/**< We have bool value to process */
-}; // CFSM_STATE
+typedef struct {
+	const char *data;				/**< Begining of mapped file */
+	const char *pos;				/**< Current position in mapped file */
+	const char *end;				/**< End of mapped file */
+	char *fileName;					/**< File name for error messages */
+	int line;						/**< Current line */
+	int column;						/**< Current column */
+	CONF_ARENA *arena;				/**< Arena for names */
+} CONF_PARSER;
 
 /**
- * Finite state machine for parsing config file
- * @param c Char from file
- * @param fn File name for error messages
- * @param retval Return value if we have something to return
- * @return If we have something to return, function returns code of what is
- *   in return parameter. Otherwise it will return 0.
+ * Table of characters allowed in identifiers, built from
+ * config_identifierAllowed on first use.
  */
-static enum CFSM_STATE config_fsm(int c, char *fn, string retval) {
-	static int line = 1;
-	static int column = 1;
+static bool config_identifierTable[256];
+static bool config_identifierTableReady = false;
 
-	static enum CFSM_STATE state = CFSM_WHITESPACE;
+/**
+ * Test whether character can be part of identifier.
+ * @param c Character
+ * @return True if character is allowed in identifier.
+ */
+static inline bool config_is_identifier(unsigned char c) {
+	return config_identifierTable[c];
+} // config_is_identifier
 
-	if (c == '\n') {
-		line++;
-		column = 1;
+/**
+ * Move to next character, keeping line and column up to date.
+ * @param parser Parser state
+ */
+static inline void config_parser_advance(CONF_PARSER *parser) {
+	if (*parser->pos == '\n') {
+		parser->line++;
+		parser->column = 1;
+	} else {
+		parser->column++;
+	}
+	parser->pos++;
+} // config_parser_advance
 
-		// End of line kills comments.
-		if (state == CFSM_COMMENT) {
-			state = CFSM_WHITESPACE;
-		}
+/**
+ * Report parse error on current position.
+ * @param parser Parser state
+ * @param expected Description of what was expected, or NULL.
+ */
+static void config_parser_error(CONF_PARSER *parser, char *expected) {
+	if (parser->pos >= parser->end) {
+		printError("config", "Parse error - unexpected end of file "
+			"(expected %s) in %s on line %d, column %d.", expected,
+			parser->fileName, parser->line, parser->column);
+	} else if (expected != NULL) {
+		printError("config", "Parse error - illegal character %c "
+			"(expected %s) in %s on line %d, column %d.", *parser->pos,
+			expected, parser->fileName, parser->line, parser->column);
+	} else {
+		printError("config", "Parse error - illegal character %c "
+			"in %s on line %d, column %d.", *parser->pos, parser->fileName,
+			parser->line, parser->column);
 	}
+} // config_parser_error
 
-	switch (state) {
-		// Whitespace inside section or on root level of config
-		// file. Characters that may follow are: a-z or _ as begining
-		// of identifier. Also } may follow as end of section. Any
-		// other characters are illegal.
-		case CFSM_WHITESPACE:
-			if (strchr(config_identifierAllowed, c) != NULL) {
-				state = CFSM_IDENTIFIER;
-				dynastring_appendchar(retval, c);
-			} else if (c == '}') {
-				state = CFSM_WHITESPACE;
-				return CFSM_END_SECTION;
-			} else if (isspace(c)) {
-				break;
-			} else if (c == '/') {
-				state = CFSM_COMMENT_1;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"in %s on line %d, column %d.", c, fn, line, column);
+/**
+ * Skip white space.
+ * @param parser Parser state
+ */
+static void config_parser_skip_space(CONF_PARSER *parser) {
+	while (parser->pos < parser->end && isspace((unsigned char)*parser->pos)) {
+		config_parser_advance(parser);
+	}
+} // config_parser_skip_space
 
-				return CFSM_ERROR;
+/**
+ * Skip white space and comments between statements.
+ * @param parser Parser state
+ * @return False if comment is malformed.
+ */
+static bool config_parser_skip(CONF_PARSER *parser) {
+	while (parser->pos < parser->end) {
+		if (isspace((unsigned char)*parser->pos)) {
+			config_parser_advance(parser);
+		} else if (*parser->pos == '/') {
+			config_parser_advance(parser);
+			if (parser->pos >= parser->end || *parser->pos != '/') {
+				config_parser_error(parser, "/");
+				return false;
 			}
-			break;
 
-		// Comment begins with //. If anything else is passed after first /,
-		// it is considered illegal.
-		case CFSM_COMMENT_1:
-			if (c == '/') {
-				state = CFSM_COMMENT;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"in %s on line %d, column %d.", c, fn, line, column);
-				return CFSM_ERROR;
-			}
+			// Comment to the end of line
+			const char *eol = memchr(parser->pos, '\n',
+				parser->end - parser->pos);
+			if (eol == NULL) eol = parser->end;
+			parser->column += eol - parser->pos;
+			parser->pos = eol;
+		} else {
 			break;
+		}
+	}
+	return true;
+} // config_parser_skip
 
-		// Inside identifier - after first char (a-z or _). Characters
-		// that may follow are: a-z, 0-9 or _. Also whitespace
-		// can occur, or = or { as begining of identifier value or
-		// section.
-		case CFSM_IDENTIFIER:
-			if (strchr(config_identifierAllowed, c) != NULL) {
-				dynastring_appendchar(retval, c);
-			} else if (isspace(c)) {
-				state = CFSM_AFTER_IDENTIFIER;
-			} else if (c == '=') {
-				state = CFSM_VALUE_WHITESPACE;
-				return CFSM_BEGIN_IDENTIFIER;
-			} else if (c == '{') {
-				state = CFSM_WHITESPACE;
-				return CFSM_BEGIN_SECTION;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"in %s on line %d, column %d.", c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+/**
+ * Read identifier and copy it into arena.
+ * @param parser Parser state
+ * @return Identifier stored in arena.
+ */
+static char *config_parser_identifier(CONF_PARSER *parser) {
+	const char *begin = parser->pos;
+	while (parser->pos < parser->end
+		&& config_is_identifier((unsigned char)*parser->pos)) {
+		parser->pos++;
+	}
 
-		// Identifier has ended with white space, expecting = or {
-		// characters as begining of identifier value or section.
-		case CFSM_AFTER_IDENTIFIER:
-			if (c == '=') {
-				state = CFSM_VALUE_WHITESPACE;
-				return CFSM_BEGIN_IDENTIFIER;
-			} else if (c == '{') {
-				state = CFSM_WHITESPACE;
-				return CFSM_BEGIN_SECTION;
-			} else if (isspace(c)) {
-				break;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected = or {) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	size_t length = parser->pos - begin;
+	parser->column += length;
 
-		// White space before identifer value. Expecting 0-9, +-,
-		// ", t, f, T or F.
-		case CFSM_VALUE_WHITESPACE:
-			if (isspace(c)) {
-				break;
-			} else if (isdigit(c) || c == '+' || c == '-' ||
-				c == '.') {
-
-				state = CFSM_VALUE_DIGIT;
-				dynastring_appendchar(retval, c);
-			} else if (c == '"') {
-				state = CFSM_VALUE_STRING;
-			} else if (c == 't' || c == 'T') {
-				state = CFSM_VALUE_BOOL_TRUE_1;
-				dynastring_appendchar(retval, 't');
-			} else if (c == 'f' || c == 'F') {
-				state = CFSM_VALUE_BOOL_FALSE_1;
-				dynastring_appendchar(retval, 'f');
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected digit, string or true / false) in %s on "
-					"line %d, column %d", c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	char *name = parser->arena->data + parser->arena->used;
+	memcpy(name, begin, length);
+	name[length] = '\0';
+	parser->arena->used += length + 1;
 
-		// It seems user wants to enter digit. Expecting 0-9, .
-		// or whitespace or ;
-		case CFSM_VALUE_DIGIT:
-			if (isdigit(c) || c == '.' || c == 'e' || c == 'E') {
-				// Correct digit
-				state = CFSM_VALUE_DIGIT;
-				dynastring_appendchar(retval, c);
-			} else if (isspace(c)) {
-				state = CFSM_VALUE_DIGIT_END;
-			} else if (c == ';') {
-				state = CFSM_WHITESPACE;
-				return CFSM_PROCESS_VALUE_DIGIT;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected digit or ;) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	return name;
+} // config_parser_identifier
 
-		// After correct value, nothing can follow, just ;
-		case CFSM_VALUE_DIGIT_END:
-			if (isspace(c)) {
-				break;
-			} else if (c == ';') {
-				state = CFSM_WHITESPACE;
-				return CFSM_PROCESS_VALUE_DIGIT;
-			} else {
-				printError("config", "Parse error - illegal characted %c "
-					"(expected ;) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
-
-		// We are inside "" block. There is no parser error, just
-		// append to string or switch to whitespace.
-		case CFSM_VALUE_STRING:
-			if (c == '"') {
-				state = CFSM_VALUE_STRING_WHITESPACE;
-			} else {
-				dynastring_appendchar(retval, c);
-			}
-			break;
+/**
+ * Expect optional white space followed by ; that ends the value.
+ * @param parser Parser state
+ * @return True if value was properly terminated.
+ */
+static bool config_parser_end_value(CONF_PARSER *parser) {
+	config_parser_skip_space(parser);
+	if (parser->pos >= parser->end || *parser->pos != ';') {
+		config_parser_error(parser, ";");
+		return false;
+	}
+	config_parser_advance(parser);
+	return true;
+} // config_parser_end_value
 
-		// We are inside string (after "" block) but before ;.
-		// " may follow to concatenate long strings on multiple lines
-		// or ; may follow to end value.
-		case CFSM_VALUE_STRING_WHITESPACE:
-			if (c == '"') {
-				state = CFSM_VALUE_STRING;
-			} else if (isspace(c)) {
-				break;
-			} else if (c == ';') {
-				state = CFSM_WHITESPACE;
-				dynastring_appendchar(retval, '\0');
-				return CFSM_PROCESS_VALUE_STRING;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected \" or ;) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+/**
+ * Parse numeric value.
+ * @param parser Parser state
+ * @param value Value to store result into
+ * @return True if value was parsed successfully.
+ */
+static bool config_parser_number(CONF_PARSER *parser, CONF_VALUE *value) {
+	char buffer[64];
+	size_t length = 0;
+	int line = parser->line, column = parser->column;
 
-		// We received T, and needs R
-		case CFSM_VALUE_BOOL_TRUE_1:
-			if (c == 'r' || c == 'R') {
-				dynastring_appendchar(retval, 'r');
-				state = CFSM_VALUE_BOOL_TRUE_2;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected r) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	// First char may be also sign.
+	buffer[length++] = *parser->pos;
+	config_parser_advance(parser);
 
-		// We received TR, and needs U
-		case CFSM_VALUE_BOOL_TRUE_2:
-			if (c == 'u' || c == 'U') {
-				dynastring_appendchar(retval, 'u');
-				state = CFSM_VALUE_BOOL_TRUE_3;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected u) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	while (parser->pos < parser->end && (isdigit((unsigned char)*parser->pos)
+		|| *parser->pos == '.' || *parser->pos == 'e' || *parser->pos == 'E')) {
 
-		// We received TRU, and needs E
-		case CFSM_VALUE_BOOL_TRUE_3:
-			if (c == 'e' || c == 'E') {
-				dynastring_appendchar(retval, 'e');
-				state = CFSM_VALUE_BOOL_END;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected r) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+		if (length == sizeof(buffer) - 1) {
+			config_parser_error(parser, "shorter number");
+			return false;
+		}
+		buffer[length++] = *parser->pos;
+		config_parser_advance(parser);
+	}
+	buffer[length] = '\0';
 
-		// We received F, and needs A
-		case CFSM_VALUE_BOOL_FALSE_1:
-			if (c == 'a' || c == 'A') {
-				dynastring_appendchar(retval, 'a');
-				state = CFSM_VALUE_BOOL_FALSE_2;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected a) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	if (parser->pos < parser->end && !isspace((unsigned char)*parser->pos)
+		&& *parser->pos != ';') {
+		config_parser_error(parser, "digit or ;");
+		return false;
+	}
 
-		// We received FA, and needs L
-		case CFSM_VALUE_BOOL_FALSE_2:
-			if (c == 'l' || c == 'L') {
-				dynastring_appendchar(retval, 'l');
-				state = CFSM_VALUE_BOOL_FALSE_3;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected l) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	// Try to convert string into int. If this fails, value may be float.
+	char *restOfString;
+	long int iv = strtol(buffer, &restOfString, 10);
+	if (*restOfString == '\0') {
+		value->value = htval_inte(iv, value->value);
+	} else {
+		double fv = strtod(buffer, &restOfString);
+		if (*restOfString == '\0') {
+			value->value = htval_floate(fv, value->value);
+		} else {
+			printError("config", "Parse error - %s is not a digit - in %s on "
+				"line %d, column %d.", buffer, parser->fileName, line, column);
+			return false;
+		}
+	}
 
-		// We received FAL, and needs S
-		case CFSM_VALUE_BOOL_FALSE_3:
-			if (c == 's' || c == 'S') {
-				dynastring_appendchar(retval, 's');
-				state = CFSM_VALUE_BOOL_FALSE_4;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected s) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+	return config_parser_end_value(parser);
+} // config_parser_number
 
-		// We received FALS, and needs E
-		case CFSM_VALUE_BOOL_FALSE_4:
-			if (c == 'e' || c == 'E') {
-				dynastring_appendchar(retval, 'e');
-				state = CFSM_VALUE_BOOL_END;
-			} else {
-				printError("config", "Parse error - illegal character %c "
-					"(expected e) in %s on line %d, column %d",
-					c, fn, line, column);
-				return CFSM_ERROR;
-			}
-			break;
+/**
+ * Parse string value. Multiple quoted strings are concatenated.
+ * @param parser Parser state
+ * @param value Value to store result into
+ * @return True if value was parsed successfully.
+ */
+static bool config_parser_string(CONF_PARSER *parser, CONF_VALUE *value) {
+	// String is assembled in free space of arena, it is copied into value
+	// so the space can be reused.
+	char *out = parser->arena->data + parser->arena->used;
+	size_t length = 0;
+
+	while (parser->pos < parser->end && *parser->pos == '"') {
+		int line = parser->line, column = parser->column;
+		config_parser_advance(parser);
+
+		const char *quote = memchr(parser->pos, '"',
+			parser->end - parser->pos);
+		if (quote == NULL) {
+			printError("config", "Parse error - unterminated string in %s on "
+				"line %d, column %d.", parser->fileName, line, column);
+			return false;
+		}
 
-		// After correct value, nothing can follow, just ;
-		case CFSM_VALUE_BOOL_END:
-			if (isspace(c)) {
-				break;
-			} else if (c == ';') {
-				state = CFSM_WHITESPACE;
-				return CFSM_PROCESS_VALUE_BOOL;
-			} else {
-				printError("config", "Parse error - illegal characted %c "
-					"(expected ;) in %s on line %d, column %d", c, fn, line,
-					column);
-			}
-			break;
+		memcpy(out + length, parser->pos, quote - parser->pos);
+		length += quote - parser->pos;
 
-		// Ignore all comment chars.
-		case CFSM_COMMENT:
-			break;
+		while (parser->pos <= quote) {
+			config_parser_advance(parser);
+		}
 
-		// Enumeration value XYZ not handled in switch.
-		default:
-			printError("config", "Unknown error, this should never happen, "
-				"in %s on line %d, column %d", fn, line, column);
-			break;
+		config_parser_skip_space(parser);
 	}
+	out[length] = '\0';
 
-	column++;
+	if (parser->pos >= parser->end || *parser->pos != ';') {
+		config_parser_error(parser, "\" or ;");
+		return false;
+	}
+	config_parser_advance(parser);
 
-	return CFSM_NO_ACTION;
-} // config_fsm
+	value->value = htval_stringe(out, value->value);
+	return true;
+} // config_parser_string
 
 /**
- * Loads configuration from file. If error occures during parsing,
- * NULL is returned and error message is printed using printError from io
- * module.
- * @param fileName Path and name of file with configuration
- * @return Configuration or NULL if error has occured during parsing.
+ * Parse bool value.
+ * @param parser Parser state
+ * @param value Value to store result into
+ * @return True if value was parsed successfully.
  */
-CONF_SECTION *config_parse(char *fileName) {
-	FILE *f = fopen(fileName, "r");
+static bool config_parser_bool(CONF_PARSER *parser, CONF_VALUE *value) {
+	bool result = (*parser->pos == 't' || *parser->pos == 'T');
+	const char *word = result ? "true" : "false";
+
+	for (size_t i = 0; word[i] != '\0'; i++) {
+		if (parser->pos >= parser->end
+			|| tolower((unsigned char)*parser->pos) != word[i]) {
+			char expected[2] = { word[i], '\0' };
+			config_parser_error(parser, expected);
+			return false;
+		}
+		config_parser_advance(parser);
+	}
 
-	if (f != NULL) {
-		CONF_SECTION *rootSection = config_new_section("");
-		CONF_SECTION *currentSection = rootSection;
+	value->value = htval_inte(result, value->value);
+	return config_parser_end_value(parser);
+} // config_parser_bool
 
-		int cancelParsing = 0;
+/**
+ * Parse value after =.
+ * @param parser Parser state
+ * @param value Value to store result into
+ * @return True if value was parsed successfully.
+ */
+static bool config_parser_value(CONF_PARSER *parser, CONF_VALUE *value) {
+	config_parser_skip_space(parser);
+	if (parser->pos >= parser->end) {
+		config_parser_error(parser, "value");
+		return false;
+	}
 
-		string retval = dynastring_init();
+	char c = *parser->pos;
+	if (isdigit((unsigned char)c) || c == '+' || c == '-' || c == '.') {
+		return config_parser_number(parser, value);
+	} else if (c == '"') {
+		return config_parser_string(parser, value);
+	} else if (c == 't' || c == 'T' || c == 'f' || c == 'F') {
+		return config_parser_bool(parser, value);
+	}
 
-		CONF_VALUE *value = malloc(sizeof(CONF_VALUE));
-		value->name = NULL;
-		value->value = htval_null();
+	config_parser_error(parser, "digit, string or true / false");
+	return false;
+} // config_parser_value
 
-		int c = 0;
-		int line = 1, column = 1;
-		while ((c = fgetc(f)) != EOF) {
-			if (c == '\n') {
-				line++;
-				column = 1;
+/**
+ * Parse mapped configuration file in one pass.
+ * @param parser Parser state
+ * @param root Root section where to store parsed items.
+ * @return True if whole file was parsed successfully.
+ */
+static bool config_parser_run(CONF_PARSER *parser, CONF_SECTION *root) {
+	CONF_SECTION *currentSection = root;
+
+	while (config_parser_skip(parser) && parser->pos < parser->end) {
+		char c = *parser->pos;
+
+		// End of section
+		if (c == '}') {
+			if (currentSection->parent != NULL) {
+				currentSection->sourceLength = parser->pos + 1 - parser->data
+					- currentSection->sourceOffset;
+				currentSection = currentSection->parent;
+			} else {
+				printError("config", "Parse error - unexpected } in %s on "
+					"line %d, column %d.", parser->fileName, parser->line,
+					parser->column);
 			}
+			config_parser_advance(parser);
+			continue;
+		}
 
-			switch (config_fsm(c, fileName, retval)) {
-				// Parse error, stop parsing config file and
-				// go back to program.
-				case CFSM_ERROR: {
-					cancelParsing = 1;
-					dynastring_clear(retval);
-					break;
-				}
-
-				// We have identifier name, but not identifier
-				// value.
-				case CFSM_BEGIN_IDENTIFIER: {
-					value->name = strdup(dynastring_getstring(retval));
-					dynastring_clear(retval);
-					break;
-				}
-
-				// We are inside new section, we have it's
-				// name.
-				case CFSM_BEGIN_SECTION: {
-					CONF_SECTION *newSection =
-						config_new_section(dynastring_getstring(retval));
-
-					config_insert_section(currentSection, newSection);
-
-					newSection->parent = currentSection;
-					currentSection = newSection;
-					dynastring_clear(retval);
-					break;
-				}
-
-				// We are at the end of section.
-				case CFSM_END_SECTION: {
-					if (currentSection->parent != NULL) {
-						currentSection = currentSection->parent;
-					} else {
-						printError("config", "Parse error - unexpected } "
-							"in %s on line %d, column %d", fileName, line,
-							column);
-					}
-					dynastring_clear(retval);
-					break;
-				}
-
-				// We are at end of digit value of identifier
-				case CFSM_PROCESS_VALUE_DIGIT: {
-					// Try to convert string into float.
-					// If this succedes, value is float,
-					// else it is int, maybe...
-					char *restOfString;
-					long int iv = strtol(dynastring_getstring(retval),
-						&restOfString, 10);
-
-					if (strlen(restOfString) == 0) {
-						value->value = htval_inte(iv, value->value);
-					} else {
-						double fv = strtod(dynastring_getstring(retval),
-							&restOfString);
-
-						if (strlen(restOfString) == 0) {
-
-							value->value = htval_floate(fv, value->value);
-						} else {
-							printError("config", "Parse error - %s is not "
-								"a digit - in %s on line %d, column %d",
-								dynastring_getstring(retval), fileName, line,
-								column);
-							break;
-						}
-					}
-
-					// Insert value into section
-					config_insert_value(currentSection, value);
-
-					// Allocate memory for new value
-					value = malloc(sizeof(CONF_VALUE));
-					value->name = NULL;
-					value->value = htval_null();
-					dynastring_clear(retval);
-					break;
-				}
-
-				// We are at end of string value of identifier
-				case CFSM_PROCESS_VALUE_STRING: {
-					value->value = htval_stringe(
-						dynastring_getstring(retval), value->value);
-
-					// Insert value into section
-					config_insert_value(currentSection,	value);
-
-					// Allocate memory for new value
-					value = malloc(sizeof(CONF_VALUE));
-					value->name = NULL;
-					value->value = htval_null();
-					dynastring_clear(retval);
-					break;
-				}
+		if (!config_is_identifier((unsigned char)c)) {
+			config_parser_error(parser, NULL);
+			return false;
+		}
 
-				// We are at end of bool value of identifier
-				case CFSM_PROCESS_VALUE_BOOL: {
-					if (strcmp(dynastring_getstring(retval), "true") == 0) {
-						value->value = htval_inte(1, value->value);
-					} else {
-						value->value = htval_inte(0, value->value);
-					}
+		const char *start = parser->pos;
+		char *name = config_parser_identifier(parser);
+		config_parser_skip_space(parser);
+
+		if (parser->pos < parser->end && *parser->pos == '{') {
+			// Begining of new section
+			config_parser_advance(parser);
+
+			CONF_SECTION *newSection = config_new_section_name(name);
+			newSection->sourceOffset = start - parser->data;
+			config_insert_section(currentSection, newSection);
+			currentSection = newSection;
+		} else if (parser->pos < parser->end && *parser->pos == '=') {
+			// Value
+			config_parser_advance(parser);
+
+			CONF_VALUE *value = config_new_value_name(name);
+			if (!config_parser_value(parser, value)) {
+				htval_free(value->value);
+				free(value);
+				return false;
+			}
+			config_insert_value(currentSection, value);
+		} else {
+			config_parser_error(parser, "= or {");
+			return false;
+		}
+	}
 
-					// Insert value ito section
-					config_insert_value(currentSection,	value);
+	return parser->pos >= parser->end;
+} // config_parser_run
 
-					// Allocate memory for new value
-					value = malloc(sizeof(CONF_VALUE));
-					value->name = NULL;
-					value->value = htval_null();
-					dynastring_clear(retval);
-					break;
-				}
+/**
+ * Loads configuration from file. If error occures during parsing,
+ * NULL is returned and error message is printed using printError from io
+ * module.
+ * @param fileName Path and name of file with configuration
+ * @return Configuration or NULL if error has occured during parsing.
+ */
+CONF_SECTION *config_parse(char *fileName) {
+	int fd = open(fileName, O_RDONLY);
+	struct stat st;
 
-				// No action...
-				case CFSM_NO_ACTION: {
-					break;
-				}
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		printError("config", "Unable to open file %s: %s", fileName,
+			strerror(errno));
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
 
-				default: {
-					printError("config", "Unknown FSM result.");
-					break;
-				}
-			}
-			column++;
-			if (cancelParsing) break;
+	const char *data = NULL;
+	if (st.st_size > 0) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			printError("config", "Unable to map file %s: %s", fileName,
+				strerror(errno));
+			close(fd);
+			return NULL;
 		}
+		madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
 
-		// Last value is always pending...
-		htval_free(value->value);
-		free(value);
-		dynastring_free(retval);
+	if (!config_identifierTableReady) {
+		for (const char *c = config_identifierAllowed; *c != '\0'; c++) {
+			config_identifierTable[(unsigned char)*c] = true;
+		}
+		config_identifierTableReady = true;
+	}
 
-		fclose(f);
+	// Every name or string in file is followed by at least one character
+	// that isn't copied, so arena of file size is always big enough.
+	CONF_ARENA *arena = malloc(sizeof(CONF_ARENA));
+	arena->size = st.st_size + 1;
+	arena->used = 0;
+	arena->mapped = false;
+	arena->data = malloc(arena->size);
+
+	CONF_SECTION *rootSection = config_new_section("");
+	rootSection->arena = arena;
+	rootSection->source = malloc(sizeof(CONF_SOURCE));
+	rootSection->source->device = st.st_dev;
+	rootSection->source->inode = st.st_ino;
+	rootSection->source->size = st.st_size;
+	rootSection->source->modified = st.st_mtim;
+
+	CONF_PARSER parser = {
+		.data = data,
+		.pos = data,
+		.end = data + st.st_size,
+		.fileName = fileName,
+		.line = 1,
+		.column = 1,
+		.arena = arena
+	};
+
+	bool result = config_parser_run(&parser, rootSection);
+
+	if (data != NULL) {
+		munmap((void *)data, st.st_size);
+	}
 
-		return rootSection;
-	} else {
-		printError("config", "Unable to open file %s: %s", fileName,
-			strerror(errno));
+	if (!result) {
+		config_free(rootSection);
 		return NULL;
 	}
+
+	return rootSection;
 } // config_parse
 
 /**
@@ -0,0 +1,408 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+// Standard libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <libgen.h>
+
+// Linux libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// This library interface
+#include "config.h"
+
+// My libraries
+#include <htable/htval.h>
+
+/**
+ * Size of output buffer
+ */
+#define CONFIG_SAVE_BUFFER 8192
+
+/**
+ * Buffered writer of configuration file
+ */
+typedef struct {
+	int fd;							/**< Output file */
+	int source;						/**< Previous version of file to copy
+										 unchanged sections from, -1 if it
+										 can't be used. */
+	off_t offset;					/**< Offset of first buffered byte */
+	size_t used;					/**< Number of buffered bytes */
+	bool error;						/**< Write error has occured */
+	char buffer[CONFIG_SAVE_BUFFER]; /**< Output buffer */
+} CONF_WRITER;
+
+/**
+ * Write out buffered data.
+ * @param writer Writer
+ */
+static void config_writer_flush(CONF_WRITER *writer) {
+	char *data = writer->buffer;
+	size_t length = writer->used;
+
+	while (length > 0 && !writer->error) {
+		ssize_t written = write(writer->fd, data, length);
+		if (written < 0) {
+			if (errno != EINTR) writer->error = true;
+			continue;
+		}
+		data += written;
+		length -= written;
+	}
+
+	writer->offset += writer->used;
+	writer->used = 0;
+} // config_writer_flush
+
+/**
+ * Current offset in output file, including buffered data.
+ * @param writer Writer
+ */
+static inline off_t config_writer_tell(CONF_WRITER *writer) {
+	return writer->offset + writer->used;
+} // config_writer_tell
+
+/**
+ * Append data to output.
+ * @param writer Writer
+ * @param data Data to write
+ * @param length Length of data
+ */
+static void config_writer_write(CONF_WRITER *writer, const char *data,
+	size_t length) {
+
+	while (length > 0) {
+		if (writer->used == CONFIG_SAVE_BUFFER) {
+			config_writer_flush(writer);
+		}
+
+		size_t chunk = CONFIG_SAVE_BUFFER - writer->used;
+		if (chunk > length) chunk = length;
+
+		memcpy(writer->buffer + writer->used, data, chunk);
+		writer->used += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+} // config_writer_write
+
+/**
+ * Append formatted text to output.
+ * @param writer Writer
+ * @param fmt Format, same as for printf
+ */
+static void config_writer_printf(CONF_WRITER *writer, const char *fmt, ...) {
+	char small[256];
+	va_list ap;
+
+	va_start(ap, fmt);
+	int length = vsnprintf(small, sizeof(small), fmt, ap);
+	va_end(ap);
+
+	if (length < 0) {
+		writer->error = true;
+	} else if ((size_t)length < sizeof(small)) {
+		config_writer_write(writer, small, length);
+	} else {
+		char *large = NULL;
+
+		va_start(ap, fmt);
+		length = vasprintf(&large, fmt, ap);
+		va_end(ap);
+
+		if (length < 0) {
+			writer->error = true;
+		} else {
+			config_writer_write(writer, large, length);
+			free(large);
+		}
+	}
+} // config_writer_printf
+
+/**
+ * Write indentation.
+ * @param writer Writer
+ * @param indent Number of tabs
+ */
+static void config_writer_indent(CONF_WRITER *writer, int indent) {
+	for (int i = 0; i < indent; i++) {
+		config_writer_write(writer, "\t", 1);
+	}
+} // config_writer_indent
+
+/**
+ * Copy byte range of previous version of the file to output. Uses
+ * copy_file_range, so the data doesn't have to pass through user space,
+ * and falls back to read and write if the file system doesn't support it.
+ * @param writer Writer
+ * @param offset Offset in previous version of the file
+ * @param length Number of bytes to copy
+ */
+static void config_writer_copy(CONF_WRITER *writer, off_t offset,
+	size_t length) {
+
+	config_writer_flush(writer);
+
+	bool splice = true;
+	while (length > 0 && !writer->error) {
+		ssize_t copied;
+
+		if (splice) {
+			copied = copy_file_range(writer->source, &offset, writer->fd,
+				NULL, length, 0);
+			if (copied < 0 && errno != EINTR) {
+				splice = false;
+				continue;
+			}
+		} else {
+			size_t chunk = length < CONFIG_SAVE_BUFFER ?
+				length : CONFIG_SAVE_BUFFER;
+			copied = pread(writer->source, writer->buffer, chunk, offset);
+			if (copied > 0) {
+				writer->used = copied;
+				config_writer_flush(writer);
+				offset += copied;
+				length -= copied;
+				continue;
+			}
+		}
+
+		if (copied == 0) {
+			// Previous version of the file is shorter than expected.
+			errno = EIO;
+			writer->error = true;
+		} else if (copied < 0) {
+			if (errno != EINTR) writer->error = true;
+		} else {
+			writer->offset += copied;
+			length -= copied;
+		}
+	}
+} // config_writer_copy
+
+/**
+ * Move byte ranges of section and all it's subsections after the section
+ * has been copied to different position.
+ * @param section Section
+ * @param delta Difference between new and old position
+ */
+static void config_save_shift(CONF_SECTION *section, off_t delta) {
+	section->sourceOffset += delta;
+	for (size_t i = 0; i < section->subSectionsCount; i++) {
+		config_save_shift(section->subSections[i], delta);
+	}
+} // config_save_shift
+
+/**
+ * Write contents of section. Sections that haven't changed since the file
+ * was loaded or saved are copied from previous version of the file, others
+ * are formatted the same way as config_save_section does. Byte ranges of
+ * sections are updated to match the new file.
+ * @param writer Writer
+ * @param section Section to write
+ * @param indent Number of tabs to indent values
+ */
+static void config_save_contents(CONF_WRITER *writer, CONF_SECTION *section,
+	int indent) {
+
+	// Save values
+	for (size_t i = 0; i < section->valuesCount; i++) {
+		CONF_VALUE *value = section->values[i];
+
+		config_writer_indent(writer, indent);
+
+		switch (htval_type(value->value)) {
+			case HT_INT:
+				config_writer_printf(writer, "%s = %ld;\n", value->name,
+					htval_get_int(value->value));
+				break;
+
+			case HT_FLOAT:
+				config_writer_printf(writer, "%s = %lf;\n", value->name,
+					htval_get_float(value->value));
+				break;
+
+			default:
+				config_writer_printf(writer, "%s = \"%s\";\n", value->name,
+					htval_get_string(value->value));
+				break;
+		}
+	}
+
+	if (section->valuesCount > 0 && section->subSectionsCount > 0) {
+		config_writer_write(writer, "\n", 1);
+	}
+
+	// Save subsections
+	for (size_t i = 0; i < section->subSectionsCount; i++) {
+		CONF_SECTION *sub = section->subSections[i];
+
+		config_writer_indent(writer, indent);
+
+		off_t start = config_writer_tell(writer);
+		if (writer->source >= 0 && !sub->changed && sub->sourceLength > 0) {
+			config_writer_copy(writer, sub->sourceOffset, sub->sourceLength);
+			config_save_shift(sub, start - sub->sourceOffset);
+		} else {
+			config_writer_printf(writer, "%s {\n", sub->name);
+			config_save_contents(writer, sub, indent + 1);
+			config_writer_indent(writer, indent);
+			config_writer_write(writer, "}", 1);
+
+			sub->sourceOffset = start;
+			sub->sourceLength = config_writer_tell(writer) - start;
+		}
+
+		config_writer_write(writer, "\n\n", 2);
+	}
+
+	section->changed = false;
+} // config_save_contents
+
+/**
+ * Test whether file is the same one configuration was loaded from or saved
+ * into.
+ * @param source Remembered identity
+ * @param st Status of the file
+ */
+static bool config_source_matches(CONF_SOURCE *source, struct stat *st) {
+	return source != NULL
+		&& source->device == st->st_dev
+		&& source->inode == st->st_ino
+		&& source->size == st->st_size
+		&& source->modified.tv_sec == st->st_mtim.tv_sec
+		&& source->modified.tv_nsec == st->st_mtim.tv_nsec;
+} // config_source_matches
+
+/**
+ * Flush directory containing the file, so rename is persisted.
+ * @param fileName File in the directory
+ */
+static void config_sync_dir(char *fileName) {
+	char *copy = strdup(fileName);
+	int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+	free(copy);
+} // config_sync_dir
+
+/**
+ * Save configuration into file. Configuration is written into temporary
+ * file which then atomically replaces the original one, so the file is
+ * never left half written. If the file wasn't modified since it was loaded
+ * or last saved, text of unchanged sections is copied from it instead of
+ * being formatted again.
+ * @param config Root configuration section
+ * @param fileName Path to the file
+ * @return True if configuration has been saved, false on error (errno is
+ *   set).
+ */
+bool config_save_file(CONF_SECTION *config, char *fileName) {
+	struct stat st;
+	mode_t mode = 0;
+
+	int source = open(fileName, O_RDONLY);
+	if (source >= 0) {
+		if (fstat(source, &st) == 0) {
+			mode = st.st_mode & 07777;
+			if (!config_source_matches(config->source, &st)) {
+				close(source);
+				source = -1;
+			}
+		} else {
+			close(source);
+			source = -1;
+		}
+	}
+
+	char *tempName;
+	if (asprintf(&tempName, "%s.XXXXXX", fileName) < 0) {
+		if (source >= 0) close(source);
+		return false;
+	}
+
+	int fd = mkstemp(tempName);
+	if (fd < 0) {
+		int error = errno;
+		if (source >= 0) close(source);
+		free(tempName);
+		errno = error;
+		return false;
+	}
+
+	// Keep permissions of the replaced file, new files are only accessible
+	// by owner.
+	if (mode != 0) {
+		fchmod(fd, mode);
+	}
+
+	CONF_WRITER *writer = malloc(sizeof(CONF_WRITER));
+	writer->fd = fd;
+	writer->source = source;
+	writer->offset = 0;
+	writer->used = 0;
+	writer->error = false;
+
+	config_save_contents(writer, config, 0);
+	config_writer_flush(writer);
+
+	bool result = !writer->error
+		&& fsync(fd) == 0
+		&& fstat(fd, &st) == 0
+		&& rename(tempName, fileName) == 0;
+	int error = errno;
+
+	free(writer);
+	close(fd);
+	if (source >= 0) close(source);
+
+	if (result) {
+		config_sync_dir(fileName);
+
+		if (config->source == NULL) {
+			config->source = malloc(sizeof(CONF_SOURCE));
+		}
+		config->source->device = st.st_dev;
+		config->source->inode = st.st_ino;
+		config->source->size = st.st_size;
+		config->source->modified = st.st_mtim;
+	} else {
+		unlink(tempName);
+
+		// Byte ranges now partially describe the file that has been thrown
+		// away, so next save must not copy anything.
+		free(config->source);
+		config->source = NULL;
+	}
+
+	free(tempName);
+	errno = error;
+	return result;
+} // config_save_file
@@ -0,0 +1,612 @@
+/**
+ *  This file is part of the IRCbot project.
+ *  Copyright (C) 2007  Michal Kuchta
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+// Standard libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Linux libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// This library interface
+#include "config.h"
+
+// My libraries
+#include <htable/htval.h>
+
+/**
+ * Snapshot file identification
+ */
+#define CONFIG_SNAPSHOT_MAGIC "IRCBSNAP"
+#define CONFIG_SNAPSHOT_VERSION 1
+#define CONFIG_SNAPSHOT_BYTEORDER 0x01020304
+
+/**
+ * Snapshot file header. Header is followed by arrays of sections, values
+ * and index slots, and by string table. All references are indexes to
+ * those arrays or offsets into string table, so the image can be mapped
+ * at any address.
+ */
+typedef struct {
+	char magic[8];					/**< CONFIG_SNAPSHOT_MAGIC */
+	uint32_t version;				/**< CONFIG_SNAPSHOT_VERSION */
+	uint32_t byteOrder;				/**< CONFIG_SNAPSHOT_BYTEORDER */
+	uint64_t device;				/**< Device of source file */
+	uint64_t inode;					/**< Inode of source file */
+	int64_t size;					/**< Size of source file */
+	int64_t modifiedSec;			/**< Modification time of source file */
+	int64_t modifiedNsec;			/**< Nanoseconds of modification time */
+	uint32_t sectionCount;			/**< Number of sections */
+	uint32_t valueCount;			/**< Number of values */
+	uint32_t slotCount;				/**< Number of index slots */
+	uint32_t reserved;				/**< Padding */
+	uint64_t stringsSize;			/**< Size of string table */
+} CONF_SNAPSHOT_HEADER;
+
+/**
+ * Section in snapshot. Sections are stored in breadth first order, so
+ * subsections of each section are stored next to each other. Root section
+ * is the first one.
+ */
+typedef struct {
+	uint64_t sourceOffset;			/**< Offset of section in source file */
+	uint64_t sourceLength;			/**< Length of section in source file */
+	uint32_t name;					/**< Offset of name in string table */
+	uint32_t firstSub;				/**< Index of first subsection */
+	uint32_t subCount;				/**< Number of subsections */
+	uint32_t firstValue;			/**< Index of first value */
+	uint32_t valueCount;			/**< Number of values */
+	uint32_t firstSlot;				/**< Index of first name index slot */
+	uint32_t slotCount;				/**< Number of name index slots */
+	uint32_t reserved;				/**< Padding */
+} CONF_SNAPSHOT_SECTION;
+
+/**
+ * Value in snapshot
+ */
+typedef struct {
+	union {
+		int64_t ival;				/**< Integer value */
+		double fval;				/**< Float value */
+		uint64_t sval;				/**< Offset of string value in string
+										 table */
+	} value;						/**< Value */
+	uint32_t name;					/**< Offset of name in string table */
+	uint32_t type;					/**< HTVAL_Type of value */
+} CONF_SNAPSHOT_VALUE;
+
+/**
+ * Slot of section's name index in snapshot. References are one based, 0
+ * means none.
+ */
+typedef struct {
+	uint32_t section;				/**< Index of subsection + 1 */
+	uint32_t value;					/**< Index of value + 1 */
+} CONF_SNAPSHOT_SLOT;
+
+/**
+ * String table being built
+ */
+typedef struct {
+	char *data;						/**< Strings */
+	size_t size;					/**< Used bytes */
+	size_t allocated;				/**< Allocated bytes */
+} CONF_SNAPSHOT_STRINGS;
+
+/**
+ * Get name of snapshot file.
+ * @param fileName Name of configuration file
+ * @return Name of snapshot, must be freed by caller.
+ */
+static char *config_snapshot_name(char *fileName) {
+	char *name;
+	if (asprintf(&name, "%s.snap", fileName) < 0) {
+		return NULL;
+	}
+	return name;
+} // config_snapshot_name
+
+/**
+ * Add string to string table.
+ * @param strings String table
+ * @param str String
+ * @return Offset of the string
+ */
+static uint64_t config_snapshot_string(CONF_SNAPSHOT_STRINGS *strings,
+	const char *str) {
+
+	size_t length = strlen(str) + 1;
+	if (strings->size + length > strings->allocated) {
+		while (strings->size + length > strings->allocated) {
+			strings->allocated *= 2;
+		}
+		strings->data = realloc(strings->data, strings->allocated);
+	}
+
+	uint64_t offset = strings->size;
+	memcpy(strings->data + offset, str, length);
+	strings->size += length;
+	return offset;
+} // config_snapshot_string
+
+/**
+ * Write binary snapshot of configuration loaded from file. Snapshot holds
+ * whole tree including name indexes and can be mapped back into memory
+ * without parsing.
+ * @param config Root section returned by config_parse
+ * @param fileName Path and name of file with configuration (not of the
+ *   snapshot)
+ * @return True if snapshot has been written.
+ */
+bool config_snapshot_write(CONF_SECTION *config, char *fileName) {
+	if (config->source == NULL) {
+		return false;
+	}
+
+	// Order sections breadth first, so subsections of each section are
+	// stored together.
+	size_t sectionCount = 1;
+	size_t sectionsAllocated = 64;
+	CONF_SECTION **sections = malloc(sectionsAllocated *
+		sizeof(CONF_SECTION *));
+	sections[0] = config;
+
+	for (size_t i = 0; i < sectionCount; i++) {
+		CONF_SECTION *section = sections[i];
+		if (sectionCount + section->subSectionsCount > sectionsAllocated) {
+			while (sectionCount + section->subSectionsCount >
+				sectionsAllocated) {
+				sectionsAllocated *= 2;
+			}
+			sections = realloc(sections, sectionsAllocated *
+				sizeof(CONF_SECTION *));
+		}
+		memcpy(sections + sectionCount, section->subSections,
+			section->subSectionsCount * sizeof(CONF_SECTION *));
+		sectionCount += section->subSectionsCount;
+	}
+
+	CONF_SNAPSHOT_SECTION *outSections = calloc(sectionCount,
+		sizeof(CONF_SNAPSHOT_SECTION));
+
+	size_t valueCount = 0;
+	size_t slotCount = 0;
+	size_t nextSub = 1;
+	for (size_t i = 0; i < sectionCount; i++) {
+		CONF_SECTION *section = sections[i];
+		CONF_INDEX *index = config_index_get(section);
+
+		outSections[i].firstSub = nextSub;
+		outSections[i].subCount = section->subSectionsCount;
+		outSections[i].firstValue = valueCount;
+		outSections[i].valueCount = section->valuesCount;
+		outSections[i].firstSlot = slotCount;
+		outSections[i].slotCount = index->size;
+		outSections[i].sourceOffset = section->sourceOffset;
+		outSections[i].sourceLength = section->sourceLength;
+
+		nextSub += section->subSectionsCount;
+		valueCount += section->valuesCount;
+		slotCount += index->size;
+	}
+
+	CONF_SNAPSHOT_VALUE *outValues = calloc(valueCount ? valueCount : 1,
+		sizeof(CONF_SNAPSHOT_VALUE));
+	CONF_SNAPSHOT_SLOT *outSlots = calloc(slotCount,
+		sizeof(CONF_SNAPSHOT_SLOT));
+	CONF_SNAPSHOT_STRINGS strings = {
+		.data = malloc(4096),
+		.size = 0,
+		.allocated = 4096
+	};
+
+	bool result = true;
+	for (size_t i = 0; i < sectionCount && result; i++) {
+		CONF_SECTION *section = sections[i];
+		CONF_SNAPSHOT_SECTION *out = &outSections[i];
+
+		out->name = config_snapshot_string(&strings, section->name);
+
+		for (size_t v = 0; v < section->valuesCount; v++) {
+			CONF_VALUE *value = section->values[v];
+			CONF_SNAPSHOT_VALUE *outValue = &outValues[out->firstValue + v];
+
+			outValue->name = config_snapshot_string(&strings, value->name);
+			outValue->type = htval_type(value->value);
+			switch (outValue->type) {
+				case HT_INT:
+					outValue->value.ival = htval_get_int(value->value);
+					break;
+
+				case HT_FLOAT:
+					outValue->value.fval = htval_get_float(value->value);
+					break;
+
+				case HT_STRING:
+					outValue->value.sval = config_snapshot_string(&strings,
+						htval_get_string(value->value));
+					break;
+
+				default:
+					// Parser doesn't create other types.
+					result = false;
+					break;
+			}
+		}
+
+		// Subsections are in the same order as in array, so index of
+		// subsection in snapshot is firstSub + it's index.
+		CONF_INDEX *index = section->nameIndex;
+		for (size_t s = 0; s < index->size; s++) {
+			CONF_INDEX_ITEM *item = &index->items[s];
+			CONF_SNAPSHOT_SLOT *slot = &outSlots[out->firstSlot + s];
+			if (item->section != NULL) {
+				slot->section = out->firstSub + item->section->index + 1;
+			}
+			if (item->value != NULL) {
+				slot->value = out->firstValue + item->value->index + 1;
+			}
+		}
+
+		// String tables in snapshot are limited to 4 GB.
+		if (strings.size > UINT32_MAX) {
+			result = false;
+		}
+	}
+
+	CONF_SNAPSHOT_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONFIG_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = CONFIG_SNAPSHOT_VERSION;
+	header.byteOrder = CONFIG_SNAPSHOT_BYTEORDER;
+	header.device = config->source->device;
+	header.inode = config->source->inode;
+	header.size = config->source->size;
+	header.modifiedSec = config->source->modified.tv_sec;
+	header.modifiedNsec = config->source->modified.tv_nsec;
+	header.sectionCount = sectionCount;
+	header.valueCount = valueCount;
+	header.slotCount = slotCount;
+	header.stringsSize = strings.size;
+
+	char *snapName = config_snapshot_name(fileName);
+	char *tempName = NULL;
+	if (result && snapName != NULL
+		&& asprintf(&tempName, "%s.XXXXXX", snapName) >= 0) {
+
+		int fd = mkstemp(tempName);
+		FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+		if (f != NULL) {
+			result = fwrite(&header, sizeof(header), 1, f) == 1
+				&& fwrite(outSections, sizeof(CONF_SNAPSHOT_SECTION),
+					sectionCount, f) == sectionCount
+				&& fwrite(outValues, sizeof(CONF_SNAPSHOT_VALUE),
+					valueCount, f) == valueCount
+				&& fwrite(outSlots, sizeof(CONF_SNAPSHOT_SLOT),
+					slotCount, f) == slotCount
+				&& fwrite(strings.data, 1, strings.size, f) == strings.size;
+			result = (fclose(f) == 0) && result
+				&& rename(tempName, snapName) == 0;
+		} else {
+			if (fd >= 0) close(fd);
+			result = false;
+		}
+
+		if (!result && fd >= 0) {
+			unlink(tempName);
+		}
+	} else {
+		result = false;
+	}
+
+	free(tempName);
+	free(snapName);
+	free(strings.data);
+	free(outSlots);
+	free(outValues);
+	free(outSections);
+	free(sections);
+
+	return result;
+} // config_snapshot_write
+
+/**
+ * Check that references in snapshot point inside the image and describe a
+ * tree, so broken snapshot can't make the loader crash.
+ * @param header Snapshot header
+ * @param sections Sections
+ * @param values Values
+ * @param slots Index slots
+ * @param strings String table
+ * @return True if snapshot is consistent.
+ */
+static bool config_snapshot_check(CONF_SNAPSHOT_HEADER *header,
+	CONF_SNAPSHOT_SECTION *sections, CONF_SNAPSHOT_VALUE *values,
+	CONF_SNAPSHOT_SLOT *slots, const char *strings) {
+
+	if (header->sectionCount == 0 || header->stringsSize == 0
+		|| strings[header->stringsSize - 1] != '\0') {
+		return false;
+	}
+
+	uint64_t nextSub = 1;
+	uint64_t nextValue = 0;
+	uint64_t nextSlot = 0;
+	for (uint32_t i = 0; i < header->sectionCount; i++) {
+		CONF_SNAPSHOT_SECTION *section = &sections[i];
+
+		if (section->name >= header->stringsSize
+			|| section->firstSub != nextSub
+			|| section->firstValue != nextValue
+			|| section->firstSlot != nextSlot
+			|| (section->subCount > 0 && section->firstSub <= i)
+			|| (section->slotCount & (section->slotCount - 1)) != 0
+			|| section->slotCount < section->subCount + section->valueCount) {
+			return false;
+		}
+
+		nextSub += section->subCount;
+		nextValue += section->valueCount;
+		nextSlot += section->slotCount;
+		if (nextSub > header->sectionCount || nextValue > header->valueCount
+			|| nextSlot > header->slotCount) {
+			return false;
+		}
+
+		for (uint32_t s = 0; s < section->slotCount; s++) {
+			CONF_SNAPSHOT_SLOT *slot = &slots[section->firstSlot + s];
+			if ((slot->section != 0 && (slot->section <= section->firstSub
+				|| slot->section > section->firstSub + section->subCount))
+				|| (slot->value != 0 && (slot->value <= section->firstValue
+				|| slot->value > section->firstValue + section->valueCount))) {
+				return false;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < header->valueCount; i++) {
+		if (values[i].name >= header->stringsSize) {
+			return false;
+		}
+		if (values[i].type == HT_STRING) {
+			if (values[i].value.sval >= header->stringsSize) {
+				return false;
+			}
+		} else if (values[i].type != HT_INT && values[i].type != HT_FLOAT) {
+			return false;
+		}
+	}
+
+	return nextSub == header->sectionCount
+		&& nextValue == header->valueCount
+		&& nextSlot == header->slotCount;
+} // config_snapshot_check
+
+/**
+ * Load configuration from binary snapshot of file.
+ * @param fileName Path and name of file with configuration (not of the
+ *   snapshot)
+ * @return Configuration, or NULL if there is no snapshot, it is invalid or
+ *   it was made from different version of the file.
+ */
+CONF_SECTION *config_snapshot_load(char *fileName) {
+	struct stat sourceStat;
+	if (stat(fileName, &sourceStat) != 0) {
+		return NULL;
+	}
+
+	char *snapName = config_snapshot_name(fileName);
+	if (snapName == NULL) {
+		return NULL;
+	}
+
+	int fd = open(snapName, O_RDONLY);
+	free(snapName);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	char *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0
+		&& (size_t)st.st_size >= sizeof(CONF_SNAPSHOT_HEADER)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	CONF_SNAPSHOT_HEADER *header = (CONF_SNAPSHOT_HEADER *)data;
+	size_t sectionsSize = (size_t)header->sectionCount *
+		sizeof(CONF_SNAPSHOT_SECTION);
+	size_t valuesSize = (size_t)header->valueCount *
+		sizeof(CONF_SNAPSHOT_VALUE);
+	size_t slotsSize = (size_t)header->slotCount * sizeof(CONF_SNAPSHOT_SLOT);
+
+	if (memcmp(header->magic, CONFIG_SNAPSHOT_MAGIC, sizeof(header->magic))
+		|| header->version != CONFIG_SNAPSHOT_VERSION
+		|| header->byteOrder != CONFIG_SNAPSHOT_BYTEORDER
+		|| header->device != sourceStat.st_dev
+		|| header->inode != sourceStat.st_ino
+		|| header->size != sourceStat.st_size
+		|| header->modifiedSec != sourceStat.st_mtim.tv_sec
+		|| header->modifiedNsec != sourceStat.st_mtim.tv_nsec
+		|| (uint64_t)st.st_size != sizeof(CONF_SNAPSHOT_HEADER) +
+			sectionsSize + valuesSize + slotsSize + header->stringsSize) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+
+	CONF_SNAPSHOT_SECTION *sections = (CONF_SNAPSHOT_SECTION *)
+		(data + sizeof(CONF_SNAPSHOT_HEADER));
+	CONF_SNAPSHOT_VALUE *values = (CONF_SNAPSHOT_VALUE *)
+		((char *)sections + sectionsSize);
+	CONF_SNAPSHOT_SLOT *slots = (CONF_SNAPSHOT_SLOT *)
+		((char *)values + valuesSize);
+	char *strings = (char *)slots + slotsSize;
+
+	if (!config_snapshot_check(header, sections, values, slots, strings)) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+
+	// Names stay in the mapped image, which serves as arena of the tree.
+	CONF_ARENA *arena = malloc(sizeof(CONF_ARENA));
+	arena->data = data;
+	arena->size = st.st_size;
+	arena->used = st.st_size;
+	arena->mapped = true;
+
+	CONF_SECTION **tree = malloc(header->sectionCount *
+		sizeof(CONF_SECTION *));
+	CONF_VALUE **treeValues = malloc((header->valueCount ?
+		header->valueCount : 1) * sizeof(CONF_VALUE *));
+
+	for (uint32_t i = 0; i < header->sectionCount; i++) {
+		tree[i] = config_new_section_name(strings + sections[i].name);
+		tree[i]->arena = arena;
+		tree[i]->sourceOffset = sections[i].sourceOffset;
+		tree[i]->sourceLength = sections[i].sourceLength;
+	}
+
+	for (uint32_t i = 0; i < header->sectionCount; i++) {
+		CONF_SNAPSHOT_SECTION *in = &sections[i];
+		CONF_SECTION *section = tree[i];
+
+		if (in->subCount > 0) {
+			section->subSections = malloc(in->subCount *
+				sizeof(CONF_SECTION *));
+			section->subSectionsAllocated = in->subCount;
+			section->subSectionsCount = in->subCount;
+			for (uint32_t s = 0; s < in->subCount; s++) {
+				CONF_SECTION *sub = tree[in->firstSub + s];
+				sub->parent = section;
+				sub->index = s;
+				section->subSections[s] = sub;
+			}
+		}
+
+		if (in->valueCount > 0) {
+			section->values = malloc(in->valueCount * sizeof(CONF_VALUE *));
+			section->valuesAllocated = in->valueCount;
+			section->valuesCount = in->valueCount;
+			for (uint32_t v = 0; v < in->valueCount; v++) {
+				CONF_SNAPSHOT_VALUE *inValue = &values[in->firstValue + v];
+				CONF_VALUE *value = config_new_value_name(
+					strings + inValue->name);
+
+				switch (inValue->type) {
+					case HT_INT:
+						value->value = htval_inte(inValue->value.ival,
+							value->value);
+						break;
+
+					case HT_FLOAT:
+						value->value = htval_floate(inValue->value.fval,
+							value->value);
+						break;
+
+					default:
+						value->value = htval_stringe(
+							strings + inValue->value.sval, value->value);
+						break;
+				}
+
+				value->section = section;
+				value->index = v;
+				section->values[v] = value;
+				treeValues[in->firstValue + v] = value;
+			}
+		}
+	}
+
+	// Name indexes were built by the same hash function, so slots can be
+	// used as they are.
+	for (uint32_t i = 0; i < header->sectionCount; i++) {
+		CONF_SNAPSHOT_SECTION *in = &sections[i];
+		if (in->slotCount == 0) continue;
+
+		CONF_INDEX *index = malloc(sizeof(CONF_INDEX));
+		index->size = in->slotCount;
+		index->items = calloc(index->size, sizeof(CONF_INDEX_ITEM));
+
+		for (uint32_t s = 0; s < in->slotCount; s++) {
+			CONF_SNAPSHOT_SLOT *slot = &slots[in->firstSlot + s];
+			CONF_INDEX_ITEM *item = &index->items[s];
+
+			if (slot->section != 0) {
+				item->section = tree[slot->section - 1];
+				item->name = item->section->name;
+			}
+			if (slot->value != 0) {
+				item->value = treeValues[slot->value - 1];
+				if (item->name == NULL) {
+					item->name = item->value->name;
+				}
+			}
+			if (item->name != NULL) {
+				item->length = strlen(item->name);
+			}
+		}
+
+		tree[i]->nameIndex = index;
+	}
+
+	CONF_SECTION *root = tree[0];
+	root->source = malloc(sizeof(CONF_SOURCE));
+	root->source->device = sourceStat.st_dev;
+	root->source->inode = sourceStat.st_ino;
+	root->source->size = sourceStat.st_size;
+	root->source->modified = sourceStat.st_mtim;
+
+	free(treeValues);
+	free(tree);
+
+	return root;
+} // config_snapshot_load
+
+/**
+ * Loads configuration from file, using it's binary snapshot (fileName.snap)
+ * when the snapshot was made from current version of the file. Otherwise the
+ * file is parsed by config_parse and new snapshot is written.
+ * @param fileName Path and name of file with configuration
+ * @return Configuration or NULL if error has occured during parsing.
+ */
+CONF_SECTION *config_load(char *fileName) {
+	CONF_SECTION *config = config_snapshot_load(fileName);
+	if (config == NULL) {
+		config = config_parse(fileName);
+
+		// Snapshot is only an optimization, so failing to write it (for
+		// example in read only directory) isn't an error.
+		if (config != NULL) {
+			config_snapshot_write(config, fileName);
+		}
+	}
+	return config;
+} // config_load
@@ -32,54 +32,102 @@ string dynastring_init() {
 	string result = malloc(sizeof(sstring));
 	if (result == NULL) return NULL;
 
-	// Initial allocation
-	result->data = malloc(64 * sizeof(char));
-	result->length = 0;
-	if (result->data != NULL) {
-		result->allocated = 64;
-		memset(result->data, '\0', result->allocated);
-	} else {
-		result->allocated = 0;
-	}
-	result->pointer = 0;
+	dynastring_init_inplace(result);
 	return result;
 } // dynastring_init
 
 /**
- * Append char to dynamic string
+ * Init dynamic string stored in caller's memory (for example on stack).
+ * Such string must be freed by dynastring_free_inplace and must not be
+ * copied.
  * @param s String
- * @param ch Char to append
  */
-void dynastring_appendchar(string s, char ch) {
-	static const int BLOCK_SIZE = 64;
+void dynastring_init_inplace(string s) {
+	s->data = s->small;
+	s->data[0] = '\0';
+	s->length = 0;
+	s->allocated = DYNASTRING_INLINE_SIZE;
+	s->pointer = 0;
+} // dynastring_init_inplace
 
-	if (s == NULL) return;
-
-	// Do the initial allocation, but it shouldn't be necessary.
-	if (s->allocated == 0) {
-		s->allocated = BLOCK_SIZE;
-		s->data = malloc(s->allocated);
-		memset(s->data, '\0', BLOCK_SIZE);
+/**
+ * Free memory allocated by string initialized with dynastring_init_inplace.
+ * @param s String
+ */
+void dynastring_free_inplace(string s) {
+	if (s->data != s->small) {
+		free(s->data);
 	}
+	dynastring_init_inplace(s);
+} // dynastring_free_inplace
+
+/**
+ * Make sure string can hold given number of chars without reallocation.
+ * Buffer grows at least twice, so appending is amortized constant time.
+ * @param s String
+ * @param length Number of chars
+ * @return False if memory can't be allocated.
+ */
+bool dynastring_reserve(string s, size_t length) {
+	if (length < s->allocated) return true;
 
-	// Realloc string, if new char doesn't fit into buffer.
-	if (s->length >= s->allocated) {
-		s->allocated += BLOCK_SIZE;
-		s->data = realloc(s->data, s->allocated);
-		memset(s->data + s->allocated - BLOCK_SIZE, '\0', BLOCK_SIZE);
+	size_t allocated = s->allocated * 2;
+	if (allocated <= length) {
+		allocated = length + 1;
 	}
 
-	if (s->data != NULL) {
-		for (size_t i = s->length; i > s->pointer; i--) {
-			s->data[i] = s->data[i-1];
+	char *data;
+	if (s->data == s->small) {
+		data = malloc(allocated);
+		if (data != NULL) {
+			memcpy(data, s->small, s->length + 1);
 		}
-		s->data[s->pointer++] = ch;
-		s->length++;
 	} else {
-		// Memory allocation error
-		s->allocated = 0;
-		s->length = 0;
-		s->pointer = 0;
+		data = realloc(s->data, allocated);
+	}
+
+	if (data == NULL) return false;
+
+	s->data = data;
+	s->allocated = allocated;
+	return true;
+} // dynastring_reserve
+
+/**
+ * Insert chars at pointer position and move pointer after them.
+ * @param s String
+ * @param str Chars to insert, don't need to be zero terminated.
+ * @param length Number of chars
+ */
+void dynastring_appendn(string s, const char *str, size_t length) {
+	if (s == NULL || length == 0) return;
+	if (!dynastring_reserve(s, s->length + length)) return;
+
+	if (s->pointer < s->length) {
+		memmove(s->data + s->pointer + length, s->data + s->pointer,
+			s->length - s->pointer);
+	}
+	memcpy(s->data + s->pointer, str, length);
+	s->pointer += length;
+	s->length += length;
+	s->data[s->length] = '\0';
+} // dynastring_appendn
+
+/**
+ * Append char to dynamic string
+ * @param s String
+ * @param ch Char to append
+ */
+void dynastring_appendchar(string s, char ch) {
+	if (s == NULL) return;
+
+	// Most chars are appended at the end.
+	if (s->pointer == s->length && s->length + 1 < s->allocated) {
+		s->data[s->length++] = ch;
+		s->data[s->length] = '\0';
+		s->pointer++;
+	} else {
+		dynastring_appendn(s, &ch, 1);
 	}
 } // dynastring_append
 
@@ -90,9 +138,7 @@ void dynastring_appendchar(string s, char ch) {
  */
 void dynastring_appendstring(string s, char *ch) {
 	if (ch != NULL) {
-		for (size_t i = 0; i < strlen(ch); i++) {
-			dynastring_appendchar(s, ch[i]);
-		}
+		dynastring_appendn(s, ch, strlen(ch));
 	}
 } // dynastring_appendstring
 
@@ -102,7 +148,7 @@ void dynastring_appendstring(string s, char *ch) {
  * @param ch String that should be appended.
  */
 void dynastring_append(string s, string ch) {
-	dynastring_appendstring(s, dynastring_getstring(ch));
+	dynastring_appendn(s, ch->data, ch->length);
 } // dynastring_append
 
 /**
@@ -112,12 +158,9 @@ void dynastring_append(string s, string ch) {
 void dynastring_clear(string s) {
 	if (s == NULL) return;
 
-	if (s->allocated > 0) {
-		// Empty string
-		memset(s->data, '\0', s->allocated);
-		s->length = 0;
-		s->pointer = 0;
-	}
+	s->data[0] = '\0';
+	s->length = 0;
+	s->pointer = 0;
 } // dynastring_clear
 
 /**
@@ -125,7 +168,7 @@ void dynastring_clear(string s) {
  * @param s String
  */
 void dynastring_free(string s) {
-	if (s->allocated > 0) {
+	if (s->data != s->small) {
 		free(s->data);
 	}
 	free(s);
@@ -207,27 +250,19 @@ int dynastring_delete(string s, int count) {
 		count *= -1;
 		if ((int)s->pointer - count < 0) count = s->pointer;
 
-		for (size_t i = s->pointer - count; i < s->length; i++) {
-			s->data[i] = s->data[i+count];
-		}
+		memmove(s->data + s->pointer - count, s->data + s->pointer,
+			s->length - s->pointer + 1);
 		s->length -= count;
 		s->pointer -= count;
 
-		// Remove deleted characters
-		memset(s->data + s->length, '\0', count);
-
 		return count;
 	} else if (count > 0) {
 		// Delete
 		if (s->pointer + count >= s->length) count = s->length - s->pointer;
-		for (int i = s->pointer + count; i < (int)s->length; i++) {
-			s->data[i-count] = s->data[i];
-		}
+		memmove(s->data + s->pointer, s->data + s->pointer + count,
+			s->length - s->pointer - count + 1);
 		s->length -= count;
 
-		// Remove deleted characters
-		memset(s->data + s->length, '\0', count);
-
 		return count;
 	}
 
@@ -21,15 +21,26 @@
 #define _DYNASTRING_H 1
 
 #include <stdio.h>
+#include <stdbool.h>
 
 /**
- * Dynamic string
+ * Size of buffer inside dynastring, including terminating zero. Strings
+ * that fit (for example whole IRC messages) don't need any other
+ * allocation.
+ */
+#define DYNASTRING_INLINE_SIZE 512
+
+/**
+ * Dynamic string. Data are always terminated by zero.
  */
 typedef struct {
-	char *data;
-	size_t length;
-	size_t allocated;
-	size_t pointer;
+	char *data;						/**< String, points to small or to
+										 allocated memory */
+	size_t length;					/**< Length of string */
+	size_t allocated;				/**< Size of data buffer */
+	size_t pointer;					/**< Position where chars are
+										 inserted */
+	char small[DYNASTRING_INLINE_SIZE]; /**< Inline buffer */
 } sstring;
 typedef sstring *string;
 
@@ -39,6 +50,36 @@ typedef sstring *string;
  */
 extern string dynastring_init();
 
+/**
+ * Init dynamic string stored in caller's memory (for example on stack).
+ * Such string must be freed by dynastring_free_inplace and must not be
+ * copied.
+ * @param s String
+ */
+extern void dynastring_init_inplace(string s);
+
+/**
+ * Free memory allocated by string initialized with dynastring_init_inplace.
+ * @param s String
+ */
+extern void dynastring_free_inplace(string s);
+
+/**
+ * Make sure string can hold given number of chars without reallocation.
+ * @param s String
+ * @param length Number of chars
+ * @return False if memory can't be allocated.
+ */
+extern bool dynastring_reserve(string s, size_t length);
+
+/**
+ * Insert chars at pointer position and move pointer after them.
+ * @param s String
+ * @param str Chars to insert, don't need to be zero terminated.
+ * @param length Number of chars
+ */
+extern void dynastring_appendn(string s, const char *str, size_t length);
+
 /**
  * Append char to dynamic string
  * @param s String
@@ -67,8 +108,7 @@ extern void dynastring_append(string s, string str);
 extern void dynastring_clear(string s);
 
 /**
- * Free dynamically allocated string, but it doesn't free the pointer, so
- * the string can be used again.
+ * Free dynamically allocated string.
  * @param s String
  */
 extern void dynastring_free(string s);
@@ -26,10 +26,106 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 // This library interface
 #include "htval.h"
 
+/**
+ * Number of values allocated at once
+ */
+#define HTVAL_SLAB_SIZE 256
+
+/**
+ * Slot in slab of values. Unused slots are linked into free list.
+ */
+typedef union uHTVAL_Slot {
+	struct sHTVAL value;		/**< Value stored in slot */
+	union uHTVAL_Slot *next;	/**< Next free slot */
+} HTVAL_Slot;
+
+/**
+ * Free slots of all slabs. Slabs are never returned to the system, freed
+ * values are reused by next allocations.
+ */
+static HTVAL_Slot *htval_freeSlots = NULL;
+
+/**
+ * Values are created from configuration reload thread too.
+ */
+static pthread_mutex_t htval_slabLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Allocate memory for HTVAL from slab.
+ * @return Uninitialized HTVAL
+ */
+static HTVAL htval_alloc() {
+	pthread_mutex_lock(&htval_slabLock);
+
+	if (htval_freeSlots == NULL) {
+		HTVAL_Slot *slab = malloc(HTVAL_SLAB_SIZE * sizeof(HTVAL_Slot));
+		for (size_t i = 0; i < HTVAL_SLAB_SIZE - 1; i++) {
+			slab[i].next = &slab[i + 1];
+		}
+		slab[HTVAL_SLAB_SIZE - 1].next = NULL;
+		htval_freeSlots = slab;
+	}
+
+	HTVAL_Slot *slot = htval_freeSlots;
+	htval_freeSlots = slot->next;
+
+	pthread_mutex_unlock(&htval_slabLock);
+	return &slot->value;
+} // htval_alloc
+
+/**
+ * Return memory of HTVAL to slab.
+ * @param value HTVAL
+ */
+static void htval_release(HTVAL value) {
+	HTVAL_Slot *slot = (HTVAL_Slot *)value;
+
+	pthread_mutex_lock(&htval_slabLock);
+	slot->next = htval_freeSlots;
+	htval_freeSlots = slot;
+	pthread_mutex_unlock(&htval_slabLock);
+} // htval_release
+
+/**
+ * Store string into HTVAL, short strings are stored inline.
+ * @param value HTVAL whose old value has already been freed.
+ * @param str String to store
+ * @param length Length of string
+ */
+static void htval_store_string(HTVAL value, const char *str, size_t length) {
+	if (length < HTVAL_INLINE_SIZE) {
+		memmove(value->small, str, length);
+		value->small[length] = '\0';
+		value->value.sval = value->small;
+	} else {
+		value->value.sval = strndup(str, length);
+	}
+	value->type = HT_STRING;
+} // htval_store_string
+
+/**
+ * Make sure array has space for given number of values. Space grows
+ * geometrically, so appending is amortized constant time.
+ * @param array Array
+ * @param needed Number of values
+ */
+static void htval_array_reserve(HTVAL_Array *array, size_t needed) {
+	if (needed <= array->allocated) return;
+
+	size_t allocated = array->allocated > 0 ? array->allocated : 4;
+	while (allocated < needed) {
+		allocated *= 2;
+	}
+
+	array->values = realloc(array->values, allocated * sizeof(HTVAL));
+	array->allocated = allocated;
+} // htval_array_reserve
+
 /**
  * Create new HTVAL or set type of existing HTVAL to NULL
  * @param existing Existing HTVAL to modify. If NULL, new htval will be
@@ -37,7 +133,7 @@
  */
 HTVAL htval_nulle(HTVAL existing) {
 	if (existing == NULL) {
-		existing = malloc(sizeof(struct sHTVAL));
+		existing = htval_alloc();
 	} else {
 		htval_free_value(existing);
 	}
@@ -74,14 +170,27 @@ HTVAL htval_floate(double value, HTVAL existing) {
 
 /**
  * Create new HTVAL or set type of existing HTVAL to string
- * @param value New value of HTVAL
+ * @param value New value of HTVAL, may point into existing's current value.
  * @param existing Existing HTVAL to modify. If NULL, new htval will be
  *   created.
  */
 HTVAL htval_stringe(char *value, HTVAL existing) {
-	existing = htval_nulle(existing);
-	existing->type = HT_STRING;
-	existing->value.sval = strdup(value);
+	char *old = NULL;
+
+	if (existing == NULL) {
+		existing = htval_alloc();
+	} else if (existing->type == HT_STRING) {
+		// Old string is freed after the new one is stored, value may be
+		// part of it.
+		if (existing->value.sval != existing->small) {
+			old = existing->value.sval;
+		}
+	} else {
+		htval_free_value(existing);
+	}
+
+	htval_store_string(existing, value, strlen(value));
+	free(old);
 	return existing;
 } // htval_stringe
 
@@ -96,6 +205,11 @@ HTVAL htval_arraye(HTVAL_Array value, HTVAL existing) {
 	existing = htval_nulle(existing);
 	existing->type = HT_ARRAY;
 	existing->value.aval = value;
+
+	// Arrays built by caller may not fill allocated space.
+	if (existing->value.aval.allocated < value.length) {
+		existing->value.aval.allocated = value.length;
+	}
 	return existing;
 } // htval_arraye
 
@@ -112,12 +226,16 @@ void htval_free_value(HTVAL value) {
 			break;
 
 		case HT_STRING:
-			free(value->value.sval);
+			if (value->value.sval != value->small) {
+				free(value->value.sval);
+			}
 			break;
 
 		case HT_ARRAY:
 			for (size_t i = 0; i < value->value.aval.length; i++) {
-				htval_free(value->value.aval.values[i]);
+				if (value->value.aval.values[i] != NULL) {
+					htval_free(value->value.aval.values[i]);
+				}
 			}
 			free(value->value.aval.values);
 			break;
@@ -132,7 +250,7 @@ void htval_free_value(HTVAL value) {
  */
 void htval_free(HTVAL value) {
 	htval_free_value(value);
-	free(value);
+	htval_release(value);
 } // htval_free
 
 /**
@@ -243,20 +361,25 @@ char *htval_get_string(HTVAL value) {
 
 	switch (value->type) {
 		case HT_INT: {
-			char *str;
-			asprintf(&str, "%ld", value->value.ival);
-			htval_free_value(value);
-			value->type = HT_STRING;
-			value->value.sval = str;
+			char str[64];
+			int length = snprintf(str, sizeof(str), "%ld", value->value.ival);
+			htval_store_string(value, str, length);
 			break;
 		}
 
 		case HT_FLOAT: {
+			// %lf of big numbers doesn't fit into any fixed buffer.
 			char *str;
-			asprintf(&str, "%lf", value->value.fval);
-			htval_free_value(value);
-			value->type = HT_STRING;
-			value->value.sval = str;
+			int length = asprintf(&str, "%lf", value->value.fval);
+			if (length < 0) {
+				htval_store_string(value, "", 0);
+			} else if (length < HTVAL_INLINE_SIZE) {
+				htval_store_string(value, str, length);
+				free(str);
+			} else {
+				value->type = HT_STRING;
+				value->value.sval = str;
+			}
 			break;
 		}
 
@@ -267,14 +390,12 @@ char *htval_get_string(HTVAL value) {
 
 		case HT_ARRAY: {
 			htval_free_value(value);
-			value->type = HT_STRING;
-			value->value.sval = strdup("Array");
+			htval_store_string(value, "Array", 5);
 			break;
 		}
 
 		case HT_NULL: {
-			value->type = HT_STRING;
-			value->value.sval = strdup("");
+			htval_store_string(value, "", 0);
 			break;
 		}
 	}
@@ -298,6 +419,7 @@ HTVAL_Array htval_get_array(HTVAL value) {
 			value->type = HT_ARRAY;
 			value->value.aval.length = 0;
 			value->value.aval.values = NULL;
+			value->value.aval.allocated = 0;
 			break;
 		}
 
@@ -319,7 +441,7 @@ HTVAL_Array htval_get_array(HTVAL value) {
  */
 HTVAL htval_get_index(HTVAL value, size_t index) {
 	HTVAL_Array array = htval_get_array(value);
-	if (array.length <= index) {
+	if (index < array.length) {
 		return array.values[index];
 	} else {
 		return NULL;
@@ -333,21 +455,17 @@ HTVAL htval_get_index(HTVAL value, size_t index) {
  * @param newval New HTVAL that will be set to specified index in array
  */
 void htval_set_index(HTVAL value, size_t index, HTVAL newval) {
-	HTVAL_Array array = htval_get_array(value);
-	if (array.length <= index) {
-		if (array.length == 0) {
-			array.length = index + 1;
-			array.values = malloc(array.length * sizeof(HTVAL));
-		} else {
-			size_t oldlength = array.length;
-			array.length = index + 1;
-			array.values = realloc(array.values, array.length * sizeof(HTVAL));
-			for (size_t i = oldlength; i < array.length; i++) {
-				array.values[i] = NULL;
-			}
+	htval_get_array(value);
+	HTVAL_Array *array = &value->value.aval;
+
+	if (index >= array->length) {
+		htval_array_reserve(array, index + 1);
+		for (size_t i = array->length; i < index; i++) {
+			array->values[i] = NULL;
 		}
+		array->length = index + 1;
 	}
-	array.values[index] = newval;
+	array->values[index] = newval;
 } // htval_set_index
 
 /**
@@ -368,11 +486,19 @@ void htval_append(HTVAL value, HTVAL newval) {
  * @param newval New HTVAL that will be inserted at specified index
  */
 void htval_insert(HTVAL value, size_t index, HTVAL newval) {
-	HTVAL_Array array = htval_get_array(value);
-	for (size_t i = array.length; i > index; i--) {
-		htval_set_index(value, i, htval_get_index(value, i-1));
+	htval_get_array(value);
+	HTVAL_Array *array = &value->value.aval;
+
+	if (index >= array->length) {
+		htval_set_index(value, index, newval);
+		return;
 	}
-	htval_set_index(value, index, newval);
+
+	htval_array_reserve(array, array->length + 1);
+	memmove(array->values + index + 1, array->values + index,
+		(array->length - index) * sizeof(HTVAL));
+	array->values[index] = newval;
+	array->length++;
 } // htval_insert
 
 /**
@@ -381,12 +507,17 @@ void htval_insert(HTVAL value, size_t index, HTVAL newval) {
  * @param index Index to remove
  */
 void htval_remove(HTVAL value, size_t index) {
-	HTVAL_Array array = htval_get_array(value);
-	for (size_t i = index; i < array.length - 1; i++) {
-		htval_set_index(value, i, htval_get_index(value, i+1));
+	htval_get_array(value);
+	HTVAL_Array *array = &value->value.aval;
+
+	if (index >= array->length) return;
+
+	if (array->values[index] != NULL) {
+		htval_free(array->values[index]);
 	}
-	htval_free(array.values[array.length - 1]);
-	array.length--;
+	memmove(array->values + index, array->values + index + 1,
+		(array->length - index - 1) * sizeof(HTVAL));
+	array->length--;
 } // htval_remove
 
 /**
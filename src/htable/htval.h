@@ -37,8 +37,15 @@ typedef enum {
 typedef struct {
 	size_t length;				/**< Number of items in array */
 	HTVAL *values;				/**< Values of array */
+	size_t allocated;			/**< Allocated space for values */
 } HTVAL_Array;
 
+/**
+ * Size of buffer for short strings stored directly in HTVAL, including
+ * terminating zero.
+ */
+#define HTVAL_INLINE_SIZE 24
+
 /**
  * HTVAL
  */
@@ -47,9 +54,11 @@ struct sHTVAL {
 	union {
 		long int ival;			/**< Integer value */
 		double fval;			/**< Float value */
-		char *sval;				/**< String value */
+		char *sval;				/**< String value, points to small for
+									 short strings */
 		HTVAL_Array aval;		/**< Array value */
 	} value;					/**< Value union */
+	char small[HTVAL_INLINE_SIZE]; /**< Storage of short string value */
 }; // sHTVAL
 
 /**
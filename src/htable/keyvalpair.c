@@ -28,6 +28,107 @@
 #include <toolbox/linkedlist.h>
 #include <toolbox/tb_string.h>
 
+/**
+ * Initial number of slots of hash table
+ */
+#define KVP_INITIAL_SIZE 8
+
+/**
+ * Compute hash of key (FNV-1a).
+ * @param key Key
+ * @return Hash
+ */
+static size_t kvp_hash(const char *key) {
+	size_t hash = (size_t)14695981039346656037ULL;
+	for (const unsigned char *c = (const unsigned char *)key; *c != '\0';
+		c++) {
+		hash ^= *c;
+		hash *= (size_t)1099511628211ULL;
+	}
+	return hash;
+} // kvp_hash
+
+/**
+ * Distance of slot from slot where the hash belongs.
+ * @param kvp Key-Value pair array
+ * @param hash Hash stored in slot
+ * @param i Slot index
+ */
+static inline size_t kvp_distance(KVPArray kvp, size_t hash, size_t i) {
+	return (i - (hash & (kvp->size - 1))) & (kvp->size - 1);
+} // kvp_distance
+
+/**
+ * Put pair into hash table. Pair that is closer to it's home slot than
+ * inserted one gives up it's slot and is moved further (Robin Hood), which
+ * keeps probe sequences short.
+ * @param kvp Key-Value pair array, must have a free slot.
+ * @param pair Pair to insert
+ */
+static void kvp_slot_insert(KVPArray kvp, KeyValPair pair) {
+	size_t mask = kvp->size - 1;
+	KVPSlot slot = { .pair = pair, .hash = pair->hash };
+	size_t i = slot.hash & mask;
+	size_t distance = 0;
+
+	while (kvp->slots[i].pair != NULL) {
+		size_t existing = kvp_distance(kvp, kvp->slots[i].hash, i);
+		if (existing < distance) {
+			KVPSlot temp = kvp->slots[i];
+			kvp->slots[i] = slot;
+			slot = temp;
+			distance = existing;
+		}
+		i = (i + 1) & mask;
+		distance++;
+	}
+
+	kvp->slots[i] = slot;
+} // kvp_slot_insert
+
+/**
+ * Resize hash table.
+ * @param kvp Key-Value pair array
+ * @param size New number of slots, power of two.
+ */
+static void kvp_resize(KVPArray kvp, size_t size) {
+	free(kvp->slots);
+	kvp->size = size;
+	kvp->slots = calloc(size, sizeof(KVPSlot));
+
+	ll_loop(kvp, kv) {
+		kvp_slot_insert(kvp, kv);
+	}
+} // kvp_resize
+
+/**
+ * Find slot of key.
+ * @param kvp Key-Value pair array
+ * @param key Key
+ * @param hash Hash of key
+ * @return Slot index, or kvp->size if key doesn't exist.
+ */
+static size_t kvp_slot_find(KVPArray kvp, const char *key, size_t hash) {
+	if (kvp->size == 0) return 0;
+
+	size_t mask = kvp->size - 1;
+	size_t i = hash & mask;
+
+	// Stop as soon as we meet pair closer to it's home than the key would
+	// be, the key can't be stored further.
+	for (size_t distance = 0; kvp->slots[i].pair != NULL; distance++) {
+		if (kvp_distance(kvp, kvp->slots[i].hash, i) < distance) {
+			break;
+		}
+		if (kvp->slots[i].hash == hash && eq(kvp->slots[i].pair->key, key)) {
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return kvp->size;
+} // kvp_slot_find
+
 /**
  * Init Key-Value pair array
  * @return Key-Value pair array
@@ -36,6 +137,9 @@ KVPArray kvp_init() {
 	KVPArray result = malloc(sizeof(struct sKVPArray));
 
 	ll_init(result);
+	result->count = 0;
+	result->size = 0;
+	result->slots = NULL;
 
 	return result;
 } // kvp_init
@@ -51,6 +155,7 @@ void kvp_free(KVPArray kvp) {
 		free(kv);
 	}
 
+	free(kvp->slots);
 	free(kvp);
 } // kvp_free
 
@@ -61,10 +166,9 @@ void kvp_free(KVPArray kvp) {
  * @return Key-Value pair of NULL if the key doesn't exists in array.
  */
 KeyValPair kvp_locate(KVPArray kvp, char *key) {
-	ll_loop(kvp, kv) {
-		if (eq(kv->key, key)) {
-			return kv;
-		}
+	size_t i = kvp_slot_find(kvp, key, kvp_hash(key));
+	if (i < kvp->size) {
+		return kvp->slots[i].pair;
 	}
 	return NULL;
 } // kvp_locate
@@ -80,7 +184,17 @@ void kvp_set(KVPArray kvp, char *key, HTVAL value) {
 	if (kv == NULL) {
 		kv = malloc(sizeof(struct sKeyValPair));
 		kv->key = strdup(key);
+		kv->hash = kvp_hash(key);
 		ll_append(kvp, kv);
+		kvp->count++;
+
+		// Keep load factor under 7/8, Robin Hood probing handles it well.
+		if (kvp->count * 8 > kvp->size * 7) {
+			kvp_resize(kvp, kvp->size > 0 ?
+				kvp->size * 2 : KVP_INITIAL_SIZE);
+		} else {
+			kvp_slot_insert(kvp, kv);
+		}
 	} else {
 		htval_free(kv->value);
 	}
@@ -94,13 +208,27 @@ void kvp_set(KVPArray kvp, char *key, HTVAL value) {
  * @param key Key to be unset
  */
 void kvp_unset(KVPArray kvp, char *key) {
-	KeyValPair kv = kvp_locate(kvp, key);
-	if (kv != NULL) {
-		ll_remove(kvp, kv);
-		free(kv->key);
-		htval_free(kv->value);
-		free(kv);
+	size_t i = kvp_slot_find(kvp, key, kvp_hash(key));
+	if (i >= kvp->size) return;
+
+	KeyValPair kv = kvp->slots[i].pair;
+
+	// Shift following pairs back, so no tombstones are needed.
+	size_t mask = kvp->size - 1;
+	size_t next = (i + 1) & mask;
+	while (kvp->slots[next].pair != NULL
+		&& kvp_distance(kvp, kvp->slots[next].hash, next) > 0) {
+		kvp->slots[i] = kvp->slots[next];
+		i = next;
+		next = (next + 1) & mask;
 	}
+	kvp->slots[i].pair = NULL;
+	kvp->count--;
+
+	ll_remove(kvp, kv);
+	free(kv->key);
+	htval_free(kv->value);
+	free(kv);
 } // kvp_unset
 
 /**
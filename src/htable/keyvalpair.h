@@ -22,20 +22,35 @@
 
 // Standard libraries
 #include <stdbool.h>
+#include <stddef.h>
 
 // My libraries
 #include "htval.h"
+#include <toolbox/linkedlist.h>
 
 // Forward
 typedef struct sKVPArray *KVPArray;
 typedef struct sKeyValPair *KeyValPair;
 
 /**
- * Key-Value pair array
+ * Slot of Key-Value pair array hash table
+ */
+typedef struct {
+	KeyValPair pair;		/**< Pair stored in slot, NULL if slot is empty */
+	size_t hash;			/**< Hash of pair's key */
+} KVPSlot;
+
+/**
+ * Key-Value pair array. Pairs are found through open addressing hash table
+ * with Robin Hood probing, and linked in order of insertion for iteration.
  */
 struct sKVPArray {
-	KeyValPair first;
-	KeyValPair last;
+	KeyValPair first;		/**< First inserted pair */
+	KeyValPair last;		/**< Last inserted pair */
+
+	size_t count;			/**< Number of pairs */
+	size_t size;			/**< Number of slots, power of two or 0 */
+	KVPSlot *slots;			/**< Hash table */
 }; // sKVPArray
 
 /**
@@ -44,11 +59,30 @@ struct sKVPArray {
 struct sKeyValPair {
 	char *key;				/**< Key */
 	HTVAL value;			/**< Value */
+	size_t hash;			/**< Hash of key */
 
 	KeyValPair prev;		/**< Previous pair in Key-Value pair array */
 	KeyValPair next;		/**< Next pair in Key-Value pair array */
 }; // sKeyValPair
 
+/**
+ * Loop through Key-Value pair array in order in which the keys were
+ * inserted. Current pair may be unset inside the loop.
+ * Usage:
+ *   kvp_loop(kvp, kv) {
+ *      printf("%s\n", kv->key);
+ *   }
+ * @param kvp Key-Value pair array
+ * @param kv Variable name where current pair will be stored.
+ */
+#define kvp_loop(kvp, kv) ll_loop(kvp, kv)
+
+/**
+ * Number of keys in Key-Value pair array
+ * @param kvp Key-Value pair array
+ */
+#define kvp_count(kvp) ((kvp)->count)
+
 /**
  * Init Key-Value pair array
  * @return Key-Value pair array
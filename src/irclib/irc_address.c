@@ -36,56 +36,21 @@
  * @return Pointer to structure IRCLib_Host
  */
 IRCLib_Host *irclib_parse_addr(char *address) {
-	string nick = dynastring_init();
-	string user = dynastring_init();
-	string host = dynastring_init();
-
-	enum {
-		IRCADDR_NICK,
-		IRCADDR_USER,
-		IRCADDR_HOST
-	} whereToAdd = IRCADDR_NICK;
-	for (size_t i = 0; i < strlen(address); i++) {
-		switch (whereToAdd) {
-			case IRCADDR_NICK:
-				if (address[i] == '!') {
-					whereToAdd = IRCADDR_USER;
-				} else {
-					dynastring_appendchar(nick,
-						address[i]);
-				}
-				break;
-
-			case IRCADDR_USER:
-				if (address[i] == '@') {
-					whereToAdd = IRCADDR_HOST;
-				} else {
-					dynastring_appendchar(user,
-						address[i]);
-				}
-				break;
-
-			case IRCADDR_HOST:
-				dynastring_appendchar(host, address[i]);
-				break;
-		}
-	}
-
-	// Just to be sure, none of this three strings should be empty...
-	dynastring_appendchar(nick, '\0');
-	dynastring_appendchar(user, '\0');
-	dynastring_appendchar(host, '\0');
-
 	IRCLib_Host *result = malloc(sizeof(IRCLib_Host));
-	if (result != NULL) {
-		result->nick = strdup(nick->data);
-		result->user = strdup(user->data);
-		result->host = strdup(host->data);
-	}
+	if (result == NULL) return NULL;
+
+	// Nick is up to first '!', user up to first '@' after it and host is
+	// the rest.
+	size_t nickLength = strcspn(address, "!");
+	char *user = address + nickLength;
+	if (*user == '!') user++;
+	size_t userLength = strcspn(user, "@");
+	char *host = user + userLength;
+	if (*host == '@') host++;
 
-	dynastring_free(nick);
-	dynastring_free(user);
-	dynastring_free(host);
+	result->nick = strndup(address, nickLength);
+	result->user = strndup(user, userLength);
+	result->host = strdup(host);
 
 	return result;
 } // irclib_parse_addr
@@ -109,14 +74,15 @@ void irclib_free_addr(IRCLib_Host *host) {
  * @return Allocated string with nick!user@host format
  */
 char *irclib_construct_addr(IRCLib_Host *host) {
-	string result = dynastring_init();
-	dynastring_appendstring(result, host->nick);
-	dynastring_appendchar(result, '!');
-	dynastring_appendstring(result, host->user);
-	dynastring_appendchar(result, '@');
-	dynastring_appendstring(result, host->host);
+	sstring result;
+	dynastring_init_inplace(&result);
+	dynastring_appendstring(&result, host->nick);
+	dynastring_appendchar(&result, '!');
+	dynastring_appendstring(&result, host->user);
+	dynastring_appendchar(&result, '@');
+	dynastring_appendstring(&result, host->host);
 
-	char *out = strdup(dynastring_getstring(result));
-	dynastring_free(result);
+	char *out = strdup(dynastring_getstring(&result));
+	dynastring_free_inplace(&result);
 	return out;
 }
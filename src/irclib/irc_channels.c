@@ -40,6 +40,7 @@ IRCLib_ChannelStorage irclib_init_channels() {
 
 	if (result != NULL) {
 		ll_init(result);
+		result->events = NULL;
 	}
 
 	return result;
@@ -147,6 +148,12 @@ void irclib_remove_channel(IRCLib_ChannelStorage storage,
 
 	if (channel == NULL) return;
 
+	// Let others forget the channel while it's still valid.
+	if (storage->events != NULL) {
+		IRCEvent_ChannelRemoved evt = { .channel = channel };
+		events_fireEvent(storage->events, "onchannelremoved", &evt);
+	}
+
 	// Free users-on-channel information
 	ll_remove(storage, channel);
 
@@ -129,4 +129,18 @@ typedef struct {
 	char *message;				/**< Quit message */
 } IRCEvent_Quit;
 
+/**
+ * IRClib event data for removal of user from user storage
+ */
+typedef struct {
+	IRCLib_User user;			/**< User that is going to be freed */
+} IRCEvent_UserRemoved;
+
+/**
+ * IRClib event data for removal of channel from channel storage
+ */
+typedef struct {
+	IRCLib_Channel channel;		/**< Channel that is going to be freed */
+} IRCEvent_ChannelRemoved;
+
 #endif
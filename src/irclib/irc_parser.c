@@ -39,19 +39,14 @@
  * @param str Original string
  * @return New string with first : stripped out.
  */
-char *irclib_stripcolon(char *str) {
+char *irclib_stripcolon(const char *str) {
 	// This is necessary, because we don't know if we can modify
 	// original string.
 	char *result = strdup(str);
 
-	int colonfound = 0;
-	for (size_t i = 0; i < strlen(result); i++) {
-		if (colonfound) {
-			result[i] = result[i+1];
-		} else if (result[i] == ':') {
-			colonfound = 1;
-			result[i] = result[i+1];
-		}
+	char *colon = strchr(result, ':');
+	if (colon != NULL) {
+		memmove(colon, colon + 1, strlen(colon));
 	}
 
 	return result;
@@ -62,7 +57,8 @@ char *irclib_stripcolon(char *str) {
  * @param connection IRCLib_Connection structure
  * @param tokenized Tokenized message
  */
-void irclib_parse_isupport(IRCLib_Connection *connection, TOKENS tokenized) {
+void irclib_parse_isupport(IRCLib_Connection *connection,
+	TOK_BUFFER *tokenized) {
 	// :eurix.lan 005 PReBoT MAP KNOCK SAFELIST HCN MAXCHANNELS=10
 	// MAXBANS=60 NICKLEN=30 TOPICLEN=307 KICKLEN=307 MAXTARGETS=20
 	// AWAYLEN=307 :are supported by this server
@@ -72,7 +68,7 @@ void irclib_parse_isupport(IRCLib_Connection *connection, TOKENS tokenized) {
 	// CASEMAPPING=ascii :are supported by this server
 
 	for (size_t i = 3; i < tokenized->count; i++) {
-		char *tok = strdup(tokenizer_gettok(tokenized, i));
+		char *tok = strdup(tok_get(tokenized, i));
 
 		// We come to "are supported by this server".
 		if (tok[0] == ':') {
@@ -96,124 +92,40 @@ void irclib_parse_isupport(IRCLib_Connection *connection, TOKENS tokenized) {
 			// Get user mode prefixes (needed for mode parsing)
 			// PREFIX=(ovh)@+%
 			if (strcmp(tok, "PREFIX") == 0) {
-				string s = dynastring_init();
-				string sym = dynastring_init();
-
-				enum {
-					IRCLib_STATE_BEGIN = 0,
-					IRCLib_STATE_MODES,
-					IRCLib_STATE_SYMBOLS,
-					IRCLib_STATE_SKIP
-				} state = IRCLib_STATE_BEGIN;
-
-				for (size_t i = 0; i < strlen(value); i++) {
-					switch (state) {
-						case IRCLib_STATE_BEGIN:
-							if (value[i] == '(') {
-								state =	IRCLib_STATE_MODES;
-							}
-							break;
-
-						case IRCLib_STATE_MODES:
-							if (value[i] == ')') {
-								state = IRCLib_STATE_SYMBOLS;
-							} else {
-								dynastring_appendchar(s, value[i]);
-							}
-							break;
-
-						case IRCLib_STATE_SYMBOLS:
-							dynastring_appendchar(sym, value[i]);
-							break;
-
-						case IRCLib_STATE_SKIP:
-							break;
-					}
-
-					if (state == IRCLib_STATE_SKIP) break;
+				char *modes = strchr(value, '(');
+				if (modes != NULL) {
+					modes++;
+					size_t modesLength = strcspn(modes, ")");
+					char *symbols = modes + modesLength;
+					if (*symbols == ')') symbols++;
+
+					connection->userPrefixes = strndup(modes, modesLength);
+					connection->userPrefixesSymbols = strdup(symbols);
+				} else {
+					connection->userPrefixes = strdup("");
+					connection->userPrefixesSymbols = strdup("");
 				}
-				// Just to be sure, this shouldn't be necessary now...
-				dynastring_appendchar(s, '\0');
-				dynastring_appendchar(sym, '\0');
-
-				connection->userPrefixes =
-					strdup(dynastring_getstring(s));
-				connection->userPrefixesSymbols =
-					strdup(dynastring_getstring(sym));
-
-				dynastring_free(s);
-				dynastring_free(sym);
 			}
 
 			// CHANMODES=beIR,k,l,imnpstaqr
 			if (strcmp(tok, "CHANMODES") == 0) {
-				string chanModesAddress = dynastring_init();
-				string chanModesAlwaysParam = dynastring_init();
-				string chanModesSetParam = dynastring_init();
-				string chanModesNeverParam = dynastring_init();
-
-				enum {
-					// Has always parameter which is
-					// address of user to be added or
-					// removed from list
-					IRCLib_STATE_ADDRESS = 0,
-
-					// Has always parameter
-					IRCLib_STATE_ALWAYSPARAM,
-
-					// Has parameter only if being set
-					IRCLib_STATE_SETPARAM,
-
-					// Never has parameter
-					IRCLib_STATE_NEVERPARAM
-				} state = IRCLib_STATE_ADDRESS;
-
-				for (size_t i = 0; i < strlen(value); i++) {
-					if (value[i] == ',') {
-						state++;
-						continue;
-					}
-
-					switch (state) {
-						case IRCLib_STATE_ADDRESS:
-							dynastring_appendchar(chanModesAddress,
-								value[i]);
-							break;
-
-						case IRCLib_STATE_ALWAYSPARAM:
-							dynastring_appendchar(chanModesAlwaysParam,
-								value[i]);
-							break;
-
-						case IRCLib_STATE_SETPARAM:
-							dynastring_appendchar(chanModesSetParam,
-								value[i]);
-							break;
+				// Groups are separated by ',', groups after the fourth
+				// one are ignored.
+				char **groups[] = {
+					&connection->chanModesAddress,
+					&connection->chanModesAlwaysParam,
+					&connection->chanModesSetParam,
+					&connection->chanModesNeverParam
+				};
 
-						case IRCLib_STATE_NEVERPARAM:
-							dynastring_appendchar(chanModesNeverParam,
-								value[i]);
-							break;
-					}
+				char *group = value;
+				for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]);
+					i++) {
+					size_t length = strcspn(group, ",");
+					*groups[i] = strndup(group, length);
+					group += length;
+					if (*group == ',') group++;
 				}
-				dynastring_appendchar(chanModesAddress, '\0');
-				dynastring_appendchar(chanModesAlwaysParam, '\0');
-				dynastring_appendchar(chanModesSetParam, '\0');
-				dynastring_appendchar(chanModesNeverParam, '\0');
-
-				connection->chanModesAddress =
-					strdup(chanModesAddress->data);
-				connection->chanModesAlwaysParam =
-					strdup(chanModesAlwaysParam->data);
-				connection->chanModesSetParam =
-					strdup(chanModesSetParam->data);
-				connection->chanModesNeverParam =
-					strdup(chanModesNeverParam->data);
-
-				dynastring_free(chanModesAddress);
-				dynastring_free(chanModesAlwaysParam);
-				dynastring_free(chanModesSetParam);
-				dynastring_free(chanModesNeverParam);
 			}
 		}
 
@@ -229,15 +141,16 @@ void irclib_parse_isupport(IRCLib_Connection *connection, TOKENS tokenized) {
  * @return 1 on successful parsing, 0 if error.
  */
 void irclib_parse(IRCLib_Connection *connection, char *message) {
-	TOKENS tok = tokenizer_tokenize(message, ' ');
+	TOK_BUFFER tok;
+	tok_split(&tok, message, ' ');
 
 	// --- PING -----------------------------------------------------------
 	// PING :server
-	if (strcmp(tokenizer_gettok(tok, 0), "PING") == 0) {
-		if (events_fireEvent(connection->events, "onping", tok)) {
+	if (strcmp(tok_get(&tok, 0), "PING") == 0) {
+		if (events_fireEvent(connection->events, "onping", &tok)) {
 
 			irclib_sendraw(connection, "PONG %s",
-				tokenizer_gettok(tok, 1));
+				tok_get(&tok, 1));
 
 		}
 		goto _irclib_parse_end;
@@ -249,7 +162,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 	// parameter is number.
 	// ToDo: It would be great to distinguish between reply messages and
 	// error messages and have another event for errors.
-	char *second = tokenizer_gettok(tok, 1), *restOfString;
+	char *second = tok_get(&tok, 1), *restOfString;
 	if (strlen(second) != 0) {
 		// We have second parameter
 
@@ -257,17 +170,17 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 		if (strlen(restOfString) == 0) {
 			// It is numeric message from server
 			if (connection->status == IRC_CONNECTING) {
-				printError("irclib", "%s", tokenizer_gettok_skipleft(tok, 3));
+				printError("irclib", "%s", tok_skipleft(&tok, 3));
 			}
 
 			IRCEvent_ServerMessage evt = {
 				.sender = connection,
 				// +1 skips the : char at the begining of
 				// message
-				.server = tokenizer_gettok(tok, 0) + 1,
+				.server = tok_get(&tok, 0) + 1,
 				.messageCode = numericMessage,
 				.message = irclib_stripcolon(
-					tokenizer_gettok_skipleft(tok, 3))
+					tok_skipleft(&tok, 3))
 			};
 			events_fireEvent(connection->events, "onservermessage",
 				&evt);
@@ -286,7 +199,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 			// Parse message number 5, which contains some
 			// important information for us
 			if (numericMessage == RPL_ISUPPORT) {
-				irclib_parse_isupport(connection, tok);
+				irclib_parse_isupport(connection, &tok);
 			}
 
 			free(evt.message);
@@ -305,9 +218,9 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 			// Add nicks to channel
 			// :eurix.lan 353 Amonet = #rls.rct.cz :Amonet niximor
 			if (numericMessage == RPL_NAMREPLY) {
-				char *channel = tokenizer_gettok(tok, 4);
+				char *channel = tok_get(&tok, 4);
 				char *users = irclib_stripcolon(
-					tokenizer_gettok_skipleft(tok, 5));
+					tok_skipleft(&tok, 5));
 
 				strtolower(channel);
 
@@ -315,23 +228,27 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 					irclib_find_channel(connection->channelStorage, channel);
 
 				if (ircchannel != NULL) {
-					TOKENS chusers = tokenizer_tokenize(users, ' ');
-					for (size_t i = 0; i < chusers->count; i++) {
-						char *user = tokenizer_gettok(chusers, i);
+					TOK_ITER it;
+					tok_init(&it, users);
+					while (tok_rest(&it) != NULL) {
+						TOK_SLICE token = tok_next(&it, ' ');
+						if (token.length == 0) continue;
+
+						// users is our copy, so the token can be terminated
+						// in place.
+						char *user = users + (token.str - users);
+						user[token.length] = '\0';
 
 						// Test if first char is not mode.
-						if (connection->userPrefixesSymbols != NULL && user != NULL) {
-							for (size_t pi = 0; pi < strlen(connection->userPrefixesSymbols); pi++) {
-								if (user[0] == connection->userPrefixesSymbols[pi]) {
-									user++;
-									break;
-								}
-							}
+						if (connection->userPrefixesSymbols != NULL &&
+							user[0] != '\0' &&
+							strchr(connection->userPrefixesSymbols, user[0])
+							!= NULL) {
+							user++;
 						}
 
 						irclib_add_channel_user(connection, ircchannel, user);
 					}
-					tokenizer_free(chusers);
 				}
 
 				free(users);
@@ -343,7 +260,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 
 	// All messages following has syntax :address ACTION params, so we can
 	// use it to globally fill users storage.
-	IRCLib_Host *address = irclib_parse_addr(tokenizer_gettok(tok, 0) + 1);
+	IRCLib_Host *address = irclib_parse_addr(tok_get(&tok, 0) + 1);
 	IRCLib_User sender = irclib_add_usera(connection->userStorage, address);
 	irclib_free_addr(address);
 
@@ -355,7 +272,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 		IRCEvent_JoinPart evt = {
 			.sender = connection,
 			.address = sender->host,
-			.channel = irclib_stripcolon(tokenizer_gettok(tok, 2)),
+			.channel = irclib_stripcolon(tok_get(&tok, 2)),
 			.reason = NULL
 		};
 
@@ -391,11 +308,11 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 			.sender = connection,
 			.address = sender->host,
 			.message = irclib_stripcolon(
-				tokenizer_gettok_skipleft(tok, 3))
+				tok_skipleft(&tok, 3))
 		};
 
 		// Private message
-		if (strcmp(tokenizer_gettok(tok, 2),
+		if (strcmp(tok_get(&tok, 2),
 			connection->nickname) == 0) {
 
 			evt.channel = NULL;
@@ -411,7 +328,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 
 		// Channel message
 		} else {
-			evt.channel = strdup(tokenizer_gettok(tok, 2));
+			evt.channel = strdup(tok_get(&tok, 2));
 			strtolower(evt.channel);
 			if (strcmp(second, "PRIVMSG") == 0) {
 				events_fireEvent(connection->events,
@@ -434,7 +351,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 	// --- Mode change ----------------------------------------------------
 	// :test!niximor@station3.lan MODE #rls.rct.cz -s+o nix`PC3
 	if (strcmp(second, "MODE") == 0) {
-		char *modes = tokenizer_gettok(tok, 3);
+		char *modes = tok_get(&tok, 3);
 
 		int setMode = 1;
 		int tokPos = 4;
@@ -457,8 +374,8 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 						.name = modeChar,
 						.set = setMode,
 						.address = sender->host,
-						.channel = strdup(tokenizer_gettok(tok, 2)),
-						.target = strdup(tokenizer_gettok(tok, tokPos))
+						.channel = strdup(tok_get(&tok, 2)),
+						.target = strdup(tok_get(&tok, tokPos))
 					};
 					tokPos++;
 
@@ -521,8 +438,8 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 						.name = modeChar,
 						.set = setMode,
 						.address = sender->host,
-						.channel = strdup(tokenizer_gettok(tok, 2)),
-						.target = strdup(tokenizer_gettok(tok, tokPos))
+						.channel = strdup(tok_get(&tok, 2)),
+						.target = strdup(tok_get(&tok, tokPos))
 					};
 					tokPos++;
 
@@ -556,8 +473,8 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 						.name = modeChar,
 						.set = setMode,
 						.address = sender->host,
-						.channel = strdup(tokenizer_gettok(tok, 2)),
-						.target = strdup(tokenizer_gettok(tok, tokPos))
+						.channel = strdup(tok_get(&tok, 2)),
+						.target = strdup(tok_get(&tok, tokPos))
 					};
 					tokPos++;
 
@@ -577,9 +494,9 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 						.name = modeChar,
 						.set = setMode,
 						.address = sender->host,
-						.channel = strdup(tokenizer_gettok(tok, 2)),
+						.channel = strdup(tok_get(&tok, 2)),
 						.target = ((setMode)?
-							strdup(tokenizer_gettok(tok, tokPos)):
+							strdup(tok_get(&tok, tokPos)):
 							NULL)
 					};
 
@@ -605,7 +522,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 						.name = modeChar,
 						.set = setMode,
 						.address = sender->host,
-						.channel = strdup(tokenizer_gettok(tok, 2)),
+						.channel = strdup(tok_get(&tok, 2)),
 						.target = NULL
 					};
 
@@ -629,14 +546,14 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 		IRCEvent_Kick evt = {
 			.sender = connection,
 			.address = sender->host,
-			.channel = strdup(tokenizer_gettok(tok, 2)),
-			.nick = strdup(tokenizer_gettok(tok, 3)),
-			.reason = irclib_stripcolon(tokenizer_gettok_skipleft(tok, 4))
+			.channel = strdup(tok_get(&tok, 2)),
+			.nick = strdup(tok_get(&tok, 3)),
+			.reason = irclib_stripcolon(tok_skipleft(&tok, 4))
 		};
 
 		strtolower(evt.channel);
 
-		if (strcmp(tokenizer_gettok(tok, 3), connection->nickname) == 0) {
+		if (strcmp(tok_get(&tok, 3), connection->nickname) == 0) {
 			// I've been kicked!!
 			events_fireEvent(connection->events, "onkicked", &evt);
 			irclib_remove_channel(connection->channelStorage,
@@ -659,11 +576,11 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 	// --- Nick change --------------------------------------------------------
 	// :niximor!niximor@station3.lan NICK :nix
 	if (strcmp(second, "NICK") == 0) {
-		IRCLib_Host *address = irclib_parse_addr(tokenizer_gettok(tok, 0)+1);
+		IRCLib_Host *address = irclib_parse_addr(tok_get(&tok, 0)+1);
 		IRCEvent_NickChange evt = {
 			.sender = connection,
 			.address = sender->host,
-			.newnick = irclib_stripcolon(tokenizer_gettok(tok, 2))
+			.newnick = irclib_stripcolon(tok_get(&tok, 2))
 		};
 
 		// If my nickname was changed
@@ -688,8 +605,8 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 		IRCEvent_JoinPart evt = {
 			.sender = connection,
 			.address = sender->host,
-			.channel = strdup(tokenizer_gettok(tok, 2)),
-			.reason = irclib_stripcolon(tokenizer_gettok_skipleft(tok, 3))
+			.channel = strdup(tok_get(&tok, 2)),
+			.reason = irclib_stripcolon(tok_skipleft(&tok, 3))
 		};
 
 		strtolower(evt.channel);
@@ -717,7 +634,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 		IRCEvent_Quit evt = {
 			.sender = connection,
 			.address = sender->host,
-			.message = irclib_stripcolon(tokenizer_gettok_skipleft(tok, 3))
+			.message = irclib_stripcolon(tok_skipleft(&tok, 3))
 		};
 
 		events_fireEvent(connection->events, "onquited", &evt);
@@ -730,7 +647,7 @@ void irclib_parse(IRCLib_Connection *connection, char *message) {
 	}
 
 	_irclib_parse_end:
-	tokenizer_free(tok);
+	tok_free(&tok);
 } // irclib_parse
 
 /**
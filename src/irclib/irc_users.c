@@ -36,6 +36,7 @@ IRCLib_UserStorage irclib_init_userstorage() {
 
 	if (result != NULL) {
 		ll_init(result);
+		result->events = NULL;
 	}
 
 	return result;
@@ -184,6 +185,14 @@ IRCLib_User irclib_find_user(IRCLib_UserStorage storage, char *nick) {
  * @param user User to be removed from that storage
  */
 void irclib_remove_user(IRCLib_UserStorage storage, IRCLib_User user) {
+	if (user == NULL) return;
+
+	// Let others forget the user while it's still valid.
+	if (storage->events != NULL) {
+		IRCEvent_UserRemoved evt = { .user = user };
+		events_fireEvent(storage->events, "onuserremoved", &evt);
+	}
+
 	// Remove user from storage
 	ll_remove(storage, user);
 
@@ -91,6 +91,9 @@ void irclib_init(IRCLib_Connection *connection) {
 		events_addEvent(connection->events, "onnick");
 
 		events_addEvent(connection->events, "onquited");
+
+		events_addEvent(connection->events, "onuserremoved");
+		events_addEvent(connection->events, "onchannelremoved");
 	}
 
 	connection->status = IRC_DISCONNECTED;
@@ -107,9 +110,11 @@ void irclib_init(IRCLib_Connection *connection) {
 
 	// Init channel list
 	connection->channelStorage = irclib_init_channels();
+	connection->channelStorage->events = connection->events;
 
 	// Init user storage
 	connection->userStorage = irclib_init_userstorage();
+	connection->userStorage->events = connection->events;
 } // irclib_init
 
 /**
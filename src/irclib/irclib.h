@@ -217,6 +217,8 @@ struct sIRCLib_UserChannel {
 struct sIRCLib_UserStorage {
 	IRCLib_User first;
 	IRCLib_User last;
+	EVENTS *events;					/**< Events to fire onuserremoved to,
+										 NULL if none */
 }; // sIRCLib_UserStorage
 
 /**
@@ -250,6 +252,8 @@ struct sIRCLib_Channel {
 struct sIRCLib_ChannelStorage {
 	IRCLib_Channel first;			/**< First channel in chain */
 	IRCLib_Channel last;			/**< Last channel in chain */
+	EVENTS *events;					/**< Events to fire onchannelremoved
+										 to, NULL if none */
 }; // sIRCLib_ChannelStorage
 
 /**
@@ -24,9 +24,10 @@
 #include <string.h>
 
 // Linux headers
-#include <unistd.h>	// daemon, chdir
+#include <unistd.h>	// daemon, chdir, pipe
 #include <signal.h> // signal
 #include <time.h>	// time
+#include <pthread.h> // pthread_create
 
 // My interface
 #include "main.h"
@@ -52,6 +53,16 @@ bool breakLoop = false;		/**< If set to true during execution, forces
 
 time_t bootTime;
 
+volatile sig_atomic_t reloadRequested = false;	/**< Set by SIGHUP, config
+													 will be reloaded in
+													 next main loop cycle. */
+bool reloadRunning = false;	/**< Config file is being parsed right now. */
+int reloadPipe[2] = { -1, -1 };	/**< Reload thread passes parsed config
+									 to main loop through this pipe. */
+char *configFile = NULL;	/**< Path to config file */
+CONF_SECTION *liveConfig = NULL;	/**< Live configuration */
+EVENTS *liveEvents = NULL;	/**< Events, for onconfigchanged */
+
 /**
  * Set application to quit in next main loop cycle.
  */
@@ -80,6 +91,7 @@ void main_signalHandler(int signum) {
 			break;
 
 		case SIGHUP:
+			reloadRequested = true;
 			break;
 	}
 } // signalHandler
@@ -184,6 +196,100 @@ void main_rawsend(EVENT *event) {
 	fprintf(stderr, "<<< %s\n", eventData->message);
 } // main_rawreceive
 
+/**
+ * Reload thread, parses config file and passes the result to main loop.
+ * @param arg Unused
+ */
+void *main_reload_thread(void *arg) {
+	(void)arg;
+
+	CONF_SECTION *loaded = config_load(configFile);
+	if (write(reloadPipe[1], &loaded, sizeof(loaded)) != sizeof(loaded)) {
+		printError("main", "Unable to pass reloaded configuration to main "
+			"loop.");
+		config_free(loaded);
+	}
+	return NULL;
+} // main_reload_thread
+
+/**
+ * Start reloading configuration file in background.
+ */
+void main_reload_start() {
+	if (reloadRunning) {
+		printError("main", "Configuration reload already in progress.");
+		return;
+	}
+
+	printError("main", "Reloading configuration from %s.", configFile);
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, main_reload_thread, NULL) == 0) {
+		pthread_detach(thread);
+		reloadRunning = true;
+	} else {
+		printError("main", "Unable to start configuration reload.");
+	}
+} // main_reload_start
+
+/**
+ * Reloaded configuration is ready. Merge it into live configuration and
+ * fire onconfigchanged event with list of changed paths.
+ * @param socket Read end of reload pipe
+ */
+void main_reload_done(Socket socket) {
+	CONF_SECTION *loaded = NULL;
+	if (read(socket->socketfd, &loaded, sizeof(loaded)) != sizeof(loaded)) {
+		return;
+	}
+	reloadRunning = false;
+
+	if (loaded == NULL) {
+		printError("main", "Configuration reload failed, keeping current "
+			"configuration.");
+		return;
+	}
+
+	CONF_CHANGES changes = { .count = 0, .allocated = 0, .paths = NULL };
+	config_merge(liveConfig, loaded, &changes);
+	config_free(loaded);
+
+	printError("main", "Configuration reloaded, %lu changes.",
+		changes.count);
+
+	if (changes.count > 0) {
+		events_fireEvent(liveEvents, "onconfigchanged", &changes);
+	}
+
+	config_changes_free(&changes);
+} // main_reload_done
+
+/**
+ * Update IRC connection settings after configuration reload. New values
+ * are used on next reconnect.
+ * @param event Event data
+ */
+void main_configchanged(EVENT *event) {
+	IRCLib_Connection *irc = (IRCLib_Connection *)event->handlerData;
+
+	irc->hostname = config_getvalue_string(liveConfig, "irc:server",
+		"localhost");
+	irc->port = config_getvalue_int(liveConfig, "irc:port", 6667);
+	irc->bind = config_getvalue_string(liveConfig, "irc:bind", NULL);
+	irc->force_ipv4 = config_getvalue_bool(liveConfig, "irc:force_ipv4",
+		false);
+	irc->force_ipv6 = config_getvalue_bool(liveConfig, "irc:force_ipv6",
+		false);
+	irc->username = config_getvalue_string(liveConfig, "irc:username",
+		"ircbot");
+	irc->realname = config_getvalue_string(liveConfig, "irc:realname",
+		"IRCBot by Niximor");
+	irc->password = config_getvalue_string(liveConfig, "irc:password", NULL);
+	irc->reconnect = config_getvalue_bool(liveConfig, "irc:reconnect", true);
+	irc->aliveCheckTimeout = config_getvalue_int(liveConfig,
+		"irc:alivecheck", 30);
+} // main_configchanged
+
 /**
  * Main
  * @param argc Number of arguments on command line
@@ -194,7 +300,7 @@ int main(int argc, char *argv[]) {
 	bootTime = time(NULL);
 
 	// Get configuration file name
-	char *dir;
+	char *dir = NULL;
 	char *configfile;
 	if (argc >= 2) {
 		configfile = strdup(argv[1]);
@@ -209,10 +315,26 @@ int main(int argc, char *argv[]) {
 	printError("main", "Trying to load config from %s.", configfile);
 
 	// Go to my root directory.
-	chdir(dir);
+	if (dir != NULL) {
+		chdir(dir);
+	}
 
 	// Load configuration
-	CONF_SECTION *config = config_parse(configfile);
+	CONF_SECTION *config = config_load(configfile);
+	if (config == NULL) {
+		printError("main", "Unable to load configuration.");
+		free(configfile);
+		free(dir);
+		return EXIT_FAILURE;
+	}
+
+	// Keep the path for reloads. It must be absolute, because the process
+	// may change it's working directory.
+	configFile = realpath(configfile, NULL);
+	if (configFile == NULL) {
+		configFile = strdup(configfile);
+	}
+	liveConfig = config;
 
 	free(configfile);
 	free(dir);
@@ -255,6 +377,17 @@ int main(int argc, char *argv[]) {
     printError("main", "Initializing socketpool...");
 	SocketPool socketpool = socketpool_init();
 
+	// Reload thread hands parsed configuration to main loop through pipe.
+	liveEvents = events;
+	events_addEvent(events, "onconfigchanged");
+	if (pipe(reloadPipe) == 0) {
+		socketpool_add(socketpool, reloadPipe[0], main_reload_done, NULL,
+			NULL, NULL);
+	} else {
+		printError("main", "Unable to create reload pipe, SIGHUP will be "
+			"ignored.");
+	}
+
 	// Init IRCLib
     printError("main", "Initializing IRC subsystem...");
 	IRCLib_Connection irc = {
@@ -279,6 +412,9 @@ int main(int argc, char *argv[]) {
 
 	irclib_init(&irc);
 
+	events_addEventListener(events, "onconfigchanged", main_configchanged,
+		&irc);
+
 	// Load plugins
     printError("main", "Loading plugins...");
 	plugins_init(&irc, config, events, socketpool);
@@ -306,6 +442,11 @@ int main(int argc, char *argv[]) {
 	while (!breakLoop) {
 		socketpool_pool(socketpool, 1000);
 		timers_test();
+
+		if (reloadRequested && reloadPipe[0] >= 0) {
+			reloadRequested = false;
+			main_reload_start();
+		}
 	}
 
 	printError("main", "Begin shutdown.");
@@ -329,6 +470,7 @@ int main(int argc, char *argv[]) {
 
 	// Free configuration
 	config_free(config);
+	free(configFile);
 
 	printError("main", "Done.");
 
@@ -368,14 +368,12 @@ PluginLoadStatus plugins_unload(char *name) {
  * @return Plugin load status
  */
 PluginLoadStatus plugins_close() {
-	// Unload all plugins
-	Plugin plug = loadedPlugins->first;
-	Plugin next;
-	while (plug != NULL) {
-		next = plug->next;
+	// Unload all plugins. Unloading plugin can unload also it's dependencies,
+	// so always start from the begining of the chain.
+	while (loadedPlugins->first != NULL) {
+		Plugin plug = loadedPlugins->first;
 		printError("plugins", "Unloading plugin %s", plug->path);
 		plugins_unloadplugin(plug);
-		plug = next;
 	}
 
 	free(loadedPlugins);
@@ -177,33 +177,12 @@ void socketpool_debugqueue(Socket socket) {
 } // socketpool_debugqueue
 
 /**
- * Add data node into socket sendq
+ * Insert created data node into socket sendq, after last node of the same or
+ * higher type.
  * @param socket Socket in pool.
- * @param data Pointer to data to be send.
- * @param dataSize Size of data.
- * @param type Node type
+ * @param node Data node
  */
-void socketpool_addtosendq(Socket socket, void *data, size_t dataSize,
-	SocketDataType type) {
-
-	if (socket == NULL) return;
-
-	SocketDataNode node = malloc(sizeof(struct sSocketDataNode));
-
-	// Copy data to node, because we cannot be sure, that original
-	// data pointer will be valid when node is going to be send.
-	node->dataSize = dataSize;
-	if (dataSize > 0) {
-		node->data = malloc(dataSize);
-		memcpy(node->data, data, dataSize);
-	} else {
-		node->data = NULL;
-	}
-
-	node->type = type;
-
-	// Add node to sendq
-
+static void socketpool_insertnode(Socket socket, SocketDataNode node) {
 	SocketDataNode sendq = socket->sendq_end;
 	while (sendq != NULL) {
 		// Find first node with lowest type than currently added
@@ -242,8 +221,93 @@ void socketpool_addtosendq(Socket socket, void *data, size_t dataSize,
 			socket->sendq_begin = node;
 		}
 	}
+} // socketpool_insertnode
+
+/**
+ * Add data node into socket sendq
+ * @param socket Socket in pool.
+ * @param data Pointer to data to be send.
+ * @param dataSize Size of data.
+ * @param type Node type
+ */
+void socketpool_addtosendq(Socket socket, void *data, size_t dataSize,
+	SocketDataType type) {
+
+	if (socket == NULL) return;
+
+	SocketDataNode node = malloc(sizeof(struct sSocketDataNode));
+
+	// Copy data to node, because we cannot be sure, that original
+	// data pointer will be valid when node is going to be send.
+	node->dataSize = dataSize;
+	if (dataSize > 0) {
+		node->data = malloc(dataSize);
+		memcpy(node->data, data, dataSize);
+	} else {
+		node->data = NULL;
+	}
+
+	node->buffer = NULL;
+	node->type = type;
+
+	socketpool_insertnode(socket, node);
 } // socketpool_addtosendq
 
+/**
+ * Create shared buffer. It has one reference, which is owned by caller.
+ * @param data Data to copy into buffer, may be NULL to leave buffer
+ *   uninitialized.
+ * @param dataSize Size of data
+ * @return Created buffer
+ */
+SocketBuffer socketpool_buffer_create(const void *data, size_t dataSize) {
+	SocketBuffer buffer = malloc(sizeof(struct sSocketBuffer) + dataSize);
+	buffer->references = 1;
+	buffer->size = dataSize;
+	if (data != NULL && dataSize > 0) {
+		memcpy(buffer->data, data, dataSize);
+	}
+	return buffer;
+} // socketpool_buffer_create
+
+/**
+ * Release reference to shared buffer, buffer is freed when last reference
+ * is released.
+ * @param buffer Shared buffer
+ */
+void socketpool_buffer_release(SocketBuffer buffer) {
+	if (buffer != NULL && --buffer->references == 0) {
+		free(buffer);
+	}
+} // socketpool_buffer_release
+
+/**
+ * Sends shared buffer through socket. The buffer isn't copied, socket holds
+ * it's own reference until the data are sent.
+ * @param pool Socketpool
+ * @param socket Socket file descriptor
+ * @param buffer Shared buffer
+ */
+void socketpool_send_buffer(SocketPool pool, int socket,
+	SocketBuffer buffer) {
+
+	Socket poolsock = socketpool_lookup(pool, socket);
+	if (poolsock == NULL) {
+		printError("socketpool", "send: Socket %d is not in pool.", socket);
+		return;
+	}
+	if (buffer->size == 0) return;
+
+	SocketDataNode node = malloc(sizeof(struct sSocketDataNode));
+	node->data = buffer->data;
+	node->dataSize = buffer->size;
+	node->buffer = buffer;
+	node->type = SN_DATA;
+	buffer->references++;
+
+	socketpool_insertnode(poolsock, node);
+} // socketpool_send_buffer
+
 /**
  * Remove node from socket's sendq
  * @param socket Socket in pool
@@ -270,7 +334,9 @@ void socketpool_removefromsendq(Socket socket, SocketDataNode node) {
 	}
 
 	// Free node data
-	if (node->data != NULL) {
+	if (node->buffer != NULL) {
+		socketpool_buffer_release(node->buffer);
+	} else if (node->data != NULL) {
 		free(node->data);
 	}
 
@@ -343,6 +409,10 @@ void socketpool_sendnode(Socket socket) {
 			strerror(errno));
 
 		socketpool_close(socket->pool, socket->socketfd);
+	} else if ((size_t)written < node->dataSize && node->buffer != NULL) {
+		// Shared buffer can't be shrinked, just skip data already sent.
+		node->data = (char *)node->data + written;
+		node->dataSize -= written;
 	} else if ((size_t)written < node->dataSize) {
 		// Not all data in node has been sent, don't delete node, but
 		// keep it alive, to send remaining data.
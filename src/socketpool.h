@@ -23,6 +23,7 @@
 typedef struct sSocketPool *SocketPool;
 typedef struct sSocket *Socket;
 typedef struct sSocketDataNode *SocketDataNode;
+typedef struct sSocketBuffer *SocketBuffer;
 
 typedef void (*socketCallback)(Socket socket);
 
@@ -41,12 +42,24 @@ typedef enum {
 	SN_DATA = 0,					/**< Node contains data to send. */
 } SocketDataType;
 
+/**
+ * Reference counted data buffer, which can be queued to more sockets
+ * without copying.
+ */
+struct sSocketBuffer {
+	size_t references;				/**< Number of references */
+	size_t size;					/**< Size of data */
+	char data[];					/**< Data */
+};
+
 /**
  * Data node of socket
  */
 struct sSocketDataNode {
 	void *data;						/**< Pointer to data */
 	size_t dataSize;				/**< Size of data */
+	SocketBuffer buffer;			/**< Shared buffer the data points to,
+										 NULL if node owns the data. */
 
 	SocketDataType type;			/**< Data node type */
 	SocketDataNode next;			/**< Next data node */
@@ -125,6 +138,33 @@ extern void socketpool_remove(SocketPool pool, int socket);
 extern void socketpool_send(SocketPool pool, int socket, void *data,
 	size_t dataSize);
 
+/**
+ * Create shared buffer. It has one reference, which is owned by caller.
+ * @param data Data to copy into buffer, may be NULL to leave buffer
+ *   uninitialized.
+ * @param dataSize Size of data
+ * @return Created buffer
+ */
+extern SocketBuffer socketpool_buffer_create(const void *data,
+	size_t dataSize);
+
+/**
+ * Release reference to shared buffer, buffer is freed when last reference
+ * is released.
+ * @param buffer Shared buffer
+ */
+extern void socketpool_buffer_release(SocketBuffer buffer);
+
+/**
+ * Sends shared buffer through socket. The buffer isn't copied, socket holds
+ * it's own reference until the data are sent.
+ * @param pool Socketpool
+ * @param socket Socket file descriptor
+ * @param buffer Shared buffer
+ */
+extern void socketpool_send_buffer(SocketPool pool, int socket,
+	SocketBuffer buffer);
+
 /**
  * Closes socket, but sends all remaining data first.
  * @param pool Socketpool
@@ -17,6 +17,10 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,27 +51,35 @@ TOKENS tokenizer_tokenize(const char *str, const char separator) {
 	TOKENS tok;
 	tokenizer_init(&tok);
 
-	tok->original = strdup(str);
-	tok->tokenized = strdup(str);
+	size_t length = strlen(str);
+
+	// Both copies share one allocation, tokenizer_free frees original.
+	tok->original = malloc(2 * (length + 1));
+	if (tok->original == NULL) {
+		free(tok);
+		return NULL;
+	}
+	tok->tokenized = tok->original + length + 1;
+	memcpy(tok->original, str, length + 1);
+	memcpy(tok->tokenized, str, length + 1);
+	tok->length = length;
 	tok->separator = separator;
 
 	char lastchar = 0;
 
-	const int BUFF_SIZE = 16;
-	tok->tokens = malloc(BUFF_SIZE * sizeof(int));
+	tok->allocated = 16;
+	tok->tokens = malloc(tok->allocated * sizeof(int));
 	if (tok->tokens == NULL) {
 		free(tok->original);
-		free(tok->tokenized);
+		free(tok);
 		return NULL;
 	}
 
-	tok->allocated = BUFF_SIZE;
-
 	// First token of string begins at 0.
 	tok->tokens[tok->count] = 0;
 	tok->count++;
 
-	for (size_t i = 0; i <= strlen(str); i++) {
+	for (size_t i = 0; i <= length; i++) {
 		// If current char is separator, end current token and proceed
 		// to next one.
 		if (str[i] == separator && lastchar != separator) {
@@ -75,15 +87,15 @@ TOKENS tokenizer_tokenize(const char *str, const char separator) {
 			// Allocate new space if there is nothing left for
 			// current token.
 			if (tok->allocated <= tok->count) {
-				tok->allocated += BUFF_SIZE;
-				tok->tokens = realloc(tok->tokens,
+				tok->allocated *= 2;
+				int *tokens = realloc(tok->tokens,
 					tok->allocated*sizeof(int));
 
-				if (tok->tokens == NULL) {
-					free(tok->original);
-					free(tok->tokenized);
+				if (tokens == NULL) {
+					tokenizer_free(tok);
 					return NULL;
 				}
+				tok->tokens = tokens;
 			}
 
 			tok->tokenized[i] = '\0';
@@ -105,7 +117,7 @@ TOKENS tokenizer_tokenize(const char *str, const char separator) {
 char *tokenizer_gettok(TOKENS tok, size_t num) {
 	if (num >= tok->count) {
 		// Out of range
-		return tok->original + strlen(tok->original);
+		return tok->original + tok->length;
 	}
 
 	return tok->tokenized + tok->tokens[num];
@@ -118,7 +130,7 @@ char *tokenizer_gettok(TOKENS tok, size_t num) {
  * @return Tokens.
  */
 char *tokenizer_gettok_skipleft(TOKENS tok, size_t num) {
-	if (num >= tok->count) return tok->original + strlen(tok->original);
+	if (num >= tok->count) return tok->original + tok->length;
 	if (num == 0) return tok->original;
 	return tok->original + tok->tokens[num];
 } // tokenizer_gettok_skipleft
@@ -128,15 +140,125 @@ char *tokenizer_gettok_skipleft(TOKENS tok, size_t num) {
  * @param tok TOKENS structure
  */
 void tokenizer_free(TOKENS tok) {
-	// Free original string
+	// Free original and tokenized string
 	free(tok->original);
 
-	// Free tokenized string
-	free(tok->tokenized);
-
 	// Free array of tokens
 	free(tok->tokens);
 
 	// Free tokens structure
 	free(tok);
 } // tokenizer_free
+
+/**
+ * Get next token. Each separator ends a token, so empty tokens are returned
+ * for consecutive separators.
+ * @param it Iterator
+ * @param separator Tokens separator
+ * @return Token, str is NULL when there are no more tokens.
+ */
+TOK_SLICE tok_next(TOK_ITER *it, char separator) {
+	TOK_SLICE token = { .str = it->pos, .length = 0 };
+	if (it->pos == NULL) return token;
+
+	const char *end = strchrnul(it->pos, separator);
+	token.length = end - it->pos;
+	it->pos = (*end != '\0') ? end + 1 : NULL;
+
+	return token;
+} // tok_next
+
+/**
+ * Compare token with zero terminated string.
+ * @param token Token
+ * @param str String
+ * @return True if token equals to string.
+ */
+bool tok_eq(TOK_SLICE token, const char *str) {
+	return token.str != NULL && strncmp(token.str, str, token.length) == 0
+		&& str[token.length] == '\0';
+} // tok_eq
+
+/**
+ * Split string into TOK_BUFFER. Runs of separators are skipped, so there are
+ * no empty tokens and each token starts with non-separator char. Unlike
+ * tokenizer_tokenize, which attaches extra separators to the next token.
+ * @param tb Buffer, usually on stack
+ * @param str String to split
+ * @param separator Tokens separator
+ */
+void tok_split(TOK_BUFFER *tb, const char *str, char separator) {
+	tb->original = str;
+	tb->length = strlen(str);
+	tb->count = 0;
+
+	if (tb->length < TOKENIZER_BUFFER_SIZE) {
+		tb->tokenized = tb->buffer;
+	} else {
+		tb->tokenized = malloc(tb->length + 1);
+		if (tb->tokenized == NULL) {
+			tb->tokenized = tb->buffer;
+			tb->buffer[0] = '\0';
+			tb->length = 0;
+			return;
+		}
+	}
+	memcpy(tb->tokenized, str, tb->length + 1);
+
+	TOK_ITER it;
+	tok_init(&it, tb->tokenized);
+	while (tok_rest(&it) != NULL) {
+		while (*it.pos == separator) it.pos++;
+		if (*it.pos == '\0') break;
+
+		// Last slot gets the rest of string.
+		if (tb->count == TOKENIZER_BUFFER_TOKENS - 1) {
+			tb->tokens[tb->count++] = tok_rest(&it) - tb->tokenized;
+			break;
+		}
+
+		TOK_SLICE token = tok_next(&it, separator);
+		tb->tokens[tb->count++] = token.str - tb->tokenized;
+		tb->tokenized[token.str - tb->tokenized + token.length] = '\0';
+	}
+} // tok_split
+
+/**
+ * Get one token from TOK_BUFFER.
+ * @param tb Buffer
+ * @param num Token number
+ * @return Zero terminated token, empty string if out of range.
+ */
+char *tok_get(TOK_BUFFER *tb, size_t num) {
+	if (num >= tb->count) {
+		return tb->tokenized + tb->length;
+	}
+	return tb->tokenized + tb->tokens[num];
+} // tok_get
+
+/**
+ * Get all tokens except num left ones from TOK_BUFFER.
+ * @param tb Buffer
+ * @param num Number of tokens to skip
+ * @return Rest of original string.
+ */
+const char *tok_skipleft(TOK_BUFFER *tb, size_t num) {
+	if (num >= tb->count) {
+		return tb->original + tb->length;
+	}
+	return tb->original + tb->tokens[num];
+} // tok_skipleft
+
+/**
+ * Free memory allocated by tok_split for long strings.
+ * @param tb Buffer
+ */
+void tok_free(TOK_BUFFER *tb) {
+	if (tb->tokenized != tb->buffer) {
+		free(tb->tokenized);
+	}
+	tb->tokenized = tb->buffer;
+	tb->buffer[0] = '\0';
+	tb->count = 0;
+	tb->length = 0;
+} // tok_free
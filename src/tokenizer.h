@@ -20,6 +20,9 @@
 #ifndef _TOKENIZER_H
 #define _TOKENIZER_H 1
 
+#include <stddef.h>
+#include <stdbool.h>
+
 /**
  * Used by tokenizer as data storage.
  */
@@ -40,6 +43,111 @@ typedef struct {
  */
 typedef sTOKENS *TOKENS;
 
+/**
+ * Part of string, not terminated by zero.
+ */
+typedef struct {
+	const char *str;	/**< Begining of token, NULL if there are no more
+							 tokens. */
+	size_t length;		/**< Length of token */
+} TOK_SLICE;
+
+/**
+ * Iterator over tokens of string. Doesn't allocate nor modify the string.
+ */
+typedef struct {
+	const char *pos;	/**< Begining of next token, NULL at the end */
+} TOK_ITER;
+
+/**
+ * Size of TOK_BUFFER's inline copy of string, long enough for IRC message.
+ */
+#define TOKENIZER_BUFFER_SIZE 512
+
+/**
+ * Maximum number of tokens in TOK_BUFFER. Last token contains rest of
+ * string when there are more.
+ */
+#define TOKENIZER_BUFFER_TOKENS 32
+
+/**
+ * Tokenized string with fixed capacity, meant to be placed on stack. Only
+ * strings longer than TOKENIZER_BUFFER_SIZE need an allocation.
+ */
+typedef struct {
+	const char *original;	/**< Original string, must not change while
+								 tokens are used. */
+	char *tokenized;		/**< Copy of string with \0 instead of
+								 separators. */
+	size_t length;			/**< Length of original string */
+	size_t count;			/**< Number of tokens */
+	size_t tokens[TOKENIZER_BUFFER_TOKENS]; /**< Starting positions of
+								 tokens */
+	char buffer[TOKENIZER_BUFFER_SIZE]; /**< Inline copy of string */
+} TOK_BUFFER;
+
+/**
+ * Start iterating over tokens of string.
+ * @param it Iterator
+ * @param str String
+ */
+#define tok_init(it, str) ((it)->pos = (str))
+
+/**
+ * Rest of string that hasn't been split by iterator yet.
+ * @param it Iterator
+ * @return Rest of string, NULL if whole string has been split.
+ */
+#define tok_rest(it) ((it)->pos)
+
+/**
+ * Get next token. Each separator ends a token, so empty tokens are returned
+ * for consecutive separators.
+ * @param it Iterator
+ * @param separator Tokens separator
+ * @return Token, str is NULL when there are no more tokens.
+ */
+extern TOK_SLICE tok_next(TOK_ITER *it, char separator);
+
+/**
+ * Compare token with zero terminated string.
+ * @param token Token
+ * @param str String
+ * @return True if token equals to string.
+ */
+extern bool tok_eq(TOK_SLICE token, const char *str);
+
+/**
+ * Split string into TOK_BUFFER. Runs of separators are skipped, so there are
+ * no empty tokens.
+ * @param tb Buffer, usually on stack
+ * @param str String to split
+ * @param separator Tokens separator
+ */
+extern void tok_split(TOK_BUFFER *tb, const char *str, char separator);
+
+/**
+ * Get one token from TOK_BUFFER.
+ * @param tb Buffer
+ * @param num Token number
+ * @return Zero terminated token, empty string if out of range.
+ */
+extern char *tok_get(TOK_BUFFER *tb, size_t num);
+
+/**
+ * Get all tokens except num left ones from TOK_BUFFER.
+ * @param tb Buffer
+ * @param num Number of tokens to skip
+ * @return Rest of original string.
+ */
+extern const char *tok_skipleft(TOK_BUFFER *tb, size_t num);
+
+/**
+ * Free memory allocated by tok_split for long strings.
+ * @param tb Buffer
+ */
+extern void tok_free(TOK_BUFFER *tb);
+
 /**
  * Tokenize string
  * @param str String to tokenize
@@ -20,55 +20,246 @@
  *  (C) 2001 by Mike Richardson.
  */
 
+#define _GNU_SOURCE
+
 // Standard libraries
 #include <stdbool.h>
-#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 
 // This library interface
 #include "wildcard.h"
 
+/**
+ * Strings up to this length are case folded on stack when matching.
+ */
+#define WILDCARD_FOLD_BUFFER 512
+
+/**
+ * ASCII case folding. Bot runs in C locale, so this is the same as tolower,
+ * just without function call for every character.
+ */
+static inline char wildcard_fold(char c) {
+	return (c >= 'A' && c <= 'Z')?(c + ('a' - 'A')):c;
+} // wildcard_fold
+
+/**
+ * Compile wildcard pattern for repeated matching. Pattern is split into
+ * segments on stars, consecutive stars are collapsed and segments text is
+ * case folded when matching should be case insensitive.
+ * @param wildcard Wildcard string (* and ? wildcard chars are supported)
+ * @param casesensitive Set to true to case sensitive matching
+ * @return Compiled wildcard, free it using wildcard_free(). NULL if out of
+ *   memory.
+ */
+Wildcard wildcard_compile(const char *wildcard, bool casesensitive) {
+	size_t length = strlen(wildcard);
+
+	// There can't be more segments than half of the pattern plus one.
+	size_t maxSegments = length / 2 + 1;
+
+	Wildcard result = malloc(sizeof(WILDCARD) +
+		maxSegments * sizeof(WILDCARD_SEGMENT) + length + 1);
+	if (result == NULL) return NULL;
+
+	result->segments = (WILDCARD_SEGMENT *)(result + 1);
+	result->text = (char *)(result->segments + maxSegments);
+	result->casesensitive = casesensitive;
+	result->hasStar = false;
+	result->leadingStar = (*wildcard == '*');
+	result->trailingStar = (length > 0 && wildcard[length - 1] == '*');
+	result->minLength = 0;
+	result->segmentsCount = 0;
+
+	char *text = result->text;
+	WILDCARD_SEGMENT *segment = NULL;
+
+	for (const char *c = wildcard; *c != '\0'; c++) {
+		if (*c == '*') {
+			result->hasStar = true;
+			segment = NULL;
+			continue;
+		}
+
+		if (segment == NULL) {
+			segment = &result->segments[result->segmentsCount++];
+			segment->text = text;
+			segment->length = 0;
+			segment->literal = true;
+		}
+
+		if (*c == '?') segment->literal = false;
+
+		*text++ = casesensitive?*c:wildcard_fold(*c);
+		segment->length++;
+		result->minLength++;
+	}
+	*text = '\0';
+
+	return result;
+} // wildcard_compile
+
+/**
+ * Free compiled wildcard.
+ * @param wildcard Wildcard returned by wildcard_compile()
+ */
+void wildcard_free(Wildcard wildcard) {
+	free(wildcard);
+} // wildcard_free
+
+/**
+ * Compare segment with string at given position. String must be at least
+ * as long as the segment.
+ */
+static inline bool wildcard_segment_eq(const WILDCARD_SEGMENT *segment,
+	const char *str) {
+
+	if (segment->literal) {
+		return memcmp(segment->text, str, segment->length) == 0;
+	}
+
+	for (size_t i = 0; i < segment->length; i++) {
+		if (segment->text[i] != '?' && segment->text[i] != str[i]) {
+			return false;
+		}
+	}
+	return true;
+} // wildcard_segment_eq
+
+/**
+ * Find leftmost occurence of segment in string.
+ * @return Pointer to start of the occurence, NULL if segment was not found.
+ */
+static const char *wildcard_segment_find(const WILDCARD_SEGMENT *segment,
+	const char *str, size_t length) {
+
+	if (segment->length > length) return NULL;
+
+	// Literal segments are searched using memmem, which is vectorized in
+	// glibc.
+	if (segment->literal) {
+		return memmem(str, length, segment->text, segment->length);
+	}
+
+	const char *last = str + length - segment->length;
+
+	// Segment starting with literal character can skip directly to
+	// candidate positions using memchr.
+	if (segment->text[0] != '?') {
+		const char *pos = str;
+		while (pos <= last &&
+			(pos = memchr(pos, segment->text[0], last - pos + 1)) != NULL) {
+
+			if (wildcard_segment_eq(segment, pos)) return pos;
+			pos++;
+		}
+		return NULL;
+	}
+
+	for (const char *pos = str; pos <= last; pos++) {
+		if (wildcard_segment_eq(segment, pos)) return pos;
+	}
+	return NULL;
+} // wildcard_segment_find
+
+/**
+ * Match already case folded string against compiled wildcard. First and last
+ * segments are anchored to the start and the end of string (unless pattern
+ * starts or ends with a star), segments in between are matched to their
+ * leftmost occurence. Leftmost match never prevents later segments from
+ * matching, so no backtracking is needed.
+ */
+static bool wildcard_match_folded(Wildcard wildcard, const char *str,
+	size_t length) {
+
+	WILDCARD_SEGMENT *first = wildcard->segments;
+	WILDCARD_SEGMENT *last = wildcard->segments + wildcard->segmentsCount;
+
+	if (!wildcard->hasStar) {
+		return length == wildcard->minLength &&
+			(first == last || wildcard_segment_eq(first, str));
+	}
+
+	const char *end = str + length;
+
+	if (!wildcard->leadingStar) {
+		if (!wildcard_segment_eq(first, str)) return false;
+		str += first->length;
+		first++;
+	}
+
+	if (!wildcard->trailingStar && first < last) {
+		last--;
+		if ((size_t)(end - str) < last->length) return false;
+		end -= last->length;
+		if (!wildcard_segment_eq(last, end)) return false;
+	}
+
+	for (WILDCARD_SEGMENT *segment = first; segment < last; segment++) {
+		const char *pos = wildcard_segment_find(segment, str, end - str);
+		if (pos == NULL) return false;
+		str = pos + segment->length;
+	}
+
+	return true;
+} // wildcard_match_folded
+
+/**
+ * Match string of given length against compiled wildcard.
+ * @param wildcard Compiled wildcard
+ * @param str String to match (doesn't need to be NULL terminated)
+ * @param length Length of the string
+ * @return True if str matches wildcard, false otherwise
+ */
+bool wildcard_matchn(Wildcard wildcard, const char *str, size_t length) {
+	if (length < wildcard->minLength) return false;
+
+	if (wildcard->casesensitive) {
+		return wildcard_match_folded(wildcard, str, length);
+	}
+
+	// Fold the string once instead of folding each compared character.
+	char buffer[WILDCARD_FOLD_BUFFER];
+	char *folded = buffer;
+	if (length > sizeof(buffer)) {
+		folded = malloc(length);
+		if (folded == NULL) return false;
+	}
+
+	for (size_t i = 0; i < length; i++) {
+		folded[i] = wildcard_fold(str[i]);
+	}
+
+	bool result = wildcard_match_folded(wildcard, folded, length);
+
+	if (folded != buffer) free(folded);
+	return result;
+} // wildcard_matchn
+
+/**
+ * Match string against compiled wildcard.
+ * @param wildcard Compiled wildcard
+ * @param str String to match
+ * @return True if str matches wildcard, false otherwise
+ */
+bool wildcard_match(Wildcard wildcard, const char *str) {
+	return wildcard_matchn(wildcard, str, strlen(str));
+} // wildcard_match
+
 /**
  * Match string against wildcard string and return true, if string matches
- * and false if don't.
+ * and false if don't. For repeated matching against the same wildcard,
+ * compile it using wildcard_compile() instead.
  * @param wildcard Wildcard string (* and ? wildcard chars are supported)
  * @param str String to match against wildcard
  * @param casesensitive Set to true to case sensitive matching
  * @return True if str matches wildcard, false otherwise
  */
 bool wildmatch(const char *wildcard, const char *str, bool casesensitive) {
-	while (*wildcard != '\0') {
-		switch (*wildcard) {
-			case '?':
-				// Match any single character. Fail if the
-				// string is exhausted, otherwise advance the
-				// string and the pattern.
-				if (*str++ == '\0') return false;
-				wildcard += 1;
-				break;
-
-			case '*':
-				// Match (a possibly empty) string. First try
-				// a match with a null string (just advance the
-				// pattern), otherwise advance the string (but
-				// check for the end).
-				if (wildmatch(&wildcard[1], str, casesensitive)) return true;
-				if (*str++ == '\0') return false;
-				break;
-
-			default:
-				// Anything else requires an exact match
-				// between the string and the pattern.
-				if (*str == '\0') return false;
-				if (!casesensitive) {
-					if (tolower(*str++) != tolower(*wildcard++)) return false;
-				} else {
-					if (*str++ != *wildcard++) return false;
-				}
-				break;
-		}
-	}
+	Wildcard compiled = wildcard_compile(wildcard, casesensitive);
+	if (compiled == NULL) return false;
 
-	// End of the pattern. There is a match if the string is also
-	// exhausted.
-	return	*str == '\0';
+	bool result = wildcard_match(compiled, str);
+	wildcard_free(compiled);
+	return result;
 } // wildmatch
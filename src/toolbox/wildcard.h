@@ -26,6 +26,32 @@
 # define _WILDCARD_H 1
 
 #include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * One part of compiled wildcard between two stars. Text is already case
+ * folded for case insensitive patterns.
+ */
+typedef struct sWildcardSegment {
+	const char *text;		/**< Segment text (not NULL terminated) */
+	size_t length;			/**< Length of segment */
+	bool literal;			/**< True if segment doesn't contain ? */
+} WILDCARD_SEGMENT;
+
+/**
+ * Compiled wildcard pattern. Can be matched against any number of strings
+ * in time linear to the length of string.
+ */
+typedef struct sWildcard {
+	bool casesensitive;		/**< Case sensitive matching */
+	bool hasStar;			/**< Pattern contains at least one * */
+	bool leadingStar;		/**< Pattern starts with * */
+	bool trailingStar;		/**< Pattern ends with * */
+	size_t minLength;		/**< Shortest string that can match */
+	size_t segmentsCount;	/**< Number of segments */
+	WILDCARD_SEGMENT *segments;	/**< Segments between stars */
+	char *text;				/**< Storage for segments text */
+} WILDCARD, *Wildcard;
 
 /**
  * Case sensitive wildcard match.
@@ -54,4 +80,37 @@
 extern bool wildmatch(const char *wildcard, const char *str,
 	bool casesensitive);
 
+/**
+ * Compile wildcard pattern for repeated matching.
+ * @param wildcard Wildcard string (* and ? wildcard chars are supported)
+ * @param casesensitive Set to true to case sensitive matching
+ * @return Compiled wildcard, free it using wildcard_free(). NULL if out of
+ *   memory.
+ */
+extern Wildcard wildcard_compile(const char *wildcard, bool casesensitive);
+
+/**
+ * Match string against compiled wildcard.
+ * @param wildcard Compiled wildcard
+ * @param str String to match
+ * @return True if str matches wildcard, false otherwise
+ */
+extern bool wildcard_match(Wildcard wildcard, const char *str);
+
+/**
+ * Match string of given length against compiled wildcard.
+ * @param wildcard Compiled wildcard
+ * @param str String to match (doesn't need to be NULL terminated)
+ * @param length Length of the string
+ * @return True if str matches wildcard, false otherwise
+ */
+extern bool wildcard_matchn(Wildcard wildcard, const char *str,
+	size_t length);
+
+/**
+ * Free compiled wildcard.
+ * @param wildcard Wildcard returned by wildcard_compile()
+ */
+extern void wildcard_free(Wildcard wildcard);
+
 #endif